@@ -0,0 +1,808 @@
+/*******************************************************************************
+ *
+ *  Copyright (c) 2008 Jonathon Jongsma
+ *
+ *  This file is part of Agave
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ *******************************************************************************/
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <glib/gi18n.h>
+#include <glib/gprintf.h>
+#include <glibmm/fileutils.h>
+#include <glibmm/optioncontext.h>
+#include <glibmm/thread.h>
+#include "config.h"
+#include "color-set-manager.h"
+#include "color-string.h"
+#include "scheme-manager.h"
+#include "scheme-cache.h"
+
+/**
+ * \file
+ * agave2-cli, a command line front end to the scheme engine that doesn't
+ * need a display.
+ *
+ * It reads base colors (one color specification per line, see
+ * color-string.h) from a file or stdin, runs the selected schemes (all by
+ * default) on every base color and writes the generated palettes as CSV,
+ * JSON or a GIMP palette.  The input is processed in chunks that are split
+ * across worker threads, and each chunk is written out as soon as it is
+ * done, so inputs of any size can be streamed through the program.
+ *
+ * With --convert-library it instead converts a library of saved color
+ * sets between the XML and the binary format.
+ */
+namespace agave
+{
+    enum output_format_t
+    {
+        FORMAT_CSV,
+        FORMAT_JSON,
+        FORMAT_GPL
+    };
+
+    /// the number of base colors that are read and processed at a time
+    static const std::size_t CHUNK_SIZE = 65536;
+    /// the number of base colors a worker generates before formatting them
+    static const std::size_t BLOCK_SIZE = 256;
+    /// don't start a thread for less than this many base colors
+    static const std::size_t MIN_COLORS_PER_THREAD = 1024;
+    static const std::size_t READ_BUFFER_SIZE = 1 << 20;
+
+    static bool version_requested = false;
+    static bool list_requested = false;
+    static std::string input_filename;
+    static std::string output_filename;
+    static Glib::ustring format_name = "csv";
+    static Glib::ustring scheme_names;
+    static Glib::ustring library_format_name;
+    static int num_threads = 0;
+    static int cache_size = 0;
+    static Glib::ustring HELP_FOOTER = _("Copyright 2007, Jonathon Jongsma <jjongsma@gnome.org>");
+
+    class OptionGroup : public Glib::OptionGroup
+    {
+        public:
+            OptionGroup() :
+                Glib::OptionGroup ("general", "General Options:",
+                        "show general application options")
+            {
+                Glib::OptionEntry input_option;
+                input_option.set_long_name ("input");
+                input_option.set_short_name ('i');
+                input_option.set_description (_("Read base colors from FILE instead of stdin"));
+                input_option.set_arg_description ("FILE");
+                add_entry_filename (input_option, input_filename);
+
+                Glib::OptionEntry output_option;
+                output_option.set_long_name ("output");
+                output_option.set_short_name ('o');
+                output_option.set_description (_("Write the palettes to FILE instead of stdout"));
+                output_option.set_arg_description ("FILE");
+                add_entry_filename (output_option, output_filename);
+
+                Glib::OptionEntry format_option;
+                format_option.set_long_name ("format");
+                format_option.set_short_name ('f');
+                format_option.set_description (_("Output format: csv (default), json or gpl"));
+                format_option.set_arg_description ("FORMAT");
+                add_entry (format_option, format_name);
+
+                Glib::OptionEntry scheme_option;
+                scheme_option.set_long_name ("schemes");
+                scheme_option.set_short_name ('s');
+                scheme_option.set_description (_("Comma-separated list of the schemes to run (default: all)"));
+                scheme_option.set_arg_description ("NAMES");
+                add_entry (scheme_option, scheme_names);
+
+                Glib::OptionEntry threads_option;
+                threads_option.set_long_name ("threads");
+                threads_option.set_short_name ('j');
+                threads_option.set_description (_("Number of worker threads (default: one per processor)"));
+                threads_option.set_arg_description ("N");
+                add_entry (threads_option, num_threads);
+
+                Glib::OptionEntry cache_option;
+                cache_option.set_long_name ("cache");
+                cache_option.set_short_name ('c');
+                cache_option.set_description (_("Cache up to N evaluations per thread, for inputs with many repeated colors.  Base colors are quantized to 1/1024."));
+                cache_option.set_arg_description ("N");
+                add_entry (cache_option, cache_size);
+
+                Glib::OptionEntry convert_option;
+                convert_option.set_long_name ("convert-library");
+                convert_option.set_description (_("Convert the saved color sets in the --input file to FORMAT (xml or binary) and write them to the --output file"));
+                convert_option.set_arg_description ("FORMAT");
+                add_entry (convert_option, library_format_name);
+
+                Glib::OptionEntry list_option;
+                list_option.set_long_name ("list-schemes");
+                list_option.set_short_name ('l');
+                list_option.set_description (_("List the available schemes and exit"));
+                add_entry (list_option, list_requested);
+
+                Glib::OptionEntry version_option;
+                version_option.set_long_name ("version");
+                version_option.set_description (_("Print application version"));
+                add_entry (version_option, version_requested);
+            }
+    };
+
+    typedef std::vector<boost::shared_ptr<IScheme> > scheme_list_t;
+
+    /**
+     * Select the schemes named in the comma-separated list @a names, or all
+     * schemes if @a names is empty
+     */
+    static bool select_schemes (const Glib::ustring& names,
+                                scheme_list_t& selected)
+    {
+        const scheme_list_t& schemes = SchemeManager::instance ().get_schemes ();
+        if (names.empty ())
+        {
+            selected = schemes;
+            return true;
+        }
+
+        const std::string list = names.raw ();
+        std::string::size_type begin = 0;
+        while (begin <= list.size ())
+        {
+            std::string::size_type end = list.find (',', begin);
+            if (end == std::string::npos)
+            {
+                end = list.size ();
+            }
+            const Glib::ustring name = list.substr (begin, end - begin);
+            begin = end + 1;
+            if (name.empty ())
+                continue;
+
+            scheme_list_t::const_iterator iter = schemes.begin ();
+            while (iter != schemes.end () && (*iter)->get_name () != name)
+            {
+                ++iter;
+            }
+            if (iter == schemes.end ())
+            {
+                std::cerr << Glib::ustring::compose (_("Unknown scheme '%1', see --list-schemes"),
+                        name) << std::endl;
+                return false;
+            }
+            selected.push_back (*iter);
+        }
+        return !selected.empty ();
+    }
+
+    static void append_hexstring (std::string& out, const rgb_t& rgb)
+    {
+        char buffer[HEXSTRING_MAX_LENGTH];
+        out.append (buffer, format_hexstring (rgb, buffer, sizeof (buffer),
+                                              HEXSTRING_HASH));
+    }
+
+    static void append_json_string (std::string& out, const std::string& str)
+    {
+        out += '"';
+        for (std::string::const_iterator iter = str.begin ();
+             iter != str.end (); ++iter)
+        {
+            const unsigned char c = *iter;
+            if (c == '"' || c == '\\')
+            {
+                out += '\\';
+                out += c;
+            }
+            else if (c < 0x20)
+            {
+                char buffer[8];
+                g_snprintf (buffer, sizeof (buffer), "\\u%04x", c);
+                out += buffer;
+            }
+            else
+            {
+                out += c;
+            }
+        }
+        out += '"';
+    }
+
+    static void append_csv_field (std::string& out, const std::string& str)
+    {
+        if (str.find_first_of (",\"\r\n") == std::string::npos)
+        {
+            out += str;
+            return;
+        }
+        out += '"';
+        for (std::string::const_iterator iter = str.begin ();
+             iter != str.end (); ++iter)
+        {
+            if (*iter == '"')
+            {
+                out += '"';
+            }
+            out += *iter;
+        }
+        out += '"';
+    }
+
+    static void append_gpl_color (std::string& out, const rgb_t& rgb,
+                                  unsigned long index, const std::string& scheme,
+                                  const char* role)
+    {
+        char buffer[64];
+        g_snprintf (buffer, sizeof (buffer), "%3d %3d %3d\t%lu ",
+                       static_cast<int> (rgb.r * 255.0 + 0.5),
+                       static_cast<int> (rgb.g * 255.0 + 0.5),
+                       static_cast<int> (rgb.b * 255.0 + 0.5), index);
+        out += buffer;
+        out += scheme;
+        out += ' ';
+        out += role;
+        out += '\n';
+    }
+
+    /**
+     * Formats the palettes of all selected schemes for one palette (i.e. a
+     * base color and the outputs of one scheme) at a time
+     */
+    class PaletteWriter
+    {
+        public:
+            PaletteWriter (output_format_t format, const scheme_list_t& schemes) :
+                m_format (format),
+                m_max_outputs (0)
+            {
+                for (scheme_list_t::const_iterator iter = schemes.begin ();
+                     iter != schemes.end (); ++iter)
+                {
+                    m_names.push_back ((*iter)->get_name ().raw ());
+                    m_max_outputs = std::max (m_max_outputs,
+                                              (*iter)->get_num_outputs ());
+                }
+            }
+
+            void write_header (std::string& out) const
+            {
+                switch (m_format)
+                {
+                    case FORMAT_CSV:
+                        out += "index,scheme,base";
+                        for (unsigned int i = 1; i <= m_max_outputs; ++i)
+                        {
+                            char buffer[32];
+                            g_snprintf (buffer, sizeof (buffer), ",color%u", i);
+                            out += buffer;
+                        }
+                        out += '\n';
+                        break;
+                    case FORMAT_JSON:
+                        out += "[\n";
+                        break;
+                    case FORMAT_GPL:
+                        {
+                            char buffer[64];
+                            g_snprintf (buffer, sizeof (buffer),
+                                           "GIMP Palette\nName: %s\nColumns: %u\n#\n",
+                                           PACKAGE_NAME, m_max_outputs + 1);
+                            out += buffer;
+                        }
+                        break;
+                }
+            }
+
+            void write_footer (std::string& out, bool empty) const
+            {
+                if (m_format == FORMAT_JSON)
+                {
+                    out += empty ? "]\n" : "\n]\n";
+                }
+            }
+
+            /**
+             * @param index  The number of the base color in the input
+             * @param first  Whether this is the first palette of the output
+             */
+            void write_palette (std::string& out, unsigned long index,
+                                std::size_t scheme, const hsv_t& base,
+                                const hsv_t* outputs, unsigned int num_outputs,
+                                bool first) const
+            {
+                const std::string& name = m_names[scheme];
+                const rgb_t base_rgb = Color::hsv_to_rgb (base);
+                char buffer[32];
+                switch (m_format)
+                {
+                    case FORMAT_CSV:
+                        g_snprintf (buffer, sizeof (buffer), "%lu,", index);
+                        out += buffer;
+                        append_csv_field (out, name);
+                        out += ',';
+                        append_hexstring (out, base_rgb);
+                        for (unsigned int i = 0; i < m_max_outputs; ++i)
+                        {
+                            out += ',';
+                            if (i < num_outputs)
+                            {
+                                append_hexstring (out, Color::hsv_to_rgb (outputs[i]));
+                            }
+                        }
+                        out += '\n';
+                        break;
+                    case FORMAT_JSON:
+                        g_snprintf (buffer, sizeof (buffer), "%s{\"index\":%lu,\"scheme\":",
+                                       first ? "" : ",\n", index);
+                        out += buffer;
+                        append_json_string (out, name);
+                        out += ",\"base\":\"";
+                        append_hexstring (out, base_rgb);
+                        out += "\",\"colors\":[";
+                        for (unsigned int i = 0; i < num_outputs; ++i)
+                        {
+                            out += (i ? ",\"" : "\"");
+                            append_hexstring (out, Color::hsv_to_rgb (outputs[i]));
+                            out += '"';
+                        }
+                        out += "]}";
+                        break;
+                    case FORMAT_GPL:
+                        append_gpl_color (out, base_rgb, index, name, "base");
+                        for (unsigned int i = 0; i < num_outputs; ++i)
+                        {
+                            g_snprintf (buffer, sizeof (buffer), "%u", i + 1);
+                            append_gpl_color (out, Color::hsv_to_rgb (outputs[i]),
+                                              index, name, buffer);
+                        }
+                        break;
+                }
+            }
+
+        private:
+            output_format_t m_format;
+            std::vector<std::string> m_names;
+            unsigned int m_max_outputs;
+    };
+
+    /**
+     * Generates and formats the palettes for a contiguous range of the base
+     * colors of a chunk.  Each worker only touches its own output buffer, the
+     * schemes are only read.
+     */
+    class Worker
+    {
+        public:
+            Worker (const scheme_list_t& schemes, const PaletteWriter& writer) :
+                m_schemes (&schemes),
+                m_writer (&writer),
+                m_colors (0),
+                m_num_colors (0),
+                m_first_index (0),
+                m_first_palette (false),
+                m_max_outputs (0)
+            {
+                for (scheme_list_t::const_iterator iter = schemes.begin ();
+                     iter != schemes.end (); ++iter)
+                {
+                    m_max_outputs = std::max (m_max_outputs,
+                                              (*iter)->get_num_outputs ());
+                }
+                m_bases.resize (BLOCK_SIZE);
+                m_outputs.resize (schemes.size () * BLOCK_SIZE * m_max_outputs);
+            }
+
+            void set_range (const rgb_t* colors, std::size_t n,
+                            unsigned long first_index, bool first_palette)
+            {
+                m_colors = colors;
+                m_num_colors = n;
+                m_first_index = first_index;
+                m_first_palette = first_palette;
+                m_output.clear ();
+            }
+
+            const std::string& get_output () const { return m_output; }
+
+            /**
+             * Serve the evaluations from a cache of @a capacity entries that
+             * is private to this worker
+             */
+            void enable_cache (std::size_t capacity)
+            {
+                m_cache.reset (new SchemeCache (capacity));
+            }
+
+            const boost::shared_ptr<SchemeCache>& get_cache () const
+            {
+                return m_cache;
+            }
+
+            void run ()
+            {
+                const scheme_list_t& schemes = *m_schemes;
+                const std::size_t stride = BLOCK_SIZE * m_max_outputs;
+                bool first = m_first_palette;
+                for (std::size_t start = 0; start < m_num_colors;
+                     start += BLOCK_SIZE)
+                {
+                    const std::size_t n = std::min (BLOCK_SIZE,
+                                                    m_num_colors - start);
+                    for (std::size_t i = 0; i < n; ++i)
+                    {
+                        m_bases[i] = Color::rgb_to_hsv (m_colors[start + i]);
+                    }
+                    for (std::size_t s = 0; s < schemes.size (); ++s)
+                    {
+                        if (m_cache)
+                        {
+                            m_cache->generate_batch (*schemes[s], &m_bases[0],
+                                                     n, &m_outputs[s * stride]);
+                        }
+                        else
+                        {
+                            schemes[s]->generate_batch (&m_bases[0], n,
+                                                        &m_outputs[s * stride]);
+                        }
+                    }
+
+                    for (std::size_t i = 0; i < n; ++i)
+                    {
+                        for (std::size_t s = 0; s < schemes.size (); ++s)
+                        {
+                            const unsigned int num_outputs =
+                                schemes[s]->get_num_outputs ();
+                            m_writer->write_palette (m_output,
+                                    m_first_index + start + i, s, m_bases[i],
+                                    &m_outputs[s * stride + i * num_outputs],
+                                    num_outputs, first);
+                            first = false;
+                        }
+                    }
+                }
+            }
+
+        private:
+            const scheme_list_t* m_schemes;
+            const PaletteWriter* m_writer;
+            const rgb_t* m_colors;
+            std::size_t m_num_colors;
+            unsigned long m_first_index;
+            bool m_first_palette;
+            unsigned int m_max_outputs;
+            std::vector<hsv_t> m_bases;
+            std::vector<hsv_t> m_outputs;
+            std::string m_output;
+            boost::shared_ptr<SchemeCache> m_cache;
+    };
+
+    static int get_default_threads ()
+    {
+#if GLIB_CHECK_VERSION (2, 36, 0)
+        return g_get_num_processors ();
+#else
+        return 1;
+#endif
+    }
+
+    static bool write_all (std::FILE* file, const std::string& data)
+    {
+        return std::fwrite (data.data (), 1, data.size (), file) == data.size ();
+    }
+
+    /**
+     * Read base colors from @a in, generate the palettes in parallel and
+     * write them to @a out chunk by chunk
+     */
+    static int process (std::FILE* in, std::FILE* out,
+                        const scheme_list_t& schemes, output_format_t format,
+                        int threads)
+    {
+        PaletteWriter writer (format, schemes);
+        std::vector<Worker> workers (threads, Worker (schemes, writer));
+        if (cache_size > 0)
+        {
+            for (std::vector<Worker>::iterator iter = workers.begin ();
+                 iter != workers.end (); ++iter)
+            {
+                iter->enable_cache (cache_size);
+            }
+        }
+        std::vector<rgb_t> colors (CHUNK_SIZE);
+        std::vector<char> buffer (READ_BUFFER_SIZE);
+        std::size_t buffered = 0;
+        std::size_t n_invalid = 0;
+        unsigned long index = 0;
+        bool eof = false;
+
+        std::string header;
+        writer.write_header (header);
+        if (!write_all (out, header))
+            return 1;
+
+        while (!eof || buffered > 0)
+        {
+            if (!eof && buffered < buffer.size ())
+            {
+                const std::size_t n = std::fread (&buffer[buffered], 1,
+                        buffer.size () - buffered, in);
+                buffered += n;
+                eof = (n == 0);
+            }
+
+            // only parse complete lines, unless there is no more input
+            const char* begin = &buffer[0];
+            const char* end = begin + buffered;
+            if (!eof)
+            {
+                const char* newline = begin + buffered;
+                while (newline > begin && newline[-1] != '\n')
+                {
+                    --newline;
+                }
+                if (newline == begin && buffered < buffer.size ())
+                    continue;
+                // a single line that doesn't fit is parsed (as garbage)
+                if (newline > begin)
+                    end = newline;
+            }
+
+            const char* next = begin;
+            const std::size_t n = parse_color_lines (begin, end, &colors[0],
+                    colors.size (), &next, &n_invalid);
+            buffered -= next - begin;
+            std::memmove (&buffer[0], next, buffered);
+            if (eof && n == 0)
+                break;
+
+            // split the chunk, but don't bother with threads for a few colors
+            const std::size_t num_workers = std::max<std::size_t> (1,
+                    std::min<std::size_t> (threads, n / MIN_COLORS_PER_THREAD));
+            const std::size_t per_worker = (n + num_workers - 1) / num_workers;
+            std::vector<Glib::Thread*> running;
+            for (std::size_t w = 0; w < num_workers; ++w)
+            {
+                const std::size_t first = std::min (n, w * per_worker);
+                const std::size_t count = std::min (n - first, per_worker);
+                workers[w].set_range (&colors[first], count, index + first,
+                                      index + first == 0);
+                if (w > 0)
+                {
+                    running.push_back (Glib::Thread::create (sigc::mem_fun
+                                (workers[w], &Worker::run), true));
+                }
+            }
+            workers[0].run ();
+            for (std::vector<Glib::Thread*>::iterator iter = running.begin ();
+                 iter != running.end (); ++iter)
+            {
+                (*iter)->join ();
+            }
+            index += n;
+
+            for (std::size_t w = 0; w < num_workers; ++w)
+            {
+                if (!write_all (out, workers[w].get_output ()))
+                    return 1;
+            }
+        }
+
+        std::string footer;
+        writer.write_footer (footer, index == 0);
+        if (!write_all (out, footer) || std::fflush (out) != 0)
+            return 1;
+
+        if (n_invalid > 0)
+        {
+            std::cerr << Glib::ustring::compose (_("Skipped %1 invalid lines"),
+                    n_invalid) << std::endl;
+        }
+        if (cache_size > 0)
+        {
+            guint64 hits = 0;
+            guint64 misses = 0;
+            for (std::vector<Worker>::const_iterator iter = workers.begin ();
+                 iter != workers.end (); ++iter)
+            {
+                hits += iter->get_cache ()->get_hits ();
+                misses += iter->get_cache ()->get_misses ();
+            }
+            std::cerr << Glib::ustring::compose (_("Cache: %1 hits, %2 misses"),
+                    hits, misses) << std::endl;
+        }
+        return 0;
+    }
+
+    /**
+     * Convert the library in input_filename to library_format_name
+     */
+    static int convert_library ()
+    {
+        ColorSetManager::file_format_t format;
+        if (library_format_name == "xml")
+            format = ColorSetManager::FORMAT_XML;
+        else if (library_format_name == "binary")
+            format = ColorSetManager::FORMAT_BINARY;
+        else
+        {
+            std::cerr << Glib::ustring::compose (_("Unknown library format '%1'"),
+                    library_format_name) << std::endl;
+            return 1;
+        }
+        if (input_filename.empty () || input_filename == "-" ||
+            output_filename.empty () || output_filename == "-")
+        {
+            std::cerr << _("Converting a library needs an input and an output file")
+                << std::endl;
+            return 1;
+        }
+        if (!Glib::file_test (input_filename, Glib::FILE_TEST_EXISTS))
+        {
+            std::cerr << Glib::ustring::compose (_("Couldn't open %1: %2"),
+                    input_filename, std::strerror (ENOENT)) << std::endl;
+            return 1;
+        }
+
+        // loading also replays the journals of the library, if any
+        const ColorSetManager library (input_filename);
+        if (!library.export_file (output_filename, format))
+        {
+            std::cerr << _("Couldn't write the output") << std::endl;
+            return 1;
+        }
+        std::cerr << Glib::ustring::compose (_("Converted %1 color sets"),
+                library.size ()) << std::endl;
+        return 0;
+    }
+
+    static int run (int argc, char** argv)
+    {
+        bindtextdomain (GETTEXT_PACKAGE, AGAVE_LOCALEDIR);
+        bind_textdomain_codeset (GETTEXT_PACKAGE, "UTF-8");
+        textdomain (GETTEXT_PACKAGE);
+
+        Glib::OptionContext context;
+#if GLIB_CHECK_VERSION (2, 12, 0)
+        g_option_context_set_summary (context.gobj (),
+                _("Generate color schemes for a list of base colors"));
+        g_option_context_set_description (context.gobj (), HELP_FOOTER.c_str ());
+#endif
+        OptionGroup option_group;
+        context.set_main_group (option_group);
+        option_group.set_translation_domain (GETTEXT_PACKAGE);
+        context.parse (argc, argv);
+
+        if (version_requested)
+        {
+            std::cout << PACKAGE_NAME << " " << PACKAGE_VERSION << std::endl
+                << _(PACKAGE_DESCRIPTION) << std::endl;
+            std::cout << "For more information, see " << PACKAGE_WEBSITE << std::endl;
+            return 0;
+        }
+
+        if (!library_format_name.empty ())
+        {
+            return convert_library ();
+        }
+
+        if (list_requested)
+        {
+            const scheme_list_t& schemes = SchemeManager::instance ().get_schemes ();
+            for (scheme_list_t::const_iterator iter = schemes.begin ();
+                 iter != schemes.end (); ++iter)
+            {
+                std::cout << (*iter)->get_name () << std::endl;
+            }
+            return 0;
+        }
+
+        output_format_t format;
+        if (format_name == "csv")
+            format = FORMAT_CSV;
+        else if (format_name == "json")
+            format = FORMAT_JSON;
+        else if (format_name == "gpl")
+            format = FORMAT_GPL;
+        else
+        {
+            std::cerr << Glib::ustring::compose (_("Unknown output format '%1'"),
+                    format_name) << std::endl;
+            return 1;
+        }
+
+        // SchemeManager isn't thread-safe, so load all schemes up front
+        scheme_list_t schemes;
+        if (!select_schemes (scheme_names, schemes))
+            return 1;
+
+        int threads = num_threads > 0 ? num_threads : get_default_threads ();
+        if (threads > 1)
+        {
+            if (!Glib::thread_supported ())
+            {
+                Glib::thread_init ();
+            }
+        }
+        else
+        {
+            threads = 1;
+        }
+
+        std::FILE* in = stdin;
+        if (!input_filename.empty () && input_filename != "-")
+        {
+            in = std::fopen (input_filename.c_str (), "rb");
+            if (!in)
+            {
+                std::cerr << Glib::ustring::compose (_("Couldn't open %1: %2"),
+                        input_filename, std::strerror (errno)) << std::endl;
+                return 1;
+            }
+        }
+        std::FILE* out = stdout;
+        if (!output_filename.empty () && output_filename != "-")
+        {
+            out = std::fopen (output_filename.c_str (), "wb");
+            if (!out)
+            {
+                std::cerr << Glib::ustring::compose (_("Couldn't open %1: %2"),
+                        output_filename, std::strerror (errno)) << std::endl;
+                if (in != stdin)
+                    std::fclose (in);
+                return 1;
+            }
+        }
+
+        int exit_code = process (in, out, schemes, format, threads);
+        if (exit_code != 0)
+        {
+            std::cerr << _("Couldn't write the output") << std::endl;
+        }
+        if (std::ferror (in))
+        {
+            std::cerr << _("Couldn't read the input") << std::endl;
+            exit_code = 1;
+        }
+        if (in != stdin)
+            std::fclose (in);
+        if (out != stdout && std::fclose (out) != 0)
+            exit_code = 1;
+        return exit_code;
+    }
+}
+
+int main (int argc, char** argv)
+{
+    int exit_code = 0;
+    try {
+        exit_code = agave::run (argc, argv);
+    } catch (const std::exception& e)
+    {
+        std::cerr << "Unhandled exception: " << e.what () << std::endl;
+        exit_code = 1;
+    }
+    catch (const Glib::Exception& e)
+    {
+        std::cerr << "Unhandled exception: " << e.what () << std::endl;
+        exit_code = 1;
+    }
+    return exit_code;
+}
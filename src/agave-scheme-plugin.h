@@ -0,0 +1,123 @@
+/*******************************************************************************
+ *
+ *  Copyright (c) 2008 Jonathon Jongsma
+ *
+ *  This file is part of Agave
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ *******************************************************************************/
+#ifndef __AGAVE_SCHEME_PLUGIN_H
+#define __AGAVE_SCHEME_PLUGIN_H
+
+/**
+ * \file
+ * The C interface for compiled color scheme plugins.
+ *
+ * A plugin is a shared object (built e.g. with libtool's -module flag) in
+ * the plugin directory that exports the function
+ * \code
+ * const agave_scheme_plugin_t* agave_scheme_plugin_query (unsigned int host_abi_version);
+ * \endcode
+ * It returns a description of the schemes in the plugin, or NULL if the
+ * plugin can't work with the given host ABI version.  The description has
+ * to stay valid as long as the plugin is loaded.  A plugin is rejected
+ * (and unloaded again) if the entry point is missing, if it reports a
+ * different ABI version or if any of its schemes is incomplete.
+ *
+ * Only plain C types are used, so plugins can be written in any language
+ * that can produce a C-compatible shared object.  Any incompatible change
+ * to the structures below increments AGAVE_SCHEME_PLUGIN_ABI_VERSION.
+ * Fields may be added at the end of a structure without a new version;
+ * the struct_size fields tell the host which ones a plugin knows about.
+ */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AGAVE_SCHEME_PLUGIN_ABI_VERSION 1
+#define AGAVE_SCHEME_PLUGIN_QUERY_SYMBOL "agave_scheme_plugin_query"
+
+/**
+ * A color in HSV.  Hue is a fraction of a full turn, all components range
+ * from 0.0 to 1.0.  Results outside of that range are wrapped (hue) or
+ * clamped by the host.
+ */
+typedef struct
+{
+    double h;
+    double s;
+    double v;
+    double a;
+} agave_hsva_t;
+
+/**
+ * Compute output color @a output (0 .. num_outputs - 1) of a scheme from
+ * @a base.  Has to be reentrant.
+ */
+typedef void (*agave_scheme_generate_func) (void* user_data,
+                                            unsigned int output,
+                                            const agave_hsva_t* base,
+                                            agave_hsva_t* result);
+
+/**
+ * Compute all outputs for @a n base colors at once.  @a results receives
+ * @a n * num_outputs colors, the outputs of base color i start at
+ * results[i * num_outputs].
+ */
+typedef void (*agave_scheme_generate_batch_func) (void* user_data,
+                                                  const agave_hsva_t* bases,
+                                                  size_t n,
+                                                  agave_hsva_t* results);
+
+typedef struct
+{
+    /** sizeof (agave_scheme_info_t) as seen by the plugin */
+    unsigned int struct_size;
+    /** the name shown to the user, UTF-8 */
+    const char* name;
+    /**
+     * The number of generated colors.  They are ordered from left to right
+     * as displayed around the base color, i.e. outer left, inner left,
+     * inner right and outer right for the usual four outputs.
+     */
+    unsigned int num_outputs;
+    /** required */
+    agave_scheme_generate_func generate;
+    /** optional, may be NULL */
+    agave_scheme_generate_batch_func generate_batch;
+    /** passed to the functions above */
+    void* user_data;
+} agave_scheme_info_t;
+
+typedef struct
+{
+    /** AGAVE_SCHEME_PLUGIN_ABI_VERSION as seen by the plugin */
+    unsigned int abi_version;
+    /** sizeof (agave_scheme_plugin_t) as seen by the plugin */
+    unsigned int struct_size;
+    unsigned int num_schemes;
+    const agave_scheme_info_t* schemes;
+} agave_scheme_plugin_t;
+
+typedef const agave_scheme_plugin_t* (*agave_scheme_plugin_query_func) (unsigned int host_abi_version);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __AGAVE_SCHEME_PLUGIN_H */
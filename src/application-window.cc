@@ -18,11 +18,13 @@
  *  along with this program; if not, see <http://www.gnu.org/licenses/>
  *
  *******************************************************************************/
+#include <algorithm>
 #include <boost/shared_ptr.hpp>
 #include <gtkmm/window.h>
 #include <gtkmm/label.h>
 #include <gtkmm/uimanager.h>
 #include <gtkmm/box.h>
+#include <gtkmm/scrolledwindow.h>
 #include <gtkmm/menu.h>
 #include <gtkmm/stock.h>
 #include <glib/gi18n.h>
@@ -35,7 +37,9 @@
 #include "scheme-combo-box.h"
 #include "color-relation.h"
 #include "i-scheme.h"
+#include "scheme-cache.h"
 #include "color-wheel.h"
+#include "history.h"
 
 namespace agave
 {
@@ -46,46 +50,102 @@ namespace agave
         "<menu action='MenuAgave'>"
         "<menuitem action='Quit'/>"
         "</menu>"
+        "<menu action='MenuEdit'>"
+        "<menuitem action='Undo'/>"
+        "<menuitem action='Redo'/>"
+        "</menu>"
+        "<menu action='MenuPalette'>"
+        "<menuitem action='AddBaseColor'/>"
+        "<menuitem action='RemoveBaseColor'/>"
+        "<separator/>"
+        "<menuitem action='AddColor'/>"
+        "<menu action='MenuDeriveColor'>"
+        "<menuitem action='DeriveOuterLeft'/>"
+        "<menuitem action='DeriveInnerLeft'/>"
+        "<menuitem action='DeriveInnerRight'/>"
+        "<menuitem action='DeriveOuterRight'/>"
+        "</menu>"
+        "<menuitem action='DetachColor'/>"
+        "<menuitem action='RemoveColor'/>"
+        "</menu>"
         "<menu action='MenuHelp'>"
         "<menuitem action='About'/>"
         "</menu>"
         "</menubar>"
         "</ui>";
 
+    /**
+     * The colors that a scheme derives from a base color, in the order in
+     * which they are displayed around it
+     */
+    enum scheme_role_t
+    {
+        ROLE_OUTER_LEFT,
+        ROLE_INNER_LEFT,
+        ROLE_INNER_RIGHT,
+        ROLE_OUTER_RIGHT,
+        NUM_SCHEME_ROLES
+    };
+
+    /**
+     * The generators go through the shared SchemeCache, so the relations of
+     * a base color evaluate the scheme only once per change, and dragging a
+     * marker by less than the quantization of the cache costs nothing.
+     */
+    static ColorRelation::SlotColorGen
+    get_generator (const boost::shared_ptr<IScheme>& scheme, scheme_role_t role)
+    {
+        if (role < NUM_SCHEME_ROLES)
+        {
+            // the roles are in the order of the scheme outputs
+            return SchemeCache::instance ().get_generator (scheme, role);
+        }
+        return sigc::ptr_fun (&generate_identity);
+    }
+
     struct ApplicationWindow::Priv : public Gtk::Window
     {
+        /**
+         * A relation whose generator is determined by the current scheme
+         */
+        struct SchemeRelation
+        {
+            boost::shared_ptr<ColorRelation> relation;
+            boost::shared_ptr<ColorModel> source;
+            boost::shared_ptr<ColorModel> dest;
+            scheme_role_t role;
+        };
+
+        typedef std::vector<boost::shared_ptr<ColorModel> > model_vector_t;
+        typedef std::vector<SchemeRelation> relation_vector_t;
+
         Glib::RefPtr<Gtk::UIManager> m_ui_manager;
         Glib::RefPtr<Gtk::ActionGroup> m_actions;
-        std::vector<boost::shared_ptr<ColorModel> > m_colors;
-        static const int DEFAULT_NUM_COLORS = 5;
-        boost::shared_ptr<ColorModel> m_base_color;
-        std::vector<boost::shared_ptr<ColorRelation> > m_relations;
+        // all colors of the palette in display order
+        model_vector_t m_colors;
+        // the colors that were added as base colors, oldest first
+        model_vector_t m_bases;
+        relation_vector_t m_relations;
+        // the color that the scheme thumbnails are drawn for
+        boost::shared_ptr<ColorModel> m_thumbnail_base;
+        sigc::connection m_thumbnail_connection;
         boost::shared_ptr<IScheme> m_scheme;
+        History m_history;
+        unsigned int m_scheme_history_id;
+        int m_scheme_index;
         Gtk::VBox m_vbox;
         Gtk::VBox m_vlayout;
         ColorWheel m_wheel;
+        Gtk::ScrolledWindow m_color_scroll;
         ColorGroupBox m_color_group;
         SchemeComboBox m_scheme_combo;
 
         Priv () :
             m_ui_manager (Gtk::UIManager::create ()),
-            m_actions (Gtk::ActionGroup::create ())
+            m_actions (Gtk::ActionGroup::create ()),
+            m_scheme_history_id (0),
+            m_scheme_index (0)
         {
-            // create the color models
-            for (int i = 0; i < DEFAULT_NUM_COLORS; ++i)
-            {
-                boost::shared_ptr<ColorModel> model = ColorModel::create ();
-                m_colors.push_back (model);
-                // the middle one is the base color
-                bool is_base = (i == 2);
-                if (is_base)
-                {
-                    m_base_color = model;
-                }
-                m_wheel.add_color(model, is_base);
-                m_color_group.add_color(model, is_base);
-            }
-
             init_actions ();
             init_signals ();
             m_ui_manager->add_ui_from_string (menus);
@@ -104,12 +164,21 @@ namespace agave
             Gtk::HBox* hbox = Gtk::manage(new Gtk::HBox ());
             m_vlayout.pack_start (*hbox, Gtk::PACK_SHRINK);
             hbox->pack_start (m_wheel.get_widget (), Gtk::PACK_EXPAND_PADDING);
-            m_vlayout.pack_start (m_color_group);
+            // large palettes don't fit next to each other, so let the user
+            // scroll through them
+            m_color_scroll.set_policy (Gtk::POLICY_AUTOMATIC, Gtk::POLICY_NEVER);
+            m_color_scroll.set_shadow_type (Gtk::SHADOW_NONE);
+            m_color_scroll.add (m_color_group);
+            m_vlayout.pack_start (m_color_scroll);
             m_vlayout.pack_start (m_scheme_combo, Gtk::PACK_SHRINK);
 
-            // trigger the scheme change manually at startup so we start with
-            // some scheme relationship
-            on_scheme_combo_changed();
+            // start out with a scheme and a single base color
+            m_scheme = m_scheme_combo.get_active_scheme ();
+            m_scheme_index = m_scheme_combo.get_active_row_number ();
+            m_scheme_history_id = m_history.add_index (sigc::mem_fun (this,
+                        &Priv::set_scheme_index));
+            add_color_group ();
+            update_actions ();
 
             add (m_vbox);
             set_default_icon_name ("agave2");
@@ -123,6 +192,55 @@ namespace agave
             m_actions->add (
                     Gtk::Action::create ("Quit", Gtk::Stock::QUIT),
                     sigc::mem_fun (this, &Priv::on_action_quit));
+            m_actions->add (
+                    Gtk::Action::create ("MenuEdit", _("_Edit")));
+            m_actions->add (
+                    Gtk::Action::create ("Undo", Gtk::Stock::UNDO),
+                    Gtk::AccelKey ("<control>z"),
+                    sigc::mem_fun (this, &Priv::on_action_undo));
+            m_actions->add (
+                    Gtk::Action::create ("Redo", Gtk::Stock::REDO),
+                    Gtk::AccelKey ("<control><shift>z"),
+                    sigc::mem_fun (this, &Priv::on_action_redo));
+            m_actions->add (
+                    Gtk::Action::create ("MenuPalette", _("_Palette")));
+            m_actions->add (
+                    Gtk::Action::create ("AddBaseColor", Gtk::Stock::ADD,
+                        _("_Add Base Color")),
+                    sigc::mem_fun (this, &Priv::on_action_add_base_color));
+            m_actions->add (
+                    Gtk::Action::create ("RemoveBaseColor", Gtk::Stock::REMOVE,
+                        _("_Remove Base Color"),
+                        _("Remove the selected base color and the colors derived from it")),
+                    sigc::mem_fun (this, &Priv::on_action_remove_base_color));
+            m_actions->add (
+                    Gtk::Action::create ("AddColor", _("Add _Color")),
+                    sigc::mem_fun (this, &Priv::on_action_add_color));
+            m_actions->add (
+                    Gtk::Action::create ("MenuDeriveColor", _("_Derive Color")));
+            m_actions->add (
+                    Gtk::Action::create ("DeriveOuterLeft", _("_Outer Left")),
+                    sigc::bind (sigc::mem_fun (this,
+                            &Priv::on_action_derive_color), ROLE_OUTER_LEFT));
+            m_actions->add (
+                    Gtk::Action::create ("DeriveInnerLeft", _("_Inner Left")),
+                    sigc::bind (sigc::mem_fun (this,
+                            &Priv::on_action_derive_color), ROLE_INNER_LEFT));
+            m_actions->add (
+                    Gtk::Action::create ("DeriveInnerRight", _("I_nner Right")),
+                    sigc::bind (sigc::mem_fun (this,
+                            &Priv::on_action_derive_color), ROLE_INNER_RIGHT));
+            m_actions->add (
+                    Gtk::Action::create ("DeriveOuterRight", _("O_uter Right")),
+                    sigc::bind (sigc::mem_fun (this,
+                            &Priv::on_action_derive_color), ROLE_OUTER_RIGHT));
+            m_actions->add (
+                    Gtk::Action::create ("DetachColor", _("De_tach Color"),
+                        _("Stop deriving the selected color from other colors")),
+                    sigc::mem_fun (this, &Priv::on_action_detach_color));
+            m_actions->add (
+                    Gtk::Action::create ("RemoveColor", _("Re_move Color")),
+                    sigc::mem_fun (this, &Priv::on_action_remove_color));
             m_actions->add (
                     Gtk::Action::create ("MenuHelp", _("_Help")));
             m_actions->add (
@@ -134,6 +252,10 @@ namespace agave
         {
             m_scheme_combo.signal_changed ().connect (sigc::mem_fun (this,
                         &Priv::on_scheme_combo_changed));
+            m_history.signal_changed ().connect (sigc::mem_fun (this,
+                        &Priv::update_actions));
+            m_color_group.signal_selection_changed ().connect (sigc::mem_fun
+                    (this, &Priv::update_actions));
         }
 
         void set_subtitle (const Glib::ustring& subtitle)
@@ -150,6 +272,33 @@ namespace agave
             set_title (title);
         }
 
+        /**
+         * Preview the schemes with the first base color
+         */
+        void update_scheme_thumbnails ()
+        {
+            m_scheme_combo.set_base_color (m_thumbnail_base->get_color ());
+        }
+
+        /**
+         * Draw the thumbnails for the first base color, or the first color
+         * if all base colors have been removed
+         */
+        void update_thumbnail_base ()
+        {
+            const boost::shared_ptr<ColorModel> base = m_bases.empty () ?
+                m_colors.front () : m_bases.front ();
+            if (base == m_thumbnail_base)
+            {
+                return;
+            }
+            m_thumbnail_connection.disconnect ();
+            m_thumbnail_base = base;
+            m_thumbnail_connection = m_thumbnail_base->signal_color_changed ().connect (
+                    sigc::mem_fun (this, &Priv::update_scheme_thumbnails));
+            update_scheme_thumbnails ();
+        }
+
         void on_action_quit ()
         {
             hide ();
@@ -161,40 +310,307 @@ namespace agave
             dialog.run ();
         }
 
+        void on_action_add_base_color ()
+        {
+            add_color_group ();
+            update_actions ();
+        }
+
+        void on_action_remove_base_color ()
+        {
+            remove_color_group (m_color_group.get_selected ());
+            update_actions ();
+        }
+
+        void on_action_add_color ()
+        {
+            add_color (ColorModel::create (), false);
+            update_actions ();
+        }
+
+        void on_action_derive_color (scheme_role_t role)
+        {
+            const boost::shared_ptr<ColorModel> source =
+                m_color_group.get_selected ();
+            if (source)
+            {
+                derive_color (source, role);
+                update_actions ();
+            }
+        }
+
+        void on_action_detach_color ()
+        {
+            const boost::shared_ptr<ColorModel> model =
+                m_color_group.get_selected ();
+            if (model)
+            {
+                remove_relations_to (model);
+                update_actions ();
+            }
+        }
+
+        void on_action_remove_color ()
+        {
+            const boost::shared_ptr<ColorModel> model =
+                m_color_group.get_selected ();
+            if (can_remove (model))
+            {
+                remove_color (model);
+                update_actions ();
+            }
+        }
+
+        void on_action_undo ()
+        {
+            m_history.undo ();
+        }
+
+        void on_action_redo ()
+        {
+            m_history.redo ();
+        }
+
+        void update_actions ()
+        {
+            m_actions->get_action ("Undo")->set_sensitive (m_history.can_undo ());
+            m_actions->get_action ("Redo")->set_sensitive (m_history.can_redo ());
+            // the palette operations work on the selected color, and there
+            // always has to be at least one base color
+            const boost::shared_ptr<ColorModel> selected =
+                m_color_group.get_selected ();
+            m_actions->get_action ("RemoveBaseColor")->set_sensitive
+                (is_base (selected) && m_bases.size () > 1);
+            m_actions->get_action ("MenuDeriveColor")->set_sensitive
+                (selected.get () != 0);
+            m_actions->get_action ("DetachColor")->set_sensitive
+                (selected && is_derived (selected));
+            m_actions->get_action ("RemoveColor")->set_sensitive
+                (can_remove (selected));
+        }
+
         void on_scheme_combo_changed ()
         {
             LOG_FUNCTION_SCOPE_NORMAL_DD ;
+            const int index = m_scheme_combo.get_active_row_number ();
+            m_history.record_index (m_scheme_history_id, m_scheme_index, index);
+            m_scheme_index = index;
             set_scheme (m_scheme_combo.get_active_scheme ());
         }
 
+        void set_scheme_index (int index)
+        {
+            // this ends up in on_scheme_combo_changed ()
+            m_scheme_combo.set_active (index);
+        }
+
         void set_scheme (const boost::shared_ptr<IScheme>& scheme)
         {
+            THROW_IF_FAIL (scheme);
             m_scheme = scheme;
-            THROW_IF_FAIL (m_base_color);
-            // get rid of the old scheme's relations, if any
-            m_relations.clear ();
+            // keep the existing relations and only swap their generators
+            for (relation_vector_t::iterator iter = m_relations.begin ();
+                 iter != m_relations.end (); ++iter)
+            {
+                iter->relation->set_generator (get_generator (m_scheme,
+                                                              iter->role));
+            }
+        }
 
-            boost::shared_ptr<ColorRelation> relation;
-            relation.reset (new
-                    ColorRelation(m_base_color, m_colors[0],
-                        scheme->get_outer_left ()));
-            m_relations.push_back (relation);
-
-            relation.reset (new
-                    ColorRelation(m_base_color, m_colors[1],
-                        scheme->get_inner_left ()));
-            m_relations.push_back (relation);
-
-            relation.reset (new
-                    ColorRelation(m_base_color, m_colors[3],
-                        scheme->get_inner_right ()));
-            m_relations.push_back (relation);
-
-            relation.reset (new
-                    ColorRelation(m_base_color, m_colors[4],
-                        scheme->get_outer_right ()));
-            m_relations.push_back (relation);
+        /// \name Palette editing
+        /// The palette is an arbitrary list of colors and relations between
+        /// them.  Base colors only differ in that they are highlighted and
+        /// come with derived colors when they are added.
+        /// @{
+        void add_color (const boost::shared_ptr<ColorModel>& model,
+                        bool is_base)
+        {
+            THROW_IF_FAIL (model);
+            m_colors.push_back (model);
+            if (is_base)
+            {
+                m_bases.push_back (model);
+            }
+            m_history.add_model (model);
+            m_wheel.add_color (model, is_base);
+            m_color_group.add_color (model, is_base);
+            update_thumbnail_base ();
+        }
+
+        /**
+         * Remove a color and all relations that it takes part in.  The
+         * colors derived from it keep their current values.
+         */
+        void remove_color (const boost::shared_ptr<ColorModel>& model)
+        {
+            remove_relations (model);
+            m_history.remove_model (model);
+            m_wheel.remove_color (model);
+            m_color_group.remove_color (model);
+            m_colors.erase (std::remove (m_colors.begin (), m_colors.end (),
+                                         model),
+                            m_colors.end ());
+            m_bases.erase (std::remove (m_bases.begin (), m_bases.end (),
+                                        model),
+                           m_bases.end ());
+            update_thumbnail_base ();
+        }
+
+        /**
+         * Whether @a model can be removed without removing the last base
+         * color
+         */
+        bool can_remove (const boost::shared_ptr<ColorModel>& model) const
+        {
+            return model && m_colors.size () > 1 &&
+                !(is_base (model) && m_bases.size () == 1);
+        }
+
+        bool is_base (const boost::shared_ptr<ColorModel>& model) const
+        {
+            return model && std::find (m_bases.begin (), m_bases.end (),
+                                       model) != m_bases.end ();
+        }
+
+        /**
+         * Whether @a model is the destination of a relation
+         */
+        bool is_derived (const boost::shared_ptr<ColorModel>& model) const
+        {
+            for (relation_vector_t::const_iterator iter = m_relations.begin ();
+                 iter != m_relations.end (); ++iter)
+            {
+                if (iter->dest == model)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void add_relation (const boost::shared_ptr<ColorModel>& source,
+                           const boost::shared_ptr<ColorModel>& dest,
+                           scheme_role_t role)
+        {
+            THROW_IF_FAIL (m_scheme);
+            SchemeRelation entry;
+            entry.relation.reset (new ColorRelation (source, dest,
+                        get_generator (m_scheme, role)));
+            entry.source = source;
+            entry.dest = dest;
+            entry.role = role;
+            m_relations.push_back (entry);
+        }
+
+        /**
+         * Remove all relations that @a model takes part in
+         */
+        void remove_relations (const boost::shared_ptr<ColorModel>& model)
+        {
+            relation_vector_t::iterator iter = m_relations.begin ();
+            while (iter != m_relations.end ())
+            {
+                if (iter->source == model || iter->dest == model)
+                {
+                    iter = m_relations.erase (iter);
+                }
+                else
+                {
+                    ++iter;
+                }
+            }
         }
+
+        /**
+         * Remove the relations that derive @a model from other colors, so
+         * that it can be edited freely
+         */
+        void remove_relations_to (const boost::shared_ptr<ColorModel>& model)
+        {
+            relation_vector_t::iterator iter = m_relations.begin ();
+            while (iter != m_relations.end ())
+            {
+                if (iter->dest == model)
+                {
+                    iter = m_relations.erase (iter);
+                }
+                else
+                {
+                    ++iter;
+                }
+            }
+        }
+
+        /**
+         * Add a color that the scheme derives from @a source
+         */
+        boost::shared_ptr<ColorModel>
+        derive_color (const boost::shared_ptr<ColorModel>& source,
+                      scheme_role_t role)
+        {
+            boost::shared_ptr<ColorModel> model = ColorModel::create ();
+            add_color (model, false);
+            add_relation (source, model, role);
+            return model;
+        }
+
+        /**
+         * Add a new base color together with the colors that the scheme
+         * derives from it
+         */
+        void add_color_group ()
+        {
+            boost::shared_ptr<ColorModel> base = ColorModel::create ();
+            if (!m_bases.empty ())
+            {
+                // start out with a different hue than the previous group
+                hsv_t hsv = m_bases.back ()->get_color ().as_hsv ();
+                hsv.h += 1.0 / 6.0;
+                base->set_color (Color (hsv));
+            }
+
+            for (int role = 0; role < NUM_SCHEME_ROLES; ++role)
+            {
+                // the base color is displayed in the middle of its group
+                if (role == ROLE_INNER_RIGHT)
+                {
+                    add_color (base, true);
+                }
+                derive_color (base, static_cast<scheme_role_t> (role));
+            }
+        }
+
+        /**
+         * Remove the base color @a base together with the colors that are
+         * only derived from it
+         */
+        void remove_color_group (const boost::shared_ptr<ColorModel>& base)
+        {
+            if (!is_base (base) || m_bases.size () <= 1)
+            {
+                return;
+            }
+
+            model_vector_t derived;
+            for (relation_vector_t::const_iterator iter = m_relations.begin ();
+                 iter != m_relations.end (); ++iter)
+            {
+                if (iter->source == base)
+                {
+                    derived.push_back (iter->dest);
+                }
+            }
+            remove_color (base);
+            for (model_vector_t::const_iterator iter = derived.begin ();
+                 iter != derived.end (); ++iter)
+            {
+                if (!is_derived (*iter) && !is_base (*iter))
+                {
+                    remove_color (*iter);
+                }
+            }
+        }
+        /// @}
     };
 
     ApplicationWindow::ApplicationWindow () :
@@ -213,4 +629,24 @@ namespace agave
         THROW_IF_FAIL (m_priv);
         return *m_priv;
     }
+
+    std::vector<rgb_t> ApplicationWindow::get_palette () const
+    {
+        THROW_IF_FAIL (m_priv);
+        std::vector<rgb_t> palette;
+        palette.reserve (m_priv->m_colors.size ());
+        for (Priv::model_vector_t::const_iterator iter = m_priv->m_colors.begin ();
+             iter != m_priv->m_colors.end (); ++iter)
+        {
+            palette.push_back ((*iter)->get_color ().as_rgb ());
+        }
+        return palette;
+    }
+
+    std::size_t ApplicationWindow::find_similar_sets (const ColorSetManager& manager,
+                                                      std::size_t k,
+                                                      std::vector<ColorSetManager::similar_set_t>& results) const
+    {
+        return manager.find_similar (get_palette (), k, results);
+    }
 }
@@ -21,7 +21,9 @@
 #ifndef __APPLICATION_WINDOW_H
 #define __APPLICATION_WINDOW_H
 
+#include <vector>
 #include <boost/shared_ptr.hpp>
+#include "color-set-manager.h"
 
 namespace Gtk
 {
@@ -38,6 +40,21 @@ namespace agave
             void set_subtitle (const Glib::ustring& subtitle);
             Gtk::Window& get_window () const;
 
+            /**
+             * Get the colors of the current palette in display order
+             */
+            std::vector<rgb_t> get_palette () const;
+
+            /**
+             * Find the @a k sets of @a manager that are most similar to the
+             * current palette (see ColorSetManager::find_similar ())
+             *
+             * @return  The number of matches
+             */
+            std::size_t find_similar_sets (const ColorSetManager& manager,
+                                           std::size_t k,
+                                           std::vector<ColorSetManager::similar_set_t>& results) const;
+
         private:
             struct Priv;
             boost::shared_ptr<Priv> m_priv;
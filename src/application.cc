@@ -21,6 +21,7 @@
 #include <gtkmm/main.h>
 #include <glib/gi18n.h>
 #include <glib/gutils.h>
+#include <glibmm/thread.h>
 #include <glibmm-utils/exception.h>
 #include "config.h"
 #include "application.h"
@@ -53,7 +54,7 @@ namespace agave
         //boost::shared_ptr<Scheme> m_current_scheme;
         boost::shared_ptr<Gtk::Main> m_main;
         boost::shared_ptr<ApplicationWindow> m_app_window;
-        // TODO: saved schemes, history, prefs
+        // TODO: saved schemes, prefs
 
         Priv (int argc, char** argv) :
             //m_current_scheme (new Scheme ()),
@@ -76,6 +77,11 @@ namespace agave
             context.set_main_group (option_group);
             option_group.set_translation_domain (GETTEXT_PACKAGE);
 
+            // the scheme thumbnails are rendered in a worker thread
+            if (!Glib::thread_supported ())
+            {
+                Glib::thread_init ();
+            }
             m_main.reset (new Gtk::Main (argc, argv, context));
         }
 
@@ -0,0 +1,369 @@
+/*******************************************************************************
+ *
+ *  Copyright (c) 2008 Jonathon Jongsma
+ *
+ *  This file is part of Agave
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ *******************************************************************************/
+
+// NOTE: this file deliberately has no include guard.  color-convert.cc
+// includes it once for every instruction set it supports, each time inside a
+// different namespace that defines an 'Ops' type with the primitive vector
+// operations for that instruction set (see simd-ops.h).  Since every variant of the kernels is
+// built from exactly the same sequence of operations, the SIMD versions
+// produce bit-identical results to the scalar one.  No data-dependent
+// branches are allowed in here: conditionals have to be expressed with
+// Ops::select ().
+
+typedef Ops::vec vec;
+typedef Ops::mask mask;
+
+static inline vec clamp_unit (vec x)
+{
+    return Ops::max (Ops::min (x, Ops::set1 (1.0f)), Ops::set1 (0.0f));
+}
+
+// returns x - floor (x), i.e. wraps a hue around into the range [0, 1)
+static inline vec wrap_unit (vec x)
+{
+    vec t = Ops::trunc (x);
+    t = Ops::select (Ops::gt (t, x), Ops::sub (t, Ops::set1 (1.0f)), t);
+    return Ops::sub (x, t);
+}
+
+// computes the hue (in sixths of a turn) for a color with the given maximum
+// component.  delta must be non-zero.
+static inline vec hue_sextant (vec r, vec g, vec b, vec max, vec delta)
+{
+    vec hr = Ops::div (Ops::sub (g, b), delta);
+    hr = Ops::select (Ops::lt (hr, Ops::set1 (0.0f)),
+                      Ops::add (hr, Ops::set1 (6.0f)), hr);
+    vec hg = Ops::add (Ops::set1 (2.0f), Ops::div (Ops::sub (b, r), delta));
+    vec hb = Ops::add (Ops::set1 (4.0f), Ops::div (Ops::sub (r, g), delta));
+    return Ops::select (Ops::eq (r, max), hr,
+                        Ops::select (Ops::eq (g, max), hg, hb));
+}
+
+struct RgbToHsv
+{
+    static inline void apply (vec r, vec g, vec b, vec& h, vec& s, vec& v)
+    {
+        vec max = Ops::max (Ops::max (r, g), b);
+        vec min = Ops::min (Ops::min (r, g), b);
+        vec delta = Ops::sub (max, min);
+        // same threshold as Color::rgb_to_hsv ()
+        mask chromatic = Ops::gt (delta, Ops::set1 (0.0001f));
+        vec one = Ops::set1 (1.0f);
+        vec safe_delta = Ops::select (chromatic, delta, one);
+        vec safe_max = Ops::select (chromatic, max, one);
+
+        vec hue = hue_sextant (r, g, b, max, safe_delta);
+        h = Ops::select (chromatic, Ops::div (hue, Ops::set1 (6.0f)),
+                         Ops::set1 (0.0f));
+        s = Ops::select (chromatic, Ops::div (delta, safe_max),
+                         Ops::set1 (0.0f));
+        v = max;
+    }
+};
+
+struct HsvToRgb
+{
+    // channel n of the color, see e.g.
+    // http://en.wikipedia.org/wiki/HSL_and_HSV#Alternative_HSV_conversion
+    static inline vec channel (float n, vec h6, vec v, vec vs)
+    {
+        vec six = Ops::set1 (6.0f);
+        vec k = Ops::add (Ops::set1 (n), h6);
+        k = Ops::select (Ops::ge (k, six), Ops::sub (k, six), k);
+        vec x = Ops::min (Ops::min (k, Ops::sub (Ops::set1 (4.0f), k)),
+                          Ops::set1 (1.0f));
+        x = Ops::max (x, Ops::set1 (0.0f));
+        return Ops::sub (v, Ops::mul (vs, x));
+    }
+
+    static inline void apply (vec h, vec s, vec v, vec& r, vec& g, vec& b)
+    {
+        s = clamp_unit (s);
+        v = clamp_unit (v);
+        vec h6 = Ops::mul (wrap_unit (h), Ops::set1 (6.0f));
+        vec vs = Ops::mul (v, s);
+        r = channel (5.0f, h6, v, vs);
+        g = channel (3.0f, h6, v, vs);
+        b = channel (1.0f, h6, v, vs);
+    }
+};
+
+struct RgbToHsl
+{
+    static inline void apply (vec r, vec g, vec b, vec& h, vec& s, vec& l)
+    {
+        vec one = Ops::set1 (1.0f);
+        vec max = Ops::max (Ops::max (r, g), b);
+        vec min = Ops::min (Ops::min (r, g), b);
+        vec delta = Ops::sub (max, min);
+        vec sum = Ops::add (max, min);
+        mask chromatic = Ops::gt (max, min);
+        l = Ops::mul (sum, Ops::set1 (0.5f));
+
+        vec denom = Ops::select (Ops::le (l, Ops::set1 (0.5f)), sum,
+                                 Ops::sub (Ops::set1 (2.0f), sum));
+        denom = Ops::select (chromatic, denom, one);
+        s = Ops::select (chromatic, Ops::div (delta, denom), Ops::set1 (0.0f));
+
+        vec safe_delta = Ops::select (chromatic, delta, one);
+        vec hue = hue_sextant (r, g, b, max, safe_delta);
+        // undefined hue is reported as -1.0, like Color::rgb_to_hsl ()
+        h = Ops::select (chromatic, Ops::div (hue, Ops::set1 (6.0f)),
+                         Ops::set1 (-1.0f));
+    }
+};
+
+struct HslToRgb
+{
+    static inline vec channel (float n, vec h12, vec l, vec a)
+    {
+        vec twelve = Ops::set1 (12.0f);
+        vec k = Ops::add (Ops::set1 (n), h12);
+        k = Ops::select (Ops::ge (k, twelve), Ops::sub (k, twelve), k);
+        vec x = Ops::min (Ops::min (Ops::sub (k, Ops::set1 (3.0f)),
+                                    Ops::sub (Ops::set1 (9.0f), k)),
+                          Ops::set1 (1.0f));
+        x = Ops::max (x, Ops::set1 (-1.0f));
+        return Ops::sub (l, Ops::mul (a, x));
+    }
+
+    static inline void apply (vec h, vec s, vec l, vec& r, vec& g, vec& b)
+    {
+        s = clamp_unit (s);
+        l = clamp_unit (l);
+        vec h12 = Ops::mul (wrap_unit (h), Ops::set1 (12.0f));
+        vec a = Ops::mul (s, Ops::min (l, Ops::sub (Ops::set1 (1.0f), l)));
+        r = channel (0.0f, h12, l, a);
+        g = channel (8.0f, h12, l, a);
+        b = channel (4.0f, h12, l, a);
+    }
+};
+
+struct RgbToCmyk
+{
+    static inline void apply (vec r, vec g, vec b, vec pullout,
+                              vec& c, vec& m, vec& y, vec& k)
+    {
+        vec one = Ops::set1 (1.0f);
+        vec zero = Ops::set1 (0.0f);
+        vec ci = Ops::sub (one, r);
+        vec mi = Ops::sub (one, g);
+        vec yi = Ops::sub (one, b);
+        k = Ops::min (Ops::min (Ops::min (one, ci), mi), yi);
+        k = Ops::mul (k, pullout);
+
+        mask has_color = Ops::lt (k, one);
+        vec denom = Ops::select (has_color, Ops::sub (one, k), one);
+        c = Ops::select (has_color, Ops::div (Ops::sub (ci, k), denom), zero);
+        m = Ops::select (has_color, Ops::div (Ops::sub (mi, k), denom), zero);
+        y = Ops::select (has_color, Ops::div (Ops::sub (yi, k), denom), zero);
+    }
+};
+
+// scale a unit channel value to a (still floating point) byte value,
+// rounding to the nearest integer once it's truncated
+static inline vec to_byte (vec x)
+{
+    return Ops::add (Ops::mul (clamp_unit (x), Ops::set1 (255.0f)),
+                     Ops::set1 (0.5f));
+}
+
+template <class Kernel>
+static void planar3 (const float* in0, const float* in1, const float* in2,
+                     float* out0, float* out1, float* out2, std::size_t n)
+{
+    std::size_t i = 0;
+    for (; i + Ops::WIDTH <= n; i += Ops::WIDTH)
+    {
+        vec o0, o1, o2;
+        Kernel::apply (Ops::load (in0 + i), Ops::load (in1 + i),
+                       Ops::load (in2 + i), o0, o1, o2);
+        Ops::store (out0 + i, o0);
+        Ops::store (out1 + i, o1);
+        Ops::store (out2 + i, o2);
+    }
+    if (i < n)
+    {
+        // run the remainder through the same kernel in a padded block so
+        // that it gets exactly the same arithmetic
+        float p0[Ops::WIDTH] = {0.0f}, p1[Ops::WIDTH] = {0.0f},
+              p2[Ops::WIDTH] = {0.0f};
+        std::size_t rest = n - i;
+        std::copy (in0 + i, in0 + n, p0);
+        std::copy (in1 + i, in1 + n, p1);
+        std::copy (in2 + i, in2 + n, p2);
+        vec o0, o1, o2;
+        Kernel::apply (Ops::load (p0), Ops::load (p1), Ops::load (p2),
+                       o0, o1, o2);
+        Ops::store (p0, o0);
+        Ops::store (p1, o1);
+        Ops::store (p2, o2);
+        std::copy (p0, p0 + rest, out0 + i);
+        std::copy (p1, p1 + rest, out1 + i);
+        std::copy (p2, p2 + rest, out2 + i);
+    }
+}
+
+static void rgb_to_hsv (const float* r, const float* g, const float* b,
+                        float* h, float* s, float* v, std::size_t n)
+{
+    planar3<RgbToHsv> (r, g, b, h, s, v, n);
+}
+
+static void hsv_to_rgb (const float* h, const float* s, const float* v,
+                        float* r, float* g, float* b, std::size_t n)
+{
+    planar3<HsvToRgb> (h, s, v, r, g, b, n);
+}
+
+static void rgb_to_hsl (const float* r, const float* g, const float* b,
+                        float* h, float* s, float* l, std::size_t n)
+{
+    planar3<RgbToHsl> (r, g, b, h, s, l, n);
+}
+
+static void hsl_to_rgb (const float* h, const float* s, const float* l,
+                        float* r, float* g, float* b, std::size_t n)
+{
+    planar3<HslToRgb> (h, s, l, r, g, b, n);
+}
+
+static void rgb_to_cmyk (const float* r, const float* g, const float* b,
+                         float* c, float* m, float* y, float* k,
+                         std::size_t n, float pullout)
+{
+    vec po = Ops::set1 (pullout);
+    std::size_t i = 0;
+    for (; i + Ops::WIDTH <= n; i += Ops::WIDTH)
+    {
+        vec oc, om, oy, ok;
+        RgbToCmyk::apply (Ops::load (r + i), Ops::load (g + i),
+                          Ops::load (b + i), po, oc, om, oy, ok);
+        Ops::store (c + i, oc);
+        Ops::store (m + i, om);
+        Ops::store (y + i, oy);
+        Ops::store (k + i, ok);
+    }
+    if (i < n)
+    {
+        float pr[Ops::WIDTH] = {0.0f}, pg[Ops::WIDTH] = {0.0f},
+              pb[Ops::WIDTH] = {0.0f}, pk[Ops::WIDTH] = {0.0f};
+        std::size_t rest = n - i;
+        std::copy (r + i, r + n, pr);
+        std::copy (g + i, g + n, pg);
+        std::copy (b + i, b + n, pb);
+        vec oc, om, oy, ok;
+        RgbToCmyk::apply (Ops::load (pr), Ops::load (pg), Ops::load (pb),
+                          po, oc, om, oy, ok);
+        Ops::store (pr, oc);
+        Ops::store (pg, om);
+        Ops::store (pb, oy);
+        Ops::store (pk, ok);
+        std::copy (pr, pr + rest, c + i);
+        std::copy (pg, pg + rest, m + i);
+        std::copy (pb, pb + rest, y + i);
+        std::copy (pk, pk + rest, k + i);
+    }
+}
+
+static inline void hsv_to_argb32_block (const float* h, const float* s,
+                                        const float* v, uint32_t* argb)
+{
+    vec r, g, b;
+    HsvToRgb::apply (Ops::load (h), Ops::load (s), Ops::load (v), r, g, b);
+    Ops::store_argb32 (argb, to_byte (r), to_byte (g), to_byte (b));
+}
+
+static void hsv_to_argb32 (const float* h, const float* s, const float* v,
+                           uint32_t* argb, std::size_t n)
+{
+    std::size_t i = 0;
+    for (; i + Ops::WIDTH <= n; i += Ops::WIDTH)
+    {
+        hsv_to_argb32_block (h + i, s + i, v + i, argb + i);
+    }
+    if (i < n)
+    {
+        float ph[Ops::WIDTH] = {0.0f}, ps[Ops::WIDTH] = {0.0f},
+              pv[Ops::WIDTH] = {0.0f};
+        uint32_t pout[Ops::WIDTH];
+        std::copy (h + i, h + n, ph);
+        std::copy (s + i, s + n, ps);
+        std::copy (v + i, v + n, pv);
+        hsv_to_argb32_block (ph, ps, pv, pout);
+        std::copy (pout, pout + (n - i), argb + i);
+    }
+}
+
+static inline void argb32_to_hsva_block (const uint32_t* argb,
+                                         float* h, float* s, float* v,
+                                         float* a)
+{
+    vec pa, pr, pg, pb;
+    Ops::load_argb32 (argb, pa, pr, pg, pb);
+    // undo the premultiplication, fully transparent pixels become black
+    mask visible = Ops::gt (pa, Ops::set1 (0.0f));
+    vec safe_a = Ops::select (visible, pa, Ops::set1 (1.0f));
+    vec zero = Ops::set1 (0.0f);
+    vec r = Ops::select (visible, Ops::min (Ops::div (pr, safe_a), Ops::set1 (1.0f)), zero);
+    vec g = Ops::select (visible, Ops::min (Ops::div (pg, safe_a), Ops::set1 (1.0f)), zero);
+    vec b = Ops::select (visible, Ops::min (Ops::div (pb, safe_a), Ops::set1 (1.0f)), zero);
+    vec oh, os, ov;
+    RgbToHsv::apply (r, g, b, oh, os, ov);
+    Ops::store (h, oh);
+    Ops::store (s, os);
+    Ops::store (v, ov);
+    Ops::store (a, Ops::div (pa, Ops::set1 (255.0f)));
+}
+
+static void argb32_to_hsva (const uint32_t* argb,
+                            float* h, float* s, float* v, float* a,
+                            std::size_t n)
+{
+    std::size_t i = 0;
+    for (; i + Ops::WIDTH <= n; i += Ops::WIDTH)
+    {
+        argb32_to_hsva_block (argb + i, h + i, s + i, v + i, a + i);
+    }
+    if (i < n)
+    {
+        uint32_t pin[Ops::WIDTH] = {0};
+        float ph[Ops::WIDTH], ps[Ops::WIDTH], pv[Ops::WIDTH], pa[Ops::WIDTH];
+        std::size_t rest = n - i;
+        std::copy (argb + i, argb + n, pin);
+        argb32_to_hsva_block (pin, ph, ps, pv, pa);
+        std::copy (ph, ph + rest, h + i);
+        std::copy (ps, ps + rest, s + i);
+        std::copy (pv, pv + rest, v + i);
+        std::copy (pa, pa + rest, a + i);
+    }
+}
+
+static const KernelTable kernels =
+{
+    &rgb_to_hsv,
+    &hsv_to_rgb,
+    &rgb_to_hsl,
+    &hsl_to_rgb,
+    &rgb_to_cmyk,
+    &hsv_to_argb32,
+    &argb32_to_hsva
+};
@@ -0,0 +1,257 @@
+/*******************************************************************************
+ *
+ *  Copyright (c) 2008 Jonathon Jongsma
+ *
+ *  This file is part of Agave
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ *******************************************************************************/
+#include <algorithm>
+#include <glib.h>
+#include "color-convert.h"
+#include "simd-ops.h"
+
+namespace agave
+{
+    struct KernelTable
+    {
+        void (*rgb_to_hsv) (const float*, const float*, const float*,
+                            float*, float*, float*, std::size_t);
+        void (*hsv_to_rgb) (const float*, const float*, const float*,
+                            float*, float*, float*, std::size_t);
+        void (*rgb_to_hsl) (const float*, const float*, const float*,
+                            float*, float*, float*, std::size_t);
+        void (*hsl_to_rgb) (const float*, const float*, const float*,
+                            float*, float*, float*, std::size_t);
+        void (*rgb_to_cmyk) (const float*, const float*, const float*,
+                             float*, float*, float*, float*, std::size_t,
+                             float);
+        void (*hsv_to_argb32) (const float*, const float*, const float*,
+                               uint32_t*, std::size_t);
+        void (*argb32_to_hsva) (const uint32_t*, float*, float*, float*,
+                                float*, std::size_t);
+    };
+
+    namespace kernels_scalar
+    {
+#include "color-convert-kernels.h"
+    }
+
+#ifdef AGAVE_X86_SIMD
+#pragma GCC push_options
+#pragma GCC target ("sse2")
+    namespace kernels_sse2
+    {
+#include "color-convert-kernels.h"
+    }
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target ("avx2")
+    namespace kernels_avx2
+    {
+#include "color-convert-kernels.h"
+    }
+#pragma GCC pop_options
+#endif // AGAVE_X86_SIMD
+
+    // the number of colors converted at a time by the interleaved
+    // conversions, which go through the planar kernels on the stack
+    static const std::size_t BLOCK_SIZE = 256;
+
+    static simd_level_t s_simd_level = SIMD_LEVEL_SCALAR;
+    static const KernelTable* s_kernels = 0;
+
+    simd_level_t get_supported_simd_level ()
+    {
+#ifdef AGAVE_X86_SIMD
+        __builtin_cpu_init ();
+        if (__builtin_cpu_supports ("avx2"))
+        {
+            return SIMD_LEVEL_AVX2;
+        }
+        if (__builtin_cpu_supports ("sse2"))
+        {
+            return SIMD_LEVEL_SSE2;
+        }
+#endif
+        return SIMD_LEVEL_SCALAR;
+    }
+
+    simd_level_t set_simd_level (simd_level_t level)
+    {
+        level = std::min (level, get_supported_simd_level ());
+        switch (level)
+        {
+#ifdef AGAVE_X86_SIMD
+            case SIMD_LEVEL_AVX2:
+                s_kernels = &kernels_avx2::kernels;
+                break;
+            case SIMD_LEVEL_SSE2:
+                s_kernels = &kernels_sse2::kernels;
+                break;
+#endif
+            default:
+                level = SIMD_LEVEL_SCALAR;
+                s_kernels = &kernels_scalar::kernels;
+                break;
+        }
+        s_simd_level = level;
+        return level;
+    }
+
+    // picks the best kernels on first use.  The conversions are called from
+    // several threads, so this has to happen exactly once.
+    static inline void init_kernels ()
+    {
+        static volatile gsize s_initialized = 0;
+        if (g_once_init_enter (&s_initialized))
+        {
+            if (!s_kernels)
+            {
+                set_simd_level (get_supported_simd_level ());
+            }
+            g_once_init_leave (&s_initialized, 1);
+        }
+    }
+
+    simd_level_t get_simd_level ()
+    {
+        init_kernels ();
+        return s_simd_level;
+    }
+
+    static inline const KernelTable& kernels ()
+    {
+        init_kernels ();
+        return *s_kernels;
+    }
+
+    void batch_rgb_to_hsv (const float* r, const float* g, const float* b,
+                           float* h, float* s, float* v, std::size_t n)
+    {
+        kernels ().rgb_to_hsv (r, g, b, h, s, v, n);
+    }
+
+    void batch_hsv_to_rgb (const float* h, const float* s, const float* v,
+                           float* r, float* g, float* b, std::size_t n)
+    {
+        kernels ().hsv_to_rgb (h, s, v, r, g, b, n);
+    }
+
+    void batch_rgb_to_hsl (const float* r, const float* g, const float* b,
+                           float* h, float* s, float* l, std::size_t n)
+    {
+        kernels ().rgb_to_hsl (r, g, b, h, s, l, n);
+    }
+
+    void batch_hsl_to_rgb (const float* h, const float* s, const float* l,
+                           float* r, float* g, float* b, std::size_t n)
+    {
+        kernels ().hsl_to_rgb (h, s, l, r, g, b, n);
+    }
+
+    void batch_rgb_to_cmyk (const float* r, const float* g, const float* b,
+                            float* c, float* m, float* y, float* k,
+                            std::size_t n, float pullout)
+    {
+        kernels ().rgb_to_cmyk (r, g, b, c, m, y, k, n, pullout);
+    }
+
+    void batch_hsv_to_argb32 (const float* h, const float* s, const float* v,
+                              uint32_t* argb, std::size_t n)
+    {
+        kernels ().hsv_to_argb32 (h, s, v, argb, n);
+    }
+
+    void batch_argb32_to_hsva (const uint32_t* argb,
+                               float* h, float* s, float* v, float* a,
+                               std::size_t n)
+    {
+        kernels ().argb32_to_hsva (argb, h, s, v, a, n);
+    }
+
+    typedef void (*planar_func_t) (const float*, const float*, const float*,
+                                   float*, float*, float*, std::size_t);
+
+    // run an interleaved conversion through a planar kernel, a block at a
+    // time, copying the fourth (alpha) channel straight through
+    static void convert_interleaved (planar_func_t func, const float* in,
+                                     float* out, std::size_t n)
+    {
+        float i0[BLOCK_SIZE], i1[BLOCK_SIZE], i2[BLOCK_SIZE];
+        float o0[BLOCK_SIZE], o1[BLOCK_SIZE], o2[BLOCK_SIZE];
+        while (n)
+        {
+            std::size_t count = std::min (n, BLOCK_SIZE);
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                i0[i] = in[4 * i];
+                i1[i] = in[4 * i + 1];
+                i2[i] = in[4 * i + 2];
+            }
+            func (i0, i1, i2, o0, o1, o2, count);
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                out[4 * i] = o0[i];
+                out[4 * i + 1] = o1[i];
+                out[4 * i + 2] = o2[i];
+                out[4 * i + 3] = in[4 * i + 3];
+            }
+            in += 4 * count;
+            out += 4 * count;
+            n -= count;
+        }
+    }
+
+    void batch_rgba_to_hsva (const float* rgba, float* hsva, std::size_t n)
+    {
+        convert_interleaved (kernels ().rgb_to_hsv, rgba, hsva, n);
+    }
+
+    void batch_hsva_to_rgba (const float* hsva, float* rgba, std::size_t n)
+    {
+        convert_interleaved (kernels ().hsv_to_rgb, hsva, rgba, n);
+    }
+
+    void batch_rgba8_to_hsva (const unsigned char* rgba, float* hsva,
+                              std::size_t n)
+    {
+        const float scale = 1.0f / 255.0f;
+        float r[BLOCK_SIZE], g[BLOCK_SIZE], b[BLOCK_SIZE];
+        float h[BLOCK_SIZE], s[BLOCK_SIZE], v[BLOCK_SIZE];
+        while (n)
+        {
+            std::size_t count = std::min (n, BLOCK_SIZE);
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                r[i] = rgba[4 * i] * scale;
+                g[i] = rgba[4 * i + 1] * scale;
+                b[i] = rgba[4 * i + 2] * scale;
+            }
+            kernels ().rgb_to_hsv (r, g, b, h, s, v, count);
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                hsva[4 * i] = h[i];
+                hsva[4 * i + 1] = s[i];
+                hsva[4 * i + 2] = v[i];
+                hsva[4 * i + 3] = rgba[4 * i + 3] * scale;
+            }
+            rgba += 4 * count;
+            hsva += 4 * count;
+            n -= count;
+        }
+    }
+}
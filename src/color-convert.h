@@ -0,0 +1,143 @@
+/*******************************************************************************
+ *
+ *  Copyright (c) 2008 Jonathon Jongsma
+ *
+ *  This file is part of Agave
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ *******************************************************************************/
+#ifndef __COLOR_CONVERT_H
+#define __COLOR_CONVERT_H
+
+#include <cstddef>
+#include <stdint.h>
+
+/**
+ * \file
+ * Batch colorspace conversion.
+ *
+ * These functions convert whole arrays of colors at once instead of one
+ * struct at a time like the Color::rgb_to_hsv () family.  The planar
+ * ("structure of arrays") variants take one array per channel, the
+ * interleaved variants take RGBA / HSVA quadruplets or packed pixels.  All
+ * channel values are single precision floats in the range 0.0 - 1.0, with
+ * hue expressed as a fraction of a full turn, just as in hsv_t.
+ *
+ * The conversions are computed without data-dependent branches, using SSE2
+ * or AVX2 where the processor supports it.  The kernel is picked at runtime
+ * and every kernel produces bit-identical results to the portable scalar
+ * fallback, so results never depend on the machine they were computed on.
+ * Note that the results are not guaranteed to be identical to the double
+ * precision conversions in Color.
+ */
+namespace agave
+{
+    /**
+     * The instruction sets that the batch conversion kernels can use
+     */
+    enum simd_level_t
+    {
+        SIMD_LEVEL_SCALAR,
+        SIMD_LEVEL_SSE2,
+        SIMD_LEVEL_AVX2
+    };
+
+    /**
+     * Get the best instruction set supported by the current processor
+     */
+    simd_level_t get_supported_simd_level ();
+
+    /**
+     * Get the instruction set that the batch kernels currently use.  By
+     * default this is the best supported level.
+     */
+    simd_level_t get_simd_level ();
+
+    /**
+     * Force the batch kernels to a particular instruction set (e.g. to
+     * compare against the scalar fallback).  Levels that aren't supported by
+     * the processor are lowered to the best supported one.  This must not
+     * be called while other threads use the batch conversions.
+     *
+     * @return  The level that is actually in use afterwards
+     */
+    simd_level_t set_simd_level (simd_level_t level);
+
+    /// \name Planar conversions
+    /// @{
+    void batch_rgb_to_hsv (const float* r, const float* g, const float* b,
+                           float* h, float* s, float* v, std::size_t n);
+
+    void batch_hsv_to_rgb (const float* h, const float* s, const float* v,
+                           float* r, float* g, float* b, std::size_t n);
+
+    /**
+     * Like Color::rgb_to_hsl (), an achromatic color gets a hue of -1.0
+     */
+    void batch_rgb_to_hsl (const float* r, const float* g, const float* b,
+                           float* h, float* s, float* l, std::size_t n);
+
+    void batch_hsl_to_rgb (const float* h, const float* s, const float* l,
+                           float* r, float* g, float* b, std::size_t n);
+
+    /**
+     * @param pullout  A scaling value (0-1) indicating how much black
+     * should be pulled out
+     */
+    void batch_rgb_to_cmyk (const float* r, const float* g, const float* b,
+                            float* c, float* m, float* y, float* k,
+                            std::size_t n, float pullout = 0.0f);
+    /// @}
+
+    /// \name Interleaved conversions
+    /// @{
+    /**
+     * Convert @a n RGBA quadruplets to HSVA quadruplets.  The alpha channel
+     * is copied unchanged.
+     */
+    void batch_rgba_to_hsva (const float* rgba, float* hsva, std::size_t n);
+
+    /**
+     * Convert @a n HSVA quadruplets to RGBA quadruplets.  The alpha channel
+     * is copied unchanged.
+     */
+    void batch_hsva_to_rgba (const float* hsva, float* rgba, std::size_t n);
+
+    /**
+     * Convert planar HSV values to opaque pixels in the native-endian 0xAARRGGBB
+     * layout used by Cairo::FORMAT_ARGB32 surfaces.  Channels are rounded to
+     * the nearest 8 bit value.
+     */
+    void batch_hsv_to_argb32 (const float* h, const float* s, const float* v,
+                              uint32_t* argb, std::size_t n);
+
+    /**
+     * Convert pixels in the premultiplied Cairo::FORMAT_ARGB32 layout to
+     * planar HSVA values, e.g. to analyze the colors of an image.
+     */
+    void batch_argb32_to_hsva (const uint32_t* argb,
+                               float* h, float* s, float* v, float* a,
+                               std::size_t n);
+
+    /**
+     * Convert @a n non-premultiplied 8 bit RGBA pixels (as used by
+     * Gdk::Pixbuf) to HSVA quadruplets
+     */
+    void batch_rgba8_to_hsva (const unsigned char* rgba, float* hsva,
+                              std::size_t n);
+    /// @}
+}
+
+#endif // __COLOR_CONVERT_H
@@ -0,0 +1,132 @@
+/*******************************************************************************
+ *
+ *  Copyright (c) 2008 Jonathon Jongsma
+ *
+ *  This file is part of Agave
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ *******************************************************************************/
+
+// NOTE: like color-convert-kernels.h, this file deliberately has no include
+// guard.  color-difference.cc includes it once for every instruction set,
+// inside a namespace that provides the matching 'Ops' type from simd-ops.h.
+// The reference-dependent constants are computed by the callers with plain
+// scalar arithmetic, so all variants still produce identical results.
+
+typedef Ops::vec vec;
+
+// Euclidean distance, used for both CIE76 in CIELAB and OKLab
+struct EuclideanDistance
+{
+    vec ref_l, ref_a, ref_b;
+
+    EuclideanDistance (float l, float a, float b) :
+        ref_l (Ops::set1 (l)),
+        ref_a (Ops::set1 (a)),
+        ref_b (Ops::set1 (b))
+    {}
+
+    inline vec operator() (vec l, vec a, vec b) const
+    {
+        vec dl = Ops::sub (l, ref_l);
+        vec da = Ops::sub (a, ref_a);
+        vec db = Ops::sub (b, ref_b);
+        return Ops::sqrt (Ops::add (Ops::add (Ops::mul (dl, dl),
+                                              Ops::mul (da, da)),
+                                    Ops::mul (db, db)));
+    }
+};
+
+struct Cie94Distance
+{
+    vec ref_l, ref_a, ref_b;
+    vec ref_c;
+    // 1 / SC and 1 / SH^2
+    vec inv_sc, inv_sh2;
+
+    Cie94Distance (float l, float a, float b, float c, float sc, float sh) :
+        ref_l (Ops::set1 (l)),
+        ref_a (Ops::set1 (a)),
+        ref_b (Ops::set1 (b)),
+        ref_c (Ops::set1 (c)),
+        inv_sc (Ops::set1 (1.0f / sc)),
+        inv_sh2 (Ops::set1 (1.0f / (sh * sh)))
+    {}
+
+    inline vec operator() (vec l, vec a, vec b) const
+    {
+        vec dl = Ops::sub (l, ref_l);
+        vec da = Ops::sub (a, ref_a);
+        vec db = Ops::sub (b, ref_b);
+        vec c = Ops::sqrt (Ops::add (Ops::mul (a, a), Ops::mul (b, b)));
+        vec dc = Ops::sub (ref_c, c);
+        // delta H squared, which can come out slightly negative due to
+        // rounding
+        vec dh2 = Ops::sub (Ops::add (Ops::mul (da, da), Ops::mul (db, db)),
+                            Ops::mul (dc, dc));
+        dh2 = Ops::max (dh2, Ops::set1 (0.0f));
+        vec tc = Ops::mul (dc, inv_sc);
+        vec sum = Ops::add (Ops::add (Ops::mul (dl, dl), Ops::mul (tc, tc)),
+                            Ops::mul (dh2, inv_sh2));
+        return Ops::sqrt (sum);
+    }
+};
+
+template <class Distance>
+static inline void run_distance (const Distance& distance,
+                                 const float* l, const float* a,
+                                 const float* b, float* out, std::size_t n)
+{
+    std::size_t i = 0;
+    for (; i + Ops::WIDTH <= n; i += Ops::WIDTH)
+    {
+        Ops::store (out + i, distance (Ops::load (l + i), Ops::load (a + i),
+                                       Ops::load (b + i)));
+    }
+    if (i < n)
+    {
+        float pl[Ops::WIDTH] = {0.0f}, pa[Ops::WIDTH] = {0.0f},
+              pb[Ops::WIDTH] = {0.0f};
+        float pout[Ops::WIDTH];
+        std::copy (l + i, l + n, pl);
+        std::copy (a + i, a + n, pa);
+        std::copy (b + i, b + n, pb);
+        Ops::store (pout, distance (Ops::load (pl), Ops::load (pa),
+                                    Ops::load (pb)));
+        std::copy (pout, pout + (n - i), out + i);
+    }
+}
+
+static void euclidean (float ref_l, float ref_a, float ref_b,
+                       const float* l, const float* a, const float* b,
+                       float* out, std::size_t n)
+{
+    run_distance (EuclideanDistance (ref_l, ref_a, ref_b), l, a, b, out, n);
+}
+
+static void cie94 (float ref_l, float ref_a, float ref_b, float ref_c,
+                   float sc, float sh,
+                   const float* l, const float* a, const float* b,
+                   float* out, std::size_t n)
+{
+    run_distance (Cie94Distance (ref_l, ref_a, ref_b, ref_c, sc, sh),
+                  l, a, b, out, n);
+}
+
+static const DeltaEKernelTable delta_e_kernels =
+{
+    &euclidean,
+    &cie94
+};
@@ -0,0 +1,361 @@
+/*******************************************************************************
+ *
+ *  Copyright (c) 2008 Jonathon Jongsma
+ *
+ *  This file is part of Agave
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ *******************************************************************************/
+#include <algorithm>
+#include <cmath>
+#include <glib/gtypes.h>
+#include "color-difference.h"
+#include "color-convert.h"
+#include "simd-ops.h"
+
+namespace agave
+{
+    struct DeltaEKernelTable
+    {
+        void (*euclidean) (float, float, float,
+                           const float*, const float*, const float*,
+                           float*, std::size_t);
+        void (*cie94) (float, float, float, float, float, float,
+                       const float*, const float*, const float*,
+                       float*, std::size_t);
+    };
+
+    namespace kernels_scalar
+    {
+#include "color-difference-kernels.h"
+    }
+
+#ifdef AGAVE_X86_SIMD
+#pragma GCC push_options
+#pragma GCC target ("sse2")
+    namespace kernels_sse2
+    {
+#include "color-difference-kernels.h"
+    }
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target ("avx2")
+    namespace kernels_avx2
+    {
+#include "color-difference-kernels.h"
+    }
+#pragma GCC pop_options
+#endif // AGAVE_X86_SIMD
+
+    // graphic arts weights for CIE94
+    static const double CIE94_K1 = 0.045;
+    static const double CIE94_K2 = 0.015;
+
+    // the number of distances computed at a time by the nearest color search
+    static const std::size_t BLOCK_SIZE = 256;
+
+    // follow the instruction set that was picked for the conversion kernels
+    static inline const DeltaEKernelTable& kernels ()
+    {
+        switch (get_simd_level ())
+        {
+#ifdef AGAVE_X86_SIMD
+            case SIMD_LEVEL_AVX2:
+                return kernels_avx2::delta_e_kernels;
+            case SIMD_LEVEL_SSE2:
+                return kernels_sse2::delta_e_kernels;
+#endif
+            default:
+                return kernels_scalar::delta_e_kernels;
+        }
+    }
+
+    static inline double degrees (double radians)
+    {
+        return radians * (180.0 / G_PI);
+    }
+
+    static inline double radians (double degrees)
+    {
+        return degrees * (G_PI / 180.0);
+    }
+
+    static inline double pow7 (double x)
+    {
+        const double x2 = x * x;
+        return x2 * x2 * x2 * x;
+    }
+
+    double delta_e_76 (const lab_t& reference, const lab_t& sample)
+    {
+        const double dl = sample.l - reference.l;
+        const double da = sample.a - reference.a;
+        const double db = sample.b - reference.b;
+        return std::sqrt (dl * dl + da * da + db * db);
+    }
+
+    double delta_e_94 (const lab_t& reference, const lab_t& sample)
+    {
+        const double c1 = std::sqrt (reference.a * reference.a +
+                                     reference.b * reference.b);
+        const double c2 = std::sqrt (sample.a * sample.a +
+                                     sample.b * sample.b);
+        const double dl = sample.l - reference.l;
+        const double da = sample.a - reference.a;
+        const double db = sample.b - reference.b;
+        const double dc = c1 - c2;
+        const double dh2 = std::max (da * da + db * db - dc * dc, 0.0);
+        const double sc = 1.0 + CIE94_K1 * c1;
+        const double sh = 1.0 + CIE94_K2 * c1;
+        const double tc = dc / sc;
+        return std::sqrt (dl * dl + tc * tc + dh2 / (sh * sh));
+    }
+
+    // see Sharma, Wu and Dalal, "The CIEDE2000 Color-Difference Formula:
+    // Implementation Notes, Supplementary Test Data, and Mathematical
+    // Observations" (2005).  The variable names follow the paper, with 'p'
+    // standing for a prime.
+    double delta_e_2000 (const lab_t& reference, const lab_t& sample)
+    {
+        static const double POW7_25 = 6103515625.0; // 25^7
+
+        const double l1 = reference.l, a1 = reference.a, b1 = reference.b;
+        const double l2 = sample.l, a2 = sample.a, b2 = sample.b;
+
+        const double c1 = std::sqrt (a1 * a1 + b1 * b1);
+        const double c2 = std::sqrt (a2 * a2 + b2 * b2);
+        const double c_bar7 = pow7 ((c1 + c2) / 2.0);
+        const double g = 0.5 * (1.0 - std::sqrt (c_bar7 / (c_bar7 + POW7_25)));
+
+        const double a1p = (1.0 + g) * a1;
+        const double a2p = (1.0 + g) * a2;
+        const double c1p = std::sqrt (a1p * a1p + b1 * b1);
+        const double c2p = std::sqrt (a2p * a2p + b2 * b2);
+
+        double h1p = (a1p == 0.0 && b1 == 0.0) ? 0.0 :
+            degrees (std::atan2 (b1, a1p));
+        if (h1p < 0.0)
+            h1p += 360.0;
+        double h2p = (a2p == 0.0 && b2 == 0.0) ? 0.0 :
+            degrees (std::atan2 (b2, a2p));
+        if (h2p < 0.0)
+            h2p += 360.0;
+
+        const double dlp = l2 - l1;
+        const double dcp = c2p - c1p;
+        const bool achromatic = (c1p * c2p == 0.0);
+
+        double dhp = 0.0;
+        if (!achromatic)
+        {
+            dhp = h2p - h1p;
+            if (dhp > 180.0)
+                dhp -= 360.0;
+            else if (dhp < -180.0)
+                dhp += 360.0;
+        }
+        const double dHp = 2.0 * std::sqrt (c1p * c2p) *
+            std::sin (radians (dhp / 2.0));
+
+        const double l_barp = (l1 + l2) / 2.0;
+        const double c_barp = (c1p + c2p) / 2.0;
+        double h_barp = h1p + h2p;
+        if (!achromatic)
+        {
+            if (std::fabs (h1p - h2p) <= 180.0)
+                h_barp /= 2.0;
+            else if (h_barp < 360.0)
+                h_barp = (h_barp + 360.0) / 2.0;
+            else
+                h_barp = (h_barp - 360.0) / 2.0;
+        }
+
+        const double t = 1.0
+            - 0.17 * std::cos (radians (h_barp - 30.0))
+            + 0.24 * std::cos (radians (2.0 * h_barp))
+            + 0.32 * std::cos (radians (3.0 * h_barp + 6.0))
+            - 0.20 * std::cos (radians (4.0 * h_barp - 63.0));
+        const double h_offset = (h_barp - 275.0) / 25.0;
+        const double d_theta = 30.0 * std::exp (-h_offset * h_offset);
+        const double c_barp7 = pow7 (c_barp);
+        const double rc = 2.0 * std::sqrt (c_barp7 / (c_barp7 + POW7_25));
+        const double l_offset2 = (l_barp - 50.0) * (l_barp - 50.0);
+        const double sl = 1.0 + 0.015 * l_offset2 / std::sqrt (20.0 + l_offset2);
+        const double sc = 1.0 + 0.045 * c_barp;
+        const double sh = 1.0 + 0.015 * c_barp * t;
+        const double rt = -std::sin (radians (2.0 * d_theta)) * rc;
+
+        const double tl = dlp / sl;
+        const double tc = dcp / sc;
+        const double th = dHp / sh;
+        return std::sqrt (tl * tl + tc * tc + th * th + rt * tc * th);
+    }
+
+    double delta_e_ok (const oklab_t& reference, const oklab_t& sample)
+    {
+        const double dl = sample.l - reference.l;
+        const double da = sample.a - reference.a;
+        const double db = sample.b - reference.b;
+        return std::sqrt (dl * dl + da * da + db * db);
+    }
+
+    double delta_e (const rgb_t& reference, const rgb_t& sample,
+                    delta_e_t metric)
+    {
+        switch (metric)
+        {
+            case DELTA_E_76:
+                return delta_e_76 (rgb_to_lab (reference), rgb_to_lab (sample));
+            case DELTA_E_94:
+                return delta_e_94 (rgb_to_lab (reference), rgb_to_lab (sample));
+            case DELTA_E_2000:
+                return delta_e_2000 (rgb_to_lab (reference),
+                                     rgb_to_lab (sample));
+            case DELTA_E_OK:
+                return delta_e_ok (rgb_to_oklab (reference),
+                                   rgb_to_oklab (sample));
+        }
+        return 0.0;
+    }
+
+    void batch_delta_e (delta_e_t metric, float l, float a, float b,
+                        const float* sample_l, const float* sample_a,
+                        const float* sample_b, float* distances,
+                        std::size_t n)
+    {
+        switch (metric)
+        {
+            case DELTA_E_76:
+            case DELTA_E_OK:
+                kernels ().euclidean (l, a, b, sample_l, sample_a, sample_b,
+                                      distances, n);
+                break;
+            case DELTA_E_94:
+                {
+                    const float c = std::sqrt (a * a + b * b);
+                    const float sc = 1.0f + static_cast<float>(CIE94_K1) * c;
+                    const float sh = 1.0f + static_cast<float>(CIE94_K2) * c;
+                    kernels ().cie94 (l, a, b, c, sc, sh,
+                                      sample_l, sample_a, sample_b,
+                                      distances, n);
+                }
+                break;
+            case DELTA_E_2000:
+                {
+                    lab_t reference = { l, a, b, 1.0 };
+                    for (std::size_t i = 0; i < n; ++i)
+                    {
+                        lab_t sample = { sample_l[i], sample_a[i],
+                            sample_b[i], 1.0 };
+                        distances[i] = static_cast<float>(
+                                delta_e_2000 (reference, sample));
+                    }
+                }
+                break;
+        }
+    }
+
+    void batch_delta_e_matrix (delta_e_t metric,
+                               const float* reference_l,
+                               const float* reference_a,
+                               const float* reference_b,
+                               std::size_t n_references,
+                               const float* sample_l, const float* sample_a,
+                               const float* sample_b, std::size_t n_samples,
+                               float* distances)
+    {
+        for (std::size_t i = 0; i < n_references; ++i)
+        {
+            batch_delta_e (metric, reference_l[i], reference_a[i],
+                           reference_b[i], sample_l, sample_a, sample_b,
+                           distances + i * n_samples, n_samples);
+        }
+    }
+
+    // orders matches by distance, then by index so that the results don't
+    // depend on the order in which candidates were visited
+    static inline bool match_less (const color_match_t& lhs,
+                                   const color_match_t& rhs)
+    {
+        if (lhs.distance != rhs.distance)
+            return lhs.distance < rhs.distance;
+        return lhs.index < rhs.index;
+    }
+
+    std::size_t nearest_colors (delta_e_t metric, float l, float a, float b,
+                                const float* candidate_l,
+                                const float* candidate_a,
+                                const float* candidate_b,
+                                std::size_t n_candidates,
+                                color_match_t* matches, std::size_t k)
+    {
+        if (k == 0)
+            return 0;
+
+        // matches[0, n_found) is kept as a max-heap, so the worst of the
+        // current matches is always at the front
+        std::size_t n_found = 0;
+        float distances[BLOCK_SIZE];
+        for (std::size_t start = 0; start < n_candidates; start += BLOCK_SIZE)
+        {
+            const std::size_t count = std::min (BLOCK_SIZE,
+                                                n_candidates - start);
+            batch_delta_e (metric, l, a, b, candidate_l + start,
+                           candidate_a + start, candidate_b + start,
+                           distances, count);
+
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                color_match_t match = { start + i, distances[i] };
+                if (n_found < k)
+                {
+                    matches[n_found++] = match;
+                    std::push_heap (matches, matches + n_found, match_less);
+                }
+                else if (match_less (match, matches[0]))
+                {
+                    std::pop_heap (matches, matches + n_found, match_less);
+                    matches[n_found - 1] = match;
+                    std::push_heap (matches, matches + n_found, match_less);
+                }
+            }
+        }
+
+        std::sort_heap (matches, matches + n_found, match_less);
+        return n_found;
+    }
+
+    std::size_t batch_nearest_colors (delta_e_t metric,
+                                      const float* reference_l,
+                                      const float* reference_a,
+                                      const float* reference_b,
+                                      std::size_t n_references,
+                                      const float* candidate_l,
+                                      const float* candidate_a,
+                                      const float* candidate_b,
+                                      std::size_t n_candidates,
+                                      color_match_t* matches, std::size_t k)
+    {
+        const std::size_t n_found = std::min (k, n_candidates);
+        for (std::size_t i = 0; i < n_references; ++i)
+        {
+            nearest_colors (metric, reference_l[i], reference_a[i],
+                            reference_b[i], candidate_l, candidate_a,
+                            candidate_b, n_candidates, matches + i * k, k);
+        }
+        return n_found;
+    }
+}
@@ -0,0 +1,144 @@
+/*******************************************************************************
+ *
+ *  Copyright (c) 2008 Jonathon Jongsma
+ *
+ *  This file is part of Agave
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ *******************************************************************************/
+#ifndef __COLOR_DIFFERENCE_H
+#define __COLOR_DIFFERENCE_H
+
+#include <cstddef>
+#include "color.h"
+#include "color-perceptual.h"
+
+/**
+ * \file
+ * Perceptual color differences (delta E).
+ *
+ * The batch functions take colors as planar single precision arrays in the
+ * colorspace that belongs to the metric: CIELAB for DELTA_E_76, DELTA_E_94
+ * and DELTA_E_2000, OKLab for DELTA_E_OK.  Use batch_rgb_to_lab () or
+ * batch_rgb_to_oklab () to prepare them.  The Euclidean metrics and CIE94
+ * use the same SIMD kernels as color-convert.h (see set_simd_level ()),
+ * CIEDE2000 is too branchy for that and is always computed one pair at a
+ * time.
+ */
+namespace agave
+{
+    /**
+     * The color difference formulas
+     */
+    enum delta_e_t
+    {
+        /// Euclidean distance in CIELAB
+        DELTA_E_76,
+        /// CIE94 with the graphic arts weights (kL = 1, K1 = 0.045,
+        /// K2 = 0.015).  Note that CIE94 is not symmetric.
+        DELTA_E_94,
+        /// CIEDE2000 with kL = kC = kH = 1
+        DELTA_E_2000,
+        /// Euclidean distance in OKLab.  Note that the values are on a much
+        /// smaller scale than the CIELAB-based metrics (roughly 0.0 - 1.0).
+        DELTA_E_OK
+    };
+
+    /**
+     * A single result of a nearest color search
+     */
+    struct color_match_t
+    {
+        /// the index of the color in the searched arrays
+        std::size_t index;
+        float distance;
+    };
+
+    /// \name Scalar differences
+    /// @{
+    double delta_e_76 (const lab_t& reference, const lab_t& sample);
+    double delta_e_94 (const lab_t& reference, const lab_t& sample);
+    double delta_e_2000 (const lab_t& reference, const lab_t& sample);
+    double delta_e_ok (const oklab_t& reference, const oklab_t& sample);
+
+    /**
+     * Convenience function that converts two sRGB colors to the right
+     * colorspace for @a metric first
+     */
+    double delta_e (const rgb_t& reference, const rgb_t& sample,
+                    delta_e_t metric = DELTA_E_2000);
+    /// @}
+
+    /// \name Batch differences
+    /// @{
+    /**
+     * Compute the difference between the reference color (@a l, @a a, @a b)
+     * and each of @a n sample colors
+     */
+    void batch_delta_e (delta_e_t metric, float l, float a, float b,
+                        const float* sample_l, const float* sample_a,
+                        const float* sample_b, float* distances,
+                        std::size_t n);
+
+    /**
+     * Compute the differences between every pair of reference and sample
+     * colors.  @a distances receives a row-major @a n_references x
+     * @a n_samples matrix.
+     */
+    void batch_delta_e_matrix (delta_e_t metric,
+                               const float* reference_l,
+                               const float* reference_a,
+                               const float* reference_b,
+                               std::size_t n_references,
+                               const float* sample_l, const float* sample_a,
+                               const float* sample_b, std::size_t n_samples,
+                               float* distances);
+
+    /**
+     * Find the @a k candidates closest to the reference color (@a l, @a a,
+     * @a b).  This doesn't allocate any memory.
+     *
+     * @param matches  An array of @a k elements that receives the matches,
+     * closest first.  Ties are broken by index.
+     * @return  The number of matches found, i.e. the smaller of @a k and
+     * @a n_candidates
+     */
+    std::size_t nearest_colors (delta_e_t metric, float l, float a, float b,
+                                const float* candidate_l,
+                                const float* candidate_a,
+                                const float* candidate_b,
+                                std::size_t n_candidates,
+                                color_match_t* matches, std::size_t k);
+
+    /**
+     * Run nearest_colors () for each of @a n_references colors.  The
+     * matches for reference i are stored at @a matches + i * @a k.
+     *
+     * @return  The number of matches found for each reference
+     */
+    std::size_t batch_nearest_colors (delta_e_t metric,
+                                      const float* reference_l,
+                                      const float* reference_a,
+                                      const float* reference_b,
+                                      std::size_t n_references,
+                                      const float* candidate_l,
+                                      const float* candidate_a,
+                                      const float* candidate_b,
+                                      std::size_t n_candidates,
+                                      color_match_t* matches, std::size_t k);
+    /// @}
+}
+
+#endif // __COLOR_DIFFERENCE_H
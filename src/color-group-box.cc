@@ -39,10 +39,21 @@ namespace agave
     struct ColorGroupBox::Priv
     {
         std::vector<boost::shared_ptr<ColorEditBox> > m_edit_boxes;
+        boost::shared_ptr<ColorModel> m_selected;
+        mutable sigc::signal<void> m_signal_selection_changed;
 
         Priv ()
         {
         }
+
+        void set_selected (const boost::shared_ptr<ColorModel>& model)
+        {
+            if (model != m_selected)
+            {
+                m_selected = model;
+                m_signal_selection_changed.emit ();
+            }
+        }
     };
 
     ColorGroupBox::ColorGroupBox() :
@@ -73,9 +84,59 @@ namespace agave
         pack_start (*edit_box);
     }
 
+    void ColorGroupBox::remove_color (const boost::shared_ptr<ColorModel>& model)
+    {
+        THROW_IF_FAIL (m_priv);
+        typedef std::vector<boost::shared_ptr<ColorEditBox> >::iterator edit_iter_t;
+        for (edit_iter_t iter = m_priv->m_edit_boxes.begin ();
+                iter != m_priv->m_edit_boxes.end (); ++iter)
+        {
+            if ((*iter)->get_model () == model)
+            {
+                remove (**iter);
+                m_priv->m_edit_boxes.erase (iter);
+                if (m_priv->m_selected == model)
+                {
+                    m_priv->set_selected (boost::shared_ptr<ColorModel> ());
+                }
+                break;
+            }
+        }
+    }
+
     unsigned int ColorGroupBox::get_num_colors () const
     {
         THROW_IF_FAIL (m_priv);
         return m_priv->m_edit_boxes.size ();
     }
+
+    boost::shared_ptr<ColorModel> ColorGroupBox::get_selected () const
+    {
+        THROW_IF_FAIL (m_priv);
+        return m_priv->m_selected;
+    }
+
+    sigc::signal<void>& ColorGroupBox::signal_selection_changed () const
+    {
+        THROW_IF_FAIL (m_priv);
+        return m_priv->m_signal_selection_changed;
+    }
+
+    void ColorGroupBox::on_set_focus_child (Gtk::Widget* widget)
+    {
+        Gtk::HBox::on_set_focus_child (widget);
+        THROW_IF_FAIL (m_priv);
+        // the focus moves into an edit box when one of its scales is used,
+        // which makes its color the selected one
+        typedef std::vector<boost::shared_ptr<ColorEditBox> >::const_iterator edit_iter_t;
+        for (edit_iter_t iter = m_priv->m_edit_boxes.begin ();
+                iter != m_priv->m_edit_boxes.end (); ++iter)
+        {
+            if (iter->get () == widget)
+            {
+                m_priv->set_selected ((*iter)->get_model ());
+                break;
+            }
+        }
+    }
 }
@@ -22,6 +22,7 @@
 #define __COLOR_GROUP_BOX_H
 
 #include <boost/shared_ptr.hpp>
+#include <sigc++/signal.h>
 #include <gtkmm/box.h>
 #include "i-multi-color-view.h"
 
@@ -34,8 +35,18 @@ namespace agave
         public:
             ColorGroupBox ();
             virtual void add_color (const boost::shared_ptr<ColorModel>& model, bool highlight);
+            virtual void remove_color (const boost::shared_ptr<ColorModel>& model);
             virtual unsigned int get_num_colors () const;
 
+            /**
+             * Get the color whose edit box last had the keyboard focus, or
+             * an empty pointer if there is none (e.g. after it was removed)
+             */
+            boost::shared_ptr<ColorModel> get_selected () const;
+            sigc::signal<void>& signal_selection_changed () const;
+
+        protected:
+            virtual void on_set_focus_child (Gtk::Widget* widget);
 
         private:
             struct Priv;
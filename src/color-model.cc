@@ -51,8 +51,21 @@ namespace agave
     void ColorModel::set_color (const Color& c)
     {
         THROW_IF_FAIL (m_priv);
+        // the color's own change notification is forwarded by
+        // Priv::on_color_changed (), so don't emit here as well
         m_priv->m_color = c;
-        signal_color_changed ().emit ();
+    }
+
+    void ColorModel::freeze_notify ()
+    {
+        THROW_IF_FAIL (m_priv);
+        m_priv->m_color.freeze_notify ();
+    }
+
+    void ColorModel::thaw_notify ()
+    {
+        THROW_IF_FAIL (m_priv);
+        m_priv->m_color.thaw_notify ();
     }
 
     Color& ColorModel::get_color ()
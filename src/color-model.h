@@ -35,8 +35,18 @@ namespace agave
             void set_color (const Color& c);
             Color& get_color ();
 
+            /**
+             * Emitted once for every change of the model's color
+             */
             sigc::signal<void>& signal_color_changed () const;
 
+            /**
+             * Collapse changes to the model's color into a single
+             * notification, see Color::freeze_notify ()
+             */
+            void freeze_notify ();
+            void thaw_notify ();
+
             static boost::shared_ptr<ColorModel> create (const Color& c = Color());
 
         private:
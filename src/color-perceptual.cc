@@ -0,0 +1,639 @@
+/*******************************************************************************
+ *
+ *  Copyright (c) 2008 Jonathon Jongsma
+ *
+ *  This file is part of Agave
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ *******************************************************************************/
+#include "color-perceptual.h"
+#include <algorithm>
+#include <cmath>
+#include <glib/gtypes.h>
+
+namespace agave
+{
+    // sRGB primaries with a D65 white point, from IEC 61966-2-1
+    static const double RGB_TO_XYZ[3][3] =
+    {
+        { 0.4124564, 0.3575761, 0.1804375 },
+        { 0.2126729, 0.7151522, 0.0721750 },
+        { 0.0193339, 0.1191920, 0.9503041 }
+    };
+
+    static const double XYZ_TO_RGB[3][3] =
+    {
+        {  3.2404542, -1.5371385, -0.4985314 },
+        { -0.9692660,  1.8760108,  0.0415560 },
+        {  0.0556434, -0.2040259,  1.0572252 }
+    };
+
+    // D65 reference white
+    static const double WHITE_X = 0.95047;
+    static const double WHITE_Y = 1.0;
+    static const double WHITE_Z = 1.08883;
+
+    // CIE constants as exact fractions
+    static const double LAB_EPSILON = 216.0 / 24389.0;
+    static const double LAB_KAPPA = 24389.0 / 27.0;
+
+    // OKLab matrices, from Björn Ottosson's reference implementation
+    static const double LINEAR_TO_LMS[3][3] =
+    {
+        { 0.4122214708, 0.5363325363, 0.0514459929 },
+        { 0.2119034982, 0.6806995451, 0.1073969566 },
+        { 0.0883024619, 0.2817188376, 0.6299787005 }
+    };
+
+    static const double LMS_TO_OKLAB[3][3] =
+    {
+        { 0.2104542553,  0.7936177850, -0.0040720468 },
+        { 1.9779984951, -2.4285922050,  0.4505937099 },
+        { 0.0259040371,  0.7827717662, -0.8086757660 }
+    };
+
+    static const double OKLAB_TO_LMS[3][3] =
+    {
+        { 1.0,  0.3963377774,  0.2158037573 },
+        { 1.0, -0.1055613458, -0.0638541728 },
+        { 1.0, -0.0894841775, -1.2914855480 }
+    };
+
+    static const double LMS_TO_LINEAR[3][3] =
+    {
+        {  4.0767416621, -3.3077115913,  0.2309699292 },
+        { -1.2684380046,  2.6097574011, -0.3413193965 },
+        { -0.0041960863, -0.7034186147,  1.7076147010 }
+    };
+
+    // Relative luminance weights for linear sRGB (the Y row of RGB_TO_XYZ,
+    // rounded as in WCAG 2)
+    static const double LUMINANCE_R = 0.2126;
+    static const double LUMINANCE_G = 0.7152;
+    static const double LUMINANCE_B = 0.0722;
+
+    static const double GAMUT_TOLERANCE = 1e-7;
+
+    /************************************************************
+     * transfer function lookup tables
+     ***********************************************************/
+    static const int TRANSFER_TABLE_SIZE = 4096;
+
+    struct TransferTables
+    {
+        // the curves sampled at TRANSFER_TABLE_SIZE + 1 evenly spaced points
+        // and interpolated linearly in between.  The linear segments near
+        // zero are computed directly instead, since that is where the
+        // encoding curve bends the most.
+        float to_linear[TRANSFER_TABLE_SIZE + 1];
+        float to_srgb[TRANSFER_TABLE_SIZE + 1];
+        float from_srgb8[256];
+
+        TransferTables ()
+        {
+            for (int i = 0; i <= TRANSFER_TABLE_SIZE; ++i)
+            {
+                const double v = static_cast<double>(i) / TRANSFER_TABLE_SIZE;
+                to_linear[i] = static_cast<float>(srgb_to_linear (v));
+                to_srgb[i] = static_cast<float>(linear_to_srgb (v));
+            }
+            for (int i = 0; i < 256; ++i)
+                from_srgb8[i] = static_cast<float>(srgb_to_linear (i / 255.0));
+        }
+    };
+
+    static const TransferTables s_transfer_tables;
+
+    static inline float lookup (const float* table, float v)
+    {
+        const float pos = v * TRANSFER_TABLE_SIZE;
+        int i = static_cast<int>(pos);
+        if (i >= TRANSFER_TABLE_SIZE)
+            i = TRANSFER_TABLE_SIZE - 1;
+        const float frac = pos - i;
+        return table[i] + frac * (table[i + 1] - table[i]);
+    }
+
+    // Like the scalar functions, these extend the linear segment below 0.0
+    // and the curve above 1.0, where the tables end.  Out of gamut values
+    // are rare, so computing them exactly costs next to nothing.  NaN takes
+    // the exact path as well and stays NaN.
+
+    static inline float srgb_to_linear_fast (float v)
+    {
+        if (v <= 0.04045f)
+            return v / 12.92f;
+        if (!(v <= 1.0f))
+            return static_cast<float>(srgb_to_linear (v));
+        return lookup (s_transfer_tables.to_linear, v);
+    }
+
+    static inline float linear_to_srgb_fast (float v)
+    {
+        if (v <= 0.0031308f)
+            return v * 12.92f;
+        if (!(v <= 1.0f))
+            return static_cast<float>(linear_to_srgb (v));
+        return lookup (s_transfer_tables.to_srgb, v);
+    }
+
+    /************************************************************
+     * scalar conversions
+     ***********************************************************/
+    double srgb_to_linear (double v)
+    {
+        if (v <= 0.04045)
+            return v / 12.92;
+        return std::pow ((v + 0.055) / 1.055, 2.4);
+    }
+
+    double linear_to_srgb (double v)
+    {
+        if (v <= 0.0031308)
+            return v * 12.92;
+        return 1.055 * std::pow (v, 1.0 / 2.4) - 0.055;
+    }
+
+    float srgb8_to_linear (unsigned char v)
+    {
+        return s_transfer_tables.from_srgb8[v];
+    }
+
+    static inline void multiply (const double m[3][3],
+                                 double x, double y, double z,
+                                 double& out_x, double& out_y, double& out_z)
+    {
+        out_x = m[0][0] * x + m[0][1] * y + m[0][2] * z;
+        out_y = m[1][0] * x + m[1][1] * y + m[1][2] * z;
+        out_z = m[2][0] * x + m[2][1] * y + m[2][2] * z;
+    }
+
+    xyz_t rgb_to_xyz (const rgb_t& rgb)
+    {
+        xyz_t xyz;
+        multiply (RGB_TO_XYZ, srgb_to_linear (rgb.r), srgb_to_linear (rgb.g),
+                  srgb_to_linear (rgb.b), xyz.x, xyz.y, xyz.z);
+        xyz.a = rgb.a;
+        return xyz;
+    }
+
+    rgb_t xyz_to_rgb (const xyz_t& xyz)
+    {
+        rgb_t rgb;
+        multiply (XYZ_TO_RGB, xyz.x, xyz.y, xyz.z, rgb.r, rgb.g, rgb.b);
+        rgb.r = linear_to_srgb (rgb.r);
+        rgb.g = linear_to_srgb (rgb.g);
+        rgb.b = linear_to_srgb (rgb.b);
+        rgb.a = xyz.a;
+        return rgb;
+    }
+
+    static inline double lab_f (double t)
+    {
+        if (t > LAB_EPSILON)
+            return cbrt (t);
+        return (LAB_KAPPA * t + 16.0) / 116.0;
+    }
+
+    static inline double lab_f_inverse (double f)
+    {
+        const double f3 = f * f * f;
+        if (f3 > LAB_EPSILON)
+            return f3;
+        return (116.0 * f - 16.0) / LAB_KAPPA;
+    }
+
+    lab_t xyz_to_lab (const xyz_t& xyz)
+    {
+        const double fx = lab_f (xyz.x / WHITE_X);
+        const double fy = lab_f (xyz.y / WHITE_Y);
+        const double fz = lab_f (xyz.z / WHITE_Z);
+
+        lab_t lab;
+        lab.l = 116.0 * fy - 16.0;
+        lab.a = 500.0 * (fx - fy);
+        lab.b = 200.0 * (fy - fz);
+        lab.alpha = xyz.a;
+        return lab;
+    }
+
+    xyz_t lab_to_xyz (const lab_t& lab)
+    {
+        const double fy = (lab.l + 16.0) / 116.0;
+        const double fx = fy + lab.a / 500.0;
+        const double fz = fy - lab.b / 200.0;
+
+        xyz_t xyz;
+        xyz.x = WHITE_X * lab_f_inverse (fx);
+        // the lightness has its own linear segment
+        xyz.y = WHITE_Y * ((lab.l > LAB_KAPPA * LAB_EPSILON) ?
+                           fy * fy * fy : lab.l / LAB_KAPPA);
+        xyz.z = WHITE_Z * lab_f_inverse (fz);
+        xyz.a = lab.alpha;
+        return xyz;
+    }
+
+    lab_t rgb_to_lab (const rgb_t& rgb)
+    {
+        return xyz_to_lab (rgb_to_xyz (rgb));
+    }
+
+    rgb_t lab_to_rgb (const lab_t& lab)
+    {
+        return xyz_to_rgb (lab_to_xyz (lab));
+    }
+
+    // shared by the CIELAB and OKLab polar forms.  The hue is returned as a
+    // fraction of a turn
+    static inline void to_polar (double a, double b, double& c, double& h)
+    {
+        c = std::sqrt (a * a + b * b);
+        if (c < 1e-9)
+        {
+            h = 0.0;
+            return;
+        }
+        h = std::atan2 (b, a) / (2.0 * G_PI);
+        if (h < 0.0)
+            h += 1.0;
+        if (h >= 1.0)
+            h = 0.0;
+    }
+
+    static inline void from_polar (double c, double h, double& a, double& b)
+    {
+        const double angle = h * 2.0 * G_PI;
+        a = c * std::cos (angle);
+        b = c * std::sin (angle);
+    }
+
+    lch_t lab_to_lch (const lab_t& lab)
+    {
+        lch_t lch;
+        lch.l = lab.l;
+        to_polar (lab.a, lab.b, lch.c, lch.h);
+        lch.a = lab.alpha;
+        return lch;
+    }
+
+    lab_t lch_to_lab (const lch_t& lch)
+    {
+        lab_t lab;
+        lab.l = lch.l;
+        from_polar (lch.c, lch.h, lab.a, lab.b);
+        lab.alpha = lch.a;
+        return lab;
+    }
+
+    lch_t rgb_to_lch (const rgb_t& rgb)
+    {
+        return lab_to_lch (rgb_to_lab (rgb));
+    }
+
+    rgb_t lch_to_rgb (const lch_t& lch)
+    {
+        return lab_to_rgb (lch_to_lab (lch));
+    }
+
+    oklab_t rgb_to_oklab (const rgb_t& rgb)
+    {
+        double l, m, s;
+        multiply (LINEAR_TO_LMS, srgb_to_linear (rgb.r),
+                  srgb_to_linear (rgb.g), srgb_to_linear (rgb.b), l, m, s);
+
+        oklab_t oklab;
+        multiply (LMS_TO_OKLAB, cbrt (l), cbrt (m), cbrt (s),
+                  oklab.l, oklab.a, oklab.b);
+        oklab.alpha = rgb.a;
+        return oklab;
+    }
+
+    rgb_t oklab_to_rgb (const oklab_t& oklab)
+    {
+        double l, m, s;
+        multiply (OKLAB_TO_LMS, oklab.l, oklab.a, oklab.b, l, m, s);
+
+        rgb_t rgb;
+        multiply (LMS_TO_LINEAR, l * l * l, m * m * m, s * s * s,
+                  rgb.r, rgb.g, rgb.b);
+        rgb.r = linear_to_srgb (rgb.r);
+        rgb.g = linear_to_srgb (rgb.g);
+        rgb.b = linear_to_srgb (rgb.b);
+        rgb.a = oklab.alpha;
+        return rgb;
+    }
+
+    oklch_t oklab_to_oklch (const oklab_t& oklab)
+    {
+        oklch_t oklch;
+        oklch.l = oklab.l;
+        to_polar (oklab.a, oklab.b, oklch.c, oklch.h);
+        oklch.a = oklab.alpha;
+        return oklch;
+    }
+
+    oklab_t oklch_to_oklab (const oklch_t& oklch)
+    {
+        oklab_t oklab;
+        oklab.l = oklch.l;
+        from_polar (oklch.c, oklch.h, oklab.a, oklab.b);
+        oklab.alpha = oklch.a;
+        return oklab;
+    }
+
+    oklch_t rgb_to_oklch (const rgb_t& rgb)
+    {
+        return oklab_to_oklch (rgb_to_oklab (rgb));
+    }
+
+    rgb_t oklch_to_rgb (const oklch_t& oklch)
+    {
+        return oklab_to_rgb (oklch_to_oklab (oklch));
+    }
+
+    bool in_srgb_gamut (const rgb_t& rgb)
+    {
+        const double low = -GAMUT_TOLERANCE;
+        const double high = 1.0 + GAMUT_TOLERANCE;
+        return rgb.r >= low && rgb.r <= high
+            && rgb.g >= low && rgb.g <= high
+            && rgb.b >= low && rgb.b <= high;
+    }
+
+    double relative_luminance (const rgb_t& rgb)
+    {
+        return LUMINANCE_R * srgb_to_linear (rgb.r)
+            + LUMINANCE_G * srgb_to_linear (rgb.g)
+            + LUMINANCE_B * srgb_to_linear (rgb.b);
+    }
+
+    double contrast_ratio (const rgb_t& first, const rgb_t& second)
+    {
+        double l1 = relative_luminance (first);
+        double l2 = relative_luminance (second);
+        if (l1 < l2)
+            std::swap (l1, l2);
+        return (l1 + 0.05) / (l2 + 0.05);
+    }
+
+    /************************************************************
+     * batch conversions
+     ***********************************************************/
+    // single precision copies of the matrices for the batch functions
+    struct matrix3f_t
+    {
+        float m[3][3];
+
+        explicit matrix3f_t (const double src[3][3])
+        {
+            for (int i = 0; i < 3; ++i)
+                for (int j = 0; j < 3; ++j)
+                    m[i][j] = static_cast<float>(src[i][j]);
+        }
+
+        inline void apply (float x, float y, float z,
+                           float& out_x, float& out_y, float& out_z) const
+        {
+            out_x = m[0][0] * x + m[0][1] * y + m[0][2] * z;
+            out_y = m[1][0] * x + m[1][1] * y + m[1][2] * z;
+            out_z = m[2][0] * x + m[2][1] * y + m[2][2] * z;
+        }
+    };
+
+    static const matrix3f_t s_rgb_to_xyz (RGB_TO_XYZ);
+    static const matrix3f_t s_xyz_to_rgb (XYZ_TO_RGB);
+    static const matrix3f_t s_linear_to_lms (LINEAR_TO_LMS);
+    static const matrix3f_t s_lms_to_oklab (LMS_TO_OKLAB);
+    static const matrix3f_t s_oklab_to_lms (OKLAB_TO_LMS);
+    static const matrix3f_t s_lms_to_linear (LMS_TO_LINEAR);
+
+    static inline float lab_f (float t)
+    {
+        if (t > static_cast<float>(LAB_EPSILON))
+            return cbrtf (t);
+        return (static_cast<float>(LAB_KAPPA) * t + 16.0f) / 116.0f;
+    }
+
+    static inline float lab_f_inverse (float f)
+    {
+        const float f3 = f * f * f;
+        if (f3 > static_cast<float>(LAB_EPSILON))
+            return f3;
+        return (116.0f * f - 16.0f) / static_cast<float>(LAB_KAPPA);
+    }
+
+    static inline void xyz_to_lab_f (float x, float y, float z,
+                                     float& l, float& a, float& b)
+    {
+        const float fx = lab_f (x / static_cast<float>(WHITE_X));
+        const float fy = lab_f (y / static_cast<float>(WHITE_Y));
+        const float fz = lab_f (z / static_cast<float>(WHITE_Z));
+        l = 116.0f * fy - 16.0f;
+        a = 500.0f * (fx - fy);
+        b = 200.0f * (fy - fz);
+    }
+
+    static inline void lab_to_xyz_f (float l, float a, float b,
+                                     float& x, float& y, float& z)
+    {
+        const float fy = (l + 16.0f) / 116.0f;
+        const float fx = fy + a / 500.0f;
+        const float fz = fy - b / 200.0f;
+        x = static_cast<float>(WHITE_X) * lab_f_inverse (fx);
+        y = static_cast<float>(WHITE_Y) *
+            ((l > static_cast<float>(LAB_KAPPA * LAB_EPSILON)) ?
+             fy * fy * fy : l / static_cast<float>(LAB_KAPPA));
+        z = static_cast<float>(WHITE_Z) * lab_f_inverse (fz);
+    }
+
+    void batch_srgb_to_linear (const float* in, float* out, std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+            out[i] = srgb_to_linear_fast (in[i]);
+    }
+
+    void batch_linear_to_srgb (const float* in, float* out, std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+            out[i] = linear_to_srgb_fast (in[i]);
+    }
+
+    void batch_srgb8_to_linear (const unsigned char* in, float* out,
+                                std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+            out[i] = s_transfer_tables.from_srgb8[in[i]];
+    }
+
+    void batch_rgb_to_xyz (const float* r, const float* g, const float* b,
+                           float* x, float* y, float* z, std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            s_rgb_to_xyz.apply (srgb_to_linear_fast (r[i]),
+                                srgb_to_linear_fast (g[i]),
+                                srgb_to_linear_fast (b[i]),
+                                x[i], y[i], z[i]);
+        }
+    }
+
+    void batch_xyz_to_rgb (const float* x, const float* y, const float* z,
+                           float* r, float* g, float* b, std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            float lr, lg, lb;
+            s_xyz_to_rgb.apply (x[i], y[i], z[i], lr, lg, lb);
+            r[i] = linear_to_srgb_fast (lr);
+            g[i] = linear_to_srgb_fast (lg);
+            b[i] = linear_to_srgb_fast (lb);
+        }
+    }
+
+    void batch_xyz_to_lab (const float* x, const float* y, const float* z,
+                           float* l, float* a, float* b, std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            float out_l, out_a, out_b;
+            xyz_to_lab_f (x[i], y[i], z[i], out_l, out_a, out_b);
+            l[i] = out_l;
+            a[i] = out_a;
+            b[i] = out_b;
+        }
+    }
+
+    void batch_lab_to_xyz (const float* l, const float* a, const float* b,
+                           float* x, float* y, float* z, std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            float out_x, out_y, out_z;
+            lab_to_xyz_f (l[i], a[i], b[i], out_x, out_y, out_z);
+            x[i] = out_x;
+            y[i] = out_y;
+            z[i] = out_z;
+        }
+    }
+
+    void batch_rgb_to_lab (const float* r, const float* g, const float* b,
+                           float* l, float* a, float* lab_b, std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            float x, y, z;
+            s_rgb_to_xyz.apply (srgb_to_linear_fast (r[i]),
+                                srgb_to_linear_fast (g[i]),
+                                srgb_to_linear_fast (b[i]), x, y, z);
+            xyz_to_lab_f (x, y, z, l[i], a[i], lab_b[i]);
+        }
+    }
+
+    void batch_lab_to_rgb (const float* l, const float* a, const float* lab_b,
+                           float* r, float* g, float* b, std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            float x, y, z, lr, lg, lb;
+            lab_to_xyz_f (l[i], a[i], lab_b[i], x, y, z);
+            s_xyz_to_rgb.apply (x, y, z, lr, lg, lb);
+            r[i] = linear_to_srgb_fast (lr);
+            g[i] = linear_to_srgb_fast (lg);
+            b[i] = linear_to_srgb_fast (lb);
+        }
+    }
+
+    void batch_rgb_to_oklab (const float* r, const float* g, const float* b,
+                             float* l, float* a, float* lab_b, std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            float lms_l, lms_m, lms_s;
+            s_linear_to_lms.apply (srgb_to_linear_fast (r[i]),
+                                   srgb_to_linear_fast (g[i]),
+                                   srgb_to_linear_fast (b[i]),
+                                   lms_l, lms_m, lms_s);
+            s_lms_to_oklab.apply (cbrtf (lms_l), cbrtf (lms_m), cbrtf (lms_s),
+                                  l[i], a[i], lab_b[i]);
+        }
+    }
+
+    void batch_oklab_to_rgb (const float* l, const float* a,
+                             const float* lab_b,
+                             float* r, float* g, float* b, std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            float lms_l, lms_m, lms_s, lr, lg, lb;
+            s_oklab_to_lms.apply (l[i], a[i], lab_b[i], lms_l, lms_m, lms_s);
+            s_lms_to_linear.apply (lms_l * lms_l * lms_l,
+                                   lms_m * lms_m * lms_m,
+                                   lms_s * lms_s * lms_s, lr, lg, lb);
+            r[i] = linear_to_srgb_fast (lr);
+            g[i] = linear_to_srgb_fast (lg);
+            b[i] = linear_to_srgb_fast (lb);
+        }
+    }
+
+    void batch_lab_to_lch (const float* a, const float* b,
+                           float* c, float* h, std::size_t n)
+    {
+        const float inverse_turn = static_cast<float>(1.0 / (2.0 * G_PI));
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            const float in_a = a[i];
+            const float in_b = b[i];
+            const float chroma = std::sqrt (in_a * in_a + in_b * in_b);
+            float hue = 0.0f;
+            if (chroma >= 1e-6f)
+            {
+                hue = atan2f (in_b, in_a) * inverse_turn;
+                if (hue < 0.0f)
+                    hue += 1.0f;
+                if (hue >= 1.0f)
+                    hue = 0.0f;
+            }
+            c[i] = chroma;
+            h[i] = hue;
+        }
+    }
+
+    void batch_lch_to_lab (const float* c, const float* h,
+                           float* a, float* b, std::size_t n)
+    {
+        const float turn = static_cast<float>(2.0 * G_PI);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            const float chroma = c[i];
+            const float angle = h[i] * turn;
+            a[i] = chroma * cosf (angle);
+            b[i] = chroma * sinf (angle);
+        }
+    }
+
+    void batch_relative_luminance (const float* r, const float* g,
+                                   const float* b, float* y, std::size_t n)
+    {
+        const float wr = static_cast<float>(LUMINANCE_R);
+        const float wg = static_cast<float>(LUMINANCE_G);
+        const float wb = static_cast<float>(LUMINANCE_B);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            y[i] = wr * srgb_to_linear_fast (r[i])
+                + wg * srgb_to_linear_fast (g[i])
+                + wb * srgb_to_linear_fast (b[i]);
+        }
+    }
+}
@@ -0,0 +1,211 @@
+/*******************************************************************************
+ *
+ *  Copyright (c) 2008 Jonathon Jongsma
+ *
+ *  This file is part of Agave
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ *******************************************************************************/
+#ifndef __COLOR_PERCEPTUAL_H
+#define __COLOR_PERCEPTUAL_H
+
+#include <cstddef>
+#include "color.h"
+
+/**
+ * \file
+ * Perceptual colorspaces.
+ *
+ * Conversions between (gamma-encoded) sRGB and the device-independent CIE
+ * XYZ, CIELAB and CIELCh colorspaces as well as Björn Ottosson's OKLab and
+ * OKLCh.  XYZ and CIELAB use the D65 reference white of sRGB, so no
+ * chromatic adaptation is involved.
+ *
+ * The scalar functions work in double precision with the exact sRGB transfer
+ * function.  The batch functions work on planar single precision arrays
+ * like the ones in color-convert.h and use lookup tables for the transfer
+ * function, which keeps them within 2e-5 of the exact values.
+ *
+ * Conversions into sRGB can produce values outside of the 0.0 - 1.0 range
+ * for colors that are outside of the sRGB gamut.  They are not clamped, use
+ * in_srgb_gamut () to check for this.  Assigning such a value to a Color or
+ * ColorValue clamps it.
+ */
+namespace agave
+{
+    /************************************************************
+     * CIE XYZ (D65, Y = 1.0 for the reference white)
+     ***********************************************************/
+    struct xyz_t
+    {
+        typedef double value_type;
+        value_type x, y, z, a;
+    };
+
+    /************************************************************
+     * CIELAB (L: 0 - 100, a and b roughly -128 - 128).  Since 'a' is
+     * already taken by a color channel, alpha is called 'alpha' here.
+     ***********************************************************/
+    struct lab_t
+    {
+        typedef double value_type;
+        value_type l, a, b, alpha;
+    };
+
+    /************************************************************
+     * CIELCh, the polar form of CIELAB.  As in hsv_t, the hue is expressed
+     * as a fraction of a full turn (0.0 - 1.0)
+     ***********************************************************/
+    struct lch_t
+    {
+        typedef double value_type;
+        value_type l, c, h, a;
+    };
+
+    /************************************************************
+     * OKLab (L: 0.0 - 1.0, a and b roughly -0.4 - 0.4)
+     ***********************************************************/
+    struct oklab_t
+    {
+        typedef double value_type;
+        value_type l, a, b, alpha;
+    };
+
+    /************************************************************
+     * OKLCh, the polar form of OKLab.  The hue is a fraction of a full turn.
+     ***********************************************************/
+    struct oklch_t
+    {
+        typedef double value_type;
+        value_type l, c, h, a;
+    };
+
+    /// \name sRGB transfer function
+    /// @{
+    /**
+     * Convert a gamma-encoded sRGB channel value to linear light
+     */
+    double srgb_to_linear (double v);
+
+    /**
+     * Convert a linear light channel value to gamma-encoded sRGB
+     */
+    double linear_to_srgb (double v);
+
+    /**
+     * Convert an 8 bit sRGB channel value to linear light with a table
+     * lookup.  The result is exact.
+     */
+    float srgb8_to_linear (unsigned char v);
+    /// @}
+
+    /// \name Scalar conversions
+    /// @{
+    xyz_t rgb_to_xyz (const rgb_t& rgb);
+    rgb_t xyz_to_rgb (const xyz_t& xyz);
+
+    lab_t xyz_to_lab (const xyz_t& xyz);
+    xyz_t lab_to_xyz (const lab_t& lab);
+
+    lab_t rgb_to_lab (const rgb_t& rgb);
+    rgb_t lab_to_rgb (const lab_t& lab);
+
+    /**
+     * For achromatic colors the hue is undefined and set to 0.0
+     */
+    lch_t lab_to_lch (const lab_t& lab);
+    lab_t lch_to_lab (const lch_t& lch);
+
+    lch_t rgb_to_lch (const rgb_t& rgb);
+    rgb_t lch_to_rgb (const lch_t& lch);
+
+    oklab_t rgb_to_oklab (const rgb_t& rgb);
+    rgb_t oklab_to_rgb (const oklab_t& oklab);
+
+    oklch_t oklab_to_oklch (const oklab_t& oklab);
+    oklab_t oklch_to_oklab (const oklch_t& oklch);
+
+    oklch_t rgb_to_oklch (const rgb_t& rgb);
+    rgb_t oklch_to_rgb (const oklch_t& oklch);
+
+    /**
+     * Check whether all channels of @a rgb are within 0.0 - 1.0 (allowing for
+     * a small rounding error)
+     */
+    bool in_srgb_gamut (const rgb_t& rgb);
+    /// @}
+
+    /// \name Contrast
+    /// @{
+    /**
+     * Get the relative luminance (the Y component of XYZ) of a color as
+     * defined by WCAG 2.  Unlike Color::luminance () this is computed from
+     * linear light values.
+     */
+    double relative_luminance (const rgb_t& rgb);
+
+    /**
+     * Get the WCAG 2 contrast ratio between two colors.  The result ranges
+     * from 1.0 (no contrast) to 21.0 (black on white), independent of the
+     * order of the arguments.  Alpha is ignored.
+     */
+    double contrast_ratio (const rgb_t& first, const rgb_t& second);
+    /// @}
+
+    /// \name Batch conversions
+    /// Planar arrays of @a n single precision values.  Input and output arrays
+    /// may be the same for in-place conversion.
+    /// @{
+    void batch_srgb_to_linear (const float* in, float* out, std::size_t n);
+    void batch_linear_to_srgb (const float* in, float* out, std::size_t n);
+    void batch_srgb8_to_linear (const unsigned char* in, float* out,
+                                std::size_t n);
+
+    void batch_rgb_to_xyz (const float* r, const float* g, const float* b,
+                           float* x, float* y, float* z, std::size_t n);
+    void batch_xyz_to_rgb (const float* x, const float* y, const float* z,
+                           float* r, float* g, float* b, std::size_t n);
+
+    void batch_xyz_to_lab (const float* x, const float* y, const float* z,
+                           float* l, float* a, float* b, std::size_t n);
+    void batch_lab_to_xyz (const float* l, const float* a, const float* b,
+                           float* x, float* y, float* z, std::size_t n);
+
+    void batch_rgb_to_lab (const float* r, const float* g, const float* b,
+                           float* l, float* a, float* lab_b, std::size_t n);
+    void batch_lab_to_rgb (const float* l, const float* a, const float* lab_b,
+                           float* r, float* g, float* b, std::size_t n);
+
+    void batch_rgb_to_oklab (const float* r, const float* g, const float* b,
+                             float* l, float* a, float* lab_b, std::size_t n);
+    void batch_oklab_to_rgb (const float* l, const float* a,
+                             const float* lab_b,
+                             float* r, float* g, float* b, std::size_t n);
+
+    /**
+     * Convert the a and b channels to chroma and hue.  This works for both
+     * CIELAB -> CIELCh and OKLab -> OKLCh since L is the same in both forms.
+     */
+    void batch_lab_to_lch (const float* a, const float* b,
+                           float* c, float* h, std::size_t n);
+    void batch_lch_to_lab (const float* c, const float* h,
+                           float* a, float* b, std::size_t n);
+
+    void batch_relative_luminance (const float* r, const float* g,
+                                   const float* b, float* y, std::size_t n);
+    /// @}
+}
+
+#endif // __COLOR_PERCEPTUAL_H
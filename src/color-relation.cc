@@ -19,31 +19,149 @@
  *
  *******************************************************************************/
 #include "color-relation.h"
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <queue>
+#include <vector>
 #include <sigc++/trackable.h>
 #include <sigc++/connection.h>
+#include <glibmm-utils/exception.h>
 
 namespace agave
 {
     Color generate_identity (const Color& src) { return src; };
 
+    // ColorValue::operator== only compares RGB, but a relation that e.g.
+    // shifts the hue of a gray color still has to propagate
+    static bool identical (const ColorValue& lhs, const ColorValue& rhs)
+    {
+        const hsv_t lhs_hsv = lhs.as_hsv ();
+        const hsv_t rhs_hsv = rhs.as_hsv ();
+        return lhs.as_rgb () == rhs.as_rgb () &&
+            lhs_hsv.h == rhs_hsv.h &&
+            lhs_hsv.s == rhs_hsv.s &&
+            lhs_hsv.v == rhs_hsv.v;
+    }
+
+    /**
+     * The dependency graph formed by all ColorRelations.
+     *
+     * The color models are the nodes and the relations are the edges of the
+     * graph.  The graph listens to every model that takes part in a
+     * relation.  When a model is changed from the outside (e.g. by a widget),
+     * the change is propagated through the graph in topological order: every
+     * relation whose source changed is evaluated exactly once, and models
+     * that didn't change don't cause any further evaluations.
+     *
+     * The affected models are frozen (see Color::freeze_notify ()) while
+     * new values are computed and only notify their listeners once all of
+     * them are up to date, so nobody ever sees a half-updated network.
+     * Relations that would create a cycle are refused.
+     */
+    class RelationGraph
+    {
+        public:
+            typedef ColorRelation::Priv Edge;
+
+            static RelationGraph& instance ();
+
+            bool add (Edge* edge);
+            void remove (Edge* edge);
+
+            /**
+             * Re-evaluate a single relation (e.g. after its generator
+             * changed) and propagate the result
+             */
+            void update (Edge* edge);
+
+            bool is_propagating () const { return m_propagating; }
+
+        private:
+            struct Node : public sigc::trackable
+            {
+                RelationGraph* graph;
+                ColorModel* model;
+                sigc::connection connection;
+                std::vector<Edge*> incoming;
+                std::vector<Edge*> outgoing;
+                // position in the topological order
+                std::size_t order;
+                bool queued;
+
+                void on_color_changed ()
+                {
+                    graph->on_model_changed (model);
+                }
+            };
+
+            typedef std::map<ColorModel*, Node*> NodeMap;
+            typedef std::pair<std::size_t, Node*> QueueEntry;
+            typedef std::priority_queue<QueueEntry, std::vector<QueueEntry>,
+                    std::greater<QueueEntry> > NodeQueue;
+
+            RelationGraph ();
+
+            Node* get_node (ColorModel* model);
+            void release_node (Node* node);
+            bool reaches (Node* from, Node* to) const;
+            void ensure_order ();
+
+            void on_model_changed (ColorModel* model);
+            void process_pending ();
+            void propagate (const std::vector<Edge*>& seeds);
+            void evaluate (Edge* edge, NodeQueue& queue,
+                           std::vector<Node*>& frozen);
+
+            NodeMap m_nodes;
+            bool m_order_valid;
+            bool m_propagating;
+            // the model whose deferred notification is being emitted
+            ColorModel* m_notifying;
+            // models that were changed by listeners during a propagation
+            std::vector<ColorModel*> m_pending;
+
+            static RelationGraph* s_instance;
+    };
+
     struct ColorRelation::Priv : public sigc::trackable
     {
         boost::shared_ptr<ColorModel> m_source;
         boost::shared_ptr<ColorModel> m_dest;
         SlotColorGen m_generator;
         hsv_t m_local_offset;
-        sigc::connection m_source_connection, m_dest_connection;
+        bool m_connected;
 
         Priv (
                 boost::shared_ptr<ColorModel> src,
                 boost::shared_ptr<ColorModel> dest,
-                const SlotColorGen& slot)
+                const SlotColorGen& slot) :
+            m_connected (false)
+        {
+            connect (src, dest, slot);
+        }
+
+        ~Priv ()
+        {
+            disconnect ();
+        }
+
+        void reset_offset ()
         {
             m_local_offset.h = 0.0;
             m_local_offset.s = 0.0;
             m_local_offset.v = 0.0;
             m_local_offset.a = 1.0;
-            connect (src, dest, slot);
+        }
+
+        void disconnect ()
+        {
+            if (m_connected)
+            {
+                RelationGraph::instance ().remove (this);
+                m_connected = false;
+            }
         }
 
         void connect (
@@ -51,39 +169,43 @@ namespace agave
                 boost::shared_ptr<ColorModel> dest,
                 const SlotColorGen& slot)
         {
-            m_source_connection.disconnect ();
-            m_dest_connection.disconnect ();
+            disconnect ();
             m_source = src;
             m_dest = dest;
             m_generator = slot;
-            if (m_source)
+            reset_offset ();
+            if (m_source && m_dest)
             {
-                m_source_connection = m_source->signal_color_changed ().connect
-                    (sigc::mem_fun (this,
-                                    &ColorRelation::Priv::on_source_color_changed));
+                // the graph evaluates the relation once immediately so that
+                // the current state of the two colors matches the
+                // relationship that we just defined.
+                m_connected = RelationGraph::instance ().add (this);
             }
-            if (m_dest)
-            {
-                m_dest_connection = m_dest->signal_color_changed ().connect
-                    (sigc::mem_fun (this,
-                                    &ColorRelation::Priv::on_dest_color_changed));
-            }
-
-            // call once immediately upon connecting so that the current state
-            // of the two colors matches the relationship that we just defined.
-            on_source_color_changed ();
         }
 
-        void on_source_color_changed ()
+        void set_generator (const SlotColorGen& slot)
         {
-            if (m_generator)
+            m_generator = slot;
+            if (m_connected)
             {
-                m_dest->set_color (m_generator (
-                            Color (m_source->get_color ().as_hsv () + m_local_offset)));
+                RelationGraph::instance ().update (this);
             }
         }
 
-        void on_dest_color_changed ()
+        /**
+         * Compute the destination color from the source color
+         */
+        Color generate () const
+        {
+            return m_generator (Color (m_source->get_color ().as_hsv () +
+                                       m_local_offset));
+        }
+
+        /**
+         * The destination was changed directly, remember how far it is off
+         * from what the relation would generate
+         */
+        void update_offset ()
         {
             if (m_generator)
             {
@@ -93,6 +215,296 @@ namespace agave
         }
     };
 
+    RelationGraph* RelationGraph::s_instance = 0;
+
+    RelationGraph& RelationGraph::instance ()
+    {
+        if (!s_instance)
+        {
+            s_instance = new RelationGraph ();
+        }
+        return *s_instance;
+    }
+
+    RelationGraph::RelationGraph () :
+        m_order_valid (true),
+        m_propagating (false),
+        m_notifying (0)
+    {
+    }
+
+    RelationGraph::Node* RelationGraph::get_node (ColorModel* model)
+    {
+        NodeMap::iterator iter = m_nodes.find (model);
+        if (iter != m_nodes.end ())
+        {
+            return iter->second;
+        }
+
+        Node* node = new Node ();
+        node->graph = this;
+        node->model = model;
+        node->order = 0;
+        node->queued = false;
+        node->connection = model->signal_color_changed ().connect
+            (sigc::mem_fun (*node, &Node::on_color_changed));
+        m_nodes[model] = node;
+        m_order_valid = false;
+        return node;
+    }
+
+    void RelationGraph::release_node (Node* node)
+    {
+        if (node->incoming.empty () && node->outgoing.empty ())
+        {
+            node->connection.disconnect ();
+            m_nodes.erase (node->model);
+            delete node;
+            m_order_valid = false;
+        }
+    }
+
+    // depth-first search along the outgoing edges
+    bool RelationGraph::reaches (Node* from, Node* to) const
+    {
+        if (from == to)
+        {
+            return true;
+        }
+        for (std::vector<Edge*>::const_iterator iter = from->outgoing.begin ();
+             iter != from->outgoing.end (); ++iter)
+        {
+            NodeMap::const_iterator next = m_nodes.find ((*iter)->m_dest.get ());
+            if (next != m_nodes.end () && reaches (next->second, to))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool RelationGraph::add (Edge* edge)
+    {
+        ColorModel* source = edge->m_source.get ();
+        ColorModel* dest = edge->m_dest.get ();
+
+        NodeMap::iterator dest_iter = m_nodes.find (dest);
+        NodeMap::iterator source_iter = m_nodes.find (source);
+        if (source == dest || (dest_iter != m_nodes.end () &&
+                               source_iter != m_nodes.end () &&
+                               reaches (dest_iter->second, source_iter->second)))
+        {
+            std::cerr << "Refusing to add a color relation that would create a cycle"
+                << std::endl;
+            return false;
+        }
+
+        get_node (source)->outgoing.push_back (edge);
+        get_node (dest)->incoming.push_back (edge);
+        m_order_valid = false;
+
+        update (edge);
+        return true;
+    }
+
+    void RelationGraph::remove (Edge* edge)
+    {
+        NodeMap::iterator source_iter = m_nodes.find (edge->m_source.get ());
+        NodeMap::iterator dest_iter = m_nodes.find (edge->m_dest.get ());
+        THROW_IF_FAIL (source_iter != m_nodes.end ());
+        THROW_IF_FAIL (dest_iter != m_nodes.end ());
+
+        Node* source = source_iter->second;
+        Node* dest = dest_iter->second;
+        source->outgoing.erase (std::remove (source->outgoing.begin (),
+                                             source->outgoing.end (), edge),
+                                source->outgoing.end ());
+        dest->incoming.erase (std::remove (dest->incoming.begin (),
+                                           dest->incoming.end (), edge),
+                              dest->incoming.end ());
+        m_order_valid = false;
+        release_node (source);
+        if (dest != source)
+        {
+            release_node (dest);
+        }
+    }
+
+    void RelationGraph::update (Edge* edge)
+    {
+        std::vector<Edge*> seeds (1, edge);
+        propagate (seeds);
+        process_pending ();
+    }
+
+    // Kahn's algorithm
+    void RelationGraph::ensure_order ()
+    {
+        if (m_order_valid)
+        {
+            return;
+        }
+
+        std::map<Node*, std::size_t> in_degree;
+        std::vector<Node*> ready;
+        for (NodeMap::iterator iter = m_nodes.begin ();
+             iter != m_nodes.end (); ++iter)
+        {
+            in_degree[iter->second] = iter->second->incoming.size ();
+            if (iter->second->incoming.empty ())
+            {
+                ready.push_back (iter->second);
+            }
+        }
+
+        std::size_t order = 0;
+        while (!ready.empty ())
+        {
+            Node* node = ready.back ();
+            ready.pop_back ();
+            node->order = order++;
+            for (std::vector<Edge*>::iterator iter = node->outgoing.begin ();
+                 iter != node->outgoing.end (); ++iter)
+            {
+                Node* dest = m_nodes[(*iter)->m_dest.get ()];
+                if (--in_degree[dest] == 0)
+                {
+                    ready.push_back (dest);
+                }
+            }
+        }
+        m_order_valid = true;
+    }
+
+    void RelationGraph::on_model_changed (ColorModel* model)
+    {
+        if (m_propagating)
+        {
+            // notifications that we deferred ourselves are expected, but a
+            // listener may also have changed another model in response.
+            // Handle that once the current propagation is done.
+            if (model != m_notifying)
+            {
+                m_pending.push_back (model);
+            }
+            return;
+        }
+
+        m_pending.push_back (model);
+        process_pending ();
+    }
+
+    void RelationGraph::process_pending ()
+    {
+        while (!m_pending.empty () && !m_propagating)
+        {
+            NodeMap::iterator iter = m_nodes.find (m_pending.front ());
+            m_pending.erase (m_pending.begin ());
+            if (iter == m_nodes.end ())
+            {
+                continue;
+            }
+
+            // the model was set directly, so any relations that lead into
+            // it need to remember the user's adjustment
+            Node* node = iter->second;
+            for (std::vector<Edge*>::iterator edge = node->incoming.begin ();
+                 edge != node->incoming.end (); ++edge)
+            {
+                (*edge)->update_offset ();
+            }
+            propagate (node->outgoing);
+        }
+    }
+
+    void RelationGraph::evaluate (Edge* edge, NodeQueue& queue,
+                                  std::vector<Node*>& frozen)
+    {
+        if (!edge->m_generator)
+        {
+            return;
+        }
+
+        Node* dest = m_nodes[edge->m_dest.get ()];
+        if (std::find (frozen.begin (), frozen.end (), dest) == frozen.end ())
+        {
+            dest->model->freeze_notify ();
+            frozen.push_back (dest);
+        }
+
+        const ColorValue old_value = dest->model->get_color ().as_value ();
+        dest->model->set_color (edge->generate ());
+        if (!dest->queued &&
+            !identical (old_value, dest->model->get_color ().as_value ()))
+        {
+            dest->queued = true;
+            queue.push (QueueEntry (dest->order, dest));
+        }
+    }
+
+    static bool compare_order (const std::pair<std::size_t, ColorModel*>& lhs,
+                               const std::pair<std::size_t, ColorModel*>& rhs)
+    {
+        return lhs.first < rhs.first;
+    }
+
+    void RelationGraph::propagate (const std::vector<Edge*>& seeds)
+    {
+        if (seeds.empty ())
+        {
+            return;
+        }
+
+        ensure_order ();
+        // a listener may connect a new relation while being notified
+        const bool was_propagating = m_propagating;
+        ColorModel* const was_notifying = m_notifying;
+        m_propagating = true;
+
+        // copy the seeds, evaluating them may change the list we were given
+        NodeQueue queue;
+        std::vector<Node*> frozen;
+        const std::vector<Edge*> initial (seeds);
+        for (std::vector<Edge*>::const_iterator iter = initial.begin ();
+             iter != initial.end (); ++iter)
+        {
+            evaluate (*iter, queue, frozen);
+        }
+
+        // the queue always yields the changed model that comes first in
+        // topological order, so by the time a model is visited all of its
+        // inputs are final and each of its relations is evaluated once
+        while (!queue.empty ())
+        {
+            Node* node = queue.top ().second;
+            queue.pop ();
+            node->queued = false;
+            for (std::vector<Edge*>::iterator iter = node->outgoing.begin ();
+                 iter != node->outgoing.end (); ++iter)
+            {
+                evaluate (*iter, queue, frozen);
+            }
+        }
+
+        // now that every model is up to date, let them notify their
+        // listeners, upstream first
+        std::vector<std::pair<std::size_t, ColorModel*> > to_thaw;
+        for (std::vector<Node*>::iterator iter = frozen.begin ();
+             iter != frozen.end (); ++iter)
+        {
+            to_thaw.push_back (std::make_pair ((*iter)->order, (*iter)->model));
+        }
+        std::sort (to_thaw.begin (), to_thaw.end (), compare_order);
+        for (std::vector<std::pair<std::size_t, ColorModel*> >::iterator iter =
+             to_thaw.begin (); iter != to_thaw.end (); ++iter)
+        {
+            m_notifying = iter->second;
+            iter->second->thaw_notify ();
+        }
+        m_notifying = was_notifying;
+        m_propagating = was_propagating;
+    }
+
 
     ColorRelation::ColorRelation(boost::shared_ptr<ColorModel> src,
                                  boost::shared_ptr<ColorModel> dest,
@@ -101,4 +513,22 @@ namespace agave
     {
     }
 
+    void ColorRelation::connect (boost::shared_ptr<ColorModel> src,
+                                 boost::shared_ptr<ColorModel> dest,
+                                 const SlotColorGen& slot)
+    {
+        THROW_IF_FAIL (m_priv);
+        m_priv->connect (src, dest, slot);
+    }
+
+    void ColorRelation::set_generator (const SlotColorGen& slot)
+    {
+        THROW_IF_FAIL (m_priv);
+        m_priv->set_generator (slot);
+    }
+
+    bool ColorRelation::is_propagating ()
+    {
+        return RelationGraph::instance ().is_propagating ();
+    }
 }
@@ -33,6 +33,19 @@ namespace agave
 
     Color generate_identity (const Color& src);
 
+    class RelationGraph;
+
+    /**
+     * Keeps the color of one ColorModel (the destination) in a fixed
+     * relationship to another one (the source).
+     *
+     * Relations can be chained and combined into arbitrary acyclic networks.
+     * When a color changes, all relations that depend on it are updated in
+     * dependency order, each generator runs at most once per change, and the
+     * affected models only notify their listeners after the whole network
+     * has been updated.  A relation that would create a cycle is not
+     * connected (a warning is printed).
+     */
     class ColorRelation
     {
         public:
@@ -41,8 +54,17 @@ namespace agave
             void connect (boost::shared_ptr<ColorModel> src, boost::shared_ptr<ColorModel> dest, const SlotColorGen& slot = sigc::ptr_fun(&generate_identity));
             void set_generator (const SlotColorGen& slot);
 
+            /**
+             * Whether a change is currently being propagated through the
+             * relations.  Observers that are only interested in direct
+             * changes of a color (e.g. an undo history) can use this to
+             * ignore the colors that were derived from it.
+             */
+            static bool is_propagating ();
+
         private:
             struct Priv;
+            friend class RelationGraph;
             boost::shared_ptr<Priv> m_priv;
     };
 }
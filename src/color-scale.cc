@@ -20,6 +20,7 @@
  *******************************************************************************/
 #include "color-scale.h"
 #include <gdkmm/general.h>  // cairo integration
+#include <vector>
 #include <cairomm/surface.h>
 #include <gdk/gdkkeysyms.h>
 #include <gtkmm/tooltip.h>
@@ -29,6 +30,7 @@
 #include <boost/format.hpp>
 #include <glibmm-utils/exception.h>
 #include "color-model.h"
+#include "color-convert.h"
 
 namespace agave
 {
@@ -307,26 +309,25 @@ namespace agave
                             unsigned char *data = m_hue_surface->get_data ();
                             g_return_if_fail (data);
 
-                            for (int row = 0; row < m_hue_surface->get_height (); ++row)
+                            // every row of the hue scale is the same, so
+                            // convert a single row in one batch and copy it
+                            const int width = m_hue_surface->get_width ();
+                            const int stride = m_hue_surface->get_stride ();
+                            if (width > 0)
                             {
-                                for (int px = 0; px < m_hue_surface->get_width (); ++px)
+                                std::vector<float> hue (width), full (width, 1.0f);
+                                for (int px = 0; px < width; ++px)
                                 {
-                                    hsv_t hsv;
-                                    hsv.h = static_cast<double>(px) /
-                                        static_cast<double>(m_hue_surface->get_width ());
-                                    hsv.s = 1.0;
-                                    hsv.v = 1.0;
-                                    Color c (hsv);
-                                    *data++ =
-                                        static_cast<unsigned char>(
-                                                c.get_blue () * static_cast<double>(std::numeric_limits<unsigned char>::max ()));
-                                    *data++ =
-                                        static_cast<unsigned char>(
-                                                c.get_green () * static_cast<double>(std::numeric_limits<unsigned char>::max ()));
-                                    *data++ =
-                                        static_cast<unsigned char>(
-                                                c.get_red () * static_cast<double>(std::numeric_limits<unsigned char>::max ()));
-                                    *data++ = std::numeric_limits<unsigned char>::max ();
+                                    hue[px] = static_cast<float>(px) /
+                                        static_cast<float>(width);
+                                }
+                                batch_hsv_to_argb32 (&hue[0], &full[0], &full[0],
+                                        reinterpret_cast<uint32_t*> (data),
+                                        width);
+                                for (int row = 1; row < m_hue_surface->get_height (); ++row)
+                                {
+                                    std::copy (data, data + width * 4,
+                                               data + row * stride);
                                 }
                             }
                             m_hue_surface->flush ();
@@ -32,13 +32,16 @@ namespace agave
 {
     struct ColorSetDetailsEditor::Priv : Gtk::Dialog
     {
-        Priv (ColorSet& set) :
+        Priv (ColorSet& set, ColorSetManager* manager = 0,
+              ColorSetManager::handle_t handle = ColorSetManager::INVALID_HANDLE) :
             m_set (set),
+            m_manager (manager),
+            m_handle (handle),
             m_label_name (_("Name:"), Gtk::ALIGN_RIGHT),
             m_label_desc (_("Description:"), Gtk::ALIGN_RIGHT),
             m_label_tags (_("Tags:"), Gtk::ALIGN_RIGHT),
             m_label_id (_("ID:"), Gtk::ALIGN_RIGHT),
-            m_label_id_value (set.get_id (), Gtk::ALIGN_LEFT),
+            m_label_id_value (set.get_id ().to_string (), Gtk::ALIGN_LEFT),
             m_table (4, 2)
         {
             set_title (_("Edit Color Set Details"));
@@ -65,6 +68,18 @@ namespace agave
 
             m_entry_name.set_text (set.get_name ());
             m_entry_desc.set_text (set.get_description ());
+            const std::list<Glib::ustring> tags = set.get_tags ();
+            Glib::ustring tag_text;
+            for (std::list<Glib::ustring>::const_iterator iter = tags.begin ();
+                 iter != tags.end (); ++iter)
+            {
+                if (!tag_text.empty ())
+                {
+                    tag_text += ", ";
+                }
+                tag_text += *iter;
+            }
+            m_entry_tags.set_text (tag_text);
 
             show_all ();
         }
@@ -75,20 +90,75 @@ namespace agave
             {
                 m_set.set_name (m_entry_name.get_text ());
                 m_set.set_description (m_entry_desc.get_text ());
+                set_tags (m_entry_tags.get_text ());
+                if (m_manager)
+                {
+                    m_manager->mark_changed (m_handle);
+                }
+            }
+        }
+
+        /**
+         * Replace the tags of the set with a comma separated list
+         */
+        void set_tags (const Glib::ustring& text)
+        {
+            const std::list<Glib::ustring> old_tags = m_set.get_tags ();
+            for (std::list<Glib::ustring>::const_iterator iter = old_tags.begin ();
+                 iter != old_tags.end (); ++iter)
+            {
+                m_set.remove_tag (*iter);
+            }
+            const std::string& raw = text.raw ();
+            std::string::size_type start = 0;
+            while (start <= raw.size ())
+            {
+                std::string::size_type end = raw.find (',', start);
+                if (end == std::string::npos)
+                {
+                    end = raw.size ();
+                }
+                const std::string::size_type first =
+                    raw.find_first_not_of (" \t", start);
+                const std::string::size_type last =
+                    raw.find_last_not_of (" \t", end - 1);
+                if (first < end && last != std::string::npos && last >= first)
+                {
+                    m_set.add_tag (raw.substr (first, last - first + 1));
+                }
+                start = end + 1;
             }
         }
 
         ColorSet& m_set;
+        ColorSetManager* m_manager;
+        ColorSetManager::handle_t m_handle;
         Gtk::Label m_label_name, m_label_desc, m_label_tags, m_label_id, m_label_id_value;
         Gtk::Entry m_entry_name, m_entry_desc, m_entry_tags;
         Gtk::Table m_table;
         Gtk::VBox m_content;
     };
 
+    /**
+     * Look up the set that @a handle refers to, which must not be stale
+     */
+    static ColorSet& get_set (ColorSetManager& manager,
+                              ColorSetManager::handle_t handle)
+    {
+        ColorSet* set = manager.get (handle);
+        THROW_IF_FAIL (set);
+        return *set;
+    }
+
     ColorSetDetailsEditor::ColorSetDetailsEditor (ColorSet& set) :
         m_priv (new Priv (set))
     {}
 
+    ColorSetDetailsEditor::ColorSetDetailsEditor (ColorSetManager& manager,
+                                                  ColorSetManager::handle_t handle) :
+        m_priv (new Priv (get_set (manager, handle), &manager, handle))
+    {}
+
     int ColorSetDetailsEditor::run ()
     {
         THROW_IF_FAIL (m_priv);
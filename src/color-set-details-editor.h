@@ -23,6 +23,7 @@
 
 #include <boost/shared_ptr.hpp>
 #include "color-set.h"
+#include "color-set-manager.h"
 
 namespace agave
 {
@@ -30,6 +31,14 @@ namespace agave
     {
         public:
             ColorSetDetailsEditor (ColorSet& set);
+
+            /**
+             * Edit the set that @a handle refers to, which must be valid.
+             * The indexes and journal of @a manager are updated when the
+             * dialog is closed.
+             */
+            ColorSetDetailsEditor (ColorSetManager& manager,
+                                   ColorSetManager::handle_t handle);
             int run ();
 
         private:
@@ -0,0 +1,569 @@
+/*******************************************************************************
+ *
+ *  Copyright (c) 2008 Jonathon Jongsma
+ *
+ *  This file is part of Agave
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ *******************************************************************************/
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <glibmm/ustring.h>
+#include "color-set-journal.h"
+
+namespace agave
+{
+    static const char JOURNAL_MAGIC[4] = { 'A', 'G', 'V', 'J' };
+    static const guint32 JOURNAL_VERSION = 1;
+    /// the magic and the version
+    static const gsize HEADER_SIZE = 8;
+    /// the length and checksum that precede each record
+    static const gsize RECORD_HEADER_SIZE = 8;
+    /// refuse records larger than this, they can only come from corruption
+    static const guint32 MAX_RECORD_SIZE = 64 * 1024 * 1024;
+
+    /**
+     * The table for the CRC-32 used by zlib and PNG
+     */
+    class Crc32Table
+    {
+        public:
+            Crc32Table ()
+            {
+                for (guint32 n = 0; n < 256; ++n)
+                {
+                    guint32 c = n;
+                    for (int k = 0; k < 8; ++k)
+                    {
+                        c = (c & 1) ? (0xedb88320u ^ (c >> 1)) : (c >> 1);
+                    }
+                    m_table[n] = c;
+                }
+            }
+
+            guint32 compute (const char* data, gsize length) const
+            {
+                guint32 crc = 0xffffffffu;
+                for (gsize i = 0; i < length; ++i)
+                {
+                    crc = m_table[(crc ^ static_cast<guint8> (data[i])) & 0xff] ^ (crc >> 8);
+                }
+                return crc ^ 0xffffffffu;
+            }
+
+        private:
+            guint32 m_table[256];
+    };
+
+    static const Crc32Table crc32;
+
+    /// \name Little endian encoding
+    /// @{
+    static void write_u32 (std::string& out, guint32 value)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            out += static_cast<char> ((value >> (i * 8)) & 0xff);
+        }
+    }
+
+    static void write_u64 (std::string& out, guint64 value)
+    {
+        write_u32 (out, value & G_MAXUINT32);
+        write_u32 (out, value >> 32);
+    }
+
+    static void write_double (std::string& out, double value)
+    {
+        guint64 bits;
+        std::memcpy (&bits, &value, sizeof (bits));
+        write_u64 (out, bits);
+    }
+
+    static void write_string (std::string& out, const std::string& value)
+    {
+        write_u32 (out, value.size ());
+        out += value;
+    }
+
+    /**
+     * Reads the values written above and keeps track of whether the data
+     * ended prematurely
+     */
+    class RecordReader
+    {
+        public:
+            RecordReader (const char* begin, const char* end) :
+                m_pos (begin), m_end (end), m_ok (true)
+            {}
+
+            bool ok () const { return m_ok; }
+            bool at_end () const { return m_pos == m_end; }
+
+            guint32 read_u32 ()
+            {
+                if (!check (4))
+                    return 0;
+                guint32 value = 0;
+                for (int i = 0; i < 4; ++i)
+                {
+                    value |= static_cast<guint32> (static_cast<guint8> (m_pos[i])) << (i * 8);
+                }
+                m_pos += 4;
+                return value;
+            }
+
+            guint64 read_u64 ()
+            {
+                const guint64 low = read_u32 ();
+                const guint64 high = read_u32 ();
+                return (high << 32) | low;
+            }
+
+            double read_double ()
+            {
+                const guint64 bits = read_u64 ();
+                double value;
+                std::memcpy (&value, &bits, sizeof (value));
+                return value;
+            }
+
+            std::string read_string ()
+            {
+                const guint32 length = read_u32 ();
+                if (!check (length))
+                    return std::string ();
+                std::string value (m_pos, length);
+                m_pos += length;
+                return value;
+            }
+
+        private:
+            bool check (gsize length)
+            {
+                if (!m_ok || static_cast<gsize> (m_end - m_pos) < length)
+                {
+                    m_ok = false;
+                }
+                return m_ok;
+            }
+
+            const char* m_pos;
+            const char* m_end;
+            bool m_ok;
+    };
+    /// @}
+
+    static bool write_all (int fd, const char* data, gsize length)
+    {
+        while (length)
+        {
+            const ssize_t written = write (fd, data, length);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            data += written;
+            length -= written;
+        }
+        return true;
+    }
+
+    static void report_error (const Glib::ustring& message,
+                              const std::string& filename)
+    {
+        std::cerr << Glib::ustring::compose ("%1 %2: %3", message, filename,
+                g_strerror (errno))
+            << std::endl;
+    }
+
+    ColorSetJournal::ColorSetJournal (const std::string& filename) :
+        m_filename (filename),
+        m_fd (-1),
+        m_size (0)
+    {}
+
+    ColorSetJournal::~ColorSetJournal ()
+    {
+        close ();
+    }
+
+    const std::string& ColorSetJournal::get_filename () const
+    {
+        return m_filename;
+    }
+
+    void ColorSetJournal::put (const ColorSet& set)
+    {
+        std::string payload;
+        payload += static_cast<char> (OP_PUT);
+        write_u64 (payload, set.get_id ().get_high ());
+        write_u64 (payload, set.get_id ().get_low ());
+        write_string (payload, set.get_name ());
+        write_string (payload, set.get_description ());
+        const std::list<Glib::ustring> tags = set.get_tags ();
+        write_u32 (payload, tags.size ());
+        for (std::list<Glib::ustring>::const_iterator iter = tags.begin ();
+             iter != tags.end (); ++iter)
+        {
+            write_string (payload, *iter);
+        }
+        write_u32 (payload, set.size ());
+        for (ColorSet::const_iterator iter = set.begin ();
+             iter != set.end (); ++iter)
+        {
+            const hsv_t hsv = iter->as_hsv ();
+            write_double (payload, hsv.h);
+            write_double (payload, hsv.s);
+            write_double (payload, hsv.v);
+            write_double (payload, hsv.a);
+        }
+
+        write_u32 (m_buffer, payload.size ());
+        write_u32 (m_buffer, crc32.compute (payload.data (), payload.size ()));
+        m_buffer += payload;
+    }
+
+    void ColorSetJournal::remove (const ColorSetId& id)
+    {
+        std::string payload;
+        payload += static_cast<char> (OP_REMOVE);
+        write_u64 (payload, id.get_high ());
+        write_u64 (payload, id.get_low ());
+
+        write_u32 (m_buffer, payload.size ());
+        write_u32 (m_buffer, crc32.compute (payload.data (), payload.size ()));
+        m_buffer += payload;
+    }
+
+    void ColorSetJournal::clear ()
+    {
+        std::string payload;
+        payload += static_cast<char> (OP_CLEAR);
+        write_u64 (payload, 0);
+        write_u64 (payload, 0);
+
+        write_u32 (m_buffer, payload.size ());
+        write_u32 (m_buffer, crc32.compute (payload.data (), payload.size ()));
+        m_buffer += payload;
+    }
+
+    bool ColorSetJournal::open_file ()
+    {
+        if (m_fd >= 0)
+        {
+            return true;
+        }
+        m_fd = g_open (m_filename.c_str (), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (m_fd < 0)
+        {
+            report_error ("Couldn't open journal", m_filename);
+            return false;
+        }
+        struct stat info;
+        if (fstat (m_fd, &info) < 0)
+        {
+            report_error ("Couldn't open journal", m_filename);
+            close ();
+            return false;
+        }
+        m_size = info.st_size;
+        if (m_size == 0)
+        {
+            std::string header (JOURNAL_MAGIC, sizeof (JOURNAL_MAGIC));
+            write_u32 (header, JOURNAL_VERSION);
+            m_buffer.insert (0, header);
+        }
+        return true;
+    }
+
+    bool ColorSetJournal::flush ()
+    {
+        if (m_buffer.empty ())
+        {
+            return true;
+        }
+        if (!open_file ())
+        {
+            return false;
+        }
+        if (!write_all (m_fd, m_buffer.data (), m_buffer.size ()) ||
+            fsync (m_fd) < 0)
+        {
+            report_error ("Couldn't write journal", m_filename);
+            // don't leave a partial record behind
+            if (ftruncate (m_fd, m_size) < 0)
+            {
+                report_error ("Couldn't truncate journal", m_filename);
+            }
+            if (m_size == 0)
+            {
+                // the header is added again when the file is reopened
+                m_buffer.erase (0, HEADER_SIZE);
+            }
+            close ();
+            return false;
+        }
+        m_size += m_buffer.size ();
+        m_buffer.clear ();
+        return true;
+    }
+
+    void ColorSetJournal::close ()
+    {
+        if (m_fd >= 0)
+        {
+            ::close (m_fd);
+            m_fd = -1;
+        }
+    }
+
+    gsize ColorSetJournal::get_size () const
+    {
+        return m_size;
+    }
+
+    bool ColorSetJournal::has_pending () const
+    {
+        return !m_buffer.empty ();
+    }
+
+    std::size_t ColorSetJournal::replay (const std::string& filename,
+                                         const SlotRecord& slot)
+    {
+        if (!g_file_test (filename.c_str (), G_FILE_TEST_EXISTS))
+        {
+            return 0;
+        }
+
+        GError* error = 0;
+        GMappedFile* file = g_mapped_file_new (filename.c_str (), FALSE, &error);
+        if (!file)
+        {
+            std::cerr << Glib::ustring::compose ("I/O Error %1: %2",
+                    error->code, error->message)
+                << std::endl;
+            g_error_free (error);
+            return 0;
+        }
+        const char* contents = g_mapped_file_get_contents (file);
+        const gsize length = g_mapped_file_get_length (file);
+
+        std::size_t count = 0;
+        gsize valid_length = 0;
+        // constructed once, since the ColorSet constructor numbers the sets
+        ColorSet set;
+        if (length >= HEADER_SIZE &&
+            std::memcmp (contents, JOURNAL_MAGIC, sizeof (JOURNAL_MAGIC)) == 0)
+        {
+            RecordReader header (contents + sizeof (JOURNAL_MAGIC),
+                                 contents + HEADER_SIZE);
+            if (header.read_u32 () != JOURNAL_VERSION)
+            {
+                std::cerr << Glib::ustring::compose (
+                        "Unsupported journal version in %1", filename)
+                    << std::endl;
+#if GLIB_CHECK_VERSION (2, 22, 0)
+                g_mapped_file_unref (file);
+#else
+                g_mapped_file_free (file);
+#endif
+                return 0;
+            }
+            valid_length = HEADER_SIZE;
+        }
+
+        while (valid_length >= HEADER_SIZE &&
+               length - valid_length >= RECORD_HEADER_SIZE)
+        {
+            const char* record = contents + valid_length;
+            RecordReader record_header (record, record + RECORD_HEADER_SIZE);
+            const guint32 payload_size = record_header.read_u32 ();
+            const guint32 checksum = record_header.read_u32 ();
+            const char* payload = record + RECORD_HEADER_SIZE;
+            if (payload_size == 0 || payload_size > MAX_RECORD_SIZE ||
+                payload_size > length - valid_length - RECORD_HEADER_SIZE ||
+                crc32.compute (payload, payload_size) != checksum)
+            {
+                break;
+            }
+
+            const op_t op = static_cast<op_t> (static_cast<guint8> (payload[0]));
+            RecordReader body (payload + 1, payload + payload_size);
+            const guint64 high = body.read_u64 ();
+            const guint64 low = body.read_u64 ();
+            if (op == OP_PUT)
+            {
+                set.clear ();
+                set.set_name (body.read_string ());
+                set.set_description (body.read_string ());
+                const guint32 num_tags = body.read_u32 ();
+                for (guint32 i = 0; i < num_tags && body.ok (); ++i)
+                {
+                    set.add_tag (body.read_string ());
+                }
+                const guint32 num_colors = body.read_u32 ();
+                std::vector<Color> colors;
+                for (guint32 i = 0; i < num_colors && body.ok (); ++i)
+                {
+                    hsv_t hsv;
+                    hsv.h = body.read_double ();
+                    hsv.s = body.read_double ();
+                    hsv.v = body.read_double ();
+                    hsv.a = body.read_double ();
+                    colors.push_back (Color (hsv));
+                }
+                set.set_colors (colors);
+            }
+            if (!body.ok () || op < OP_PUT || op > OP_CLEAR)
+            {
+                break;
+            }
+
+            slot (op, ColorSetId (high, low), set);
+            ++count;
+            valid_length += RECORD_HEADER_SIZE + payload_size;
+        }
+
+#if GLIB_CHECK_VERSION (2, 22, 0)
+        g_mapped_file_unref (file);
+#else
+        g_mapped_file_free (file);
+#endif
+
+        if (valid_length < length)
+        {
+            std::cerr << Glib::ustring::compose (
+                    "Dropping %1 bytes of incomplete records from %2",
+                    length - valid_length, filename)
+                << std::endl;
+            if (truncate (filename.c_str (), valid_length) < 0)
+            {
+                report_error ("Couldn't truncate journal", filename);
+            }
+        }
+        return count;
+    }
+
+    bool ColorSetJournal::retire (const std::string& filename,
+                                  const std::string& retired)
+    {
+        if (!g_file_test (filename.c_str (), G_FILE_TEST_EXISTS))
+        {
+            return true;
+        }
+        if (!g_file_test (retired.c_str (), G_FILE_TEST_EXISTS))
+        {
+            if (g_rename (filename.c_str (), retired.c_str ()) < 0)
+            {
+                report_error ("Couldn't rename journal", filename);
+                return false;
+            }
+            return true;
+        }
+
+        // an earlier journal hasn't been folded into the snapshot yet, so
+        // append the records to it
+        GError* error = 0;
+        GMappedFile* file = g_mapped_file_new (filename.c_str (), FALSE, &error);
+        if (!file)
+        {
+            std::cerr << Glib::ustring::compose ("I/O Error %1: %2",
+                    error->code, error->message)
+                << std::endl;
+            g_error_free (error);
+            return false;
+        }
+        const char* contents = g_mapped_file_get_contents (file);
+        const gsize length = g_mapped_file_get_length (file);
+        bool success = true;
+        if (length > HEADER_SIZE)
+        {
+            const int fd = g_open (retired.c_str (), O_WRONLY | O_APPEND, 0644);
+            success = fd >= 0 &&
+                write_all (fd, contents + HEADER_SIZE, length - HEADER_SIZE) &&
+                fsync (fd) == 0;
+            if (!success)
+            {
+                report_error ("Couldn't write journal", retired);
+            }
+            if (fd >= 0)
+            {
+                ::close (fd);
+            }
+        }
+#if GLIB_CHECK_VERSION (2, 22, 0)
+        g_mapped_file_unref (file);
+#else
+        g_mapped_file_free (file);
+#endif
+
+        if (success && g_unlink (filename.c_str ()) < 0)
+        {
+            report_error ("Couldn't remove journal", filename);
+            success = false;
+        }
+        return success;
+    }
+
+    bool write_file_atomically (const std::string& filename,
+                                const std::string& contents)
+    {
+        const std::string temp_filename = filename + ".tmp";
+        const int fd = g_open (temp_filename.c_str (),
+                               O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+        {
+            report_error ("Couldn't open file", temp_filename);
+            return false;
+        }
+        if (!write_all (fd, contents.data (), contents.size ()) ||
+            fsync (fd) < 0)
+        {
+            report_error ("Couldn't write file", temp_filename);
+            ::close (fd);
+            g_unlink (temp_filename.c_str ());
+            return false;
+        }
+        ::close (fd);
+
+        if (g_rename (temp_filename.c_str (), filename.c_str ()) < 0)
+        {
+            report_error ("Couldn't rename file", temp_filename);
+            g_unlink (temp_filename.c_str ());
+            return false;
+        }
+
+        // make the rename itself durable
+        gchar* dirname = g_path_get_dirname (filename.c_str ());
+        const int dir_fd = g_open (dirname, O_RDONLY, 0);
+        if (dir_fd >= 0)
+        {
+            fsync (dir_fd);
+            ::close (dir_fd);
+        }
+        g_free (dirname);
+        return true;
+    }
+}
@@ -0,0 +1,132 @@
+/*******************************************************************************
+ *
+ *  Copyright (c) 2008 Jonathon Jongsma
+ *
+ *  This file is part of Agave
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ *******************************************************************************/
+#ifndef __COLOR_SET_JOURNAL_H
+#define __COLOR_SET_JOURNAL_H
+
+#include <string>
+#include <glib/gtypes.h>
+#include <sigc++/functors/slot.h>
+#include "color-set.h"
+
+namespace agave
+{
+    /**
+     * An append-only log of changes to a library of color sets.
+     *
+     * Changes are encoded as compact binary records and buffered until
+     * flush () appends them to the file and syncs it to disk, so saving costs
+     * time proportional to the size of the change.  Each record carries its
+     * length and a CRC-32 of its contents.  When a write is interrupted by a
+     * crash, the torn record at the end of the file is detected and dropped
+     * by replay ().
+     *
+     * All records are idempotent (they set the state of one set, or of the
+     * whole library), so replaying a journal twice, or replaying it on top of
+     * a snapshot that already contains some of its changes, is harmless.
+     */
+    class ColorSetJournal
+    {
+        public:
+            enum op_t
+            {
+                /// add a set or replace the set with the same id
+                OP_PUT = 1,
+                /// remove the set with the given id
+                OP_REMOVE = 2,
+                /// remove all sets
+                OP_CLEAR = 3
+            };
+
+            /**
+             * Receives the replayed records.  The set is only filled in for
+             * OP_PUT, it may be swapped out by the slot.
+             */
+            typedef sigc::slot<void, op_t, const ColorSetId&, ColorSet&> SlotRecord;
+
+            ColorSetJournal (const std::string& filename);
+            ~ColorSetJournal ();
+
+            const std::string& get_filename () const;
+
+            void put (const ColorSet& set);
+            void remove (const ColorSetId& id);
+            void clear ();
+
+            /**
+             * Append the buffered records to the file and sync it.  If this
+             * fails, the records stay buffered.
+             */
+            bool flush ();
+
+            /**
+             * Close the file.  It is reopened by the next flush (), so the
+             * file can be renamed in between.
+             */
+            void close ();
+
+            /**
+             * The size of the file, not including buffered records
+             */
+            gsize get_size () const;
+            bool has_pending () const;
+
+            /**
+             * Apply the records in a journal file.  A torn or corrupted
+             * record ends the replay, and the file is truncated to the
+             * records before it so that new records can be appended.
+             *
+             * @return  The number of records replayed
+             */
+            static std::size_t replay (const std::string& filename,
+                                       const SlotRecord& slot);
+
+            /**
+             * Move the records of the journal @a filename to the end of the
+             * journal @a retired, which is created if it doesn't exist.  The
+             * journal is removed afterwards.
+             */
+            static bool retire (const std::string& filename,
+                                const std::string& retired);
+
+        private:
+            // not copyable
+            ColorSetJournal (const ColorSetJournal&);
+            ColorSetJournal& operator= (const ColorSetJournal&);
+
+            bool open_file ();
+
+            const std::string m_filename;
+            int m_fd;
+            gsize m_size;
+            std::string m_buffer;
+    };
+
+    /**
+     * Replace @a filename with @a contents so that it holds either the old or
+     * the new contents even if the system crashes while it is written.  The
+     * data is written to a temporary file which is synced and then renamed.
+     * Errors are reported on stderr.
+     */
+    bool write_file_atomically (const std::string& filename,
+                                const std::string& contents);
+}
+
+#endif // __COLOR_SET_JOURNAL_H
@@ -0,0 +1,565 @@
+/*******************************************************************************
+ *
+ *  Copyright (c) 2008 Jonathon Jongsma
+ *
+ *  This file is part of Agave
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ *******************************************************************************/
+
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <vector>
+#include <boost/static_assert.hpp>
+#include <glib.h>
+#include <glibmm-utils/exception.h>
+#include <glibmm/ustring.h>
+#include "color-set-library.h"
+
+namespace agave
+{
+    static const char LIBRARY_MAGIC[4] = { 'A', 'G', 'V', 'L' };
+    static const guint32 LIBRARY_VERSION = 1;
+    /// reads as a different value on a host with the other byte order
+    static const guint32 BYTE_ORDER_MARK = 0x01020304;
+    /// marks an empty bucket of the id index
+    static const guint32 EMPTY_BUCKET = G_MAXUINT32;
+
+    const std::size_t ColorSetLibrary::NOT_FOUND = static_cast<std::size_t> (-1);
+
+    struct library_header_t
+    {
+        char magic[4];
+        guint32 byte_order;
+        guint32 version;
+        guint32 header_size;
+        guint64 num_sets;
+        guint64 sets_offset;
+        guint64 num_colors;
+        guint64 colors_offset;
+        guint64 num_tag_refs;
+        guint64 tag_refs_offset;
+        guint64 num_strings;
+        /// num_strings + 1 offsets into the string data
+        guint64 string_offsets_offset;
+        guint64 string_data_size;
+        guint64 string_data_offset;
+        /// the number of buckets, a power of two
+        guint64 index_size;
+        guint64 index_offset;
+    };
+
+    struct set_record_t
+    {
+        guint64 id_high;
+        guint64 id_low;
+        guint32 name;
+        guint32 description;
+        guint32 first_tag;
+        guint32 num_tags;
+        guint64 first_color;
+        guint64 num_colors;
+    };
+
+    BOOST_STATIC_ASSERT (sizeof (library_header_t) == 112);
+    BOOST_STATIC_ASSERT (sizeof (set_record_t) == 48);
+    // colors are used in place
+    BOOST_STATIC_ASSERT (sizeof (hsv_t) == 4 * sizeof (double));
+
+    static gsize align (gsize offset)
+    {
+        return (offset + 7) & ~static_cast<gsize> (7);
+    }
+
+    static guint32 bucket_for (const ColorSetId& id, guint64 index_size)
+    {
+        return hash_value (id) & (index_size - 1);
+    }
+
+    struct ColorSetLibrary::Priv
+    {
+        GMappedFile* m_file;
+        const char* m_data;
+        gsize m_length;
+        const library_header_t* m_header;
+        const set_record_t* m_sets;
+        const hsv_t* m_colors;
+        const guint32* m_tag_refs;
+        const guint64* m_string_offsets;
+        const char* m_string_data;
+        const guint32* m_index;
+
+        Priv () :
+            m_file (0)
+        {
+            reset ();
+        }
+
+        ~Priv ()
+        {
+            unmap ();
+        }
+
+        void reset ()
+        {
+            m_data = 0;
+            m_length = 0;
+            m_header = 0;
+            m_sets = 0;
+            m_colors = 0;
+            m_tag_refs = 0;
+            m_string_offsets = 0;
+            m_string_data = 0;
+            m_index = 0;
+        }
+
+        void unmap ()
+        {
+            if (m_file)
+            {
+#if GLIB_CHECK_VERSION (2, 22, 0)
+                g_mapped_file_unref (m_file);
+#else
+                g_mapped_file_free (m_file);
+#endif
+                m_file = 0;
+            }
+        }
+
+        /**
+         * Check that a table of @a count elements of @a size bytes fits into
+         * the data
+         */
+        bool check_table (guint64 offset, guint64 count, gsize size) const
+        {
+            return offset % 8 == 0 && offset <= m_length &&
+                count <= (m_length - offset) / size;
+        }
+
+        bool attach (const char* data, gsize length)
+        {
+            reset ();
+            if (!has_signature (data, length) ||
+                reinterpret_cast<gsize> (data) % 8 != 0)
+            {
+                return false;
+            }
+            const library_header_t* header =
+                reinterpret_cast<const library_header_t*> (data);
+            if (header->byte_order != BYTE_ORDER_MARK ||
+                header->version != LIBRARY_VERSION ||
+                header->header_size != sizeof (library_header_t))
+            {
+                return false;
+            }
+
+            m_data = data;
+            m_length = length;
+            if (!check_table (header->sets_offset, header->num_sets,
+                              sizeof (set_record_t)) ||
+                !check_table (header->colors_offset, header->num_colors,
+                              sizeof (hsv_t)) ||
+                !check_table (header->tag_refs_offset, header->num_tag_refs,
+                              sizeof (guint32)) ||
+                header->num_strings >= G_MAXUINT32 ||
+                !check_table (header->string_offsets_offset,
+                              header->num_strings + 1, sizeof (guint64)) ||
+                !check_table (header->string_data_offset,
+                              header->string_data_size, 1) ||
+                (header->index_size & (header->index_size - 1)) != 0 ||
+                !check_table (header->index_offset, header->index_size,
+                              sizeof (guint32)))
+            {
+                reset ();
+                return false;
+            }
+
+            m_header = header;
+            m_sets = reinterpret_cast<const set_record_t*> (data + header->sets_offset);
+            m_colors = reinterpret_cast<const hsv_t*> (data + header->colors_offset);
+            m_tag_refs = reinterpret_cast<const guint32*> (data + header->tag_refs_offset);
+            m_string_offsets = reinterpret_cast<const guint64*> (data + header->string_offsets_offset);
+            m_string_data = data + header->string_data_offset;
+            m_index = reinterpret_cast<const guint32*> (data + header->index_offset);
+            return true;
+        }
+
+        const set_record_t* get_record (std::size_t index) const
+        {
+            if (!m_header || index >= m_header->num_sets)
+            {
+                return 0;
+            }
+            return &m_sets[index];
+        }
+
+        /**
+         * Get string @a string, or an empty string if the table is corrupt
+         */
+        const char* get_string (guint32 string) const
+        {
+            if (string >= m_header->num_strings)
+            {
+                return "";
+            }
+            const guint64 begin = m_string_offsets[string];
+            const guint64 end = m_string_offsets[string + 1];
+            if (begin >= end || end > m_header->string_data_size ||
+                m_string_data[end - 1] != '\0')
+            {
+                return "";
+            }
+            return m_string_data + begin;
+        }
+    };
+
+    ColorSetLibrary::ColorSetLibrary () :
+        m_priv (new Priv ())
+    {
+        THROW_IF_FAIL (m_priv);
+    }
+
+    bool ColorSetLibrary::open (const std::string& filename)
+    {
+        THROW_IF_FAIL (m_priv);
+        close ();
+        GError* error = 0;
+        m_priv->m_file = g_mapped_file_new (filename.c_str (), FALSE, &error);
+        if (!m_priv->m_file)
+        {
+            std::cerr << Glib::ustring::compose ("I/O Error %1: %2",
+                    error->code, error->message)
+                << std::endl;
+            g_error_free (error);
+            return false;
+        }
+        if (!m_priv->attach (g_mapped_file_get_contents (m_priv->m_file),
+                             g_mapped_file_get_length (m_priv->m_file)))
+        {
+            std::cerr << Glib::ustring::compose ("%1 is not a valid library",
+                    filename)
+                << std::endl;
+            m_priv->unmap ();
+            return false;
+        }
+        return true;
+    }
+
+    bool ColorSetLibrary::open (const char* data, gsize length)
+    {
+        THROW_IF_FAIL (m_priv);
+        close ();
+        return m_priv->attach (data, length);
+    }
+
+    void ColorSetLibrary::close ()
+    {
+        THROW_IF_FAIL (m_priv);
+        m_priv->reset ();
+        m_priv->unmap ();
+    }
+
+    bool ColorSetLibrary::is_open () const
+    {
+        THROW_IF_FAIL (m_priv);
+        return m_priv->m_header;
+    }
+
+    bool ColorSetLibrary::has_signature (const char* data, gsize length)
+    {
+        return data && length >= sizeof (library_header_t) &&
+            std::memcmp (data, LIBRARY_MAGIC, sizeof (LIBRARY_MAGIC)) == 0;
+    }
+
+    std::size_t ColorSetLibrary::size () const
+    {
+        THROW_IF_FAIL (m_priv);
+        return m_priv->m_header ? m_priv->m_header->num_sets : 0;
+    }
+
+    ColorSetId ColorSetLibrary::get_id (std::size_t index) const
+    {
+        THROW_IF_FAIL (m_priv);
+        const set_record_t* record = m_priv->get_record (index);
+        if (!record)
+        {
+            return ColorSetId ();
+        }
+        return ColorSetId (record->id_high, record->id_low);
+    }
+
+    const char* ColorSetLibrary::get_name (std::size_t index) const
+    {
+        THROW_IF_FAIL (m_priv);
+        const set_record_t* record = m_priv->get_record (index);
+        return record ? m_priv->get_string (record->name) : "";
+    }
+
+    const char* ColorSetLibrary::get_description (std::size_t index) const
+    {
+        THROW_IF_FAIL (m_priv);
+        const set_record_t* record = m_priv->get_record (index);
+        return record ? m_priv->get_string (record->description) : "";
+    }
+
+    std::size_t ColorSetLibrary::get_num_tags (std::size_t index) const
+    {
+        THROW_IF_FAIL (m_priv);
+        const set_record_t* record = m_priv->get_record (index);
+        if (!record || record->first_tag > m_priv->m_header->num_tag_refs ||
+            record->num_tags > m_priv->m_header->num_tag_refs - record->first_tag)
+        {
+            return 0;
+        }
+        return record->num_tags;
+    }
+
+    const char* ColorSetLibrary::get_tag (std::size_t index, std::size_t tag) const
+    {
+        THROW_IF_FAIL (m_priv);
+        if (tag >= get_num_tags (index))
+        {
+            return "";
+        }
+        const set_record_t* record = m_priv->get_record (index);
+        return m_priv->get_string (m_priv->m_tag_refs[record->first_tag + tag]);
+    }
+
+    std::size_t ColorSetLibrary::get_num_colors (std::size_t index) const
+    {
+        THROW_IF_FAIL (m_priv);
+        const set_record_t* record = m_priv->get_record (index);
+        if (!record || record->first_color > m_priv->m_header->num_colors ||
+            record->num_colors > m_priv->m_header->num_colors - record->first_color)
+        {
+            return 0;
+        }
+        return record->num_colors;
+    }
+
+    const hsv_t* ColorSetLibrary::get_colors (std::size_t index) const
+    {
+        THROW_IF_FAIL (m_priv);
+        if (!get_num_colors (index))
+        {
+            return 0;
+        }
+        return m_priv->m_colors + m_priv->get_record (index)->first_color;
+    }
+
+    std::size_t ColorSetLibrary::find (const ColorSetId& id) const
+    {
+        THROW_IF_FAIL (m_priv);
+        if (!m_priv->m_header || !m_priv->m_header->index_size)
+        {
+            return NOT_FOUND;
+        }
+        const guint64 mask = m_priv->m_header->index_size - 1;
+        guint64 bucket = bucket_for (id, m_priv->m_header->index_size);
+        for (guint64 probes = 0; probes <= mask; ++probes)
+        {
+            const guint32 index = m_priv->m_index[bucket];
+            if (index == EMPTY_BUCKET)
+            {
+                break;
+            }
+            if (get_id (index) == id)
+            {
+                return index;
+            }
+            bucket = (bucket + 1) & mask;
+        }
+        return NOT_FOUND;
+    }
+
+    void ColorSetLibrary::get_set (std::size_t index, ColorSet& set) const
+    {
+        THROW_IF_FAIL (m_priv);
+        set.clear ();
+        set.set_name (get_name (index));
+        set.set_description (get_description (index));
+        const std::size_t num_tags = get_num_tags (index);
+        for (std::size_t i = 0; i < num_tags; ++i)
+        {
+            set.add_tag (get_tag (index, i));
+        }
+        const std::size_t num_colors = get_num_colors (index);
+        const hsv_t* colors = get_colors (index);
+        std::vector<Color> values;
+        values.reserve (num_colors);
+        for (std::size_t i = 0; i < num_colors; ++i)
+        {
+            values.push_back (Color (colors[i]));
+        }
+        set.set_colors (values);
+    }
+
+    /**
+     * Collects the distinct strings of a library
+     */
+    class StringTable
+    {
+        public:
+            StringTable () : m_size (0) {}
+
+            guint32 intern (const std::string& value)
+            {
+                std::pair<std::map<std::string, guint32>::iterator, bool> result =
+                    m_indices.insert (std::make_pair (value, m_strings.size ()));
+                if (result.second)
+                {
+                    m_strings.push_back (&result.first->first);
+                    m_size += value.size () + 1;
+                }
+                return result.first->second;
+            }
+
+            std::size_t count () const { return m_strings.size (); }
+            gsize data_size () const { return m_size; }
+            const std::string& get (std::size_t index) const { return *m_strings[index]; }
+
+        private:
+            std::map<std::string, guint32> m_indices;
+            std::vector<const std::string*> m_strings;
+            gsize m_size;
+    };
+
+    void ColorSetLibrary::write (const ColorSet* sets, std::size_t n,
+                                 std::string& out)
+    {
+        std::vector<set_record_t> records (n);
+        std::vector<guint32> tag_refs;
+        StringTable strings;
+        guint64 num_colors = 0;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            const ColorSet& set = sets[i];
+            set_record_t& record = records[i];
+            record.id_high = set.get_id ().get_high ();
+            record.id_low = set.get_id ().get_low ();
+            record.name = strings.intern (set.get_name ());
+            record.description = strings.intern (set.get_description ());
+            const std::list<Glib::ustring> tags = set.get_tags ();
+            record.first_tag = tag_refs.size ();
+            record.num_tags = tags.size ();
+            for (std::list<Glib::ustring>::const_iterator iter = tags.begin ();
+                 iter != tags.end (); ++iter)
+            {
+                tag_refs.push_back (strings.intern (*iter));
+            }
+            record.first_color = num_colors;
+            record.num_colors = set.size ();
+            num_colors += set.size ();
+        }
+
+        // the id index is at most half full
+        guint64 index_size = 0;
+        if (n)
+        {
+            index_size = 2;
+            while (index_size < 2 * static_cast<guint64> (n))
+            {
+                index_size *= 2;
+            }
+        }
+        std::vector<guint32> index (index_size, EMPTY_BUCKET);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            const ColorSetId id (records[i].id_high, records[i].id_low);
+            guint64 bucket = bucket_for (id, index_size);
+            bool duplicate = false;
+            while (index[bucket] != EMPTY_BUCKET)
+            {
+                const set_record_t& other = records[index[bucket]];
+                if (ColorSetId (other.id_high, other.id_low) == id)
+                {
+                    // only the first of several sets with the same id is
+                    // found
+                    duplicate = true;
+                    break;
+                }
+                bucket = (bucket + 1) & (index_size - 1);
+            }
+            if (!duplicate)
+            {
+                index[bucket] = i;
+            }
+        }
+
+        library_header_t header;
+        std::memset (&header, 0, sizeof (header));
+        std::memcpy (header.magic, LIBRARY_MAGIC, sizeof (LIBRARY_MAGIC));
+        header.byte_order = BYTE_ORDER_MARK;
+        header.version = LIBRARY_VERSION;
+        header.header_size = sizeof (header);
+        header.num_sets = n;
+        header.sets_offset = align (sizeof (header));
+        header.num_colors = num_colors;
+        header.colors_offset = align (header.sets_offset + n * sizeof (set_record_t));
+        header.num_tag_refs = tag_refs.size ();
+        header.tag_refs_offset = align (header.colors_offset + num_colors * sizeof (hsv_t));
+        header.num_strings = strings.count ();
+        header.string_offsets_offset =
+            align (header.tag_refs_offset + tag_refs.size () * sizeof (guint32));
+        header.string_data_size = strings.data_size ();
+        header.string_data_offset = align (header.string_offsets_offset +
+                (strings.count () + 1) * sizeof (guint64));
+        header.index_size = index_size;
+        header.index_offset = align (header.string_data_offset + header.string_data_size);
+        const gsize size = header.index_offset + index_size * sizeof (guint32);
+
+        out.assign (size, '\0');
+        char* data = &out[0];
+        std::memcpy (data, &header, sizeof (header));
+        if (n)
+        {
+            std::memcpy (data + header.sets_offset, &records[0],
+                         n * sizeof (set_record_t));
+        }
+        hsv_t* colors = reinterpret_cast<hsv_t*> (data + header.colors_offset);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            for (ColorSet::const_iterator iter = sets[i].begin ();
+                 iter != sets[i].end (); ++iter)
+            {
+                *colors++ = iter->as_hsv ();
+            }
+        }
+        if (!tag_refs.empty ())
+        {
+            std::memcpy (data + header.tag_refs_offset, &tag_refs[0],
+                         tag_refs.size () * sizeof (guint32));
+        }
+        guint64* string_offsets =
+            reinterpret_cast<guint64*> (data + header.string_offsets_offset);
+        guint64 string_offset = 0;
+        for (std::size_t i = 0; i < strings.count (); ++i)
+        {
+            const std::string& value = strings.get (i);
+            string_offsets[i] = string_offset;
+            std::memcpy (data + header.string_data_offset + string_offset,
+                         value.data (), value.size ());
+            // the nul terminator is already there
+            string_offset += value.size () + 1;
+        }
+        string_offsets[strings.count ()] = string_offset;
+        if (index_size)
+        {
+            std::memcpy (data + header.index_offset, &index[0],
+                         index_size * sizeof (guint32));
+        }
+    }
+}
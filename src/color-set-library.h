@@ -0,0 +1,120 @@
+/*******************************************************************************
+ *
+ *  Copyright (c) 2008 Jonathon Jongsma
+ *
+ *  This file is part of Agave
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ *******************************************************************************/
+#ifndef __COLOR_SET_LIBRARY_H
+#define __COLOR_SET_LIBRARY_H
+
+#include <cstddef>
+#include <string>
+#include <boost/shared_ptr.hpp>
+#include <glib/gtypes.h>
+#include "color-set.h"
+
+namespace agave
+{
+    /**
+     * A read-only view of a library of color sets in the binary snapshot
+     * format.
+     *
+     * The format is designed to be used in place: opening a file only maps
+     * it and checks the header, and the accessors return pointers into the
+     * mapping, so opening even a very large library takes constant time and
+     * the pages are shared with other processes through the page cache.
+     *
+     * A file consists of a header followed by these tables, each aligned to
+     * 8 bytes:
+     *   - fixed-width set records with the id, the indices of the name and
+     *     description strings and the ranges of the set's colors and tags
+     *   - fixed-width color records (hue, saturation, value and alpha as
+     *     doubles, exactly as in hsv_t)
+     *   - tag references (string indices)
+     *   - an interned string table: each distinct name, description and tag
+     *     is stored once, nul-terminated, and addressed by an offset table
+     *   - an open-addressing hash table that maps set ids to set indices
+     *
+     * Values are stored in host byte order; files from a host with the
+     * other byte order are rejected.
+     */
+    class ColorSetLibrary
+    {
+        public:
+            /**
+             * Returned by find () if there is no set with the given id
+             */
+            static const std::size_t NOT_FOUND;
+
+            ColorSetLibrary ();
+
+            /**
+             * Map a library file.  Errors are reported on stderr.
+             */
+            bool open (const std::string& filename);
+
+            /**
+             * Use a library that is already in memory.  The data must stay
+             * valid and be aligned to 8 bytes.
+             */
+            bool open (const char* data, gsize length);
+            void close ();
+            bool is_open () const;
+
+            /**
+             * Check whether a buffer starts like a library file
+             */
+            static bool has_signature (const char* data, gsize length);
+
+            std::size_t size () const;
+            ColorSetId get_id (std::size_t index) const;
+            const char* get_name (std::size_t index) const;
+            const char* get_description (std::size_t index) const;
+            std::size_t get_num_tags (std::size_t index) const;
+            const char* get_tag (std::size_t index, std::size_t tag) const;
+            std::size_t get_num_colors (std::size_t index) const;
+
+            /**
+             * Get the colors of set @a index, get_num_colors () of them
+             */
+            const hsv_t* get_colors (std::size_t index) const;
+
+            /**
+             * Find the set with the given id
+             *
+             * @return  The index of the set or NOT_FOUND
+             */
+            std::size_t find (const ColorSetId& id) const;
+
+            /**
+             * Copy set @a index into @a set
+             */
+            void get_set (std::size_t index, ColorSet& set) const;
+
+            /**
+             * Serialize @a n sets into @a out
+             */
+            static void write (const ColorSet* sets, std::size_t n,
+                               std::string& out);
+
+        private:
+            struct Priv;
+            boost::shared_ptr<Priv> m_priv;
+    };
+}
+
+#endif // __COLOR_SET_LIBRARY_H
@@ -19,15 +19,16 @@
  *
  *******************************************************************************/
 
+#include <algorithm>
 #include <iostream>
-#include <iomanip>
+#include <glib.h>
+#include <glib/gstdio.h>
 #include <glibmm/markup.h>
+#include <glibmm/thread.h>
 #include <giomm/init.h>
-#include <giomm/file.h>
-#include <giomm/error.h>
-#include <giomm/bufferedoutputstream.h>
 #include <glibmm-utils/ustring.h>
 #include "color-set-manager.h"
+#include "color-set-library.h"
 #include <stdexcept>
 
 namespace agave
@@ -61,10 +62,17 @@ namespace agave
     static const Glib::ustring ELEMENT_VALUE = "value";
     static const Glib::ustring ELEMENT_ALPHA = "alpha";
 
+    /**
+     * Parses the saved sets and adds them to a ColorSetManager as soon as
+     * each one is complete.  Sets that are already present are skipped.
+     * When importing, the added sets are journaled.
+     */
     class SavedSetParser : public Parser
     {
         public:
-            SavedSetParser () :
+            SavedSetParser (ColorSetManager& manager, bool import) :
+                m_manager (manager),
+                m_import (import),
                 m_active_element_bitfield (0)
             {}
 
@@ -85,31 +93,22 @@ namespace agave
                     return;
                 }
 
-                if (element_name == ELEMENT_SETS)
-                {
-                    // make sure there wasn't already something left over in the
-                    // working data from a previous parse
-                    m_parsed_sets.clear ();
-                }
-                else if (element_name == ELEMENT_SET)
+                if (element_name == ELEMENT_SET)
                 {
                     m_working_set.clear ();
-                    try
-                    {
-                        m_working_set.set_id (attributes.at (ATTRIBUTE_ID));
-                    }
-                    catch (const std::out_of_range&)
+                    // the id is computed from the colors, the attribute is
+                    // only checked for well-formedness.  Older versions wrote
+                    // longer ids, they are simply replaced.
+                    if (attributes.find (ATTRIBUTE_ID) == attributes.end ())
                     {
                         std::cerr << Glib::ustring::compose (
                                 "Error while loading saved sets: '%1' element without required '%2' attribute",
                                 ELEMENT_SET, ATTRIBUTE_ID) << std::endl;
-                        // FIXME: should we assign an ID ourselves if it's not
-                        // provided?
                     }
                 }
                 else if (element_name == ELEMENT_COLORS)
                 {
-                    m_working_colors.clear ();
+                    m_working_set.set_colors (std::vector<Color> ());
                 }
                 else if (element_name == ELEMENT_COLOR)
                 {
@@ -135,15 +134,20 @@ namespace agave
 
                 if (element_name == ELEMENT_SET)
                 {
-                    m_parsed_sets.push_back (m_working_set);
+                    if (m_import)
+                    {
+                        m_manager.insert (m_working_set);
+                    }
+                    else
+                    {
+                        // this leaves m_working_set in an unspecified
+                        // state, it is cleared at the start of the next set
+                        m_manager.adopt (m_working_set);
+                    }
                 }
                 else if (element_name == ELEMENT_COLOR)
                 {
-                    m_working_colors.push_back (m_working_color);
-                }
-                else if (element_name == ELEMENT_COLORS)
-                {
-                    m_working_set.set_colors (m_working_colors);
+                    m_working_set.add_color (m_working_color);
                 }
             }
 
@@ -161,6 +165,10 @@ namespace agave
                 {
                     m_working_set.set_description (text);
                 }
+                else if ((m_active_element_bitfield & s_element_bitmap.at (ELEMENT_TAG)) && !text.empty ())
+                {
+                    m_working_set.add_tag (text);
+                }
                 else if ((m_active_element_bitfield & s_element_bitmap.at (ELEMENT_COLOR))
                         && (m_active_element_bitfield &
                             (s_element_bitmap.at (ELEMENT_HUE) |
@@ -168,10 +176,11 @@ namespace agave
                              s_element_bitmap.at (ELEMENT_VALUE) |
                              s_element_bitmap.at (ELEMENT_ALPHA))))
                 {
-                    std::istringstream stream (text);
-                    double value = 0.0; // default to 0 if parsed value is invalid
-                    if (!(stream >> value))
+                    char* end = 0;
+                    double value = g_ascii_strtod (text.c_str (), &end);
+                    if (end == text.c_str ())
                     {
+                        value = 0.0; // default to 0 if parsed value is invalid
                         std::cerr
                             << Glib::ustring::compose ("Invalid value for double type: '%1'", text)
                             << std::endl;
@@ -195,11 +204,6 @@ namespace agave
                 }
             }
 
-            std::list<ColorSet> get_parsed_sets () const
-            {
-                return m_parsed_sets;
-            }
-
         private:
             class ElementBitMap : public std::map<Glib::ustring, uint16_t>
             {
@@ -222,21 +226,86 @@ namespace agave
                     }
             };
 
+            ColorSetManager& m_manager;
+            bool m_import;
             uint16_t m_active_element_bitfield;
             ColorSet m_working_set;
-            std::list<Color> m_working_colors;
             Color m_working_color;
-            std::list<ColorSet> m_parsed_sets;
 
             static const ElementBitMap s_element_bitmap;
     };
 
     const SavedSetParser::ElementBitMap SavedSetParser::s_element_bitmap;
 
+    const ColorSetManager::handle_t ColorSetManager::INVALID_HANDLE = 0;
+
+    /// marks the end of the free slot list
+    static const guint32 NO_SLOT = G_MAXUINT32;
+
+    /// the journal is folded into the file once it is larger than this and
+    /// half the size of the file
+    static const gsize JOURNAL_COMPACT_SIZE = 1024 * 1024;
+
+    /**
+     * Writes a snapshot of the library and removes the journal that it
+     * replaces
+     */
+    struct ColorSetManager::CompactionJob
+    {
+        std::string filename;
+        std::string retired_journal;
+        std::string contents;
+
+        void run ()
+        {
+            if (write_file_atomically (filename, contents))
+            {
+                g_unlink (retired_journal.c_str ());
+            }
+            // the snapshot can be large
+            std::string ().swap (contents);
+        }
+    };
+
     ColorSetManager::ColorSetManager (std::string filename) :
-        m_filename (filename)
+        m_filename (filename),
+        m_free_slot (NO_SLOT),
+        m_replaying (false),
+        m_base_size (0),
+        m_format (FORMAT_XML),
+        m_compaction_thread (0)
     { load (); }
 
+    ColorSetManager::~ColorSetManager ()
+    {
+        wait_for_compaction ();
+    }
+
+    std::string ColorSetManager::get_journal_filename () const
+    {
+        return m_filename + ".journal";
+    }
+
+    std::string ColorSetManager::get_retired_journal_filename () const
+    {
+        return m_filename + ".journal.old";
+    }
+
+    /**
+     * Format a channel value so that it reads back exactly, using as few
+     * digits as possible
+     */
+    static Glib::ustring format_channel (double value)
+    {
+        gchar buffer[G_ASCII_DTOSTR_BUF_SIZE];
+        g_ascii_formatd (buffer, sizeof (buffer), "%.15g", value);
+        if (g_ascii_strtod (buffer, 0) != value)
+        {
+            g_ascii_dtostr (buffer, sizeof (buffer), value);
+        }
+        return buffer;
+    }
+
     inline static Glib::ustring
     write_simple_element (const Glib::ustring& element_name,
                    const Glib::ustring& text,
@@ -257,99 +326,507 @@ namespace agave
 
     void ColorSetManager::load ()
     {
-        // load saved sets from file
-        Glib::RefPtr<Gio::File> file = Gio::File::create_for_path (m_filename);
-        g_return_if_fail (file);
-        try {
-            Glib::RefPtr<Gio::FileInputStream> in_stream = file->read ();
-            g_return_if_fail (in_stream);
-            char read_buffer[500];
-            std::string file_contents;
-            for (;;)
+        wait_for_compaction ();
+        const std::string journal = get_journal_filename ();
+        const std::string retired_journal = get_retired_journal_filename ();
+        const bool have_journal =
+            g_file_test (journal.c_str (), G_FILE_TEST_EXISTS) ||
+            g_file_test (retired_journal.c_str (), G_FILE_TEST_EXISTS);
+
+        // map the file and parse it in place, so that the only copy of the
+        // data that is made is the sets themselves.  If there is a journal,
+        // the file may not have been written yet.
+        GError* error = 0;
+        GMappedFile* file = g_mapped_file_new (m_filename.c_str (), FALSE, &error);
+        if (!file)
+        {
+            if (!have_journal || error->code != G_FILE_ERROR_NOENT)
             {
-                gssize bytes_read = 0;
-                bytes_read = in_stream->read (read_buffer, sizeof (read_buffer));
-                if (!bytes_read)
-                    break;
-                file_contents += std::string(read_buffer, read_buffer + bytes_read);
+                std::cerr << Glib::ustring::compose ("I/O Error %1: %2",
+                        error->code, error->message)
+                    << std::endl;
             }
-
-            SavedSetParser parser;
-            Glib::Markup::ParseContext pcontext (parser);
-            try
+            g_error_free (error);
+            if (!have_journal)
             {
-                pcontext.parse (file_contents);
+                return;
             }
-            // FIXME: this doesn't actually catch some exceptions on invalid
-            // UTF-8, see http://bugzilla.gnome.org/show_bug.cgi?id=521294
-            catch (const Glib::Error& exception)
+        }
+
+        m_replaying = true;
+        clear ();
+        m_base_size = 0;
+        if (file)
+        {
+            const char* contents = g_mapped_file_get_contents (file);
+            const gsize length = g_mapped_file_get_length (file);
+            m_base_size = length;
+            m_format = ColorSetLibrary::has_signature (contents, length) ?
+                FORMAT_BINARY : FORMAT_XML;
+            read_data (contents, length, m_filename, false);
+#if GLIB_CHECK_VERSION (2, 22, 0)
+            g_mapped_file_unref (file);
+#else
+            g_mapped_file_free (file);
+#endif
+        }
+
+        // the retired journal is older than the current one
+        const ColorSetJournal::SlotRecord slot =
+            sigc::mem_fun (this, &ColorSetManager::on_replay);
+        ColorSetJournal::replay (retired_journal, slot);
+        ColorSetJournal::replay (journal, slot);
+        m_replaying = false;
+    }
+
+    void ColorSetManager::on_replay (ColorSetJournal::op_t op,
+                                     const ColorSetId& id, ColorSet& set)
+    {
+        switch (op)
+        {
+            case ColorSetJournal::OP_PUT:
+                {
+                    const handle_t handle = find (id);
+                    ColorSet* existing = get (handle);
+                    if (existing)
+                    {
+                        existing->swap (set);
+                        mark_changed (handle);
+                    }
+                    else
+                    {
+                        adopt (set);
+                    }
+                }
+                break;
+            case ColorSetJournal::OP_REMOVE:
+                remove (find (id));
+                break;
+            case ColorSetJournal::OP_CLEAR:
+                clear ();
+                break;
+        }
+    }
+
+    void ColorSetManager::read_data (const char* contents, gsize length,
+                                     const std::string& filename, bool import)
+    {
+        if (ColorSetLibrary::has_signature (contents, length))
+        {
+            ColorSetLibrary library;
+            if (!library.open (contents, length))
             {
-                std::cerr
-                    << Glib::ustring::compose ("Parse Error %1: %2\n%3",
-                        exception.code (), exception.what (), file_contents)
+                std::cerr << Glib::ustring::compose ("%1 is not a valid library",
+                        filename)
                     << std::endl;
+                return;
             }
-            m_sets = parser.get_parsed_sets ();
+            reserve (size () + library.size ());
+            // constructed once, since the ColorSet constructor numbers the sets
+            ColorSet set;
+            for (std::size_t i = 0; i < library.size (); ++i)
+            {
+                library.get_set (i, set);
+                if (import)
+                {
+                    insert (set);
+                }
+                else
+                {
+                    adopt (set);
+                }
+            }
+            return;
         }
-        catch (const Gio::Error& exception)
+
+        SavedSetParser parser (*this, import);
+        Glib::Markup::ParseContext pcontext (parser);
+        try
+        {
+            if (length)
+            {
+                pcontext.parse (contents, contents + length);
+                pcontext.end_parse ();
+            }
+        }
+        // FIXME: this doesn't actually catch some exceptions on invalid
+        // UTF-8, see http://bugzilla.gnome.org/show_bug.cgi?id=521294
+        catch (const Glib::Error& exception)
+        {
+            std::cerr
+                << Glib::ustring::compose ("Parse Error %1 in %2: %3",
+                    exception.code (), filename, exception.what ())
+                << std::endl;
+        }
+    }
+
+    std::size_t ColorSetManager::import_file (const std::string& filename)
+    {
+        GError* error = 0;
+        GMappedFile* file = g_mapped_file_new (filename.c_str (), FALSE, &error);
+        if (!file)
         {
             std::cerr << Glib::ustring::compose ("I/O Error %1: %2",
-                    exception.code (), exception.what ())
+                    error->code, error->message)
                 << std::endl;
+            g_error_free (error);
+            return 0;
+        }
+        const std::size_t old_size = size ();
+        read_data (g_mapped_file_get_contents (file),
+                   g_mapped_file_get_length (file), filename, true);
+#if GLIB_CHECK_VERSION (2, 22, 0)
+        g_mapped_file_unref (file);
+#else
+        g_mapped_file_free (file);
+#endif
+        return size () - old_size;
+    }
+
+    bool ColorSetManager::export_file (const std::string& filename,
+                                       file_format_t format) const
+    {
+        std::string contents;
+        serialize (contents, format);
+        return write_file_atomically (filename, contents);
+    }
+
+    void ColorSetManager::set_file_format (file_format_t format)
+    {
+        m_format = format;
+    }
+
+    ColorSetManager::file_format_t ColorSetManager::get_file_format () const
+    {
+        return m_format;
+    }
+
+    void ColorSetManager::serialize (std::string& out, file_format_t format) const
+    {
+        if (format == FORMAT_BINARY)
+        {
+            ColorSetLibrary::write (m_sets.empty () ? 0 : &m_sets[0],
+                                    m_sets.size (), out);
+        }
+        else
+        {
+            write_xml (out);
+        }
+    }
+
+    void ColorSetManager::write_xml (std::string& out) const
+    {
+        out += Glib::ustring::compose ("<%1>\n", ELEMENT_SETS);
+        for (ColorSetManager::const_iterator set_iter = begin ();
+                set_iter != end ();
+                ++set_iter)
+        {
+            std::string id = set_iter->get_id ().to_string ();
+            out += Glib::ustring::compose ("<%1 id=\"%2\">\n", ELEMENT_SET, id);
+            out += write_simple_element (ELEMENT_NAME, set_iter->get_name ());
+            out += write_simple_element (ELEMENT_DESCRIPTION, set_iter->get_description ());
+            const std::list<Glib::ustring> tags = set_iter->get_tags ();
+            if (!tags.empty ())
+            {
+                out += Glib::ustring::compose ("<%1>\n", ELEMENT_TAGS);
+                for (std::list<Glib::ustring>::const_iterator tag_iter = tags.begin ();
+                        tag_iter != tags.end (); ++tag_iter)
+                {
+                    out += write_simple_element (ELEMENT_TAG, *tag_iter);
+                }
+                out += Glib::ustring::compose ("</%1>\n", ELEMENT_TAGS);
+            }
+            out += Glib::ustring::compose ("<%1>\n", ELEMENT_COLORS);
+            for (ColorSet::const_iterator color_iter = set_iter->begin ();
+                    color_iter != set_iter->end (); ++color_iter)
+            {
+                out += Glib::ustring::compose ("<%1>\n", ELEMENT_COLOR);
+                out += write_simple_element (ELEMENT_HUE,
+                            format_channel (color_iter->get_hue ()));
+                out += write_simple_element (ELEMENT_SATURATION,
+                            format_channel (color_iter->get_saturation ()));
+                out += write_simple_element (ELEMENT_VALUE,
+                            format_channel (color_iter->get_value ()));
+                out += write_simple_element (ELEMENT_ALPHA,
+                            format_channel (color_iter->get_alpha ()));
+                out += Glib::ustring::compose ("</%1>\n", ELEMENT_COLOR);
+            }
+            out += Glib::ustring::compose ("</%1>\n", ELEMENT_COLORS);
+            out += Glib::ustring::compose ("</%1>\n", ELEMENT_SET);
         }
+        out += Glib::ustring::compose ("</%1>\n", ELEMENT_SETS);
     }
 
     void ColorSetManager::save ()
     {
-        Glib::RefPtr<Gio::File> file = Gio::File::create_for_path (m_filename);
-        g_return_if_fail (file);
-        try
+        if (m_journal)
         {
-            Glib::RefPtr<Gio::BufferedOutputStream> out_stream =
-                Gio::BufferedOutputStream::create (file->replace ());
-            out_stream->write (Glib::ustring::compose ("<%1>\n", ELEMENT_SETS));
-            for (ColorSetManager::iterator set_iter = begin ();
-                    set_iter != end ();
-                    ++set_iter)
+            if (m_journal->flush () &&
+                m_journal->get_size () > std::max (JOURNAL_COMPACT_SIZE,
+                                                   m_base_size / 2))
             {
-                std::string id = set_iter->get_id ();
-                out_stream->write (Glib::ustring::compose ("<%1 id=\"%2\">\n", ELEMENT_SET, id));
-                out_stream->write (write_simple_element (ELEMENT_NAME, set_iter->get_name ()));
-                out_stream->write (write_simple_element (ELEMENT_DESCRIPTION, set_iter->get_description ()));
-                out_stream->write (Glib::ustring::compose ("<%1>\n", ELEMENT_COLORS));
-                for (ColorSet::const_iterator color_iter = set_iter->begin ();
-                        color_iter != set_iter->end (); ++color_iter)
+                compact ();
+            }
+            return;
+        }
+
+        wait_for_compaction ();
+        std::string contents;
+        serialize (contents, m_format);
+        if (write_file_atomically (m_filename, contents))
+        {
+            m_base_size = contents.size ();
+            // the journals are part of the file now
+            g_unlink (get_journal_filename ().c_str ());
+            g_unlink (get_retired_journal_filename ().c_str ());
+        }
+    }
+
+    void ColorSetManager::set_journaled (bool journaled)
+    {
+        if (journaled && !m_journal)
+        {
+            m_journal.reset (new ColorSetJournal (get_journal_filename ()));
+        }
+        else if (!journaled && m_journal)
+        {
+            m_journal->flush ();
+            m_journal.reset ();
+        }
+    }
+
+    bool ColorSetManager::get_journaled () const
+    {
+        return m_journal.get () != 0;
+    }
+
+    void ColorSetManager::mark_changed (handle_t handle)
+    {
+        const ColorSet* set = get (handle);
+        if (!set)
+        {
+            return;
+        }
+        const std::size_t index = m_slots[lookup_slot (handle)].index;
+        index_contents (index);
+        // a duplicate can't be told apart from the indexed set in the journal
+        if (m_journal && !m_replaying && m_entries[index].indexed)
+        {
+            m_journal->put (*set);
+        }
+    }
+
+    void ColorSetManager::compact ()
+    {
+        wait_for_compaction ();
+        // if the changes can't be journaled, the journal is the only place
+        // where the earlier ones are stored, so keep it
+        if (m_journal && !m_journal->flush ())
+        {
+            return;
+        }
+
+        // new changes go to a new journal while the snapshot is written
+        const std::string retired_journal = get_retired_journal_filename ();
+        if (m_journal)
+        {
+            m_journal->close ();
+        }
+        if (!ColorSetJournal::retire (get_journal_filename (), retired_journal))
+        {
+            return;
+        }
+
+        m_compaction.reset (new CompactionJob ());
+        m_compaction->filename = m_filename;
+        m_compaction->retired_journal = retired_journal;
+        serialize (m_compaction->contents, m_format);
+        m_base_size = m_compaction->contents.size ();
+        if (Glib::thread_supported ())
+        {
+            try
+            {
+                m_compaction_thread = Glib::Thread::create (sigc::mem_fun (
+                            *m_compaction, &CompactionJob::run), true);
+                return;
+            }
+            catch (const Glib::ThreadError& error)
+            {
+                std::cerr << Glib::ustring::compose (
+                        "Couldn't start compaction thread: %1", error.what ())
+                    << std::endl;
+            }
+        }
+        m_compaction->run ();
+        m_compaction.reset ();
+    }
+
+    void ColorSetManager::wait_for_compaction ()
+    {
+        if (m_compaction_thread)
+        {
+            m_compaction_thread->join ();
+            m_compaction_thread = 0;
+        }
+        m_compaction.reset ();
+    }
+
+    ColorSetManager::handle_t
+    ColorSetManager::make_handle (guint32 slot) const
+    {
+        return (static_cast<handle_t> (m_slots[slot].generation) << 32) | slot;
+    }
+
+    guint32 ColorSetManager::lookup_slot (handle_t handle) const
+    {
+        const guint32 slot = handle & G_MAXUINT32;
+        const guint32 generation = handle >> 32;
+        if (handle == INVALID_HANDLE || slot >= m_slots.size () ||
+            m_slots[slot].generation != generation)
+        {
+            return NO_SLOT;
+        }
+        return slot;
+    }
+
+    void ColorSetManager::index_set (std::size_t index)
+    {
+        entry_t& entry = m_entries[index];
+        entry.id = m_sets[index].get_id ();
+        entry.indexed =
+            m_index.insert (std::make_pair (entry.id, entry.slot)).second;
+        if (!entry.indexed)
+        {
+            m_duplicates.insert (std::make_pair (entry.id, entry.slot));
+        }
+        index_contents (index);
+    }
+
+    void ColorSetManager::unindex_set (std::size_t index)
+    {
+        entry_t& entry = m_entries[index];
+        if (!entry.indexed)
+        {
+            std::pair<duplicate_index_t::iterator, duplicate_index_t::iterator>
+                range = m_duplicates.equal_range (entry.id);
+            for (duplicate_index_t::iterator iter = range.first;
+                 iter != range.second; ++iter)
+            {
+                if (iter->second == entry.slot)
                 {
-                    out_stream->write (Glib::ustring::compose ("<%1>\n", ELEMENT_COLOR));
-                    out_stream->write (write_simple_element (ELEMENT_HUE,
-                                Glib::ustring::format (std::fixed,
-                                    std::setprecision (4), color_iter->get_hue ())));
-                    out_stream->write (write_simple_element (ELEMENT_SATURATION,
-                                Glib::ustring::format (std::fixed,
-                                    std::setprecision (4),
-                                    color_iter->get_saturation ())));
-                    out_stream->write (write_simple_element (ELEMENT_VALUE,
-                                Glib::ustring::format (std::fixed,
-                                    std::setprecision (4), color_iter->get_value ())));
-                    out_stream->write (write_simple_element (ELEMENT_ALPHA,
-                                Glib::ustring::format (std::fixed,
-                                    std::setprecision (4), color_iter->get_alpha ())));
-                    out_stream->write (Glib::ustring::compose ("</%1>\n", ELEMENT_COLOR));
+                    m_duplicates.erase (iter);
+                    break;
                 }
-                out_stream->write (Glib::ustring::compose ("</%1>\n", ELEMENT_COLORS));
-                out_stream->write (Glib::ustring::compose ("</%1>\n", ELEMENT_SET));
             }
-            out_stream->write (Glib::ustring::compose ("</%1>\n", ELEMENT_SETS));
-            out_stream->close ();
+            return;
         }
-        catch (const Gio::Error& exception)
+        m_index.erase (entry.id);
+        entry.indexed = false;
+
+        // another set with the same id takes over, so that find () and
+        // the journal keep working with that id
+        duplicate_index_t::iterator duplicate = m_duplicates.find (entry.id);
+        if (duplicate != m_duplicates.end ())
         {
-            std::cerr << Glib::ustring::compose ("Couldn't open file %1: %2",
-                    m_filename, exception.what ())
-                << std::endl;
+            const std::size_t other_index = m_slots[duplicate->second].index;
+            entry_t& other = m_entries[other_index];
+            m_index.insert (std::make_pair (other.id, other.slot));
+            other.indexed = true;
+            m_duplicates.erase (duplicate);
+            if (m_journal && !m_replaying)
+            {
+                m_journal->put (m_sets[other_index]);
+            }
+        }
+    }
+
+    void ColorSetManager::index_contents (std::size_t index)
+    {
+        const ColorSet& set = m_sets[index];
+        const guint32 slot = m_entries[index].slot;
+        m_tag_index.set_tags (slot, set.get_tags ());
+        m_text_index.set_text (slot, set.get_name () + "\n" + set.get_description ());
+        std::vector<rgb_t> palette;
+        palette.reserve (set.size ());
+        for (ColorSet::const_iterator iter = set.begin ();
+             iter != set.end (); ++iter)
+        {
+            palette.push_back (iter->as_rgb ());
+        }
+        m_palette_index.set_palette (slot, palette.empty () ? 0 : &palette[0],
+                                     palette.size ());
+    }
+
+    void ColorSetManager::slots_to_handles (const std::vector<guint32>& slots,
+                                            std::vector<handle_t>& handles) const
+    {
+        handles.reserve (slots.size ());
+        for (std::vector<guint32>::const_iterator iter = slots.begin ();
+             iter != slots.end (); ++iter)
+        {
+            handles.push_back (make_handle (*iter));
         }
     }
 
+    ColorSetManager::handle_t ColorSetManager::insert (const ColorSet& set)
+    {
+        id_index_t::const_iterator existing = m_index.find (set.get_id ());
+        if (existing != m_index.end ())
+        {
+            return make_handle (existing->second);
+        }
+        if (m_journal && !m_replaying)
+        {
+            m_journal->put (set);
+        }
+        return append (set);
+    }
+
+    ColorSetManager::handle_t ColorSetManager::append (const ColorSet& set)
+    {
+        const handle_t handle = allocate (set);
+        index_set (m_sets.size () - 1);
+        return handle;
+    }
+
+    ColorSetManager::handle_t ColorSetManager::adopt (ColorSet& set)
+    {
+        id_index_t::const_iterator existing = m_index.find (set.get_id ());
+        if (existing != m_index.end ())
+        {
+            return make_handle (existing->second);
+        }
+        // an empty set is cheap to copy
+        static const ColorSet empty;
+        const handle_t handle = allocate (empty);
+        m_sets.back ().swap (set);
+        index_set (m_sets.size () - 1);
+        return handle;
+    }
+
+    ColorSetManager::handle_t ColorSetManager::allocate (const ColorSet& set)
+    {
+        guint32 slot = m_free_slot;
+        if (slot != NO_SLOT)
+        {
+            m_free_slot = m_slots[slot].index;
+        }
+        else
+        {
+            slot_t new_slot = { 0, 1 };
+            slot = m_slots.size ();
+            m_slots.push_back (new_slot);
+        }
+        m_slots[slot].index = m_sets.size ();
+
+        entry_t entry;
+        entry.slot = slot;
+        entry.indexed = false;
+        m_sets.push_back (set);
+        m_entries.push_back (entry);
+        return make_handle (slot);
+    }
+
     // FIXME: this is a poor interface.  It doesn't work intuitively.  The user
     // has to create a ColorSet object and pass it to this function and then
     // throw it away and use the one returned from this function since it might
@@ -358,26 +835,218 @@ namespace agave
     // but maybe that's not such a bad thing to allow...
     ColorSet& ColorSetManager::add_set (const ColorSet& set)
     {
-        iterator it = std::find (m_sets.begin (), m_sets.end (), set);
-        if (it == m_sets.end ())
-        {
-            m_sets.push_back (set);
-            return m_sets.back ();
-        }
-        return *it;
+        return *get (insert (set));
     }
 
     void ColorSetManager::remove_set (const ColorSet& set)
     {
-        iterator it = std::find (m_sets.begin (), m_sets.end (), set);
-        if (it != m_sets.end ())
+        remove (find (set.get_id ()));
+    }
+
+    bool ColorSetManager::remove (handle_t handle)
+    {
+        const guint32 slot = lookup_slot (handle);
+        if (slot == NO_SLOT)
+        {
+            return false;
+        }
+
+        // move the last set into the gap
+        const std::size_t index = m_slots[slot].index;
+        const std::size_t last = m_sets.size () - 1;
+        if (m_journal && !m_replaying && m_entries[index].indexed)
+        {
+            m_journal->remove (m_sets[index].get_id ());
+        }
+        unindex_set (index);
+        m_tag_index.remove (slot);
+        m_text_index.remove (slot);
+        m_palette_index.remove (slot);
+        if (index != last)
+        {
+            m_sets[index] = m_sets[last];
+            m_entries[index] = m_entries[last];
+            m_slots[m_entries[index].slot].index = index;
+        }
+        m_sets.pop_back ();
+        m_entries.pop_back ();
+
+        // invalidate the outstanding handles and put the slot on the free list
+        ++m_slots[slot].generation;
+        if (m_slots[slot].generation == 0)
         {
-            m_sets.erase (it);
+            m_slots[slot].generation = 1;
         }
+        m_slots[slot].index = m_free_slot;
+        m_free_slot = slot;
+        return true;
     }
 
     void ColorSetManager::clear ()
-    { m_sets.clear (); }
+    {
+        if (m_journal && !m_replaying)
+        {
+            m_journal->clear ();
+        }
+        // don't journal the individual removals
+        const bool replaying = m_replaying;
+        m_replaying = true;
+        while (!m_sets.empty ())
+        {
+            remove (make_handle (m_entries.back ().slot));
+        }
+        m_replaying = replaying;
+    }
+
+    ColorSet* ColorSetManager::get (handle_t handle)
+    {
+        const guint32 slot = lookup_slot (handle);
+        if (slot == NO_SLOT)
+        {
+            return 0;
+        }
+        return &m_sets[m_slots[slot].index];
+    }
+
+    const ColorSet* ColorSetManager::get (handle_t handle) const
+    {
+        const guint32 slot = lookup_slot (handle);
+        if (slot == NO_SLOT)
+        {
+            return 0;
+        }
+        return &m_sets[m_slots[slot].index];
+    }
+
+    ColorSetManager::handle_t
+    ColorSetManager::find (const ColorSetId& id) const
+    {
+        id_index_t::const_iterator iter = m_index.find (id);
+        if (iter == m_index.end ())
+        {
+            return INVALID_HANDLE;
+        }
+        return make_handle (iter->second);
+    }
+
+    ColorSetManager::handle_t
+    ColorSetManager::get_handle (std::size_t index) const
+    {
+        if (index >= m_entries.size ())
+        {
+            return INVALID_HANDLE;
+        }
+        return make_handle (m_entries[index].slot);
+    }
+
+    void ColorSetManager::reindex (handle_t handle)
+    {
+        const guint32 slot = lookup_slot (handle);
+        if (slot == NO_SLOT)
+        {
+            return;
+        }
+        const std::size_t index = m_slots[slot].index;
+        if (m_journal && !m_replaying && m_entries[index].indexed)
+        {
+            m_journal->remove (m_entries[index].id);
+        }
+        unindex_set (index);
+        index_set (index);
+        if (m_journal && !m_replaying && m_entries[index].indexed)
+        {
+            m_journal->put (m_sets[index]);
+        }
+    }
+
+    bool ColorSetManager::add_tag (handle_t handle, const Glib::ustring& tag)
+    {
+        ColorSet* set = get (handle);
+        if (!set)
+        {
+            return false;
+        }
+        set->add_tag (tag);
+        mark_changed (handle);
+        return true;
+    }
+
+    bool ColorSetManager::remove_tag (handle_t handle, const Glib::ustring& tag)
+    {
+        ColorSet* set = get (handle);
+        if (!set)
+        {
+            return false;
+        }
+        set->remove_tag (tag);
+        mark_changed (handle);
+        return true;
+    }
+
+    bool ColorSetManager::find_tagged (const Glib::ustring& query,
+                                       std::vector<handle_t>& handles) const
+    {
+        handles.clear ();
+        std::vector<guint32> slots;
+        if (!m_tag_index.query (query, slots))
+        {
+            return false;
+        }
+        slots_to_handles (slots, handles);
+        return true;
+    }
+
+    std::vector<Glib::ustring> ColorSetManager::get_tags () const
+    {
+        return m_tag_index.get_tags ();
+    }
+
+    bool ColorSetManager::search (const Glib::ustring& query,
+                                  std::vector<handle_t>& handles,
+                                  const Glib::RefPtr<Gio::Cancellable>& cancellable) const
+    {
+        handles.clear ();
+        std::vector<guint32> slots;
+        if (!m_text_index.query (query, slots, cancellable))
+        {
+            return false;
+        }
+        slots_to_handles (slots, handles);
+        return true;
+    }
+
+    std::size_t ColorSetManager::find_similar (const std::vector<rgb_t>& palette,
+                                               std::size_t k,
+                                               std::vector<similar_set_t>& results) const
+    {
+        results.clear ();
+        std::vector<PaletteIndex::Match> matches;
+        m_palette_index.find_nearest (palette.empty () ? 0 : &palette[0],
+                                      palette.size (), k, matches);
+        results.reserve (matches.size ());
+        for (std::vector<PaletteIndex::Match>::const_iterator iter = matches.begin ();
+             iter != matches.end (); ++iter)
+        {
+            similar_set_t result;
+            result.handle = make_handle (iter->item);
+            result.distance = iter->distance;
+            results.push_back (result);
+        }
+        return results.size ();
+    }
+
+    std::size_t ColorSetManager::size () const
+    { return m_sets.size (); }
+
+    bool ColorSetManager::empty () const
+    { return m_sets.empty (); }
+
+    void ColorSetManager::reserve (std::size_t n)
+    {
+        m_sets.reserve (n);
+        m_entries.reserve (n);
+        m_slots.reserve (n);
+    }
 
     ColorSetManager::iterator
         ColorSetManager::begin ()
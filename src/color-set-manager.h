@@ -21,25 +21,258 @@
 #ifndef __COLOR_SET_MANAGER_H
 #define __COLOR_SET_MANAGER_H
 
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
+#include <glib/gtypes.h>
 #include "color-set.h"
+#include "color-set-journal.h"
+#include "palette-index.h"
+#include "tag-index.h"
+#include "text-index.h"
+
+namespace Glib
+{
+    class Thread;
+}
 
 namespace agave
 {
+    /**
+     * The library of saved color sets.
+     *
+     * The sets are stored contiguously and indexed by their id, so adding,
+     * finding and removing a set takes constant time on average.  Removing a
+     * set moves the last set into its place, so the order of iteration is
+     * only the order of insertion as long as nothing has been removed.
+     *
+     * Since sets move around, pointers, references and iterators to them are
+     * invalidated by add_set () and remove_set ().  Use a handle_t to keep
+     * track of a set instead: a handle stays valid until its set is removed,
+     * after which get () returns NULL for it.
+     *
+     * By default save () rewrites the whole file.  In journaled mode (see
+     * set_journaled ()) it only appends the changes since the last save to
+     * a journal next to the file instead.  When the journal has grown large
+     * enough, it is folded into the file by compact () in a background
+     * thread.  The file is always replaced atomically, and load () replays
+     * any journals that are found, so no saved change is lost if the
+     * program crashes at any point.
+     */
     class ColorSetManager
     {
         public:
-            typedef std::list<ColorSet>::iterator iterator;
-            typedef std::list<ColorSet>::const_iterator const_iterator;
-            typedef std::list<ColorSet>::reverse_iterator reverse_iterator;
-            typedef std::list<ColorSet>::const_reverse_iterator const_reverse_iterator;
+            typedef std::vector<ColorSet>::iterator iterator;
+            typedef std::vector<ColorSet>::const_iterator const_iterator;
+            typedef std::vector<ColorSet>::reverse_iterator reverse_iterator;
+            typedef std::vector<ColorSet>::const_reverse_iterator const_reverse_iterator;
+
+            /**
+             * A stable reference to a set in the manager
+             */
+            typedef guint64 handle_t;
+
+            /**
+             * A handle that never refers to a set
+             */
+            static const handle_t INVALID_HANDLE;
+
+            enum file_format_t
+            {
+                /// the original XML format
+                FORMAT_XML,
+                /// the binary snapshot format of ColorSetLibrary
+                FORMAT_BINARY
+            };
 
             ColorSetManager (std::string filename);
+            ~ColorSetManager ();
+
+            /**
+             * Load the sets from the file, which can be in either format.
+             * The format of the file becomes the format that save () uses.
+             *
+             * A binary file is read without parsing, but every set is still
+             * copied out of the mapping and added to the tag, search and
+             * palette indexes, so loading takes linear time in either
+             * format.  A set with the same id as one that was loaded before
+             * it is skipped.
+             */
             void load ();
             void save ();
+
+            /**
+             * Set the format that save () and compact () write.  XML is
+             * used until a binary file is loaded.
+             */
+            void set_file_format (file_format_t format);
+            file_format_t get_file_format () const;
+
+            /**
+             * Add the sets from a file in either format that aren't present
+             * yet
+             *
+             * @return  The number of sets added
+             */
+            std::size_t import_file (const std::string& filename);
+
+            /**
+             * Write the library to another file, e.g. to convert it between
+             * the formats.  The conversion is lossless.
+             */
+            bool export_file (const std::string& filename,
+                              file_format_t format) const;
+
+            /**
+             * Switch journaled saving on or off.  Switching it off flushes the
+             * journal; the next save () writes the whole file and removes
+             * the journals.
+             */
+            void set_journaled (bool journaled);
+            bool get_journaled () const;
+
+            /**
+             * Record that the name, description or tags of a set were
+             * changed, so that the next save () in journaled mode includes
+             * them and the tag and search indexes are updated.  Use reindex () when the
+             * colors were changed.
+             */
+            void mark_changed (handle_t handle);
+
+            /**
+             * Write the whole library to the file and remove the journals.
+             * The file is written by a background thread if threads are
+             * supported, call wait_for_compaction () to wait for it.
+             */
+            void compact ();
+            void wait_for_compaction ();
+
+            /**
+             * Add a set unless a set with the same id is already present
+             *
+             * @return  The handle of the new set, or of the set that was
+             * already present
+             */
+            handle_t insert (const ColorSet& set);
+
+            /**
+             * Like insert (), but returns the set in the manager.  The
+             * reference is only valid until the next insertion or removal.
+             */
             ColorSet& add_set (const ColorSet& set);
+
+            /**
+             * Remove the set with the same id as @a set, if any
+             */
             void remove_set (const ColorSet& set);
+
+            /**
+             * @return  false if @a handle didn't refer to a set
+             */
+            bool remove (handle_t handle);
             void clear ();
 
+            /**
+             * Get the set that @a handle refers to, or NULL if it has been
+             * removed
+             */
+            ColorSet* get (handle_t handle);
+            const ColorSet* get (handle_t handle) const;
+
+            /**
+             * Find the set with the given id
+             *
+             * @return  Its handle or INVALID_HANDLE
+             */
+            handle_t find (const ColorSetId& id) const;
+
+            /**
+             * Get the handle of the set at position @a index of the iteration
+             * order
+             */
+            handle_t get_handle (std::size_t index) const;
+
+            /**
+             * Update the index after the colors (and thus the id) of the set
+             * that @a handle refers to were changed.  If another set already
+             * has the new id, the set is no longer found by find ().  Such a
+             * duplicate isn't journaled, since the journal identifies sets by
+             * their id, and like any duplicate it is skipped by the next
+             * load ().
+             */
+            void reindex (handle_t handle);
+
+            /// \name Tags
+            /// The tags of all sets are kept in a TagIndex, see there for the
+            /// query syntax.
+            /// @{
+            /**
+             * Add a tag to the set that @a handle refers to
+             *
+             * @return  false if @a handle didn't refer to a set
+             */
+            bool add_tag (handle_t handle, const Glib::ustring& tag);
+            bool remove_tag (handle_t handle, const Glib::ustring& tag);
+
+            /**
+             * Find the sets that match a tag query such as
+             * "warm AND print AND NOT draft"
+             *
+             * @param handles  Receives the handles of the matching sets
+             * @return  false if the query is malformed
+             */
+            bool find_tagged (const Glib::ustring& query,
+                              std::vector<handle_t>& handles) const;
+
+            /**
+             * Get the tags used by any set, in alphabetical order
+             */
+            std::vector<Glib::ustring> get_tags () const;
+            /// @}
+
+            /**
+             * Find the sets whose name or description contain the words of
+             * @a query, for search-as-you-type.  See TextIndex for the
+             * matching rules.
+             *
+             * @param handles  Receives the handles of the matching sets
+             * @param cancellable  Allows a search in another thread to be
+             * abandoned when the query changes.  The manager must not be
+             * modified while it runs.
+             * @return  false if the search was cancelled
+             */
+            bool search (const Glib::ustring& query,
+                         std::vector<handle_t>& handles,
+                         const Glib::RefPtr<Gio::Cancellable>& cancellable =
+                             Glib::RefPtr<Gio::Cancellable> ()) const;
+
+            /**
+             * A result of find_similar ()
+             */
+            struct similar_set_t
+            {
+                handle_t handle;
+                /// see palette_distance ()
+                double distance;
+            };
+
+            /**
+             * Find the @a k sets whose colors are closest to @a palette by
+             * palette_distance (), regardless of the order of the colors.
+             * The sets are kept in a PaletteIndex, so this is fast for large
+             * libraries, but a close set is occasionally missed.
+             *
+             * @param results  Receives the matches, closest first
+             * @return  The number of matches
+             */
+            std::size_t find_similar (const std::vector<rgb_t>& palette,
+                                      std::size_t k,
+                                      std::vector<similar_set_t>& results) const;
+
+            std::size_t size () const;
+            bool empty () const;
+            void reserve (std::size_t n);
+
             iterator begin ();
             const_iterator begin () const;
             iterator end ();
@@ -50,8 +283,105 @@ namespace agave
             const_reverse_iterator rend () const;
 
         private:
+            friend class SavedSetParser;
+            struct CompactionJob;
+
+            // not copyable
+            ColorSetManager (const ColorSetManager&);
+            ColorSetManager& operator= (const ColorSetManager&);
+
+            struct slot_t
+            {
+                /// the position of the set in m_sets while the slot is in use,
+                /// otherwise the next free slot
+                guint32 index;
+                /// incremented whenever the slot is freed, so that stale
+                /// handles can be detected
+                guint32 generation;
+            };
+
+            /**
+             * Bookkeeping for each element of m_sets
+             */
+            struct entry_t
+            {
+                guint32 slot;
+                /// whether the set is in m_index
+                bool indexed;
+                /// the id under which the set is indexed
+                ColorSetId id;
+            };
+
+            typedef boost::unordered_map<ColorSetId, guint32> id_index_t;
+            typedef boost::unordered_multimap<ColorSetId, guint32> duplicate_index_t;
+
+            /**
+             * Add a set without checking for duplicates or journaling it.
+             * Only the first of several sets with the same id is indexed.
+             */
+            handle_t append (const ColorSet& set);
+
+            /**
+             * Like insert (), but swaps the contents of @a set into the
+             * manager instead of copying them and doesn't journal it
+             */
+            handle_t adopt (ColorSet& set);
+
+            /**
+             * Add a copy of @a set without indexing it
+             */
+            handle_t allocate (const ColorSet& set);
+            handle_t make_handle (guint32 slot) const;
+            guint32 lookup_slot (handle_t handle) const;
+            void index_set (std::size_t index);
+
+            /**
+             * Remove the set at @a index from m_index.  If another set has
+             * the same id, it is indexed (and journaled) in its place.
+             */
+            void unindex_set (std::size_t index);
+
+            /**
+             * Update the tag, search and palette indexes for the set at
+             * @a index
+             */
+            void index_contents (std::size_t index);
+            void slots_to_handles (const std::vector<guint32>& slots,
+                                   std::vector<handle_t>& handles) const;
+            std::string get_journal_filename () const;
+            std::string get_retired_journal_filename () const;
+            void read_data (const char* contents, gsize length,
+                            const std::string& filename, bool import);
+            void write_xml (std::string& out) const;
+            void serialize (std::string& out, file_format_t format) const;
+            void on_replay (ColorSetJournal::op_t op, const ColorSetId& id,
+                            ColorSet& set);
+
             const std::string m_filename;
-            std::list<ColorSet> m_sets;
+            std::vector<ColorSet> m_sets;
+            std::vector<entry_t> m_entries;
+            std::vector<slot_t> m_slots;
+            guint32 m_free_slot;
+            /// maps ids to slots
+            id_index_t m_index;
+            /// maps the ids of the sets that aren't in m_index because another
+            /// set has the same id to their slots
+            duplicate_index_t m_duplicates;
+            /// maps tags to slots
+            TagIndex m_tag_index;
+            /// maps the words of the names and descriptions to slots
+            TextIndex m_text_index;
+            /// maps the colors of the sets to slots
+            PaletteIndex m_palette_index;
+
+            boost::shared_ptr<ColorSetJournal> m_journal;
+            /// true while changes shouldn't be journaled
+            bool m_replaying;
+            /// the size of the file after the last load or save
+            gsize m_base_size;
+            file_format_t m_format;
+            boost::shared_ptr<CompactionJob> m_compaction;
+            Glib::Thread* m_compaction_thread;
     };
 }
 
@@ -20,43 +20,135 @@
  *******************************************************************************/
 
 #include <algorithm>
-#include <iomanip>
 #include <glibmm.h>
 #include "color-set.h"
 
 namespace agave
 {
-    std::string ColorSet::update_id ()
+    ColorSetId::ColorSetId () :
+        m_high (0),
+        m_low (0)
+    {}
+
+    ColorSetId::ColorSetId (guint64 high, guint64 low) :
+        m_high (high),
+        m_low (low)
+    {}
+
+    bool ColorSetId::parse (const std::string& str, ColorSetId& id)
     {
-        using Glib::ustring;
-        std::string input;
-        for (std::list<Color>::const_iterator it = m_colors.begin ();
-                it != m_colors.end (); ++it)
+        if (str.size () != STRING_LENGTH)
+        {
+            return false;
+        }
+        guint64 words[2] = { 0, 0 };
+        for (std::size_t i = 0; i < STRING_LENGTH; ++i)
+        {
+            const int digit = g_ascii_xdigit_value (str[i]);
+            if (digit < 0)
+            {
+                return false;
+            }
+            guint64& word = words[i / 16];
+            word = (word << 4) | digit;
+        }
+        id = ColorSetId (words[0], words[1]);
+        return true;
+    }
+
+    std::string ColorSetId::to_string () const
+    {
+        static const char digits[] = "0123456789abcdef";
+        std::string result (STRING_LENGTH, '0');
+        guint64 high = m_high;
+        guint64 low = m_low;
+        for (int i = 15; i >= 0; --i)
         {
-            input += ustring::compose ("%1-%2-%3-%4",
-                ustring::format (std::fixed, std::setprecision(4), it->get_red ()),
-                ustring::format (std::fixed, std::setprecision(4), it->get_green ()),
-                ustring::format (std::fixed, std::setprecision(4), it->get_blue ()),
-                ustring::format (std::fixed, std::setprecision(4), it->get_alpha ()));
+            result[i] = digits[high & 0xf];
+            result[i + 16] = digits[low & 0xf];
+            high >>= 4;
+            low >>= 4;
         }
-        return Glib::Checksum::compute_checksum (Glib::Checksum::CHECKSUM_SHA1, input);
+        return result;
+    }
+
+    /**
+     * The splitmix64 finalizer
+     */
+    static inline guint64 mix (guint64 x)
+    {
+        x += G_GUINT64_CONSTANT (0x9e3779b97f4a7c15);
+        x = (x ^ (x >> 30)) * G_GUINT64_CONSTANT (0xbf58476d1ce4e5b9);
+        x = (x ^ (x >> 27)) * G_GUINT64_CONSTANT (0x94d049bb133111eb);
+        return x ^ (x >> 31);
+    }
+
+    static inline guint64 quantize (double channel)
+    {
+        if (!(channel > 0.0))
+            return 0;
+        if (channel >= 1.0)
+            return 0xffff;
+        return static_cast<guint64> (channel * 65535.0 + 0.5);
+    }
+
+    /**
+     * Compute the contribution of a color at position @a index to the two
+     * halves of the id
+     */
+    static inline void hash_term (const Color& color, std::size_t index,
+                                  guint64& high, guint64& low)
+    {
+        const guint64 packed = (quantize (color.get_red ()) << 48) |
+            (quantize (color.get_green ()) << 32) |
+            (quantize (color.get_blue ()) << 16) |
+            quantize (color.get_alpha ());
+        const guint64 position = mix (index);
+        high = mix (packed ^ position);
+        low = mix (packed + mix (position));
+    }
+
+    void ColorSet::rehash ()
+    {
+        m_hash_high = 0;
+        m_hash_low = 0;
+        for (std::size_t i = 0; i < m_colors.size (); ++i)
+        {
+            guint64 high, low;
+            hash_term (m_colors[i], i, high, low);
+            m_hash_high += high;
+            m_hash_low += low;
+        }
+        update_id ();
+    }
+
+    void ColorSet::update_id ()
+    {
+        // mix in the number of colors so that sets that only differ in
+        // trailing transparent black colors get different ids
+        const guint64 size = m_colors.size ();
+        m_id = ColorSetId (mix (m_hash_high ^ mix (size)),
+                           mix (m_hash_low + size));
     }
 
     static int session_count = 0;
 
-    ColorSet::ColorSet ()
+    ColorSet::ColorSet () :
+        m_hash_high (0),
+        m_hash_low (0)
     {
+        update_id ();
         using Glib::ustring;
         m_name = ustring::compose ("Color Set %1",
                                    ustring::format(++session_count));
     }
 
-    std::string ColorSet::get_id () const
+    ColorSetId ColorSet::get_id () const
     {
         return m_id;
     }
 
-    void ColorSet::set_id (std::string new_id)
+    void ColorSet::set_id (const ColorSetId& new_id)
     {
         m_id = new_id;
     }
@@ -109,12 +201,52 @@ namespace agave
     void ColorSet::set_colors (const std::list<Color>& colors)
     {
         m_colors.assign (colors.begin (), colors.end ());
-        m_id = update_id ();
+        rehash ();
+    }
+
+    void ColorSet::set_colors (const std::vector<Color>& colors)
+    {
+        m_colors = colors;
+        rehash ();
     }
 
     std::list<Color> ColorSet::get_colors () const
     {
-        return m_colors;
+        return std::list<Color> (m_colors.begin (), m_colors.end ());
+    }
+
+    void ColorSet::set_color (std::size_t index, const Color& color)
+    {
+        g_return_if_fail (index < m_colors.size ());
+        guint64 high, low;
+        hash_term (m_colors[index], index, high, low);
+        m_hash_high -= high;
+        m_hash_low -= low;
+        m_colors[index] = color;
+        hash_term (m_colors[index], index, high, low);
+        m_hash_high += high;
+        m_hash_low += low;
+        update_id ();
+    }
+
+    void ColorSet::add_color (const Color& color)
+    {
+        guint64 high, low;
+        hash_term (color, m_colors.size (), high, low);
+        m_colors.push_back (color);
+        m_hash_high += high;
+        m_hash_low += low;
+        update_id ();
+    }
+
+    const Color& ColorSet::get_color (std::size_t index) const
+    {
+        return m_colors.at (index);
+    }
+
+    std::size_t ColorSet::size () const
+    {
+        return m_colors.size ();
     }
 
     void ColorSet::clear ()
@@ -123,9 +255,21 @@ namespace agave
         m_description.clear ();
         m_tags.clear ();
         m_colors.clear ();
+        rehash ();
+    }
+
+    void ColorSet::swap (ColorSet& other)
+    {
+        std::swap (m_id, other.m_id);
+        std::swap (m_hash_high, other.m_hash_high);
+        std::swap (m_hash_low, other.m_hash_low);
+        m_name.swap (other.m_name);
+        m_description.swap (other.m_description);
+        m_tags.swap (other.m_tags);
+        m_colors.swap (other.m_colors);
     }
 
-    bool ColorSet::operator== (const ColorSet& other)
+    bool ColorSet::operator== (const ColorSet& other) const
     {
         return (m_id == other.m_id);
     }
@@ -172,7 +316,7 @@ namespace agave
 
     std::ostream& operator<<(std::ostream& out, const ColorSet& s)
     {
-        out << "ID: " << s.m_id << std::endl;
+        out << "ID: " << s.m_id.to_string () << std::endl;
         out << "Name: " << s.get_name () << std::endl;
         out << "Description: " << s.get_description () << std::endl;
         for (ColorSet::const_iterator color_iter = s.begin ();
@@ -21,23 +21,93 @@
 #ifndef __COLOR_SET_H
 #define __COLOR_SET_H
 
+#include <cstddef>
 #include <list>
+#include <string>
+#include <vector>
+#include <glib/gtypes.h>
 #include <glibmm/ustring.h>
 #include "color.h"
 
 namespace agave
 {
+    /**
+     * A 128 bit identifier for the contents of a ColorSet
+     */
+    class ColorSetId
+    {
+        public:
+            /**
+             * The length of the string returned by to_string ()
+             */
+            static const std::size_t STRING_LENGTH = 32;
+
+            ColorSetId ();
+            ColorSetId (guint64 high, guint64 low);
+
+            /**
+             * Parse a string written by to_string ()
+             *
+             * @return  false if @a str isn't a valid id, @a id is not modified
+             * then
+             */
+            static bool parse (const std::string& str, ColorSetId& id);
+
+            /**
+             * Format the id as lower case hexadecimal digits
+             */
+            std::string to_string () const;
+
+            guint64 get_high () const { return m_high; }
+            guint64 get_low () const { return m_low; }
+
+            bool operator== (const ColorSetId& other) const
+            { return m_high == other.m_high && m_low == other.m_low; }
+            bool operator!= (const ColorSetId& other) const
+            { return !(*this == other); }
+            bool operator< (const ColorSetId& other) const
+            {
+                return m_high < other.m_high ||
+                    (m_high == other.m_high && m_low < other.m_low);
+            }
+
+        private:
+            guint64 m_high;
+            guint64 m_low;
+    };
+
+    /**
+     * Hash function for boost::unordered containers
+     */
+    inline std::size_t hash_value (const ColorSetId& id)
+    {
+        // the bits are already well mixed
+        return static_cast<std::size_t> (id.get_low ());
+    }
+
+    /**
+     * A named list of colors.
+     *
+     * The id of a set is a hash of its colors, with each channel quantized to
+     * 16 bits.  Each color contributes a term that depends on the color and
+     * its position, and the terms are summed up, so replacing or appending a
+     * single color updates the id in constant time.
+     */
     class ColorSet
     {
         public:
-            typedef std::list<Color>::iterator iterator;
-            typedef std::list<Color>::const_iterator const_iterator;
-            typedef std::list<Color>::reverse_iterator reverse_iterator;
-            typedef std::list<Color>::const_reverse_iterator const_reverse_iterator;
+            typedef std::vector<Color>::iterator iterator;
+            typedef std::vector<Color>::const_iterator const_iterator;
+            typedef std::vector<Color>::reverse_iterator reverse_iterator;
+            typedef std::vector<Color>::const_reverse_iterator const_reverse_iterator;
 
             ColorSet ();
-            std::string get_id () const;
-            void set_id (std::string new_id);
+            ColorSetId get_id () const;
+
+            /**
+             * Override the id.  It is recomputed when the colors change.
+             */
+            void set_id (const ColorSetId& new_id);
             Glib::ustring get_name () const;
             void set_name (Glib::ustring name);
             Glib::ustring get_description () const;
@@ -46,9 +116,25 @@ namespace agave
             void remove_tag (Glib::ustring tag);
             std::list<Glib::ustring> get_tags () const;
             void set_colors (const std::list<Color>& colors);
+            void set_colors (const std::vector<Color>& colors);
             std::list<Color> get_colors () const;
+
+            /**
+             * Replace the color at @a index.  Use this instead of modifying
+             * the colors through an iterator, which doesn't update the id.
+             */
+            void set_color (std::size_t index, const Color& color);
+            void add_color (const Color& color);
+            const Color& get_color (std::size_t index) const;
+            std::size_t size () const;
+
             void clear ();
-            bool operator== (const ColorSet& other);
+
+            /**
+             * Exchange the contents of two sets without copying them
+             */
+            void swap (ColorSet& other);
+            bool operator== (const ColorSet& other) const;
 
             iterator begin ();
             const_iterator begin () const;
@@ -63,13 +149,17 @@ namespace agave
             friend std::ostream& operator<<(std::ostream& out, const ColorSet& s);
 
         private:
-            std::string update_id ();
+            void rehash ();
+            void update_id ();
 
-            std::string m_id;
+            ColorSetId m_id;
+            /// the sums of the hash terms of all colors
+            guint64 m_hash_high;
+            guint64 m_hash_low;
             Glib::ustring m_name;
             Glib::ustring m_description;
             std::list<Glib::ustring> m_tags;
-            std::list<Color> m_colors;
+            std::vector<Color> m_colors;
     };
 }
 
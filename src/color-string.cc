@@ -0,0 +1,833 @@
+/*******************************************************************************
+ *
+ *  Copyright (c) 2008 Jonathon Jongsma
+ *
+ *  This file is part of Agave
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ *******************************************************************************/
+#include "color-string.h"
+#include <cmath>
+#include <cstring>
+#include <stdint.h>
+#include <glib/gtypes.h>
+
+namespace agave
+{
+    struct css_color_t
+    {
+        const char* name;
+        unsigned int value;
+    };
+
+    // the CSS Color Module Level 4 named colors.  This table must be kept
+    // sorted by name since it is searched with a binary search
+    static const css_color_t s_named_colors[] =
+    {
+        { "aliceblue", 0xf0f8ff },
+        { "antiquewhite", 0xfaebd7 },
+        { "aqua", 0x00ffff },
+        { "aquamarine", 0x7fffd4 },
+        { "azure", 0xf0ffff },
+        { "beige", 0xf5f5dc },
+        { "bisque", 0xffe4c4 },
+        { "black", 0x000000 },
+        { "blanchedalmond", 0xffebcd },
+        { "blue", 0x0000ff },
+        { "blueviolet", 0x8a2be2 },
+        { "brown", 0xa52a2a },
+        { "burlywood", 0xdeb887 },
+        { "cadetblue", 0x5f9ea0 },
+        { "chartreuse", 0x7fff00 },
+        { "chocolate", 0xd2691e },
+        { "coral", 0xff7f50 },
+        { "cornflowerblue", 0x6495ed },
+        { "cornsilk", 0xfff8dc },
+        { "crimson", 0xdc143c },
+        { "cyan", 0x00ffff },
+        { "darkblue", 0x00008b },
+        { "darkcyan", 0x008b8b },
+        { "darkgoldenrod", 0xb8860b },
+        { "darkgray", 0xa9a9a9 },
+        { "darkgreen", 0x006400 },
+        { "darkgrey", 0xa9a9a9 },
+        { "darkkhaki", 0xbdb76b },
+        { "darkmagenta", 0x8b008b },
+        { "darkolivegreen", 0x556b2f },
+        { "darkorange", 0xff8c00 },
+        { "darkorchid", 0x9932cc },
+        { "darkred", 0x8b0000 },
+        { "darksalmon", 0xe9967a },
+        { "darkseagreen", 0x8fbc8f },
+        { "darkslateblue", 0x483d8b },
+        { "darkslategray", 0x2f4f4f },
+        { "darkslategrey", 0x2f4f4f },
+        { "darkturquoise", 0x00ced1 },
+        { "darkviolet", 0x9400d3 },
+        { "deeppink", 0xff1493 },
+        { "deepskyblue", 0x00bfff },
+        { "dimgray", 0x696969 },
+        { "dimgrey", 0x696969 },
+        { "dodgerblue", 0x1e90ff },
+        { "firebrick", 0xb22222 },
+        { "floralwhite", 0xfffaf0 },
+        { "forestgreen", 0x228b22 },
+        { "fuchsia", 0xff00ff },
+        { "gainsboro", 0xdcdcdc },
+        { "ghostwhite", 0xf8f8ff },
+        { "gold", 0xffd700 },
+        { "goldenrod", 0xdaa520 },
+        { "gray", 0x808080 },
+        { "green", 0x008000 },
+        { "greenyellow", 0xadff2f },
+        { "grey", 0x808080 },
+        { "honeydew", 0xf0fff0 },
+        { "hotpink", 0xff69b4 },
+        { "indianred", 0xcd5c5c },
+        { "indigo", 0x4b0082 },
+        { "ivory", 0xfffff0 },
+        { "khaki", 0xf0e68c },
+        { "lavender", 0xe6e6fa },
+        { "lavenderblush", 0xfff0f5 },
+        { "lawngreen", 0x7cfc00 },
+        { "lemonchiffon", 0xfffacd },
+        { "lightblue", 0xadd8e6 },
+        { "lightcoral", 0xf08080 },
+        { "lightcyan", 0xe0ffff },
+        { "lightgoldenrodyellow", 0xfafad2 },
+        { "lightgray", 0xd3d3d3 },
+        { "lightgreen", 0x90ee90 },
+        { "lightgrey", 0xd3d3d3 },
+        { "lightpink", 0xffb6c1 },
+        { "lightsalmon", 0xffa07a },
+        { "lightseagreen", 0x20b2aa },
+        { "lightskyblue", 0x87cefa },
+        { "lightslategray", 0x778899 },
+        { "lightslategrey", 0x778899 },
+        { "lightsteelblue", 0xb0c4de },
+        { "lightyellow", 0xffffe0 },
+        { "lime", 0x00ff00 },
+        { "limegreen", 0x32cd32 },
+        { "linen", 0xfaf0e6 },
+        { "magenta", 0xff00ff },
+        { "maroon", 0x800000 },
+        { "mediumaquamarine", 0x66cdaa },
+        { "mediumblue", 0x0000cd },
+        { "mediumorchid", 0xba55d3 },
+        { "mediumpurple", 0x9370db },
+        { "mediumseagreen", 0x3cb371 },
+        { "mediumslateblue", 0x7b68ee },
+        { "mediumspringgreen", 0x00fa9a },
+        { "mediumturquoise", 0x48d1cc },
+        { "mediumvioletred", 0xc71585 },
+        { "midnightblue", 0x191970 },
+        { "mintcream", 0xf5fffa },
+        { "mistyrose", 0xffe4e1 },
+        { "moccasin", 0xffe4b5 },
+        { "navajowhite", 0xffdead },
+        { "navy", 0x000080 },
+        { "oldlace", 0xfdf5e6 },
+        { "olive", 0x808000 },
+        { "olivedrab", 0x6b8e23 },
+        { "orange", 0xffa500 },
+        { "orangered", 0xff4500 },
+        { "orchid", 0xda70d6 },
+        { "palegoldenrod", 0xeee8aa },
+        { "palegreen", 0x98fb98 },
+        { "paleturquoise", 0xafeeee },
+        { "palevioletred", 0xdb7093 },
+        { "papayawhip", 0xffefd5 },
+        { "peachpuff", 0xffdab9 },
+        { "peru", 0xcd853f },
+        { "pink", 0xffc0cb },
+        { "plum", 0xdda0dd },
+        { "powderblue", 0xb0e0e6 },
+        { "purple", 0x800080 },
+        { "rebeccapurple", 0x663399 },
+        { "red", 0xff0000 },
+        { "rosybrown", 0xbc8f8f },
+        { "royalblue", 0x4169e1 },
+        { "saddlebrown", 0x8b4513 },
+        { "salmon", 0xfa8072 },
+        { "sandybrown", 0xf4a460 },
+        { "seagreen", 0x2e8b57 },
+        { "seashell", 0xfff5ee },
+        { "sienna", 0xa0522d },
+        { "silver", 0xc0c0c0 },
+        { "skyblue", 0x87ceeb },
+        { "slateblue", 0x6a5acd },
+        { "slategray", 0x708090 },
+        { "slategrey", 0x708090 },
+        { "snow", 0xfffafa },
+        { "springgreen", 0x00ff7f },
+        { "steelblue", 0x4682b4 },
+        { "tan", 0xd2b48c },
+        { "teal", 0x008080 },
+        { "thistle", 0xd8bfd8 },
+        { "tomato", 0xff6347 },
+        { "turquoise", 0x40e0d0 },
+        { "violet", 0xee82ee },
+        { "wheat", 0xf5deb3 },
+        { "white", 0xffffff },
+        { "whitesmoke", 0xf5f5f5 },
+        { "yellow", 0xffff00 },
+        { "yellowgreen", 0x9acd32 },
+    };
+
+    static const std::size_t N_NAMED_COLORS =
+        sizeof (s_named_colors) / sizeof (s_named_colors[0]);
+
+    // long enough for "lightgoldenrodyellow"
+    static const std::size_t MAX_NAME_LENGTH = 24;
+
+    static const double s_powers_of_ten[] =
+    {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    static const char s_lower_digits[] = "0123456789abcdef";
+    static const char s_upper_digits[] = "0123456789ABCDEF";
+
+    enum unit_t
+    {
+        UNIT_NONE,
+        UNIT_PERCENT,
+        UNIT_DEG,
+        UNIT_RAD,
+        UNIT_GRAD,
+        UNIT_TURN
+    };
+
+    struct number_t
+    {
+        double value;
+        unit_t unit;
+    };
+
+    static inline bool is_space (char c)
+    {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+    }
+
+    static inline bool is_digit (char c)
+    {
+        return static_cast<unsigned char>(c - '0') < 10;
+    }
+
+    static inline bool is_alpha (char c)
+    {
+        return static_cast<unsigned char>((c | 0x20) - 'a') < 26;
+    }
+
+    static inline char to_lower (char c)
+    {
+        return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+    }
+
+    static inline int hex_value (char c)
+    {
+        if (is_digit (c))
+            return c - '0';
+        unsigned char lower = static_cast<unsigned char>((c | 0x20) - 'a');
+        if (lower < 6)
+            return lower + 10;
+        return -1;
+    }
+
+    static inline const char* skip_space (const char* p, const char* end)
+    {
+        while (p != end && is_space (*p))
+            ++p;
+        return p;
+    }
+
+    static inline double clamp_channel (double x)
+    {
+        // written so that NaN ends up as 0.0
+        if (!(x > 0.0))
+            return 0.0;
+        if (x > 1.0)
+            return 1.0;
+        return x;
+    }
+
+    // compare an identifier of length @a len to the lower case string @a word
+    static bool identifier_equals (const char* p, std::size_t len,
+                                   const char* word)
+    {
+        std::size_t i = 0;
+        for (; i < len; ++i)
+        {
+            if (word[i] == '\0' || to_lower (p[i]) != word[i])
+                return false;
+        }
+        return word[i] == '\0';
+    }
+
+    static bool parse_hex (const char* p, const char* end, rgb_t& rgb)
+    {
+        const std::size_t len = end - p;
+        int digits[8];
+
+        if (len != 3 && len != 4 && len != 6 && len != 8)
+            return false;
+
+        for (std::size_t i = 0; i < len; ++i)
+        {
+            digits[i] = hex_value (p[i]);
+            if (digits[i] < 0)
+                return false;
+        }
+
+        int channels[4] = { 0, 0, 0, 255 };
+        if (len <= 4)
+        {
+            // shorthand notation: #abc is the same as #aabbcc
+            for (std::size_t i = 0; i < len; ++i)
+                channels[i] = digits[i] * 17;
+        }
+        else
+        {
+            for (std::size_t i = 0; i < len / 2; ++i)
+                channels[i] = digits[2 * i] * 16 + digits[2 * i + 1];
+        }
+
+        rgb.r = channels[0] / 255.0;
+        rgb.g = channels[1] / 255.0;
+        rgb.b = channels[2] / 255.0;
+        rgb.a = channels[3] / 255.0;
+        return true;
+    }
+
+    static inline void unpack_rgb (unsigned int value, rgb_t& rgb)
+    {
+        rgb.r = ((value >> 16) & 0xff) / 255.0;
+        rgb.g = ((value >> 8) & 0xff) / 255.0;
+        rgb.b = (value & 0xff) / 255.0;
+        rgb.a = 1.0;
+    }
+
+    static bool parse_name (const char* p, const char* end, rgb_t& rgb)
+    {
+        const std::size_t len = end - p;
+        char name[MAX_NAME_LENGTH];
+
+        if (len == 0 || len >= MAX_NAME_LENGTH)
+            return false;
+
+        for (std::size_t i = 0; i < len; ++i)
+        {
+            if (!is_alpha (p[i]))
+                return false;
+            name[i] = to_lower (p[i]);
+        }
+        name[len] = '\0';
+
+        if (std::strcmp (name, "transparent") == 0)
+        {
+            rgb.r = rgb.g = rgb.b = rgb.a = 0.0;
+            return true;
+        }
+
+        std::size_t low = 0;
+        std::size_t high = N_NAMED_COLORS;
+        while (low < high)
+        {
+            const std::size_t mid = low + (high - low) / 2;
+            const int cmp = std::strcmp (name, s_named_colors[mid].name);
+            if (cmp == 0)
+            {
+                unpack_rgb (s_named_colors[mid].value, rgb);
+                return true;
+            }
+            else if (cmp < 0)
+                high = mid;
+            else
+                low = mid + 1;
+        }
+        return false;
+    }
+
+    // parses a CSS <number>, <percentage> or <angle>, advancing @a p
+    static bool parse_number (const char*& p, const char* end, number_t& num)
+    {
+        const char* q = p;
+        bool negative = false;
+        uint64_t mantissa = 0;
+        int n_digits = 0;
+        int exponent = 0;
+        bool any_digits = false;
+
+        if (q != end && (*q == '+' || *q == '-'))
+        {
+            negative = (*q == '-');
+            ++q;
+        }
+
+        for (; q != end && is_digit (*q); ++q)
+        {
+            any_digits = true;
+            // ignore digits beyond what a 64 bit integer can hold, they
+            // don't change the result at double precision anyway
+            if (n_digits < 18)
+            {
+                mantissa = mantissa * 10 + (*q - '0');
+                if (mantissa)
+                    ++n_digits;
+            }
+            else
+                ++exponent;
+        }
+
+        if (q != end && *q == '.')
+        {
+            ++q;
+            for (; q != end && is_digit (*q); ++q)
+            {
+                any_digits = true;
+                if (n_digits < 18)
+                {
+                    mantissa = mantissa * 10 + (*q - '0');
+                    if (mantissa)
+                        ++n_digits;
+                    --exponent;
+                }
+            }
+        }
+
+        if (!any_digits)
+            return false;
+
+        // only treat 'e' as an exponent if digits follow, so that units
+        // can't be mistaken for one
+        if (q != end && (*q == 'e' || *q == 'E'))
+        {
+            const char* e = q + 1;
+            bool negative_exponent = false;
+            if (e != end && (*e == '+' || *e == '-'))
+            {
+                negative_exponent = (*e == '-');
+                ++e;
+            }
+            if (e != end && is_digit (*e))
+            {
+                int value = 0;
+                for (; e != end && is_digit (*e); ++e)
+                {
+                    if (value < 10000)
+                        value = value * 10 + (*e - '0');
+                }
+                exponent += negative_exponent ? -value : value;
+                q = e;
+            }
+        }
+
+        double value = static_cast<double>(mantissa);
+        if (mantissa != 0 && exponent != 0)
+        {
+            const int abs_exponent = exponent < 0 ? -exponent : exponent;
+            const double scale = abs_exponent <= 22 ?
+                s_powers_of_ten[abs_exponent] : std::pow (10.0, abs_exponent);
+            value = exponent < 0 ? value / scale : value * scale;
+        }
+        num.value = negative ? -value : value;
+
+        num.unit = UNIT_NONE;
+        if (q != end && *q == '%')
+        {
+            num.unit = UNIT_PERCENT;
+            ++q;
+        }
+        else if (q != end && is_alpha (*q))
+        {
+            const char* unit = q;
+            while (q != end && is_alpha (*q))
+                ++q;
+            const std::size_t len = q - unit;
+            if (identifier_equals (unit, len, "deg"))
+                num.unit = UNIT_DEG;
+            else if (identifier_equals (unit, len, "rad"))
+                num.unit = UNIT_RAD;
+            else if (identifier_equals (unit, len, "grad"))
+                num.unit = UNIT_GRAD;
+            else if (identifier_equals (unit, len, "turn"))
+                num.unit = UNIT_TURN;
+            else
+                return false;
+        }
+
+        p = q;
+        return true;
+    }
+
+    // an 8 bit channel in rgb(), either 0-255 or a percentage
+    static bool rgb_channel (const number_t& num, double& value)
+    {
+        if (num.unit == UNIT_NONE)
+            value = num.value / 255.0;
+        else if (num.unit == UNIT_PERCENT)
+            value = num.value / 100.0;
+        else
+            return false;
+        value = clamp_channel (value);
+        return true;
+    }
+
+    // a percentage in hsl() or hwb().  Plain numbers are accepted as well,
+    // as in CSS Color Module Level 4
+    static bool percent_channel (const number_t& num, double& value)
+    {
+        if (num.unit != UNIT_NONE && num.unit != UNIT_PERCENT)
+            return false;
+        value = clamp_channel (num.value / 100.0);
+        return true;
+    }
+
+    static bool alpha_channel (const number_t& num, double& value)
+    {
+        if (num.unit == UNIT_NONE)
+            value = num.value;
+        else if (num.unit == UNIT_PERCENT)
+            value = num.value / 100.0;
+        else
+            return false;
+        value = clamp_channel (value);
+        return true;
+    }
+
+    // converts an angle to a fraction of a full turn in [0, 1)
+    static bool hue_channel (const number_t& num, double& value)
+    {
+        switch (num.unit)
+        {
+            case UNIT_NONE:
+            case UNIT_DEG:
+                value = num.value / 360.0;
+                break;
+            case UNIT_RAD:
+                value = num.value / (2.0 * G_PI);
+                break;
+            case UNIT_GRAD:
+                value = num.value / 400.0;
+                break;
+            case UNIT_TURN:
+                value = num.value;
+                break;
+            default:
+                return false;
+        }
+        value -= std::floor (value);
+        if (!(value < 1.0))
+            value = 0.0;
+        return true;
+    }
+
+    enum function_t
+    {
+        FUNCTION_RGB,
+        FUNCTION_HSL,
+        FUNCTION_HWB
+    };
+
+    static bool parse_function (const char* p, const char* end, rgb_t& rgb)
+    {
+        const char* name = p;
+        while (p != end && is_alpha (*p))
+            ++p;
+        const std::size_t name_len = p - name;
+
+        function_t function;
+        if (identifier_equals (name, name_len, "rgb") ||
+            identifier_equals (name, name_len, "rgba"))
+            function = FUNCTION_RGB;
+        else if (identifier_equals (name, name_len, "hsl") ||
+                 identifier_equals (name, name_len, "hsla"))
+            function = FUNCTION_HSL;
+        else if (identifier_equals (name, name_len, "hwb"))
+            function = FUNCTION_HWB;
+        else
+            return false;
+
+        if (p == end || *p != '(')
+            return false;
+        p = skip_space (p + 1, end);
+
+        // arguments are either all separated by commas (legacy syntax) or
+        // all by whitespace, with the alpha value set off by a slash
+        enum
+        {
+            SEPARATOR_UNKNOWN,
+            SEPARATOR_COMMA,
+            SEPARATOR_SPACE
+        } separator = SEPARATOR_UNKNOWN;
+        number_t args[4];
+        std::size_t n_args = 0;
+        while (true)
+        {
+            if (n_args == 4 || !parse_number (p, end, args[n_args]))
+                return false;
+            ++n_args;
+
+            const char* number_end = p;
+            p = skip_space (p, end);
+            if (p == end)
+                return false;
+            if (*p == ')')
+                break;
+            if (*p == ',')
+            {
+                if (separator == SEPARATOR_SPACE)
+                    return false;
+                separator = SEPARATOR_COMMA;
+                p = skip_space (p + 1, end);
+            }
+            else if (*p == '/')
+            {
+                if (separator == SEPARATOR_COMMA || n_args != 3)
+                    return false;
+                separator = SEPARATOR_SPACE;
+                p = skip_space (p + 1, end);
+            }
+            else if (p == number_end || separator == SEPARATOR_COMMA ||
+                     n_args == 3)
+            {
+                // no separator at all (e.g. "1.5.5"), a missing comma, or
+                // an alpha value without the slash
+                return false;
+            }
+            else
+            {
+                separator = SEPARATOR_SPACE;
+            }
+        }
+
+        if (n_args < 3 || skip_space (p + 1, end) != end)
+            return false;
+
+        double a = 1.0;
+        if (n_args == 4 && !alpha_channel (args[3], a))
+            return false;
+
+        switch (function)
+        {
+            case FUNCTION_RGB:
+                {
+                    rgb_t result;
+                    if (!rgb_channel (args[0], result.r) ||
+                        !rgb_channel (args[1], result.g) ||
+                        !rgb_channel (args[2], result.b))
+                        return false;
+                    result.a = a;
+                    rgb = result;
+                    return true;
+                }
+            case FUNCTION_HSL:
+                {
+                    hsl_t hsl;
+                    if (!hue_channel (args[0], hsl.h) ||
+                        !percent_channel (args[1], hsl.s) ||
+                        !percent_channel (args[2], hsl.l))
+                        return false;
+                    hsl.a = a;
+                    rgb = Color::hsl_to_rgb (hsl);
+                    return true;
+                }
+            case FUNCTION_HWB:
+                {
+                    double h, w, b;
+                    if (!hue_channel (args[0], h) ||
+                        !percent_channel (args[1], w) ||
+                        !percent_channel (args[2], b))
+                        return false;
+                    if (w + b >= 1.0)
+                    {
+                        // achromatic: whiteness and blackness are normalized
+                        // so that they add up to 100%
+                        const double gray = w / (w + b);
+                        rgb.r = rgb.g = rgb.b = gray;
+                        rgb.a = a;
+                    }
+                    else
+                    {
+                        // hwb maps directly onto hsv
+                        hsv_t hsv;
+                        hsv.h = h;
+                        hsv.v = 1.0 - b;
+                        hsv.s = 1.0 - w / hsv.v;
+                        hsv.a = a;
+                        rgb = Color::hsv_to_rgb (hsv);
+                    }
+                    return true;
+                }
+        }
+        return false;
+    }
+
+    bool parse_color (const char* begin, const char* end, rgb_t& rgb)
+    {
+        begin = skip_space (begin, end);
+        while (end != begin && is_space (*(end - 1)))
+            --end;
+
+        if (begin == end)
+            return false;
+
+        if (*begin == '#')
+            return parse_hex (begin + 1, end, rgb);
+
+        if (std::memchr (begin, '(', end - begin))
+            return parse_function (begin, end, rgb);
+
+        // try names first so that a bare hexstring can never shadow a named
+        // color
+        return parse_name (begin, end, rgb) || parse_hex (begin, end, rgb);
+    }
+
+    bool parse_color (const char* spec, rgb_t& rgb)
+    {
+        if (!spec)
+            return false;
+        return parse_color (spec, spec + std::strlen (spec), rgb);
+    }
+
+    bool parse_color (const std::string& spec, rgb_t& rgb)
+    {
+        const char* data = spec.data ();
+        return parse_color (data, data + spec.size (), rgb);
+    }
+
+    const char* get_css_color (std::size_t index, rgb_t& rgb)
+    {
+        if (index >= N_NAMED_COLORS)
+            return 0;
+        unpack_rgb (s_named_colors[index].value, rgb);
+        return s_named_colors[index].name;
+    }
+
+    std::size_t parse_colors (const char* const* specs, std::size_t n,
+                              rgb_t* colors, bool* valid)
+    {
+        std::size_t n_valid = 0;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            const bool ok = parse_color (specs[i], colors[i]);
+            if (!ok)
+            {
+                colors[i].r = colors[i].g = colors[i].b = 0.0;
+                colors[i].a = 1.0;
+            }
+            else
+                ++n_valid;
+            if (valid)
+                valid[i] = ok;
+        }
+        return n_valid;
+    }
+
+    std::size_t parse_color_lines (const char* begin, const char* end,
+                                   rgb_t* colors, std::size_t max_colors,
+                                   const char** next, std::size_t* n_invalid)
+    {
+        std::size_t n_colors = 0;
+        const char* p = begin;
+
+        while (p != end && n_colors < max_colors)
+        {
+            const char* eol = static_cast<const char*>(
+                    std::memchr (p, '\n', end - p));
+            const char* line_end = eol ? eol : end;
+
+            const char* first = skip_space (p, line_end);
+            if (first != line_end)
+            {
+                if (parse_color (first, line_end, colors[n_colors]))
+                    ++n_colors;
+                else if (n_invalid)
+                    ++(*n_invalid);
+            }
+
+            p = eol ? eol + 1 : end;
+        }
+
+        if (next)
+            *next = p;
+        return n_colors;
+    }
+
+    static inline unsigned int to_byte (double x)
+    {
+        return static_cast<unsigned int>(clamp_channel (x) * 255.0 + 0.5);
+    }
+
+    static inline std::size_t hexstring_length (unsigned int flags)
+    {
+        return 6 + ((flags & HEXSTRING_HASH) ? 1 : 0)
+            + ((flags & HEXSTRING_ALPHA) ? 2 : 0);
+    }
+
+    // @a buffer must have room for hexstring_length (flags) characters
+    static inline void write_hexstring (const rgb_t& rgb, char* buffer,
+                                        unsigned int flags)
+    {
+        const char* digits = (flags & HEXSTRING_UPPERCASE) ?
+            s_upper_digits : s_lower_digits;
+        unsigned int bytes[4] =
+        {
+            to_byte (rgb.r), to_byte (rgb.g), to_byte (rgb.b), to_byte (rgb.a)
+        };
+        const int n_channels = (flags & HEXSTRING_ALPHA) ? 4 : 3;
+
+        if (flags & HEXSTRING_HASH)
+            *buffer++ = '#';
+        for (int i = 0; i < n_channels; ++i)
+        {
+            *buffer++ = digits[bytes[i] >> 4];
+            *buffer++ = digits[bytes[i] & 0xf];
+        }
+    }
+
+    std::size_t format_hexstring (const rgb_t& rgb, char* buffer,
+                                  std::size_t size, unsigned int flags)
+    {
+        const std::size_t len = hexstring_length (flags);
+        if (size < len)
+            return 0;
+        write_hexstring (rgb, buffer, flags);
+        return len;
+    }
+
+    std::size_t format_hexstrings (const rgb_t* colors, std::size_t n,
+                                   char* buffer, std::size_t size,
+                                   unsigned int flags, std::size_t* n_written)
+    {
+        const std::size_t line_len = hexstring_length (flags) + 1;
+        std::size_t count = size / line_len;
+        if (count > n)
+            count = n;
+
+        char* p = buffer;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            write_hexstring (colors[i], p, flags);
+            p += line_len;
+            *(p - 1) = '\n';
+        }
+
+        if (n_written)
+            *n_written = count;
+        return p - buffer;
+    }
+}
@@ -0,0 +1,157 @@
+/*******************************************************************************
+ *
+ *  Copyright (c) 2008 Jonathon Jongsma
+ *
+ *  This file is part of Agave
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ *******************************************************************************/
+#ifndef __COLOR_STRING_H
+#define __COLOR_STRING_H
+
+#include <cstddef>
+#include <string>
+#include "color.h"
+
+/**
+ * \file
+ * Parsing and formatting of textual color specifications.
+ *
+ * The parser understands the following forms (case-insensitive, surrounding
+ * whitespace is ignored):
+ *   - hexstrings: \#rgb, \#rgba, \#rrggbb and \#rrggbbaa.  The leading '#'
+ *     is optional, so the output of Color::as_hexstring () parses as well.
+ *   - CSS functional notation: rgb(), rgba(), hsl(), hsla() and hwb(), with
+ *     either comma or space separated arguments and an optional alpha
+ *     component (e.g. "rgb(255 0 0 / 50%)" or "hsl(120deg, 100%, 50%)").
+ *     As in CSS, the two separator styles can't be mixed and the alpha
+ *     component needs a slash in the space separated form, so
+ *     "rgb(1 2,3)", "rgb(1,2,3 / 0.5)", "rgb(1 2 3 0.5)" and arguments
+ *     without any separator ("rgb(1.5.5,0,0)", "rgb(1-2-3)") are invalid.
+ *   - the CSS named colors (e.g. "rebeccapurple") and "transparent"
+ *
+ * None of these functions allocate memory, so they are suitable for
+ * processing large lists of colors.
+ */
+namespace agave
+{
+    /**
+     * Flags that control the output of format_hexstring ()
+     */
+    enum hexstring_flags_t
+    {
+        HEXSTRING_DEFAULT = 0,
+        /// prefix the output with '#'
+        HEXSTRING_HASH = 1 << 0,
+        /// append the alpha channel (\#rrggbbaa)
+        HEXSTRING_ALPHA = 1 << 1,
+        /// use upper case hexadecimal digits
+        HEXSTRING_UPPERCASE = 1 << 2
+    };
+
+    /**
+     * The largest number of characters that format_hexstring () writes,
+     * not including a terminating nul character
+     */
+    const std::size_t HEXSTRING_MAX_LENGTH = 9;
+
+    /// \name Parsing
+    /// @{
+    /**
+     * Parse the color specification in the range [@a begin, @a end)
+     *
+     * @param rgb  Receives the parsed color.  It is not modified if the
+     * specification is invalid.
+     * @return  true if the whole range was a valid color specification
+     */
+    bool parse_color (const char* begin, const char* end, rgb_t& rgb);
+
+    /**
+     * Parse a nul-terminated color specification
+     */
+    bool parse_color (const char* spec, rgb_t& rgb);
+
+    bool parse_color (const std::string& spec, rgb_t& rgb);
+
+    /**
+     * Parse @a n color specifications.
+     *
+     * @param valid  An optional array of @a n flags that receives whether each
+     * specification was valid.  Invalid entries in @a colors are set to
+     * opaque black.
+     * @return  The number of valid specifications
+     */
+    std::size_t parse_colors (const char* const* specs, std::size_t n,
+                              rgb_t* colors, bool* valid = 0);
+
+    /**
+     * Parse a buffer containing one color specification per line (e.g. a
+     * file that has been read into memory).  Empty lines are skipped and
+     * lines that can't be parsed are counted in @a n_invalid.
+     *
+     * Parsing stops after @a max_colors colors have been stored, so a large
+     * buffer can be processed in several calls by passing the value returned
+     * in @a next as the new @a begin.
+     *
+     * @param next  If non-NULL, receives the position where parsing stopped
+     * @param n_invalid  If non-NULL, the number of invalid lines is added to it
+     * @return  The number of colors stored in @a colors
+     */
+    std::size_t parse_color_lines (const char* begin, const char* end,
+                                   rgb_t* colors, std::size_t max_colors,
+                                   const char** next = 0,
+                                   std::size_t* n_invalid = 0);
+
+    /**
+     * Enumerate the CSS named colors that the parser knows about, in
+     * alphabetical order ("transparent" is not included)
+     *
+     * @return  The lower case name of color @a index, or NULL if @a index is
+     * out of range
+     */
+    const char* get_css_color (std::size_t index, rgb_t& rgb);
+    /// @}
+
+    /// \name Formatting
+    /// @{
+    /**
+     * Write the hexstring representation of @a rgb into @a buffer.  Channels
+     * are rounded to the nearest 8 bit value.  The output is not nul
+     * terminated.
+     *
+     * @param flags  A combination of hexstring_flags_t values
+     * @return  The number of characters written, or 0 if @a size is too small
+     */
+    std::size_t format_hexstring (const rgb_t& rgb, char* buffer,
+                                  std::size_t size,
+                                  unsigned int flags = HEXSTRING_DEFAULT);
+
+    /**
+     * Write the hexstrings of @a n colors into @a buffer, each one followed by
+     * a newline, so that the output can be read back with
+     * parse_color_lines ().  Only complete lines are written.
+     *
+     * @param n_written  If non-NULL, receives the number of colors that fit
+     * into the buffer
+     * @return  The number of characters written
+     */
+    std::size_t format_hexstrings (const rgb_t* colors, std::size_t n,
+                                   char* buffer, std::size_t size,
+                                   unsigned int flags = HEXSTRING_DEFAULT,
+                                   std::size_t* n_written = 0);
+    /// @}
+}
+
+#endif // __COLOR_STRING_H
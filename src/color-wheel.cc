@@ -23,6 +23,7 @@
 #include <gdk/gdkkeysyms.h>
 #include "color-wheel.h"
 #include "color-model.h"
+#include "color-convert.h"
 #include <goocanvasmm.h>
 #include <goocanvas.h>
 #include <glibmm-utils/exception.h>
@@ -274,21 +275,21 @@ namespace agave
 
             Color color_at_position (double x, double y)
             {
-                double dy = - (y - property_center_y ());
-                double dx = x - property_center_x ();
-                double angle = atan2 (dy, dx);
-                if (angle < 0.0)
-                {
-                    angle += 2.0 * G_PI;
-                }
-                double dist = sqrt (dx * dx + dy * dy);
+                return Color (value_at_position (x, y));
+            }
 
+            ColorValue value_at_position (double x, double y)
+            {
+                double h = 0.0, s = 0.0;
+                hue_saturation_at (x - property_center_x (),
+                                   y - property_center_y (),
+                                   property_radius_x (), h, s);
                 hsv_t hsv;
-                hsv.h = angle / (2.0 * G_PI);
-                hsv.s = std::min (dist / (property_radius_x ()), 1.0);
+                hsv.h = h;
+                hsv.s = s;
                 hsv.v = 1.0;
                 hsv.a = 1.0;
-                return Color (hsv);
+                return ColorValue (hsv);
             }
 
             bool is_in_path (double x, double y)
@@ -328,34 +329,56 @@ namespace agave
             virtual ~WheelItem () {}
 
         private:
+            // determine the hue and saturation of the wheel at the given
+            // offset from its center
+            static void hue_saturation_at (double dx, double dy, double radius,
+                                           double& h, double& s)
+            {
+                // y axis points down, but hue increases counter-clockwise
+                dy = -dy;
+                double angle = atan2 (dy, dx);
+                if (angle < 0.0)
+                {
+                    angle += 2.0 * G_PI;
+                }
+                double dist = sqrt (dx * dx + dy * dy);
+                h = angle / (2.0 * G_PI);
+                s = std::min (dist / radius, 1.0);
+            }
+
             void update_pattern ()
             {
+                const double xc = property_center_x ();
+                const double yc = property_center_y ();
+                const double radius = property_radius_x ();
                 Cairo::RefPtr<Cairo::ImageSurface> image_surface =
                     Cairo::ImageSurface::create (Cairo::FORMAT_ARGB32,
                             // FIXME: do we really have to create the image
                             // surface from the 0,0 point of the entire canvas?
                             // that could be huge in theory...
-                            static_cast<int>(property_center_x () + property_radius_x ()),
-                            static_cast<int>(property_center_y () + property_radius_y ()));
+                            static_cast<int>(xc + radius),
+                            static_cast<int>(yc + property_radius_y ()));
+                const int width = image_surface->get_width ();
                 unsigned char *data = image_surface->get_data ();
-                for (int row = 0; row < image_surface->get_height (); ++row)
+                if (width > 0)
                 {
-                    int dy = row;
-                    for (int px = 0; px < image_surface->get_width (); ++px)
+                    // compute the hue and saturation of a whole row at once and
+                    // then convert it to pixels in a single batch
+                    std::vector<float> hue (width), saturation (width),
+                        value (width, 1.0f);
+                    for (int row = 0; row < image_surface->get_height (); ++row)
                     {
-                        int dx = px;
-                        Color c = color_at_position (dx, dy);
-                        rgb_t rgb = c.as_rgb ();
-                        *data++ =
-                            static_cast<unsigned char>(
-                                    rgb.b * static_cast<double>(std::numeric_limits<unsigned char>::max ()));
-                        *data++ =
-                            static_cast<unsigned char>(
-                                    rgb.g * static_cast<double>(std::numeric_limits<unsigned char>::max ()));
-                        *data++ =
-                            static_cast<unsigned char>(
-                                    rgb.r * static_cast<double>(std::numeric_limits<unsigned char>::max ()));
-                        *data++ = std::numeric_limits<unsigned char>::max ();
+                        for (int px = 0; px < width; ++px)
+                        {
+                            double h = 0.0, s = 0.0;
+                            hue_saturation_at (px - xc, row - yc, radius, h, s);
+                            hue[px] = h;
+                            saturation[px] = s;
+                        }
+                        batch_hsv_to_argb32 (&hue[0], &saturation[0], &value[0],
+                                reinterpret_cast<uint32_t*> (data +
+                                    row * image_surface->get_stride ()),
+                                width);
                     }
                 }
                 image_surface->flush ();
@@ -443,7 +466,7 @@ namespace agave
                 }
             }
 
-            if (!found)
+            if (found)
             {
                 // color found, remove it
                 int id = get_root_item ()->find_child (*i);
@@ -472,6 +495,12 @@ namespace agave
         m_priv->add_color (model);
     }
 
+    void ColorWheel::remove_color (const boost::shared_ptr<ColorModel>& model)
+    {
+        THROW_IF_FAIL (m_priv);
+        m_priv->remove_color (model);
+    }
+
     unsigned int ColorWheel::get_num_colors () const
     {
         THROW_IF_FAIL (m_priv);
@@ -41,6 +41,7 @@ namespace agave
             ColorWheel ();
 
             virtual void add_color (const boost::shared_ptr<ColorModel>& model, bool highlight);
+            virtual void remove_color (const boost::shared_ptr<ColorModel>& model);
             virtual unsigned int get_num_colors () const;
 
             Gtk::Widget& get_widget ();
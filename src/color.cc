@@ -19,10 +19,11 @@
  *
  *******************************************************************************/
 #include "color.h"
+#include "color-string.h"
 #include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <iomanip>
-#include <sstream>
 #include <limits>
 #include <glibmm-utils/exception.h>
 
@@ -71,52 +72,234 @@ namespace agave
         return new_hsv;
     }
 
-    struct Color::Priv
+    hsv_t clamp_hsv (const hsv_t& hsv)
     {
-        void clamp ()
+        hsv_t result;
+        result.s = std::max (std::min (hsv.s, MAX_VALUE), MIN_VALUE);
+        result.v = std::max (std::min (hsv.v, MAX_VALUE), MIN_VALUE);
+        result.a = std::max (std::min (hsv.a, MAX_VALUE), MIN_VALUE);
+
+        // hue is a special case -- it should wrap around, not be clamped
+        result.h = hsv.h - std::floor (hsv.h);
+        // a tiny negative hue rounds up to a full turn
+        if (result.h >= MAX_VALUE)
         {
-            // clamp rgb
-            m_rgb.r = std::min (m_rgb.r, MAX_VALUE);
-            m_rgb.g = std::min (m_rgb.g, MAX_VALUE);
-            m_rgb.b = std::min (m_rgb.b, MAX_VALUE);
-            m_rgb.a = std::min (m_rgb.a, MAX_VALUE);
-
-            m_rgb.r = std::max (m_rgb.r, MIN_VALUE);
-            m_rgb.g = std::max (m_rgb.g, MIN_VALUE);
-            m_rgb.b = std::max (m_rgb.b, MIN_VALUE);
-            m_rgb.a = std::max (m_rgb.a, MIN_VALUE);
-
-            // clamp hsv
-            m_hsv.s = std::min (m_hsv.s, MAX_VALUE);
-            m_hsv.v = std::min (m_hsv.v, MAX_VALUE);
-            m_hsv.a = std::min (m_hsv.a, MAX_VALUE);
-
-            m_hsv.s = std::max (m_hsv.s, MIN_VALUE);
-            m_hsv.v = std::max (m_hsv.v, MIN_VALUE);
-            m_hsv.a = std::max (m_hsv.a, MIN_VALUE);
-
-            // hue is a special case -- it should wrap around, not be clamped
-            while (m_hsv.h < MIN_VALUE)
-            {
-                m_hsv.h += MAX_VALUE - MIN_VALUE;
-            }
-            while (m_hsv.h >= MAX_VALUE)
-            {
-                m_hsv.h -= MAX_VALUE - MIN_VALUE;
-            }
+            result.h = MIN_VALUE;
         }
+        return result;
+    }
+
+    ColorValue::ColorValue ()
+    {
+        // initialize to opaque red
+        set_hsv (0.0, 1.0, 1.0, 1.0);
+    }
+
+    ColorValue::ColorValue (double r, double g, double b, double a)
+    {
+        set_rgb (r, g, b, a);
+    }
+
+    ColorValue::ColorValue (rgb_t rgb)
+    {
+        set (rgb);
+    }
+
+    ColorValue::ColorValue (hsv_t hsv)
+    {
+        set (hsv);
+    }
 
-        /** Internal data representation in RGBA.
+    ColorValue::ColorValue (hsl_t hsl)
+    {
+        set (hsl);
+    }
+
+    ColorValue::ColorValue (cmyk_t cmyk)
+    {
+        set (cmyk);
+    }
+
+    bool ColorValue::operator==(const ColorValue& rhs) const
+    {
+        return (m_rgb == rhs.m_rgb);
+    }
+
+    bool ColorValue::operator!=(const ColorValue& rhs) const
+    {
+        return !(*this == rhs);
+    }
+
+    void ColorValue::clamp ()
+    {
+        // clamp rgb
+        m_rgb.r = std::min (m_rgb.r, MAX_VALUE);
+        m_rgb.g = std::min (m_rgb.g, MAX_VALUE);
+        m_rgb.b = std::min (m_rgb.b, MAX_VALUE);
+        m_rgb.a = std::min (m_rgb.a, MAX_VALUE);
+
+        m_rgb.r = std::max (m_rgb.r, MIN_VALUE);
+        m_rgb.g = std::max (m_rgb.g, MIN_VALUE);
+        m_rgb.b = std::max (m_rgb.b, MIN_VALUE);
+        m_rgb.a = std::max (m_rgb.a, MIN_VALUE);
+
+        m_hsv = clamp_hsv (m_hsv);
+    }
+
+    void ColorValue::set (rgb_t rgb)
+    {
+        m_rgb = rgb;
+        m_hsv = Color::rgb_to_hsv (rgb);
+        clamp ();
+    }
+
+    void ColorValue::set_rgb (double r, double g, double b, double a)
+    {
+        rgb_t rgb = {r, g, b, a};
+        set (rgb);
+    }
+
+    void ColorValue::set_red (double r)
+    {
+        rgb_t new_rgb = m_rgb;
+        new_rgb.r = r;
+        set (new_rgb);
+    }
+
+    void ColorValue::set_green (double g)
+    {
+        rgb_t new_rgb = m_rgb;
+        new_rgb.g = g;
+        set (new_rgb);
+    }
+
+    void ColorValue::set_blue (double b)
+    {
+        rgb_t new_rgb = m_rgb;
+        new_rgb.b = b;
+        set (new_rgb);
+    }
+
+    void ColorValue::set (hsv_t hsv)
+    {
+        m_hsv = hsv;
+        clamp ();
+        m_rgb = Color::hsv_to_rgb (m_hsv);
+    }
+
+    void ColorValue::set_hsv (double h, double s, double v, double a)
+    {
+        hsv_t new_hsv = {h, s, v, a};
+        set (new_hsv);
+    }
+
+    void ColorValue::set_hue (double h)
+    {
+        hsv_t new_hsv = m_hsv;
+        new_hsv.h = h;
+        set (new_hsv);
+    }
+
+    void ColorValue::shift_hue (hsv_t::value_type hue_delta)
+    {
+        hsv_t hsv = m_hsv;
+        hsv.h += hue_delta;
+        if (hsv.h < 0)
+        {
+            hsv.h += 1.0;
+        }
+        set (hsv);
+    }
+
+    void ColorValue::set_saturation (double s)
+    {
+        hsv_t new_hsv = m_hsv;
+        new_hsv.s = s;
+        set (new_hsv);
+    }
+
+    void ColorValue::set_value (double v)
+    {
+        hsv_t new_hsv = m_hsv;
+        new_hsv.v = v;
+        set (new_hsv);
+    }
+
+    void ColorValue::set (hsl_t hsl)
+    {
+        set (Color::hsl_to_rgb (hsl));
+    }
+
+    void ColorValue::set_hsl (double h, double s, double l, double a)
+    {
+        hsl_t new_hsl = {h, s, l, a};
+        set (new_hsl);
+    }
+
+    hsl_t ColorValue::as_hsl () const
+    {
+        return Color::rgb_to_hsl (m_rgb);
+    }
+
+    void ColorValue::set (cmyk_t cmyk)
+    {
+        set (Color::cmyk_to_rgb (cmyk));
+    }
+
+    void ColorValue::set_cmyk (double c, double m, double y, double k, double a)
+    {
+        cmyk_t new_cmyk = {c, m, y, k, a};
+        set (new_cmyk);
+    }
+
+    cmyk_t ColorValue::as_cmyk () const
+    {
+        return Color::rgb_to_cmyk (m_rgb);
+    }
+
+    void ColorValue::set_alpha (double a)
+    {
+        rgb_t new_rgb = m_rgb;
+        new_rgb.a = a;
+        set (new_rgb);
+    }
+
+    double ColorValue::luminance () const
+    {
+        return (m_rgb.r * RED_LUMINANCE +
+                m_rgb.g * GREEN_LUMINANCE +
+                m_rgb.b * BLUE_LUMINANCE);
+    }
+
+    struct Color::Priv
+    {
+        /** The current value of the color
         */
-        rgb_t m_rgb;
-        /** Internal representation in HSV.  We keep a cached copy of this
-         * around since it reduces conversions on demand, and since
-         * converting to rgb and back is lossy (e.g. if VALUE reaches 0,
-         * then HUE and SATURATION get set to 0 automatically)
+        ColorValue m_value;
+
+        /** The value of the color when notifications were frozen, so that
+         * thawing only notifies about actual changes
          */
-        hsv_t m_hsv;
+        ColorValue m_frozen_value;
+        unsigned int m_freeze_count;
 
         mutable sigc::signal<void> m_signal_changed;
+
+        Priv () :
+            m_freeze_count (0)
+        {}
+
+        // ColorValue::operator== only compares the RGB values, but a change
+        // of e.g. the hue of a gray color is a change too
+        static bool identical (const ColorValue& lhs, const ColorValue& rhs)
+        {
+            const hsv_t lhs_hsv = lhs.as_hsv ();
+            const hsv_t rhs_hsv = rhs.as_hsv ();
+            return lhs.as_rgb () == rhs.as_rgb () &&
+                lhs_hsv.h == rhs_hsv.h &&
+                lhs_hsv.s == rhs_hsv.s &&
+                lhs_hsv.v == rhs_hsv.v;
+        }
     };
 
     hsv_t Color::rgb_to_hsv (const rgb_t& rgb)
@@ -428,24 +611,33 @@ namespace agave
         m_priv (new Priv ())
     {
         THROW_IF_FAIL (m_priv);
-        set (hsl_to_rgb (hsl));
-        m_priv->clamp ();
+        set (hsl);
     }
 
     Color::Color (cmyk_t cmyk) :
         m_priv (new Priv ())
     {
         THROW_IF_FAIL (m_priv);
-        set (cmyk_to_rgb (cmyk));
-        m_priv->clamp ();
+        set (cmyk);
     }
 
     Color::Color (std::string hexstring) :
         m_priv (new Priv ())
     {
-        // FIXME
         THROW_IF_FAIL (m_priv);
-        m_priv->clamp ();
+        rgb_t rgb;
+        if (parse_color (hexstring, rgb))
+            m_priv->m_value.set (rgb);
+        else
+            std::cerr << Glib::ustring::compose ("Invalid color specification '%1'",
+                    hexstring) << std::endl;
+    }
+
+    Color::Color (const ColorValue& value) :
+        m_priv (new Priv ())
+    {
+        THROW_IF_FAIL (m_priv);
+        m_priv->m_value = value;
     }
 
     Color::Color (const Color& other) :
@@ -453,7 +645,6 @@ namespace agave
     {
         THROW_IF_FAIL (m_priv);
         *this = other;
-        m_priv->clamp ();
     }
 
     Color::~Color ()
@@ -464,10 +655,8 @@ namespace agave
     {
         THROW_IF_FAIL (m_priv);
         if (this == &rhs) return *this;
-        m_priv->m_rgb = rhs.m_priv->m_rgb;
-        m_priv->m_hsv = rhs.m_priv->m_hsv;
-        m_priv->clamp ();
-        m_priv->m_signal_changed.emit ();
+        ChangeTransaction<Color> transaction (*this);
+        m_priv->m_value = rhs.m_priv->m_value;
         return *this;
     }
 
@@ -481,7 +670,7 @@ namespace agave
 
     bool Color::operator==(const Color& rhs) const
     {
-        return (m_priv->m_rgb == rhs.m_priv->m_rgb);
+        return (m_priv->m_value == rhs.m_priv->m_value);
     }
 
     bool Color::operator!=(const Color& rhs) const
@@ -509,27 +698,18 @@ namespace agave
     Color Color::operator*(double factor) const
     {
         THROW_IF_FAIL (m_priv);
-        Color result;
-        result.m_priv->m_rgb.r = m_priv->m_rgb.r * factor;
-        result.m_priv->m_rgb.g = m_priv->m_rgb.g * factor;
-        result.m_priv->m_rgb.b = m_priv->m_rgb.b * factor;
-        result.m_priv->m_rgb.a = m_priv->m_rgb.a * factor;
-        result.m_priv->clamp ();
-        return result;
+        rgb_t rgb = m_priv->m_value.as_rgb ();
+        rgb.r *= factor;
+        rgb.g *= factor;
+        rgb.b *= factor;
+        rgb.a *= factor;
+        return Color (rgb);
     }
 
     std::ostream& operator<< (std::ostream& out, const Color& c)
     {
-        rgb_t rgb = c.as_rgb ();
         out << std::fixed << std::setprecision (4);
         out << "<" << &c << "> {Color} ";
-        /*
-        out << "[R=" << rgb.r
-            << " G=" << rgb.g
-            << " B=" << rgb.b
-            << " A=" << rgb.a
-            << "]";
-        */
 
         hsv_t hsv = c.as_hsv ();
         out << c.as_hexstring ();
@@ -544,22 +724,16 @@ namespace agave
 
     void Color::shift_hue (hsv_t::value_type hue_delta)
     {
-        hsv_t hsv = as_hsv ();
-        hsv.h += hue_delta;
-        if (hsv.h < 0)
-        {
-            hsv.h += 1.0;
-        }
-        set (hsv);
+        THROW_IF_FAIL (m_priv);
+        ChangeTransaction<Color> transaction (*this);
+        m_priv->m_value.shift_hue (hue_delta);
     }
 
     void Color::set (rgb_t rgb)
     {
         THROW_IF_FAIL (m_priv);
-        m_priv->m_rgb = rgb;
-        m_priv->m_hsv = rgb_to_hsv (rgb);
-        m_priv->clamp ();
-        m_priv->m_signal_changed.emit ();
+        ChangeTransaction<Color> transaction (*this);
+        m_priv->m_value.set (rgb);
     }
 
     void Color::set_rgb (double r, double g, double b, double a)
@@ -571,52 +745,47 @@ namespace agave
     void Color::set_red (double r)
     {
         THROW_IF_FAIL (m_priv);
-        rgb_t new_rgb = m_priv->m_rgb;
-        new_rgb.r = r;
-        set (new_rgb);
+        ChangeTransaction<Color> transaction (*this);
+        m_priv->m_value.set_red (r);
     }
 
     void Color::set_green (double g)
     {
         THROW_IF_FAIL (m_priv);
-        rgb_t new_rgb = m_priv->m_rgb;
-        new_rgb.g = g;
-        set (new_rgb);
+        ChangeTransaction<Color> transaction (*this);
+        m_priv->m_value.set_green (g);
     }
 
     void Color::set_blue (double b)
     {
         THROW_IF_FAIL (m_priv);
-        rgb_t new_rgb = m_priv->m_rgb;
-        new_rgb.b = b;
-        set (new_rgb);
+        ChangeTransaction<Color> transaction (*this);
+        m_priv->m_value.set_blue (b);
     }
 
     double Color::get_red () const
     {
         THROW_IF_FAIL (m_priv);
-        return m_priv->m_rgb.r;
+        return m_priv->m_value.get_red ();
     }
 
     double Color::get_green () const
     {
         THROW_IF_FAIL (m_priv);
-        return m_priv->m_rgb.g;
+        return m_priv->m_value.get_green ();
     }
 
     double Color::get_blue () const
     {
         THROW_IF_FAIL (m_priv);
-        return m_priv->m_rgb.b;
+        return m_priv->m_value.get_blue ();
     }
 
     void Color::set (hsv_t hsv)
     {
         THROW_IF_FAIL (m_priv);
-        m_priv->m_hsv = hsv;
-        m_priv->clamp ();
-        m_priv->m_rgb = hsv_to_rgb (m_priv->m_hsv);
-        m_priv->m_signal_changed.emit ();
+        ChangeTransaction<Color> transaction (*this);
+        m_priv->m_value.set (hsv);
     }
 
     void Color::set_hsv (double h, double s, double v, double a)
@@ -627,51 +796,61 @@ namespace agave
 
     void Color::set_hue (double h)
     {
-        hsv_t new_hsv = as_hsv ();
-        new_hsv.h = h;
-        set (new_hsv);
+        THROW_IF_FAIL (m_priv);
+        ChangeTransaction<Color> transaction (*this);
+        m_priv->m_value.set_hue (h);
     }
 
     void Color::set_saturation (double s)
     {
-        hsv_t new_hsv = as_hsv ();
-        new_hsv.s = s;
-        set (new_hsv);
+        THROW_IF_FAIL (m_priv);
+        ChangeTransaction<Color> transaction (*this);
+        m_priv->m_value.set_saturation (s);
     }
 
     void Color::set_value (double v)
     {
-        hsv_t new_hsv = as_hsv ();
-        new_hsv.v = v;
-        set (new_hsv);
+        THROW_IF_FAIL (m_priv);
+        ChangeTransaction<Color> transaction (*this);
+        m_priv->m_value.set_value (v);
     }
 
     double Color::get_hue () const
     {
-        hsv_t hsv = as_hsv ();
-        return hsv.h;
+        THROW_IF_FAIL (m_priv);
+        return m_priv->m_value.get_hue ();
     }
 
     double Color::get_saturation () const
     {
-        hsv_t hsv = as_hsv ();
-        return hsv.s;
+        THROW_IF_FAIL (m_priv);
+        return m_priv->m_value.get_saturation ();
     }
 
     double Color::get_value () const
     {
-        hsv_t hsv = as_hsv ();
-        return hsv.v;
+        THROW_IF_FAIL (m_priv);
+        return m_priv->m_value.get_value ();
     }
 
     void Color::set (hsl_t hsl)
     {
-        set (hsl_to_rgb (hsl));
+        THROW_IF_FAIL (m_priv);
+        ChangeTransaction<Color> transaction (*this);
+        m_priv->m_value.set (hsl);
+    }
+
+    void Color::set_hsl (double h, double s, double l, double a)
+    {
+        hsl_t new_hsl = {h, s, l, a};
+        set (new_hsl);
     }
 
     void Color::set (cmyk_t cmyk)
     {
-        set (cmyk_to_rgb (cmyk));
+        THROW_IF_FAIL (m_priv);
+        ChangeTransaction<Color> transaction (*this);
+        m_priv->m_value.set (cmyk);
     }
 
     void Color::set_cmyk (double c, double m, double y, double k, double a)
@@ -735,66 +914,96 @@ namespace agave
     void Color::set_alpha (double a)
     {
         THROW_IF_FAIL (m_priv);
-        rgb_t new_rgb = m_priv->m_rgb;
-        new_rgb.a = a;
-        set (new_rgb);
+        ChangeTransaction<Color> transaction (*this);
+        m_priv->m_value.set_alpha (a);
     }
 
     double Color::get_alpha () const
     {
         THROW_IF_FAIL (m_priv);
-        return m_priv->m_rgb.a;
+        return m_priv->m_value.get_alpha ();
     }
 
     void Color::set (std::string hexstring)
     {
-        // FIXME: parse string to rgb color
+        rgb_t rgb;
+        if (parse_color (hexstring, rgb))
+            set (rgb);
+        else
+            std::cerr << Glib::ustring::compose ("Invalid color specification '%1'",
+                    hexstring) << std::endl;
+    }
+
+    void Color::set (const ColorValue& value)
+    {
+        THROW_IF_FAIL (m_priv);
+        ChangeTransaction<Color> transaction (*this);
+        m_priv->m_value = value;
+    }
+
+    ColorValue Color::as_value () const
+    {
+        THROW_IF_FAIL (m_priv);
+        return m_priv->m_value;
     }
 
     rgb_t Color::as_rgb () const
     {
         THROW_IF_FAIL (m_priv);
-        return m_priv->m_rgb;
+        return m_priv->m_value.as_rgb ();
     }
 
     hsv_t Color::as_hsv () const
     {
         THROW_IF_FAIL (m_priv);
-        return m_priv->m_hsv;
+        return m_priv->m_value.as_hsv ();
     }
 
     hsl_t Color::as_hsl () const
     {
         THROW_IF_FAIL (m_priv);
-        return rgb_to_hsl (m_priv->m_rgb);
+        return m_priv->m_value.as_hsl ();
     }
 
     cmyk_t Color::as_cmyk () const
     {
         THROW_IF_FAIL (m_priv);
-        return rgb_to_cmyk (m_priv->m_rgb);
+        return m_priv->m_value.as_cmyk ();
     }
 
     std::string Color::as_hexstring () const
     {
         THROW_IF_FAIL (m_priv);
-        std::ostringstream ostream;
-        uint16_t x;
-        x = static_cast<uint16_t>((m_priv->m_rgb.r) * static_cast<double>(255.0));
-        ostream << std::hex << std::setw (2) << std::setfill('0') << x;
-        x = static_cast<uint16_t>((m_priv->m_rgb.g) * static_cast<double>(255.0));
-        ostream << std::hex << std::setw (2) << std::setfill('0') << x;
-        x = static_cast<uint16_t>((m_priv->m_rgb.b) * static_cast<double>(255.0));
-        ostream << std::hex << std::setw (2) << std::setfill('0') << x;
-        return ostream.str ();
+        char buffer[HEXSTRING_MAX_LENGTH];
+        std::size_t len = format_hexstring (m_priv->m_value.as_rgb (), buffer,
+                                            sizeof (buffer));
+        return std::string (buffer, len);
     }
 
     double Color::luminance () const
     {
         THROW_IF_FAIL (m_priv);
-        return (m_priv->m_rgb.r * RED_LUMINANCE +
-                m_priv->m_rgb.g * GREEN_LUMINANCE +
-                m_priv->m_rgb.b * BLUE_LUMINANCE);
+        return m_priv->m_value.luminance ();
+    }
+
+    void Color::freeze_notify ()
+    {
+        THROW_IF_FAIL (m_priv);
+        if (m_priv->m_freeze_count++ == 0)
+        {
+            m_priv->m_frozen_value = m_priv->m_value;
+        }
+    }
+
+    void Color::thaw_notify ()
+    {
+        THROW_IF_FAIL (m_priv);
+        g_return_if_fail (m_priv->m_freeze_count > 0);
+        if (--m_priv->m_freeze_count == 0 &&
+            !Priv::identical (m_priv->m_value, m_priv->m_frozen_value))
+        {
+            m_priv->m_signal_changed.emit ();
+        }
     }
 
     sigc::signal<void>& Color::signal_changed () const
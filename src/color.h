@@ -54,6 +54,13 @@ namespace agave
     hsv_t operator-(const hsv_t& lhs, const hsv_t& rhs);
     hsv_t operator+(const hsv_t& lhs, const hsv_t& rhs);
 
+    /**
+     * Bring @a hsv into the range that ColorValue and Color store: the hue
+     * is wrapped into [0.0, 1.0), saturation, value and alpha are clamped
+     * to 0.0 - 1.0
+     */
+    hsv_t clamp_hsv (const hsv_t& hsv);
+
     /************************************************************
      * HSL
      ***********************************************************/
@@ -73,6 +80,96 @@ namespace agave
     };
 
 
+    /**
+     * A lightweight color value.
+     *
+     * ColorValue holds the same RGBA and HSVA representation as a Color and
+     * offers the same conversion API, but it has no change notification and
+     * no heap-allocated state.  It is trivially copyable, so it can be
+     * created on the stack and passed around by value in code that handles
+     * many colors (e.g. scheme generators or image rasterizers) without
+     * costing any allocations.
+     *
+     * A Color can be converted to a ColorValue with Color::as_value () and
+     * back with Color::set (const ColorValue&).
+     */
+    class ColorValue
+    {
+        public:
+            ColorValue ();
+            ColorValue (double r, double g, double b, double a = 1.0);
+            explicit ColorValue (rgb_t rgb);
+            explicit ColorValue (hsv_t hsv);
+            explicit ColorValue (hsl_t hsl);
+            explicit ColorValue (cmyk_t cmyk);
+
+            bool operator==(const ColorValue& rhs) const;
+            bool operator!=(const ColorValue& rhs) const;
+
+            /// \name rgb operations
+            /// @{
+            void set (rgb_t rgb);
+            void set_rgb (double r, double g, double b, double a=1.0);
+            void set_red (double r);
+            void set_green (double g);
+            void set_blue (double b);
+            double get_red () const { return m_rgb.r; }
+            double get_green () const { return m_rgb.g; }
+            double get_blue () const { return m_rgb.b; }
+            rgb_t as_rgb () const { return m_rgb; }
+            /// @}
+
+            /// \name hsv operations
+            /// @{
+            void set (hsv_t hsv);
+            void set_hsv (double h, double s, double v, double a=1.0);
+            void set_hue (double h);
+            void shift_hue (hsv_t::value_type hue_delta);
+            void set_saturation (double s);
+            void set_value (double v);
+            double get_hue () const { return m_hsv.h; }
+            double get_saturation () const { return m_hsv.s; }
+            double get_value () const { return m_hsv.v; }
+            hsv_t as_hsv () const { return m_hsv; }
+            /// @}
+
+            /// \name hsl operations
+            /// @{
+            void set (hsl_t hsl);
+            void set_hsl (double h, double s, double l, double a=1.0);
+            hsl_t as_hsl () const;
+            /// @}
+
+            /// \name cmyk operations
+            /// @{
+            void set (cmyk_t cmyk);
+            void set_cmyk (double c, double m, double y, double k, double a=1.0);
+            cmyk_t as_cmyk () const;
+            /// @}
+
+            void set_alpha (double a);
+            double get_alpha () const { return m_rgb.a; }
+
+            /**
+             * Get the luminance of the color
+             */
+            double luminance () const;
+
+        private:
+            void clamp ();
+
+            /** Internal data representation in RGBA.
+            */
+            rgb_t m_rgb;
+            /** Internal representation in HSV.  We keep a cached copy of this
+             * around since it reduces conversions on demand, and since
+             * converting to rgb and back is lossy (e.g. if VALUE reaches 0,
+             * then HUE and SATURATION get set to 0 automatically)
+             */
+            hsv_t m_hsv;
+    };
+
+
     /**
      * A class to encapsulate the specification of a color.
      *
@@ -96,6 +193,7 @@ namespace agave
             explicit Color (hsl_t hsl);
             explicit Color (cmyk_t cmyk);
             explicit Color (std::string hexstring);
+            explicit Color (const ColorValue& value);
             Color (const Color& other);
             virtual ~Color ();
 
@@ -197,16 +295,43 @@ namespace agave
             void set_alpha (double a);
             double get_alpha () const;
 
+            /**
+             * Set the value of the color from a lightweight color value
+             */
+            void set (const ColorValue& value);
+
+            /**
+             * Get a lightweight copy of the current value of the color
+             */
+            ColorValue as_value () const;
+
             /**
              * Get the luminance of the color
              */
             double luminance () const;
 
             /**
-             * signal emitted whenever the color is changed
+             * signal emitted whenever the value of the color changes.
+             * Setting the color to the value it already has doesn't emit it.
              */
             sigc::signal<void>& signal_changed () const;
 
+            /// \name Change notification
+            /// @{
+            /**
+             * Stop emitting signal_changed () until thaw_notify () is called.
+             * Calls can be nested; the outermost thaw_notify () emits the
+             * signal once if the color changed in the meantime, no matter
+             * how many setters were called.  See also ChangeTransaction.
+             */
+            void freeze_notify ();
+
+            /**
+             * Undo one call to freeze_notify ()
+             */
+            void thaw_notify ();
+            /// @}
+
             /// \name Conversion helper functions
             /// @{
             /**
@@ -271,5 +396,43 @@ namespace agave
             boost::shared_ptr<Priv> m_priv;
     };
 
+
+    /**
+     * Collapses all changes that are made to a Color or ColorModel during
+     * the lifetime of the transaction into a single change notification (see
+     * Color::freeze_notify ()).  The notification is sent when the
+     * transaction goes out of scope, even if an exception is thrown.
+     *
+     * \code
+     * {
+     *     ChangeTransaction<Color> transaction (color);
+     *     color.set_hue (0.5);
+     *     color.set_saturation (1.0);
+     * } // color.signal_changed () is emitted once here
+     * \endcode
+     */
+    template <class T>
+    class ChangeTransaction
+    {
+        public:
+            explicit ChangeTransaction (T& target) :
+                m_target (target)
+            {
+                m_target.freeze_notify ();
+            }
+
+            ~ChangeTransaction ()
+            {
+                m_target.thaw_notify ();
+            }
+
+        private:
+            // not copyable
+            ChangeTransaction (const ChangeTransaction& other);
+            ChangeTransaction& operator= (const ChangeTransaction& other);
+
+            T& m_target;
+    };
+
 } // namespace agave
 #endif // __COLOR_H
@@ -0,0 +1,625 @@
+/*******************************************************************************
+ *
+ *  Copyright (c) 2008 Jonathon Jongsma
+ *
+ *  This file is part of Agave
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ *******************************************************************************/
+#include "history.h"
+#include <algorithm>
+#include <map>
+#include <vector>
+#include <boost/weak_ptr.hpp>
+#include <glib/gtypes.h>
+#include <glibmm/main.h>
+#include <glibmm/timeval.h>
+#include <sigc++/trackable.h>
+#include <sigc++/connection.h>
+#include <glibmm-utils/exception.h>
+#include "color-model.h"
+#include "color-relation.h"
+
+namespace agave
+{
+    const std::size_t History::DEFAULT_MAX_BYTES = 256 * 1024;
+    const double History::DEFAULT_MERGE_INTERVAL = 0.5;
+
+    enum entry_kind_t
+    {
+        KIND_COLOR,
+        KIND_INDEX
+    };
+
+    enum entry_flags_t
+    {
+        // the first entry of an undo step
+        ENTRY_STEP_START = 1 << 0
+    };
+
+    // colors are stored in single precision HSV so that the hue of grays
+    // survives an undo
+    union history_value_t
+    {
+        float hsva[4];
+        gint32 index;
+    };
+
+    /**
+     * A single recorded change (40 bytes)
+     */
+    struct history_entry_t
+    {
+        guint32 target;
+        guint16 kind;
+        guint16 flags;
+        history_value_t before;
+        history_value_t after;
+    };
+
+    static history_value_t value_from_color (const Color& color)
+    {
+        const hsv_t hsv = color.as_hsv ();
+        history_value_t value;
+        value.hsva[0] = hsv.h;
+        value.hsva[1] = hsv.s;
+        value.hsva[2] = hsv.v;
+        value.hsva[3] = hsv.a;
+        return value;
+    }
+
+    static Color color_from_value (const history_value_t& value)
+    {
+        hsv_t hsv;
+        hsv.h = value.hsva[0];
+        hsv.s = value.hsva[1];
+        hsv.v = value.hsva[2];
+        hsv.a = value.hsva[3];
+        return Color (hsv);
+    }
+
+    struct History::Priv : public sigc::trackable
+    {
+        /**
+         * A recorded model or index value
+         */
+        struct Target : public sigc::trackable
+        {
+            Priv* history;
+            guint32 id;
+            boost::weak_ptr<ColorModel> model;
+            SlotSetIndex setter;
+            sigc::connection connection;
+            // the value of the model as of the last notification, since the
+            // change notification doesn't carry the old value
+            history_value_t last;
+
+            void on_color_changed ()
+            {
+                history->on_model_changed (*this);
+            }
+        };
+
+        typedef std::map<ColorModel*, Target*> model_map_t;
+
+        mutable sigc::signal<void> m_signal_changed;
+        std::vector<Target*> m_targets;
+        model_map_t m_models;
+
+        // the ring buffer.  Logical index 0 is the oldest entry, entries
+        // before m_cursor can be undone, the ones after it redone.
+        std::vector<history_entry_t> m_ring;
+        std::size_t m_first;
+        std::size_t m_size;
+        std::size_t m_cursor;
+
+        bool m_step_open;
+        std::size_t m_step_start;
+        // the open step didn't fit into the budget on its own
+        bool m_discard_step;
+        int m_step_depth;
+        sigc::connection m_idle_connection;
+
+        // true while undoing or redoing, so the changes aren't recorded
+        bool m_applying;
+        double m_merge_interval;
+        double m_last_step_time;
+        bool m_can_merge;
+
+        Priv (std::size_t max_bytes) :
+            m_first (0),
+            m_size (0),
+            m_cursor (0),
+            m_step_open (false),
+            m_step_start (0),
+            m_discard_step (false),
+            m_step_depth (0),
+            m_applying (false),
+            m_merge_interval (DEFAULT_MERGE_INTERVAL),
+            m_last_step_time (0.0),
+            m_can_merge (false)
+        {
+            m_ring.resize (capacity_for (max_bytes));
+        }
+
+        ~Priv ()
+        {
+            m_idle_connection.disconnect ();
+            for (std::vector<Target*>::iterator iter = m_targets.begin ();
+                 iter != m_targets.end (); ++iter)
+            {
+                (*iter)->connection.disconnect ();
+                delete *iter;
+            }
+        }
+
+        static std::size_t capacity_for (std::size_t max_bytes)
+        {
+            return std::max (max_bytes / sizeof (history_entry_t),
+                             static_cast<std::size_t> (1));
+        }
+
+        history_entry_t& at (std::size_t index)
+        {
+            return m_ring[(m_first + index) % m_ring.size ()];
+        }
+
+        Target* new_target ()
+        {
+            Target* target = new Target ();
+            target->history = this;
+            target->id = m_targets.size ();
+            target->last.index = 0;
+            m_targets.push_back (target);
+            return target;
+        }
+
+        void on_model_changed (Target& target)
+        {
+            boost::shared_ptr<ColorModel> model = target.model.lock ();
+            if (!model)
+            {
+                return;
+            }
+            const history_value_t value = value_from_color (model->get_color ());
+            // colors that are derived through relations are not recorded,
+            // restoring the color that they were derived from restores them
+            // as well
+            if (!m_applying && !ColorRelation::is_propagating ())
+            {
+                record (target.id, KIND_COLOR, target.last, value);
+            }
+            target.last = value;
+        }
+
+        void record (guint32 target, entry_kind_t kind,
+                     const history_value_t& before,
+                     const history_value_t& after)
+        {
+            if (m_applying)
+            {
+                return;
+            }
+            if (!m_step_open)
+            {
+                open_step ();
+            }
+            if (m_discard_step)
+            {
+                return;
+            }
+
+            // a value that changes several times within one step only needs
+            // a single entry
+            for (std::size_t i = m_step_start; i < m_size; ++i)
+            {
+                if (at (i).target == target)
+                {
+                    at (i).after = after;
+                    return;
+                }
+            }
+
+            if (m_size == m_ring.size ())
+            {
+                drop_oldest_step ();
+                if (m_discard_step)
+                {
+                    return;
+                }
+            }
+            history_entry_t& entry = at (m_size);
+            entry.target = target;
+            entry.kind = kind;
+            entry.flags = (m_size == m_step_start) ? ENTRY_STEP_START : 0;
+            entry.before = before;
+            entry.after = after;
+            m_cursor = ++m_size;
+        }
+
+        void open_step ()
+        {
+            // a new change makes the undone steps unreachable
+            m_size = m_cursor;
+            m_step_open = true;
+            m_step_start = m_size;
+            m_discard_step = false;
+            if (m_step_depth == 0)
+            {
+                // everything that happens until control returns to the main
+                // loop belongs to this step
+                m_idle_connection = Glib::signal_idle ().connect
+                    (sigc::mem_fun (this, &Priv::on_idle));
+            }
+        }
+
+        bool on_idle ()
+        {
+            if (m_step_depth == 0)
+            {
+                close_step ();
+            }
+            return false;
+        }
+
+        /**
+         * Make room for a new entry by discarding the oldest step.  If the
+         * open step is the only one left, it is too big for the budget and
+         * the whole history is discarded.
+         */
+        void drop_oldest_step ()
+        {
+            std::size_t n = 1;
+            while (n < m_step_start && !(at (n).flags & ENTRY_STEP_START))
+            {
+                ++n;
+            }
+            if (m_step_start == 0 || n > m_step_start)
+            {
+                m_first = 0;
+                m_size = m_cursor = m_step_start = 0;
+                m_discard_step = m_step_open;
+                m_can_merge = false;
+                return;
+            }
+            m_first = (m_first + n) % m_ring.size ();
+            m_size -= n;
+            m_cursor -= n;
+            m_step_start -= n;
+        }
+
+        std::size_t find_step_start (std::size_t index)
+        {
+            while (index > 0 && !(at (index).flags & ENTRY_STEP_START))
+            {
+                --index;
+            }
+            return index;
+        }
+
+        bool is_mergeable (std::size_t previous, std::size_t current)
+        {
+            const std::size_t length = current - previous;
+            if (m_size - current != length)
+            {
+                return false;
+            }
+            for (std::size_t i = 0; i < length; ++i)
+            {
+                const history_entry_t& prev = at (previous + i);
+                const history_entry_t& cur = at (current + i);
+                if (prev.target != cur.target || prev.kind != KIND_COLOR ||
+                    cur.kind != KIND_COLOR)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        void close_step ()
+        {
+            if (!m_step_open)
+            {
+                return;
+            }
+            m_idle_connection.disconnect ();
+            m_step_open = false;
+            if (m_discard_step)
+            {
+                m_discard_step = false;
+                m_step_start = m_size;
+                m_signal_changed.emit ();
+                return;
+            }
+            if (m_size == m_step_start)
+            {
+                return;
+            }
+
+            Glib::TimeVal now;
+            now.assign_current_time ();
+            const double time = now.as_double ();
+
+            // merge the step into the previous one if it changed the same
+            // colors shortly before, e.g. while dragging a marker
+            if (m_can_merge && m_step_start > 0 &&
+                time - m_last_step_time <= m_merge_interval)
+            {
+                const std::size_t previous = find_step_start (m_step_start - 1);
+                if (is_mergeable (previous, m_step_start))
+                {
+                    for (std::size_t i = 0; i < m_size - m_step_start; ++i)
+                    {
+                        at (previous + i).after = at (m_step_start + i).after;
+                    }
+                    m_size = m_cursor = m_step_start;
+                }
+            }
+            m_step_start = m_size;
+            m_last_step_time = time;
+            m_can_merge = true;
+            m_signal_changed.emit ();
+        }
+
+        void apply (const history_entry_t& entry, const history_value_t& value)
+        {
+            THROW_IF_FAIL (entry.target < m_targets.size ());
+            Target& target = *m_targets[entry.target];
+            if (entry.kind == KIND_COLOR)
+            {
+                boost::shared_ptr<ColorModel> model = target.model.lock ();
+                if (model)
+                {
+                    model->set_color (color_from_value (value));
+                    target.last = value;
+                }
+            }
+            else if (target.setter)
+            {
+                target.setter (value.index);
+            }
+        }
+
+        bool undo ()
+        {
+            close_step ();
+            if (m_cursor == 0)
+            {
+                return false;
+            }
+
+            const std::size_t start = find_step_start (m_cursor - 1);
+            m_applying = true;
+            for (std::size_t i = m_cursor; i-- > start; )
+            {
+                apply (at (i), at (i).before);
+            }
+            m_applying = false;
+            m_cursor = m_step_start = start;
+            m_can_merge = false;
+            m_signal_changed.emit ();
+            return true;
+        }
+
+        bool redo ()
+        {
+            close_step ();
+            if (m_cursor == m_size)
+            {
+                return false;
+            }
+
+            std::size_t end = m_cursor + 1;
+            while (end < m_size && !(at (end).flags & ENTRY_STEP_START))
+            {
+                ++end;
+            }
+            m_applying = true;
+            for (std::size_t i = m_cursor; i < end; ++i)
+            {
+                apply (at (i), at (i).after);
+            }
+            m_applying = false;
+            m_cursor = m_step_start = end;
+            m_can_merge = false;
+            m_signal_changed.emit ();
+            return true;
+        }
+
+        void clear ()
+        {
+            m_idle_connection.disconnect ();
+            m_step_open = false;
+            m_discard_step = false;
+            m_first = m_size = m_cursor = m_step_start = 0;
+            m_can_merge = false;
+            m_signal_changed.emit ();
+        }
+
+        void set_max_bytes (std::size_t max_bytes)
+        {
+            close_step ();
+            const std::size_t capacity = capacity_for (max_bytes);
+            if (m_size > capacity)
+            {
+                // the undone steps go first, and drop_oldest_step () relies
+                // on the cursor being at the end
+                m_size = m_cursor;
+            }
+            while (m_size > capacity)
+            {
+                m_step_start = m_size;
+                drop_oldest_step ();
+            }
+
+            std::vector<history_entry_t> ring (capacity);
+            for (std::size_t i = 0; i < m_size; ++i)
+            {
+                ring[i] = at (i);
+            }
+            m_ring.swap (ring);
+            m_first = 0;
+            m_step_start = m_size;
+            m_signal_changed.emit ();
+        }
+    };
+
+    History::History (std::size_t max_bytes) :
+        m_priv (new Priv (max_bytes))
+    {
+    }
+
+    unsigned int History::add_model (const boost::shared_ptr<ColorModel>& model)
+    {
+        THROW_IF_FAIL (m_priv);
+        THROW_IF_FAIL (model);
+        Priv::model_map_t::iterator iter = m_priv->m_models.find (model.get ());
+        if (iter != m_priv->m_models.end ())
+        {
+            return iter->second->id;
+        }
+
+        Priv::Target* target = m_priv->new_target ();
+        target->model = model;
+        target->last = value_from_color (model->get_color ());
+        target->connection = model->signal_color_changed ().connect
+            (sigc::mem_fun (*target, &Priv::Target::on_color_changed));
+        m_priv->m_models[model.get ()] = target;
+        return target->id;
+    }
+
+    void History::remove_model (const boost::shared_ptr<ColorModel>& model)
+    {
+        THROW_IF_FAIL (m_priv);
+        Priv::model_map_t::iterator iter = m_priv->m_models.find (model.get ());
+        if (iter != m_priv->m_models.end ())
+        {
+            // keep the target so that the identifiers stay valid, changes
+            // of the model are skipped from now on
+            iter->second->connection.disconnect ();
+            iter->second->model.reset ();
+            m_priv->m_models.erase (iter);
+        }
+    }
+
+    unsigned int History::add_index (const SlotSetIndex& setter)
+    {
+        THROW_IF_FAIL (m_priv);
+        Priv::Target* target = m_priv->new_target ();
+        target->setter = setter;
+        return target->id;
+    }
+
+    void History::record_index (unsigned int id, int before, int after)
+    {
+        THROW_IF_FAIL (m_priv);
+        THROW_IF_FAIL (id < m_priv->m_targets.size ());
+        if (before == after)
+        {
+            return;
+        }
+        history_value_t before_value, after_value;
+        before_value.index = before;
+        after_value.index = after;
+        m_priv->record (id, KIND_INDEX, before_value, after_value);
+    }
+
+    void History::begin_step ()
+    {
+        THROW_IF_FAIL (m_priv);
+        if (m_priv->m_step_depth++ == 0)
+        {
+            // the step itself is opened by the first change
+            m_priv->close_step ();
+        }
+    }
+
+    void History::end_step ()
+    {
+        THROW_IF_FAIL (m_priv);
+        g_return_if_fail (m_priv->m_step_depth > 0);
+        if (--m_priv->m_step_depth == 0)
+        {
+            m_priv->close_step ();
+        }
+    }
+
+    bool History::can_undo () const
+    {
+        THROW_IF_FAIL (m_priv);
+        return m_priv->m_cursor > 0;
+    }
+
+    bool History::can_redo () const
+    {
+        THROW_IF_FAIL (m_priv);
+        return m_priv->m_cursor < m_priv->m_size;
+    }
+
+    bool History::undo ()
+    {
+        THROW_IF_FAIL (m_priv);
+        return m_priv->undo ();
+    }
+
+    bool History::redo ()
+    {
+        THROW_IF_FAIL (m_priv);
+        return m_priv->redo ();
+    }
+
+    void History::clear ()
+    {
+        THROW_IF_FAIL (m_priv);
+        m_priv->clear ();
+    }
+
+    void History::set_max_bytes (std::size_t max_bytes)
+    {
+        THROW_IF_FAIL (m_priv);
+        m_priv->set_max_bytes (max_bytes);
+    }
+
+    std::size_t History::get_max_bytes () const
+    {
+        THROW_IF_FAIL (m_priv);
+        return m_priv->m_ring.size () * sizeof (history_entry_t);
+    }
+
+    std::size_t History::get_size_bytes () const
+    {
+        THROW_IF_FAIL (m_priv);
+        return m_priv->m_size * sizeof (history_entry_t);
+    }
+
+    void History::set_merge_interval (double seconds)
+    {
+        THROW_IF_FAIL (m_priv);
+        m_priv->m_merge_interval = seconds;
+    }
+
+    double History::get_merge_interval () const
+    {
+        THROW_IF_FAIL (m_priv);
+        return m_priv->m_merge_interval;
+    }
+
+    sigc::signal<void>& History::signal_changed () const
+    {
+        THROW_IF_FAIL (m_priv);
+        return m_priv->m_signal_changed;
+    }
+}
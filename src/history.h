@@ -0,0 +1,136 @@
+/*******************************************************************************
+ *
+ *  Copyright (c) 2008 Jonathon Jongsma
+ *
+ *  This file is part of Agave
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ *******************************************************************************/
+#ifndef __HISTORY_H
+#define __HISTORY_H
+
+#include <cstddef>
+#include <boost/shared_ptr.hpp>
+#include <sigc++/signal.h>
+#include <sigc++/functors/slot.h>
+
+namespace agave
+{
+    class ColorModel;
+
+    /**
+     * Undo and redo support for a set of color models and other integer
+     * values (e.g. the index of the active scheme).
+     *
+     * The history listens to the models that were added to it and records
+     * every direct change as a small fixed-size entry (the old and new value
+     * of a single model) in a ring buffer with a fixed byte budget.  Changes
+     * made by a ColorRelation are not recorded since undoing the change of
+     * their source restores them.  When the budget is exhausted, the oldest
+     * steps are discarded.
+     *
+     * All changes that happen during one main loop iteration form a single
+     * undo step.  Steps can also be delimited explicitly with begin_step ()
+     * and end_step ().  Consecutive steps that change the same models within
+     * a short interval, as happens when a marker is dragged around the color
+     * wheel, are merged into one.
+     */
+    class History
+    {
+        public:
+            /// The default byte budget for the recorded changes (256 KiB)
+            static const std::size_t DEFAULT_MAX_BYTES;
+
+            /// The default merge interval in seconds
+            static const double DEFAULT_MERGE_INTERVAL;
+
+            typedef sigc::slot<void, int> SlotSetIndex;
+
+            History (std::size_t max_bytes = DEFAULT_MAX_BYTES);
+
+            /**
+             * Start recording the changes of @a model.  The history only
+             * keeps a weak reference to it, changes of models that have been
+             * destroyed are skipped when undoing.
+             *
+             * @return  An identifier for the model
+             */
+            unsigned int add_model (const boost::shared_ptr<ColorModel>& model);
+            void remove_model (const boost::shared_ptr<ColorModel>& model);
+
+            /**
+             * Register an integer value that is not a color.  Changes have to
+             * be reported with record_index (), @a setter is called to
+             * restore a value on undo or redo.
+             *
+             * @return  An identifier for the value
+             */
+            unsigned int add_index (const SlotSetIndex& setter);
+            void record_index (unsigned int id, int before, int after);
+
+            /**
+             * Group all changes until the matching end_step () into a single
+             * undo step.  Calls can be nested.
+             */
+            void begin_step ();
+            void end_step ();
+
+            bool can_undo () const;
+            bool can_redo () const;
+
+            /**
+             * Revert the most recent step
+             *
+             * @return  false if there was nothing to undo
+             */
+            bool undo ();
+            bool redo ();
+
+            /**
+             * Forget all recorded steps
+             */
+            void clear ();
+
+            /**
+             * Set the byte budget for the recorded changes.  If the current
+             * history doesn't fit, the oldest steps are discarded.
+             */
+            void set_max_bytes (std::size_t max_bytes);
+            std::size_t get_max_bytes () const;
+
+            /**
+             * Get the number of bytes used by the recorded changes
+             */
+            std::size_t get_size_bytes () const;
+
+            /**
+             * Set the maximum time in seconds between two steps that change
+             * the same values for them to be merged.  0.0 disables merging.
+             */
+            void set_merge_interval (double seconds);
+            double get_merge_interval () const;
+
+            /**
+             * Emitted when can_undo () or can_redo () may have changed
+             */
+            sigc::signal<void>& signal_changed () const;
+
+        private:
+            struct Priv;
+            boost::shared_ptr<Priv> m_priv;
+    };
+}
+
+#endif // __HISTORY_H
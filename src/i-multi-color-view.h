@@ -33,6 +33,11 @@ namespace agave
         public:
             virtual ~IMultiColorView() {}
             virtual void add_color (const boost::shared_ptr<ColorModel>& model, bool highlight) = 0;
+            /**
+             * Remove a color that was added with add_color ().  Colors that
+             * are not part of the view are ignored.
+             */
+            virtual void remove_color (const boost::shared_ptr<ColorModel>& model) = 0;
             virtual unsigned int get_num_colors () const = 0;
     };
 } // namespace agave
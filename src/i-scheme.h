@@ -21,6 +21,7 @@
 #ifndef __I_SCHEME_H
 #define __I_SCHEME_H
 
+#include <cstddef>
 #include <iostream>
 #include <vector>
 #include <boost/shared_ptr.hpp>
@@ -28,6 +29,16 @@
 
 namespace agave
 {
+    /**
+     * A color scheme derives a number of output colors from a base color.
+     *
+     * The get_*() functions return generators for the four outputs that are
+     * displayed around the base color, for use with ColorRelation.  Code
+     * that needs many generated colors (e.g. previews or palette searches)
+     * should use generate () or generate_batch () instead, which compute all
+     * outputs of a base color in one call on plain hsv_t values without any
+     * slot dispatch or Color allocation.
+     */
     class IScheme
     {
         public:
@@ -37,6 +48,38 @@ namespace agave
             virtual ColorRelation::SlotColorGen get_inner_left () const = 0;
             virtual ColorRelation::SlotColorGen get_inner_right () const = 0;
             virtual ColorRelation::SlotColorGen get_outer_right () const = 0;
+
+            /**
+             * The number of colors that generate () produces.  The outputs
+             * are ordered from left to right as displayed around the base
+             * color, so for the usual four outputs they are the colors of
+             * get_outer_left (), get_inner_left (), get_inner_right () and
+             * get_outer_right ().
+             */
+            virtual unsigned int get_num_outputs () const = 0;
+
+            /**
+             * Compute all outputs for @a base.  The results are in the range
+             * of clamp_hsv ().
+             *
+             * @param outputs  An array of get_num_outputs () colors
+             */
+            virtual void generate (const hsv_t& base, hsv_t* outputs) const = 0;
+
+            /**
+             * Compute all outputs for each of @a n base colors.  The outputs
+             * of base color i are stored at @a outputs + i *
+             * get_num_outputs ().
+             */
+            virtual void generate_batch (const hsv_t* bases, std::size_t n,
+                                         hsv_t* outputs) const
+            {
+                const unsigned int num_outputs = get_num_outputs ();
+                for (std::size_t i = 0; i < n; ++i)
+                {
+                    generate (bases[i], outputs + i * num_outputs);
+                }
+            }
     };
 }
 
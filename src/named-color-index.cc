@@ -0,0 +1,553 @@
+/*******************************************************************************
+ *
+ *  Copyright (c) 2008 Jonathon Jongsma
+ *
+ *  This file is part of Agave
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ *******************************************************************************/
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <glibmm/fileutils.h>
+#include <glibmm/miscutils.h>
+#include <glibmm-utils/exception.h>
+#include "named-color-index.h"
+#include "color-set.h"
+#include "color-string.h"
+#include "color-perceptual.h"
+
+namespace agave
+{
+    const std::size_t NamedColorIndex::NOT_FOUND =
+        std::numeric_limits<std::size_t>::max ();
+
+    NamedColorIndex* NamedColorIndex::s_instance = 0;
+
+    static const char GIMP_PALETTE_MAGIC[] = "GIMP Palette";
+
+    static inline bool is_space (char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v';
+    }
+
+    static inline const char* skip_space (const char* p, const char* end)
+    {
+        while (p != end && is_space (*p))
+            ++p;
+        return p;
+    }
+
+    static inline const char* trim_end (const char* begin, const char* end)
+    {
+        while (end != begin && is_space (*(end - 1)))
+            --end;
+        return end;
+    }
+
+    static inline bool has_suffix (const std::string& str, const char* suffix)
+    {
+        const std::size_t len = std::strlen (suffix);
+        return str.size () >= len &&
+            str.compare (str.size () - len, len, suffix) == 0;
+    }
+
+    // parses the next whitespace-delimited integer of a GIMP palette line
+    static bool parse_channel (const char*& p, const char* end, int& value)
+    {
+        p = skip_space (p, end);
+        if (p == end || *p < '0' || *p > '9')
+            return false;
+        value = 0;
+        for (; p != end && *p >= '0' && *p <= '9'; ++p)
+        {
+            value = value * 10 + (*p - '0');
+            if (value > 255)
+                return false;
+        }
+        return true;
+    }
+
+    static inline bool is_hex_digit (char c)
+    {
+        return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') ||
+            (c >= 'A' && c <= 'F');
+    }
+
+    // parses the color of a text palette line.  Hexstrings need the leading
+    // '#' here, since a bare one such as "cafe" may just as well be a word
+    // of the name.
+    static bool parse_color_token (const char* begin, const char* end,
+                                   rgb_t& color)
+    {
+        if (*begin != '#')
+        {
+            const char* p = begin;
+            while (p != end && is_hex_digit (*p))
+                ++p;
+            if (p == end)
+                return false;
+        }
+        return parse_color (begin, end, color);
+    }
+
+    struct NamedColorIndex::Priv
+    {
+        // a node of the k-d tree.  The tree is stored implicitly: the node
+        // for the range [lo, hi) of m_tree is at its midpoint, the left
+        // subtree is [lo, mid) and the right subtree [mid + 1, hi).
+        struct node_t
+        {
+            float coords[3];
+            unsigned int entry;
+            unsigned char axis;
+        };
+
+        // all names back to back, separated by nul characters, so that a
+        // large palette doesn't need one allocation per name
+        std::string m_names;
+        std::vector<std::size_t> m_name_offsets;
+        std::vector<rgb_t> m_colors;
+        std::vector<float> m_lab;   // l, a, b triplets
+
+        mutable std::vector<node_t> m_tree;
+        mutable bool m_tree_valid;
+
+        Priv () :
+            m_tree_valid (true)
+        {}
+
+        void add (const char* name, std::size_t name_len, const rgb_t& color)
+        {
+            m_name_offsets.push_back (m_names.size ());
+            m_names.append (name, name_len);
+            m_names.push_back ('\0');
+            m_colors.push_back (color);
+            const lab_t lab = rgb_to_lab (color);
+            m_lab.push_back (static_cast<float>(lab.l));
+            m_lab.push_back (static_cast<float>(lab.a));
+            m_lab.push_back (static_cast<float>(lab.b));
+            m_tree_valid = false;
+        }
+
+        bool add_name (const char* name, const char* name_end,
+                       const rgb_t& color)
+        {
+            name = skip_space (name, name_end);
+            name_end = trim_end (name, name_end);
+            if (name == name_end)
+            {
+                // unnamed colors are named after their value
+                char hex[HEXSTRING_MAX_LENGTH];
+                add (hex, format_hexstring (color, hex, sizeof (hex),
+                                            HEXSTRING_HASH), color);
+                return true;
+            }
+            if (!Glib::ustring (name, name_end).validate ())
+                return false;
+            add (name, name_end - name, color);
+            return true;
+        }
+
+        bool parse_gimp_line (const char* p, const char* end)
+        {
+            if (*p == '#' || (end - p >= 5 && std::strncmp (p, "Name:", 5) == 0)
+                || (end - p >= 8 && std::strncmp (p, "Columns:", 8) == 0))
+                return false;
+
+            int channels[3];
+            for (int i = 0; i < 3; ++i)
+            {
+                if (!parse_channel (p, end, channels[i]))
+                    return false;
+            }
+            rgb_t color = { channels[0] / 255.0, channels[1] / 255.0,
+                channels[2] / 255.0, 1.0 };
+            return add_name (p, end, color);
+        }
+
+        // "<color> <name>" or "<name> <color>".  A hexstring at the start
+        // is unambiguous, otherwise the last word is tried first, so that a
+        // name starting with a CSS color name ("Tan Leather #a0785a") keeps
+        // its own color.
+        bool parse_text_line (const char* p, const char* end)
+        {
+            if ((*p == '#' && (end - p == 1 || is_space (p[1]))) || *p == ';'
+                || (end - p >= 2 && p[0] == '/' && p[1] == '/'))
+                return false;
+
+            rgb_t color;
+            const char* token_end = p;
+            while (token_end != end && !is_space (*token_end))
+                ++token_end;
+            if (*p == '#' && parse_color_token (p, token_end, color))
+                return add_name (token_end, end, color);
+
+            const char* token = end;
+            while (token != p && !is_space (*(token - 1)))
+                --token;
+            if (token != p && parse_color_token (token, end, color))
+                return add_name (p, token, color);
+
+            if (parse_color_token (p, token_end, color))
+                return add_name (token_end, end, color);
+
+            return false;
+        }
+
+        std::size_t load_data (const char* begin, const char* end)
+        {
+            const std::size_t old_size = m_colors.size ();
+            const std::size_t magic_len = sizeof (GIMP_PALETTE_MAGIC) - 1;
+            const bool gimp = static_cast<std::size_t>(end - begin) >= magic_len
+                && std::strncmp (begin, GIMP_PALETTE_MAGIC, magic_len) == 0;
+
+            const char* p = begin;
+            bool first_line = true;
+            while (p != end)
+            {
+                const char* eol = static_cast<const char*>(
+                        std::memchr (p, '\n', end - p));
+                const char* line_end = trim_end (p, eol ? eol : end);
+                const char* line = skip_space (p, line_end);
+                if (line != line_end && !(gimp && first_line))
+                {
+                    if (gimp)
+                        parse_gimp_line (line, line_end);
+                    else
+                        parse_text_line (line, line_end);
+                }
+                first_line = false;
+                p = eol ? eol + 1 : end;
+            }
+            return m_colors.size () - old_size;
+        }
+
+        void build_tree (std::size_t lo, std::size_t hi) const
+        {
+            if (hi - lo < 2)
+            {
+                if (hi > lo)
+                    m_tree[lo].axis = 0;
+                return;
+            }
+
+            // split along the axis with the largest extent
+            float min[3], max[3];
+            for (int i = 0; i < 3; ++i)
+                min[i] = max[i] = m_tree[lo].coords[i];
+            for (std::size_t n = lo + 1; n < hi; ++n)
+            {
+                for (int i = 0; i < 3; ++i)
+                {
+                    min[i] = std::min (min[i], m_tree[n].coords[i]);
+                    max[i] = std::max (max[i], m_tree[n].coords[i]);
+                }
+            }
+            unsigned char axis = 0;
+            for (unsigned char i = 1; i < 3; ++i)
+            {
+                if (max[i] - min[i] > max[axis] - min[axis])
+                    axis = i;
+            }
+
+            const std::size_t mid = lo + (hi - lo) / 2;
+            std::nth_element (m_tree.begin () + lo, m_tree.begin () + mid,
+                              m_tree.begin () + hi, AxisLess (axis));
+            m_tree[mid].axis = axis;
+            build_tree (lo, mid);
+            build_tree (mid + 1, hi);
+        }
+
+        struct AxisLess
+        {
+            unsigned char axis;
+            explicit AxisLess (unsigned char a) : axis (a) {}
+            bool operator() (const node_t& lhs, const node_t& rhs) const
+            {
+                return lhs.coords[axis] < rhs.coords[axis];
+            }
+        };
+
+        void ensure_tree () const
+        {
+            if (m_tree_valid)
+                return;
+            m_tree.resize (m_colors.size ());
+            for (std::size_t i = 0; i < m_tree.size (); ++i)
+            {
+                m_tree[i].coords[0] = m_lab[3 * i];
+                m_tree[i].coords[1] = m_lab[3 * i + 1];
+                m_tree[i].coords[2] = m_lab[3 * i + 2];
+                m_tree[i].entry = static_cast<unsigned int>(i);
+            }
+            build_tree (0, m_tree.size ());
+            m_tree_valid = true;
+        }
+
+        void search (std::size_t lo, std::size_t hi, const float* query,
+                     float& best_d2, unsigned int& best) const
+        {
+            while (lo < hi)
+            {
+                const std::size_t mid = lo + (hi - lo) / 2;
+                const node_t& node = m_tree[mid];
+
+                const float dl = node.coords[0] - query[0];
+                const float da = node.coords[1] - query[1];
+                const float db = node.coords[2] - query[2];
+                const float d2 = dl * dl + da * da + db * db;
+                if (d2 < best_d2 || (d2 == best_d2 && node.entry < best))
+                {
+                    best_d2 = d2;
+                    best = node.entry;
+                }
+
+                // descend into the side of the split that contains the query
+                // first, and only visit the other side if the splitting plane
+                // is closer than the best match so far
+                const float diff = query[node.axis] - node.coords[node.axis];
+                std::size_t near_lo = lo, near_hi = mid;
+                std::size_t far_lo = mid + 1, far_hi = hi;
+                if (diff >= 0.0f)
+                {
+                    std::swap (near_lo, far_lo);
+                    std::swap (near_hi, far_hi);
+                }
+                search (near_lo, near_hi, query, best_d2, best);
+                if (diff * diff > best_d2)
+                    return;
+                // tail call for the far side
+                lo = far_lo;
+                hi = far_hi;
+            }
+        }
+
+        std::size_t find_nearest (float l, float a, float b,
+                                  float* distance) const
+        {
+            ensure_tree ();
+            if (m_tree.empty ())
+                return NOT_FOUND;
+
+            const float query[3] = { l, a, b };
+            float best_d2 = std::numeric_limits<float>::max ();
+            unsigned int best = std::numeric_limits<unsigned int>::max ();
+            search (0, m_tree.size (), query, best_d2, best);
+            if (distance)
+                *distance = std::sqrt (best_d2);
+            return best;
+        }
+    };
+
+    NamedColorIndex::NamedColorIndex () :
+        m_priv (new Priv ())
+    {
+        THROW_IF_FAIL (m_priv);
+    }
+
+    NamedColorIndex& NamedColorIndex::instance ()
+    {
+        if (!s_instance)
+        {
+            s_instance = new NamedColorIndex ();
+            s_instance->add_css_colors ();
+#ifdef AGAVE_PALETTEDIR
+            s_instance->load_directory (AGAVE_PALETTEDIR);
+#endif
+            s_instance->load_directory (Glib::build_filename
+                    (Glib::get_user_data_dir (), "agave2", "palettes"));
+        }
+        return *s_instance;
+    }
+
+    void NamedColorIndex::add (const Glib::ustring& name, const rgb_t& color)
+    {
+        THROW_IF_FAIL (m_priv);
+        m_priv->add (name.data (), name.bytes (), color);
+    }
+
+    std::size_t NamedColorIndex::add_css_colors ()
+    {
+        THROW_IF_FAIL (m_priv);
+        rgb_t color;
+        std::size_t i = 0;
+        for (const char* name; (name = get_css_color (i, color)); ++i)
+        {
+            m_priv->add (name, std::strlen (name), color);
+        }
+        return i;
+    }
+
+    std::size_t NamedColorIndex::load_file (const std::string& filename)
+    {
+        THROW_IF_FAIL (m_priv);
+        try
+        {
+            const std::string contents = Glib::file_get_contents (filename);
+            return load_data (contents.data (),
+                              contents.data () + contents.size ());
+        }
+        catch (const Glib::FileError& exception)
+        {
+            std::cerr << Glib::ustring::compose ("Couldn't load palette %1: %2",
+                    filename, exception.what ())
+                << std::endl;
+        }
+        return 0;
+    }
+
+    std::size_t NamedColorIndex::load_directory (const std::string& dirname)
+    {
+        THROW_IF_FAIL (m_priv);
+        if (!Glib::file_test (dirname, Glib::FILE_TEST_IS_DIR))
+            return 0;
+
+        std::size_t count = 0;
+        try
+        {
+            // sort the file names so that the order of the index (and thus
+            // which of two equally close colors wins) is reproducible
+            std::vector<std::string> filenames;
+            Glib::Dir dir (dirname);
+            for (std::string name = dir.read_name (); !name.empty ();
+                 name = dir.read_name ())
+            {
+                if (has_suffix (name, ".gpl") || has_suffix (name, ".txt"))
+                    filenames.push_back (name);
+            }
+            std::sort (filenames.begin (), filenames.end ());
+
+            for (std::vector<std::string>::const_iterator iter = filenames.begin ();
+                 iter != filenames.end (); ++iter)
+            {
+                count += load_file (Glib::build_filename (dirname, *iter));
+            }
+        }
+        catch (const Glib::FileError& exception)
+        {
+            std::cerr << Glib::ustring::compose ("Couldn't read directory %1: %2",
+                    dirname, exception.what ())
+                << std::endl;
+        }
+        return count;
+    }
+
+    std::size_t NamedColorIndex::load_data (const char* begin, const char* end)
+    {
+        THROW_IF_FAIL (m_priv);
+        return m_priv->load_data (begin, end);
+    }
+
+    void NamedColorIndex::clear ()
+    {
+        THROW_IF_FAIL (m_priv);
+        m_priv.reset (new Priv ());
+    }
+
+    std::size_t NamedColorIndex::size () const
+    {
+        THROW_IF_FAIL (m_priv);
+        return m_priv->m_colors.size ();
+    }
+
+    bool NamedColorIndex::empty () const
+    {
+        THROW_IF_FAIL (m_priv);
+        return m_priv->m_colors.empty ();
+    }
+
+    Glib::ustring NamedColorIndex::get_name (std::size_t index) const
+    {
+        THROW_IF_FAIL (m_priv);
+        THROW_IF_FAIL (index < m_priv->m_name_offsets.size ());
+        return Glib::ustring (m_priv->m_names.c_str () +
+                              m_priv->m_name_offsets[index]);
+    }
+
+    rgb_t NamedColorIndex::get_color (std::size_t index) const
+    {
+        THROW_IF_FAIL (m_priv);
+        THROW_IF_FAIL (index < m_priv->m_colors.size ());
+        return m_priv->m_colors[index];
+    }
+
+    std::size_t NamedColorIndex::find_nearest (const rgb_t& color,
+                                               double* distance) const
+    {
+        THROW_IF_FAIL (m_priv);
+        const lab_t lab = rgb_to_lab (color);
+        float d;
+        std::size_t index = m_priv->find_nearest (static_cast<float>(lab.l),
+                                                  static_cast<float>(lab.a),
+                                                  static_cast<float>(lab.b),
+                                                  &d);
+        if (distance)
+            *distance = d;
+        return index;
+    }
+
+    void NamedColorIndex::find_nearest (const float* l, const float* a,
+                                        const float* b, std::size_t n,
+                                        std::size_t* indices,
+                                        float* distances) const
+    {
+        THROW_IF_FAIL (m_priv);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            indices[i] = m_priv->find_nearest (l[i], a[i], b[i],
+                                               distances ? distances + i : 0);
+        }
+    }
+
+    Glib::ustring NamedColorIndex::nearest_name (const Color& color) const
+    {
+        std::size_t index = find_nearest (color.as_rgb ());
+        if (index == NOT_FOUND)
+            return Glib::ustring ();
+        return get_name (index);
+    }
+
+    std::vector<Glib::ustring>
+    NamedColorIndex::nearest_names (const ColorSet& set) const
+    {
+        std::vector<float> r, g, b;
+        for (ColorSet::const_iterator iter = set.begin ();
+             iter != set.end (); ++iter)
+        {
+            r.push_back (static_cast<float>(iter->get_red ()));
+            g.push_back (static_cast<float>(iter->get_green ()));
+            b.push_back (static_cast<float>(iter->get_blue ()));
+        }
+
+        const std::size_t n = r.size ();
+        std::vector<Glib::ustring> names (n);
+        if (n == 0)
+            return names;
+
+        // convert in place, r/g/b become l/a/b
+        batch_rgb_to_lab (&r[0], &g[0], &b[0], &r[0], &g[0], &b[0], n);
+        std::vector<std::size_t> indices (n);
+        find_nearest (&r[0], &g[0], &b[0], n, &indices[0]);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            if (indices[i] != NOT_FOUND)
+                names[i] = get_name (indices[i]);
+        }
+        return names;
+    }
+}
@@ -0,0 +1,153 @@
+/*******************************************************************************
+ *
+ *  Copyright (c) 2008 Jonathon Jongsma
+ *
+ *  This file is part of Agave
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ *******************************************************************************/
+#ifndef __NAMED_COLOR_INDEX_H
+#define __NAMED_COLOR_INDEX_H
+
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <glibmm/ustring.h>
+#include "color.h"
+
+namespace agave
+{
+    class ColorSet;
+
+    /**
+     * A searchable collection of named reference colors (e.g. brand colors
+     * or a paint vendor's color table).
+     *
+     * The colors are kept in a k-d tree in CIELAB space, so looking up the
+     * closest named color (by CIE76 delta E) takes logarithmic time even for
+     * palettes with tens of thousands of entries.  The tree is rebuilt lazily
+     * on the first lookup after colors were added.
+     *
+     * Palette files can be in the GIMP palette format (.gpl) or a simple
+     * text format with one color per line, consisting of a hexstring or CSS
+     * color name and the name of the color, in either order:
+     * \code
+     * #c8102e Signal Red
+     * Ocean Blue #005eb8
+     * \endcode
+     * The hexstrings need the leading '#' in this format.  If neither end
+     * of the line is a hexstring, a CSS color name at the end of the line
+     * is preferred over one at the start.
+     * Empty lines and lines starting with '#' followed by a space, '//' or
+     * ';' are ignored.
+     */
+    class NamedColorIndex
+    {
+        public:
+            /**
+             * Returned by find_nearest () if the index is empty
+             */
+            static const std::size_t NOT_FOUND;
+
+            NamedColorIndex ();
+
+            /**
+             * Get the shared index used by the widgets.  On first use it is
+             * filled with the CSS named colors and the palettes found in the
+             * system palette directory and in the user's palette directory
+             * ($XDG_DATA_HOME/agave2/palettes).
+             */
+            static NamedColorIndex& instance ();
+
+            void add (const Glib::ustring& name, const rgb_t& color);
+
+            /**
+             * Add the CSS named colors
+             *
+             * @return  The number of colors added
+             */
+            std::size_t add_css_colors ();
+
+            /**
+             * Add the colors from a palette file.  Errors are reported on
+             * stderr.
+             *
+             * @return  The number of colors added
+             */
+            std::size_t load_file (const std::string& filename);
+
+            /**
+             * Add the colors from all palette files (*.gpl and *.txt) in a
+             * directory.  A missing directory is not an error.
+             *
+             * @return  The number of colors added
+             */
+            std::size_t load_directory (const std::string& dirname);
+
+            /**
+             * Add the colors from a palette that has been read into memory
+             *
+             * @return  The number of colors added
+             */
+            std::size_t load_data (const char* begin, const char* end);
+
+            void clear ();
+            std::size_t size () const;
+            bool empty () const;
+
+            Glib::ustring get_name (std::size_t index) const;
+            rgb_t get_color (std::size_t index) const;
+
+            /**
+             * Find the named color closest to @a color
+             *
+             * @param distance  If non-NULL, receives the CIE76 delta E between
+             * @a color and the match
+             * @return  The index of the closest color, or NOT_FOUND
+             */
+            std::size_t find_nearest (const rgb_t& color,
+                                      double* distance = 0) const;
+
+            /**
+             * Find the closest named color for each of @a n colors given as
+             * planar CIELAB arrays (see batch_rgb_to_lab ())
+             *
+             * @param indices  Receives the index of each match, or NOT_FOUND
+             * @param distances  If non-NULL, receives the delta E of each match
+             */
+            void find_nearest (const float* l, const float* a, const float* b,
+                               std::size_t n, std::size_t* indices,
+                               float* distances = 0) const;
+
+            /**
+             * Get the name of the closest named color, or an empty string if
+             * the index is empty
+             */
+            Glib::ustring nearest_name (const Color& color) const;
+
+            /**
+             * Get the name of the closest named color for every color of
+             * @a set, in the order of the set
+             */
+            std::vector<Glib::ustring> nearest_names (const ColorSet& set) const;
+
+        private:
+            struct Priv;
+            boost::shared_ptr<Priv> m_priv;
+            static NamedColorIndex* s_instance;
+    };
+}
+
+#endif // __NAMED_COLOR_INDEX_H
@@ -0,0 +1,707 @@
+/*******************************************************************************
+ *
+ *  Copyright (c) 2008 Jonathon Jongsma
+ *
+ *  This file is part of Agave
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ *******************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <iostream>
+#include <queue>
+#include <glibmm/thread.h>
+#include <glibmm-utils/exception.h>
+#include "palette-index.h"
+#include "color-perceptual.h"
+
+namespace agave
+{
+    /// \name Graph parameters
+    /// @{
+    /// the number of links per node and level (twice that on level 0)
+    static const std::size_t MAX_LINKS = 16;
+    static const std::size_t CONSTRUCTION_CANDIDATES = 100;
+    /// the number of candidates that a search keeps track of
+    static const std::size_t SEARCH_CANDIDATES = 64;
+    static const unsigned int MAX_LEVEL = 15;
+    /// indexes up to this size are searched without the graph
+    static const std::size_t EXHAUSTIVE_SEARCH_SIZE = 1024;
+    /// @}
+
+    static const guint32 NO_NODE = G_MAXUINT32;
+    /// palettes up to this size are compared without allocating memory
+    static const std::size_t STACK_COLORS = 32;
+
+    /**
+     * Convert colors to an array of OKLab triples
+     */
+    static void to_oklab (const rgb_t* colors, std::size_t n,
+                          std::vector<float>& labs)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            const oklab_t lab = rgb_to_oklab (colors[i]);
+            labs.push_back (lab.l);
+            labs.push_back (lab.a);
+            labs.push_back (lab.b);
+        }
+    }
+
+    /**
+     * The chamfer distance between two arrays of OKLab triples
+     */
+    static double chamfer_distance (const float* first, std::size_t n_first,
+                                    const float* second, std::size_t n_second)
+    {
+        if (!n_first || !n_second)
+        {
+            return (n_first == n_second) ? 0.0 :
+                std::numeric_limits<double>::infinity ();
+        }
+        // the closest distance from each color of the second palette.  This
+        // is called for every node that a search visits, so avoid allocating
+        // memory for the usual palette sizes.
+        float buffer[STACK_COLORS];
+        std::vector<float> heap_buffer;
+        float* second_min = buffer;
+        if (n_second > STACK_COLORS)
+        {
+            heap_buffer.resize (n_second);
+            second_min = &heap_buffer[0];
+        }
+        std::fill (second_min, second_min + n_second,
+                   std::numeric_limits<float>::max ());
+        float first_sum = 0.0f;
+        for (std::size_t i = 0; i < n_first; ++i)
+        {
+            const float* a = first + 3 * i;
+            float first_min = std::numeric_limits<float>::max ();
+            for (std::size_t j = 0; j < n_second; ++j)
+            {
+                const float* b = second + 3 * j;
+                const float dl = a[0] - b[0];
+                const float da = a[1] - b[1];
+                const float db = a[2] - b[2];
+                const float d = dl * dl + da * da + db * db;
+                first_min = std::min (first_min, d);
+                second_min[j] = std::min (second_min[j], d);
+            }
+            first_sum += std::sqrt (first_min);
+        }
+        float second_sum = 0.0f;
+        for (std::size_t j = 0; j < n_second; ++j)
+        {
+            second_sum += std::sqrt (second_min[j]);
+        }
+        return 0.5 * (first_sum / n_first + second_sum / n_second);
+    }
+
+    double palette_distance (const rgb_t* first, std::size_t n_first,
+                             const rgb_t* second, std::size_t n_second)
+    {
+        std::vector<float> first_labs, second_labs;
+        to_oklab (first, n_first, first_labs);
+        to_oklab (second, n_second, second_labs);
+        return chamfer_distance (n_first ? &first_labs[0] : 0, n_first,
+                                 n_second ? &second_labs[0] : 0, n_second);
+    }
+
+    /**
+     * The OKLab triples of a palette
+     */
+    struct palette_t
+    {
+        const float* labs;
+        std::size_t size;
+    };
+
+    static inline float distance (const palette_t& first,
+                                  const palette_t& second)
+    {
+        return chamfer_distance (first.labs, first.size,
+                                 second.labs, second.size);
+    }
+
+    /// a node and its distance to the query
+    typedef std::pair<float, guint32> candidate_t;
+    /// closest candidate on top
+    typedef std::priority_queue<candidate_t, std::vector<candidate_t>,
+                                std::greater<candidate_t> > closest_first_t;
+    /// farthest candidate on top
+    typedef std::priority_queue<candidate_t> farthest_first_t;
+
+    struct PaletteIndex::Priv
+    {
+        struct node_t
+        {
+            guint32 item;
+            bool deleted;
+            /// the neighbors on each level the node is on
+            std::vector<std::vector<guint32> > links;
+        };
+
+        /// \name Nodes
+        /// Nodes are only appended, a changed palette gets a new node.
+        /// @{
+        std::vector<node_t> m_nodes;
+        /// the OKLab triples of all nodes
+        std::vector<float> m_labs;
+        /// the first triple of each node, plus the end
+        std::vector<std::size_t> m_lab_offsets;
+        /// @}
+
+        std::vector<guint32> m_item_nodes;
+        std::size_t m_num_live;
+        std::size_t m_num_deleted;
+
+        /// \name Graph
+        /// @{
+        /// the nodes before this one are in the graph
+        guint32 m_num_linked;
+        guint32 m_entry;
+        unsigned int m_max_level;
+        guint64 m_random;
+        /// the search marks visited nodes with the current tag
+        std::vector<guint32> m_visited;
+        guint32 m_visit_tag;
+        /// @}
+
+        /// \name Background linking
+        /// The builder thread inserts the new nodes into the graph one at a
+        /// time, so a search never waits long for the lock.
+        /// @{
+        Glib::Mutex m_mutex;
+        Glib::Thread* m_builder;
+        bool m_building;
+        bool m_stop_building;
+        /// @}
+
+        Priv () :
+            m_lab_offsets (1, 0),
+            m_num_live (0),
+            m_num_deleted (0),
+            m_num_linked (0),
+            m_entry (NO_NODE),
+            m_max_level (0),
+            m_random (G_GUINT64_CONSTANT (0x9e3779b97f4a7c15)),
+            m_visit_tag (0),
+            m_builder (0),
+            m_building (false),
+            m_stop_building (false)
+        {}
+
+        ~Priv ()
+        {
+            {
+                Glib::Mutex::Lock lock (m_mutex);
+                m_stop_building = true;
+            }
+            if (m_builder)
+            {
+                m_builder->join ();
+            }
+        }
+
+        palette_t get_palette (guint32 node) const
+        {
+            palette_t palette;
+            palette.labs = &m_labs[3 * m_lab_offsets[node]];
+            palette.size = m_lab_offsets[node + 1] - m_lab_offsets[node];
+            return palette;
+        }
+
+        /**
+         * Pick the highest level of a new node, with an exponentially
+         * decreasing probability for each level
+         */
+        unsigned int random_level ()
+        {
+            // xorshift64*
+            m_random ^= m_random >> 12;
+            m_random ^= m_random << 25;
+            m_random ^= m_random >> 27;
+            const guint64 bits =
+                (m_random * G_GUINT64_CONSTANT (0x2545f4914f6cdd1d)) >> 11;
+            // uniform in (0, 1]
+            const double uniform = (bits + 1.0) / 9007199254740992.0;
+            const double level = -std::log (uniform) / std::log (double (MAX_LINKS));
+            return std::min (static_cast<unsigned int> (level), MAX_LEVEL);
+        }
+
+        void add_node (guint32 item, const float* labs, std::size_t n)
+        {
+            node_t node;
+            node.item = item;
+            node.deleted = false;
+            m_nodes.push_back (node);
+            m_labs.insert (m_labs.end (), labs, labs + 3 * n);
+            m_lab_offsets.push_back (m_labs.size () / 3);
+            ++m_num_live;
+        }
+
+        void delete_node (guint32 node)
+        {
+            m_nodes[node].deleted = true;
+            --m_num_live;
+            ++m_num_deleted;
+        }
+
+        /**
+         * Drop the deleted nodes and the graph once the deleted nodes
+         * outnumber the live ones.  The graph is built again from scratch.
+         */
+        void compact_if_needed ()
+        {
+            if (m_num_deleted <= m_num_live ||
+                m_num_deleted <= EXHAUSTIVE_SEARCH_SIZE)
+            {
+                return;
+            }
+            std::vector<node_t> nodes;
+            std::vector<float> labs;
+            std::vector<std::size_t> lab_offsets (1, 0);
+            nodes.reserve (m_num_live);
+            for (guint32 node = 0; node < m_nodes.size (); ++node)
+            {
+                if (m_nodes[node].deleted)
+                {
+                    continue;
+                }
+                const palette_t palette = get_palette (node);
+                m_item_nodes[m_nodes[node].item] = nodes.size ();
+                node_t compacted;
+                compacted.item = m_nodes[node].item;
+                compacted.deleted = false;
+                nodes.push_back (compacted);
+                labs.insert (labs.end (), palette.labs,
+                             palette.labs + 3 * palette.size);
+                lab_offsets.push_back (labs.size () / 3);
+            }
+            m_nodes.swap (nodes);
+            m_labs.swap (labs);
+            m_lab_offsets.swap (lab_offsets);
+            m_num_deleted = 0;
+            m_num_linked = 0;
+            m_entry = NO_NODE;
+            m_max_level = 0;
+        }
+
+        /**
+         * Move to the neighbor closest to @a query on @a level until there
+         * is no closer one
+         */
+        guint32 search_greedy (const palette_t& query, guint32 node,
+                               unsigned int level) const
+        {
+            float node_distance = distance (query, get_palette (node));
+            bool changed = true;
+            while (changed)
+            {
+                changed = false;
+                const std::vector<guint32>& links = m_nodes[node].links[level];
+                for (std::vector<guint32>::const_iterator iter = links.begin ();
+                     iter != links.end (); ++iter)
+                {
+                    const float d = distance (query, get_palette (*iter));
+                    if (d < node_distance)
+                    {
+                        node_distance = d;
+                        node = *iter;
+                        changed = true;
+                    }
+                }
+            }
+            return node;
+        }
+
+        /**
+         * Find the @a ef nodes closest to @a query on @a level, starting at
+         * @a entry
+         *
+         * @param live_only  Leave deleted nodes out of the result.  They
+         * are still followed.
+         * @param result  Receives the nodes, closest first
+         */
+        void search_level (const palette_t& query, guint32 entry,
+                           std::size_t ef, unsigned int level, bool live_only,
+                           std::vector<candidate_t>& result)
+        {
+            if (m_visited.size () < m_nodes.size ())
+            {
+                m_visited.resize (m_nodes.size (), 0);
+            }
+            if (++m_visit_tag == 0)
+            {
+                std::fill (m_visited.begin (), m_visited.end (), 0);
+                m_visit_tag = 1;
+            }
+
+            closest_first_t candidates;
+            farthest_first_t found;
+            const candidate_t start (distance (query, get_palette (entry)),
+                                     entry);
+            candidates.push (start);
+            if (!live_only || !m_nodes[entry].deleted)
+            {
+                found.push (start);
+            }
+            m_visited[entry] = m_visit_tag;
+
+            while (!candidates.empty ())
+            {
+                const candidate_t current = candidates.top ();
+                if (found.size () >= ef && current.first > found.top ().first)
+                {
+                    break;
+                }
+                candidates.pop ();
+                const std::vector<guint32>& links =
+                    m_nodes[current.second].links[level];
+                for (std::vector<guint32>::const_iterator iter = links.begin ();
+                     iter != links.end (); ++iter)
+                {
+                    if (m_visited[*iter] == m_visit_tag)
+                    {
+                        continue;
+                    }
+                    m_visited[*iter] = m_visit_tag;
+                    const float d = distance (query, get_palette (*iter));
+                    if (found.size () < ef || d < found.top ().first)
+                    {
+                        candidates.push (candidate_t (d, *iter));
+                        if (!live_only || !m_nodes[*iter].deleted)
+                        {
+                            found.push (candidate_t (d, *iter));
+                            if (found.size () > ef)
+                            {
+                                found.pop ();
+                            }
+                        }
+                    }
+                }
+            }
+
+            result.resize (found.size ());
+            for (std::size_t i = found.size (); i > 0; --i)
+            {
+                result[i - 1] = found.top ();
+                found.pop ();
+            }
+        }
+
+        /**
+         * Choose up to @a max_links neighbors from @a candidates (closest
+         * first).  A candidate is skipped if it is closer to a neighbor that
+         * was already chosen than to the node, so that the links point in
+         * different directions.
+         */
+        void select_neighbors (const std::vector<candidate_t>& candidates,
+                               std::size_t max_links,
+                               std::vector<guint32>& neighbors) const
+        {
+            neighbors.clear ();
+            for (std::vector<candidate_t>::const_iterator iter = candidates.begin ();
+                 iter != candidates.end () && neighbors.size () < max_links;
+                 ++iter)
+            {
+                const palette_t palette = get_palette (iter->second);
+                bool diverse = true;
+                for (std::vector<guint32>::const_iterator neighbor = neighbors.begin ();
+                     neighbor != neighbors.end () && diverse; ++neighbor)
+                {
+                    diverse = distance (palette, get_palette (*neighbor)) >=
+                        iter->first;
+                }
+                if (diverse)
+                {
+                    neighbors.push_back (iter->second);
+                }
+            }
+        }
+
+        void link (guint32 node)
+        {
+            const unsigned int level = random_level ();
+            m_nodes[node].links.resize (level + 1);
+            if (m_entry == NO_NODE)
+            {
+                m_entry = node;
+                m_max_level = level;
+                return;
+            }
+
+            const palette_t query = get_palette (node);
+            guint32 entry = m_entry;
+            for (unsigned int l = m_max_level; l > level; --l)
+            {
+                entry = search_greedy (query, entry, l);
+            }
+
+            std::vector<candidate_t> candidates;
+            std::vector<candidate_t> neighbor_candidates;
+            for (int l = std::min (level, m_max_level); l >= 0; --l)
+            {
+                search_level (query, entry, CONSTRUCTION_CANDIDATES, l, false,
+                              candidates);
+                const std::size_t max_links = (l == 0) ? 2 * MAX_LINKS : MAX_LINKS;
+                std::vector<guint32>& links = m_nodes[node].links[l];
+                select_neighbors (candidates, MAX_LINKS, links);
+
+                // link back, pruning the neighbors that have too many links
+                for (std::vector<guint32>::const_iterator iter = links.begin ();
+                     iter != links.end (); ++iter)
+                {
+                    std::vector<guint32>& neighbor_links = m_nodes[*iter].links[l];
+                    neighbor_links.push_back (node);
+                    if (neighbor_links.size () <= max_links)
+                    {
+                        continue;
+                    }
+                    const palette_t palette = get_palette (*iter);
+                    neighbor_candidates.clear ();
+                    for (std::vector<guint32>::const_iterator link = neighbor_links.begin ();
+                         link != neighbor_links.end (); ++link)
+                    {
+                        neighbor_candidates.push_back (candidate_t (
+                                    distance (palette, get_palette (*link)),
+                                    *link));
+                    }
+                    std::sort (neighbor_candidates.begin (), neighbor_candidates.end ());
+                    select_neighbors (neighbor_candidates, max_links, neighbor_links);
+                }
+                entry = candidates.front ().second;
+            }
+
+            if (level > m_max_level)
+            {
+                m_entry = node;
+                m_max_level = level;
+            }
+        }
+
+        /**
+         * Small indexes are searched without the graph
+         */
+        bool is_small () const
+        {
+            return m_nodes.size () <= EXHAUSTIVE_SEARCH_SIZE;
+        }
+
+        /**
+         * Start inserting the nodes that aren't in the graph yet.  Without
+         * threads, they are inserted by the next search.  Called with the
+         * lock held.
+         */
+        void start_building ()
+        {
+            if (m_building || is_small () || m_num_linked == m_nodes.size () ||
+                !Glib::thread_supported ())
+            {
+                return;
+            }
+            if (m_builder)
+            {
+                // the previous run has finished
+                m_builder->join ();
+                m_builder = 0;
+            }
+            try
+            {
+                m_builder = Glib::Thread::create (sigc::mem_fun (this,
+                            &Priv::build), true);
+                m_building = true;
+            }
+            catch (const Glib::ThreadError& error)
+            {
+                std::cerr << Glib::ustring::compose (
+                        "Couldn't start palette index thread: %1", error.what ())
+                    << std::endl;
+            }
+        }
+
+        /**
+         * Runs in the builder thread
+         */
+        void build ()
+        {
+            for (;;)
+            {
+                {
+                    Glib::Mutex::Lock lock (m_mutex);
+                    if (m_stop_building || m_num_linked == m_nodes.size ())
+                    {
+                        m_building = false;
+                        return;
+                    }
+                    link (m_num_linked++);
+                }
+                // let a waiting search have the lock
+                Glib::Thread::yield ();
+            }
+        }
+
+        /**
+         * Find the live nodes closest to @a query.  The nodes that aren't
+         * in the graph yet are compared with the query one by one.
+         */
+        void search (const palette_t& query, std::size_t ef,
+                     std::vector<candidate_t>& result)
+        {
+            if (!m_building && !is_small ())
+            {
+                // no threads
+                for (; m_num_linked < m_nodes.size (); ++m_num_linked)
+                {
+                    link (m_num_linked);
+                }
+            }
+
+            result.clear ();
+            guint32 first_unlinked = 0;
+            if (!is_small () && m_entry != NO_NODE)
+            {
+                guint32 entry = m_entry;
+                for (unsigned int level = m_max_level; level > 0; --level)
+                {
+                    entry = search_greedy (query, entry, level);
+                }
+                search_level (query, entry, ef, 0, true, result);
+                first_unlinked = m_num_linked;
+            }
+            for (guint32 node = first_unlinked; node < m_nodes.size (); ++node)
+            {
+                if (!m_nodes[node].deleted)
+                {
+                    result.push_back (candidate_t (
+                                distance (query, get_palette (node)), node));
+                }
+            }
+        }
+    };
+
+    /**
+     * Orders matches by distance, then by item
+     */
+    static bool closer (const PaletteIndex::Match& first,
+                        const PaletteIndex::Match& second)
+    {
+        return first.distance < second.distance ||
+            (first.distance == second.distance && first.item < second.item);
+    }
+
+    PaletteIndex::PaletteIndex () :
+        m_priv (new Priv ())
+    {
+        THROW_IF_FAIL (m_priv);
+    }
+
+    void PaletteIndex::set_palette (guint32 item, const rgb_t* colors,
+                                    std::size_t n)
+    {
+        THROW_IF_FAIL (m_priv);
+        std::vector<float> labs;
+        to_oklab (colors, n, labs);
+        Glib::Mutex::Lock lock (m_priv->m_mutex);
+        if (item >= m_priv->m_item_nodes.size ())
+        {
+            m_priv->m_item_nodes.resize (item + 1, NO_NODE);
+        }
+        guint32& node = m_priv->m_item_nodes[item];
+        if (node != NO_NODE)
+        {
+            const palette_t old_palette = m_priv->get_palette (node);
+            if (old_palette.size == n &&
+                std::equal (labs.begin (), labs.end (), old_palette.labs))
+            {
+                return;
+            }
+            m_priv->delete_node (node);
+            node = NO_NODE;
+        }
+        // a palette without colors isn't similar to anything
+        if (n)
+        {
+            node = m_priv->m_nodes.size ();
+            m_priv->add_node (item, &labs[0], n);
+        }
+        m_priv->compact_if_needed ();
+        m_priv->start_building ();
+    }
+
+    void PaletteIndex::remove (guint32 item)
+    {
+        THROW_IF_FAIL (m_priv);
+        Glib::Mutex::Lock lock (m_priv->m_mutex);
+        if (item < m_priv->m_item_nodes.size () &&
+            m_priv->m_item_nodes[item] != NO_NODE)
+        {
+            m_priv->delete_node (m_priv->m_item_nodes[item]);
+            m_priv->m_item_nodes[item] = NO_NODE;
+            m_priv->compact_if_needed ();
+            m_priv->start_building ();
+        }
+    }
+
+    void PaletteIndex::clear ()
+    {
+        THROW_IF_FAIL (m_priv);
+        m_priv.reset (new Priv ());
+    }
+
+    std::size_t PaletteIndex::size () const
+    {
+        THROW_IF_FAIL (m_priv);
+        Glib::Mutex::Lock lock (m_priv->m_mutex);
+        return m_priv->m_num_live;
+    }
+
+    std::size_t PaletteIndex::find_nearest (const rgb_t* colors, std::size_t n,
+                                            std::size_t k,
+                                            std::vector<Match>& matches) const
+    {
+        THROW_IF_FAIL (m_priv);
+        matches.clear ();
+        if (!n || !k)
+        {
+            return 0;
+        }
+        std::vector<float> labs;
+        to_oklab (colors, n, labs);
+        palette_t query;
+        query.labs = &labs[0];
+        query.size = n;
+
+        Glib::Mutex::Lock lock (m_priv->m_mutex);
+        std::vector<candidate_t> candidates;
+        m_priv->search (query, std::max (k, SEARCH_CANDIDATES), candidates);
+
+        for (std::vector<candidate_t>::const_iterator iter = candidates.begin ();
+             iter != candidates.end (); ++iter)
+        {
+            Match match;
+            match.item = m_priv->m_nodes[iter->second].item;
+            match.distance = iter->first;
+            matches.push_back (match);
+        }
+        const std::size_t num_matches = std::min (k, matches.size ());
+        std::partial_sort (matches.begin (), matches.begin () + num_matches,
+                           matches.end (), closer);
+        matches.resize (num_matches);
+        return num_matches;
+    }
+}
@@ -0,0 +1,100 @@
+/*******************************************************************************
+ *
+ *  Copyright (c) 2008 Jonathon Jongsma
+ *
+ *  This file is part of Agave
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ *******************************************************************************/
+#ifndef __PALETTE_INDEX_H
+#define __PALETTE_INDEX_H
+
+#include <cstddef>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <glib/gtypes.h>
+#include "color.h"
+
+namespace agave
+{
+    /**
+     * Get the perceptual distance between two palettes, regardless of the
+     * order of their colors.  This is the symmetric chamfer distance in
+     * OKLab: the mean distance from each color to the closest color of the
+     * other palette, averaged over both directions.  Identical palettes have
+     * a distance of 0.0, and it is on the scale of DELTA_E_OK.  Alpha is
+     * ignored.
+     */
+    double palette_distance (const rgb_t* first, std::size_t n_first,
+                             const rgb_t* second, std::size_t n_second);
+
+    /**
+     * An approximate nearest neighbor index for palette similarity searches
+     * over a large number of palettes.  Palettes are identified by small
+     * integers, as in TagIndex.
+     *
+     * The palettes are organized in a hierarchical navigable small world
+     * graph (HNSW) under palette_distance (), which finds the neighbors of a
+     * query in a logarithmic number of steps, but can occasionally miss a
+     * close palette.  The distances in the results are always exact.
+     *
+     * New palettes are inserted into the graph by a background thread, so
+     * filling the index (e.g. while loading a library) is cheap.  Until
+     * they are linked, searches compare them with the query one by one.
+     * Changed and removed palettes are only marked as deleted, and the graph
+     * is rebuilt once they outnumber the live ones.  Small indexes are
+     * searched exhaustively.  All methods may be called from any thread.
+     */
+    class PaletteIndex
+    {
+        public:
+            struct Match
+            {
+                guint32 item;
+                /// see palette_distance ()
+                double distance;
+            };
+
+            PaletteIndex ();
+
+            /**
+             * Replace the palette of @a item
+             */
+            void set_palette (guint32 item, const rgb_t* colors, std::size_t n);
+
+            /**
+             * Remove @a item from the index
+             */
+            void remove (guint32 item);
+            void clear ();
+            std::size_t size () const;
+
+            /**
+             * Find the @a k palettes closest to @a colors
+             *
+             * @param matches  Receives the matches, closest first
+             * @return  The number of matches
+             */
+            std::size_t find_nearest (const rgb_t* colors, std::size_t n,
+                                      std::size_t k,
+                                      std::vector<Match>& matches) const;
+
+        private:
+            struct Priv;
+            boost::shared_ptr<Priv> m_priv;
+    };
+}
+
+#endif // __PALETTE_INDEX_H
@@ -0,0 +1,541 @@
+/*******************************************************************************
+ *
+ *  Copyright (c) 2008 Jonathon Jongsma
+ *
+ *  This file is part of Agave
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ *******************************************************************************/
+#include <algorithm>
+#include <limits>
+#include <glib.h>
+#include <glibmm/dispatcher.h>
+#include <glibmm/thread.h>
+#include <glibmm-utils/exception.h>
+#include "palette-search.h"
+#include "color-perceptual.h"
+#include "scheme-manager.h"
+
+namespace agave
+{
+    // the smallest and the combined largest weight of the channels in the
+    // WCAG 2 relative luminance (blue, and red plus green)
+    static const double MIN_LUMINANCE_WEIGHT = 0.0722;
+    static const double MAX_LUMINANCE_WEIGHT = 1.0 - MIN_LUMINANCE_WEIGHT;
+    // keeps rounding differences from pruning a row that could pass
+    static const double BOUND_EPSILON = 1e-9;
+
+    struct contrast_constraint_t
+    {
+        double luminance;
+        double min_ratio;
+        /// the luminance range that fails the constraint
+        double band_low;
+        double band_high;
+    };
+
+    struct search_candidate_t
+    {
+        std::size_t scheme;
+        /// the index of the base color in the grid
+        std::size_t position;
+        hsv_t base;
+        double score;
+    };
+
+    static bool is_better (const search_candidate_t& lhs,
+                           const search_candidate_t& rhs)
+    {
+        if (lhs.score != rhs.score)
+            return lhs.score > rhs.score;
+        if (lhs.scheme != rhs.scheme)
+            return lhs.scheme < rhs.scheme;
+        return lhs.position < rhs.position;
+    }
+
+    /**
+     * Keep only the best @a max_results candidates once the list has grown
+     * to twice that size
+     */
+    static void trim_candidates (std::vector<search_candidate_t>& candidates,
+                                 std::size_t max_results, bool force = false)
+    {
+        if (candidates.size () <= max_results ||
+            (!force && candidates.size () < 2 * max_results))
+            return;
+        std::nth_element (candidates.begin (),
+                          candidates.begin () + max_results,
+                          candidates.end (), is_better);
+        candidates.resize (max_results);
+    }
+
+    static double grid_value (unsigned int index, unsigned int steps)
+    {
+        return steps > 1 ? index / double (steps - 1) : 1.0;
+    }
+
+    static unsigned int get_default_threads ()
+    {
+#if GLIB_CHECK_VERSION (2, 36, 0)
+        return g_get_num_processors ();
+#else
+        return 1;
+#endif
+    }
+
+    struct PaletteSearch::Priv
+    {
+        std::vector<boost::shared_ptr<IScheme> > m_schemes;
+        std::vector<contrast_constraint_t> m_constraints;
+        unsigned int m_hue_steps;
+        unsigned int m_saturation_steps;
+        unsigned int m_value_steps;
+        std::size_t m_max_results;
+        unsigned int m_threads;
+
+        /// \name Shared with the workers, protected by m_mutex
+        /// @{
+        Glib::Mutex m_mutex;
+        std::size_t m_num_rows;
+        std::size_t m_next_row;
+        std::size_t m_rows_done;
+        unsigned int m_active_workers;
+        bool m_cancelled;
+        std::vector<search_candidate_t> m_candidates;
+        std::size_t m_num_matches;
+        /// @}
+
+        bool m_running;
+        /// whether the workers report through the dispatchers
+        bool m_async;
+        std::vector<Glib::Thread*> m_workers;
+        boost::shared_ptr<Glib::Dispatcher> m_progress_dispatcher;
+        boost::shared_ptr<Glib::Dispatcher> m_finished_dispatcher;
+        std::vector<Result> m_results;
+        std::size_t m_result_matches;
+        sigc::signal<void, double> m_signal_progress;
+        sigc::signal<void, bool> m_signal_finished;
+
+        Priv () :
+            m_schemes (SchemeManager::instance ().get_schemes ()),
+            m_hue_steps (DEFAULT_HUE_STEPS),
+            m_saturation_steps (DEFAULT_SATURATION_STEPS),
+            m_value_steps (DEFAULT_VALUE_STEPS),
+            m_max_results (DEFAULT_MAX_RESULTS),
+            m_threads (0),
+            m_num_rows (0),
+            m_next_row (0),
+            m_rows_done (0),
+            m_active_workers (0),
+            m_cancelled (false),
+            m_num_matches (0),
+            m_running (false),
+            m_async (false),
+            m_result_matches (0)
+        {}
+
+        ~Priv ()
+        {
+            {
+                Glib::Mutex::Lock lock (m_mutex);
+                m_cancelled = true;
+            }
+            join_workers ();
+        }
+
+        /**
+         * The smallest ratio of actual to required contrast of a color
+         * with relative luminance @a y over all constraints
+         */
+        double score (double y) const
+        {
+            double result = std::numeric_limits<double>::max ();
+            for (std::vector<contrast_constraint_t>::const_iterator iter =
+                 m_constraints.begin (); iter != m_constraints.end (); ++iter)
+            {
+                const double ratio = (std::max (y, iter->luminance) + 0.05) /
+                    (std::min (y, iter->luminance) + 0.05);
+                result = std::min (result, ratio / iter->min_ratio);
+            }
+            return result;
+        }
+
+        double score (const hsv_t& hsv) const
+        {
+            return score (relative_luminance (Color::hsv_to_rgb (hsv)));
+        }
+
+        /**
+         * Check whether any base color with saturation @a s and value @a v
+         * can pass.  The darkest of them has the full value in blue and the
+         * lowest one in red and green, the brightest one the opposite.
+         */
+        bool row_may_pass (double s, double v) const
+        {
+            const double high = srgb_to_linear (v);
+            const double low = srgb_to_linear (v * (1.0 - s));
+            const double min_y = MIN_LUMINANCE_WEIGHT * high +
+                MAX_LUMINANCE_WEIGHT * low;
+            const double max_y = MAX_LUMINANCE_WEIGHT * high +
+                MIN_LUMINANCE_WEIGHT * low;
+            for (std::vector<contrast_constraint_t>::const_iterator iter =
+                 m_constraints.begin (); iter != m_constraints.end (); ++iter)
+            {
+                if (min_y > iter->band_low + BOUND_EPSILON &&
+                    max_y < iter->band_high - BOUND_EPSILON)
+                    return false;
+            }
+            return true;
+        }
+
+        void search_row (std::size_t row,
+                         std::vector<search_candidate_t>& candidates,
+                         std::size_t& num_matches,
+                         std::vector<hsv_t>& bases,
+                         std::vector<double>& base_scores,
+                         std::vector<std::size_t>& positions,
+                         std::vector<hsv_t>& outputs) const
+        {
+            const double s = grid_value (row % m_saturation_steps,
+                                         m_saturation_steps);
+            const double v = grid_value (row / m_saturation_steps,
+                                         m_value_steps);
+            if (!row_may_pass (s, v))
+                return;
+
+            // only the base colors that pass on their own are worth running
+            // the schemes on
+            bases.clear ();
+            base_scores.clear ();
+            positions.clear ();
+            for (unsigned int i = 0; i < m_hue_steps; ++i)
+            {
+                const hsv_t base = { i / double (m_hue_steps), s, v, 1.0 };
+                const double base_score = score (base);
+                if (base_score >= 1.0)
+                {
+                    bases.push_back (base);
+                    base_scores.push_back (base_score);
+                    positions.push_back (row * m_hue_steps + i);
+                }
+            }
+            if (bases.empty ())
+                return;
+
+            for (std::size_t k = 0; k < m_schemes.size (); ++k)
+            {
+                const unsigned int num_outputs = m_schemes[k]->get_num_outputs ();
+                outputs.resize (bases.size () * num_outputs);
+                m_schemes[k]->generate_batch (&bases[0], bases.size (),
+                                              &outputs[0]);
+                for (std::size_t i = 0; i < bases.size (); ++i)
+                {
+                    double palette_score = base_scores[i];
+                    const hsv_t* colors = &outputs[i * num_outputs];
+                    for (unsigned int j = 0;
+                         j < num_outputs && palette_score >= 1.0; ++j)
+                    {
+                        palette_score = std::min (palette_score,
+                                                  score (colors[j]));
+                    }
+                    if (palette_score < 1.0)
+                        continue;
+
+                    ++num_matches;
+                    const search_candidate_t candidate =
+                        { k, positions[i], bases[i], palette_score };
+                    candidates.push_back (candidate);
+                    trim_candidates (candidates, m_max_results);
+                }
+            }
+        }
+
+        void work ()
+        {
+            std::vector<search_candidate_t> candidates;
+            std::size_t num_matches = 0;
+            std::vector<hsv_t> bases;
+            std::vector<double> base_scores;
+            std::vector<std::size_t> positions;
+            std::vector<hsv_t> outputs;
+            for (;;)
+            {
+                std::size_t row;
+                {
+                    Glib::Mutex::Lock lock (m_mutex);
+                    if (m_cancelled || m_next_row >= m_num_rows)
+                        break;
+                    row = m_next_row++;
+                }
+
+                search_row (row, candidates, num_matches, bases, base_scores,
+                            positions, outputs);
+
+                bool notify;
+                {
+                    Glib::Mutex::Lock lock (m_mutex);
+                    ++m_rows_done;
+                    // about one notification per percent
+                    notify = (m_rows_done * 100 / m_num_rows !=
+                              (m_rows_done - 1) * 100 / m_num_rows);
+                }
+                if (notify && m_async)
+                {
+                    (*m_progress_dispatcher) ();
+                }
+            }
+
+            bool last;
+            {
+                Glib::Mutex::Lock lock (m_mutex);
+                m_candidates.insert (m_candidates.end (), candidates.begin (),
+                                     candidates.end ());
+                trim_candidates (m_candidates, m_max_results);
+                m_num_matches += num_matches;
+                last = (--m_active_workers == 0);
+            }
+            if (last && m_async)
+            {
+                (*m_finished_dispatcher) ();
+            }
+        }
+
+        unsigned int prepare (bool async)
+        {
+            m_async = async;
+            m_num_rows = std::size_t (m_saturation_steps) * m_value_steps;
+            m_next_row = 0;
+            m_rows_done = 0;
+            m_cancelled = false;
+            m_candidates.clear ();
+            m_num_matches = 0;
+            m_results.clear ();
+            m_result_matches = 0;
+
+            unsigned int threads = m_threads ? m_threads : get_default_threads ();
+            threads = std::max (1u, std::min<unsigned int> (threads,
+                        std::max<std::size_t> (m_num_rows, 1)));
+            if (!Glib::thread_supported ())
+            {
+                Glib::thread_init ();
+            }
+            m_active_workers = threads;
+            return threads;
+        }
+
+        void join_workers ()
+        {
+            for (std::vector<Glib::Thread*>::iterator iter = m_workers.begin ();
+                 iter != m_workers.end (); ++iter)
+            {
+                (*iter)->join ();
+            }
+            m_workers.clear ();
+        }
+
+        /**
+         * Turn the candidates into the ranked result list
+         */
+        void collect_results ()
+        {
+            trim_candidates (m_candidates, m_max_results, true);
+            std::sort (m_candidates.begin (), m_candidates.end (), is_better);
+            m_results.clear ();
+            for (std::vector<search_candidate_t>::const_iterator iter =
+                 m_candidates.begin (); iter != m_candidates.end (); ++iter)
+            {
+                Result result;
+                result.scheme = m_schemes[iter->scheme];
+                result.base = iter->base;
+                result.score = iter->score;
+                m_results.push_back (result);
+            }
+            m_candidates.clear ();
+            m_result_matches = m_num_matches;
+        }
+
+        void on_progress ()
+        {
+            m_signal_progress.emit (get_progress ());
+        }
+
+        void on_finished ()
+        {
+            join_workers ();
+            collect_results ();
+            m_running = false;
+            bool cancelled;
+            {
+                Glib::Mutex::Lock lock (m_mutex);
+                cancelled = m_cancelled;
+            }
+            m_signal_finished.emit (cancelled);
+        }
+
+        double get_progress ()
+        {
+            Glib::Mutex::Lock lock (m_mutex);
+            return m_num_rows ? double (m_rows_done) / m_num_rows : 1.0;
+        }
+    };
+
+    PaletteSearch::PaletteSearch () :
+        m_priv (new Priv ())
+    {
+    }
+
+    PaletteSearch::~PaletteSearch ()
+    {
+    }
+
+    void PaletteSearch::set_schemes (
+            const std::vector<boost::shared_ptr<IScheme> >& schemes)
+    {
+        THROW_IF_FAIL (m_priv && !m_priv->m_running);
+        m_priv->m_schemes = schemes;
+    }
+
+    void PaletteSearch::add_contrast_constraint (const rgb_t& against,
+                                                 double min_ratio)
+    {
+        THROW_IF_FAIL (m_priv && !m_priv->m_running);
+        contrast_constraint_t constraint;
+        constraint.luminance = relative_luminance (against);
+        constraint.min_ratio = std::max (min_ratio, 1.0);
+        constraint.band_low = (constraint.luminance + 0.05) /
+            constraint.min_ratio - 0.05;
+        constraint.band_high = (constraint.luminance + 0.05) *
+            constraint.min_ratio - 0.05;
+        m_priv->m_constraints.push_back (constraint);
+    }
+
+    void PaletteSearch::clear_constraints ()
+    {
+        THROW_IF_FAIL (m_priv && !m_priv->m_running);
+        m_priv->m_constraints.clear ();
+    }
+
+    void PaletteSearch::set_grid (unsigned int hue_steps,
+                                  unsigned int saturation_steps,
+                                  unsigned int value_steps)
+    {
+        THROW_IF_FAIL (m_priv && !m_priv->m_running);
+        m_priv->m_hue_steps = std::max (hue_steps, 1u);
+        m_priv->m_saturation_steps = std::max (saturation_steps, 1u);
+        m_priv->m_value_steps = std::max (value_steps, 1u);
+    }
+
+    void PaletteSearch::set_max_results (std::size_t max_results)
+    {
+        THROW_IF_FAIL (m_priv && !m_priv->m_running);
+        m_priv->m_max_results = max_results;
+    }
+
+    void PaletteSearch::set_threads (unsigned int threads)
+    {
+        THROW_IF_FAIL (m_priv && !m_priv->m_running);
+        m_priv->m_threads = threads;
+    }
+
+    bool PaletteSearch::run ()
+    {
+        THROW_IF_FAIL (m_priv);
+        if (m_priv->m_running)
+            return false;
+
+        const unsigned int threads = m_priv->prepare (false);
+        for (unsigned int i = 1; i < threads; ++i)
+        {
+            m_priv->m_workers.push_back (Glib::Thread::create (sigc::mem_fun
+                        (*m_priv, &Priv::work), true));
+        }
+        m_priv->work ();
+        m_priv->join_workers ();
+        m_priv->collect_results ();
+
+        Glib::Mutex::Lock lock (m_priv->m_mutex);
+        return !m_priv->m_cancelled;
+    }
+
+    bool PaletteSearch::start ()
+    {
+        THROW_IF_FAIL (m_priv);
+        if (m_priv->m_running)
+            return false;
+
+        const unsigned int threads = m_priv->prepare (true);
+        if (!m_priv->m_finished_dispatcher)
+        {
+            // the dispatchers deliver to the main loop of the thread that
+            // creates them
+            m_priv->m_progress_dispatcher.reset (new Glib::Dispatcher ());
+            m_priv->m_progress_dispatcher->connect (sigc::mem_fun
+                    (*m_priv, &Priv::on_progress));
+            m_priv->m_finished_dispatcher.reset (new Glib::Dispatcher ());
+            m_priv->m_finished_dispatcher->connect (sigc::mem_fun
+                    (*m_priv, &Priv::on_finished));
+        }
+        m_priv->m_running = true;
+        for (unsigned int i = 0; i < threads; ++i)
+        {
+            m_priv->m_workers.push_back (Glib::Thread::create (sigc::mem_fun
+                        (*m_priv, &Priv::work), true));
+        }
+        return true;
+    }
+
+    void PaletteSearch::cancel ()
+    {
+        THROW_IF_FAIL (m_priv);
+        Glib::Mutex::Lock lock (m_priv->m_mutex);
+        m_priv->m_cancelled = true;
+    }
+
+    bool PaletteSearch::is_running () const
+    {
+        THROW_IF_FAIL (m_priv);
+        return m_priv->m_running;
+    }
+
+    double PaletteSearch::get_progress () const
+    {
+        THROW_IF_FAIL (m_priv);
+        return m_priv->get_progress ();
+    }
+
+    const std::vector<PaletteSearch::Result>& PaletteSearch::get_results () const
+    {
+        THROW_IF_FAIL (m_priv);
+        return m_priv->m_results;
+    }
+
+    std::size_t PaletteSearch::get_num_matches () const
+    {
+        THROW_IF_FAIL (m_priv);
+        return m_priv->m_result_matches;
+    }
+
+    sigc::signal<void, double>& PaletteSearch::signal_progress ()
+    {
+        THROW_IF_FAIL (m_priv);
+        return m_priv->m_signal_progress;
+    }
+
+    sigc::signal<void, bool>& PaletteSearch::signal_finished ()
+    {
+        THROW_IF_FAIL (m_priv);
+        return m_priv->m_signal_finished;
+    }
+}
@@ -0,0 +1,162 @@
+/*******************************************************************************
+ *
+ *  Copyright (c) 2008 Jonathon Jongsma
+ *
+ *  This file is part of Agave
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ *******************************************************************************/
+#ifndef __PALETTE_SEARCH_H
+#define __PALETTE_SEARCH_H
+
+#include <cstddef>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <sigc++/signal.h>
+#include "i-scheme.h"
+
+namespace agave
+{
+    /**
+     * Searches for base colors whose palettes (the base color and all
+     * outputs of a scheme) satisfy a set of WCAG contrast constraints, e.g.
+     * "every color of the Triadic palette has a contrast of at least 4.5
+     * against white".
+     *
+     * The search sweeps a regular grid over the HSV cube for each of the
+     * selected schemes.  The grid is split into rows of constant saturation
+     * and value that are handed out to worker threads.  Since a row covers
+     * all hues, the luminance of its base colors can be bounded without
+     * converting them, and rows whose bases can't possibly pass are skipped
+     * without evaluating any scheme.  Within a row, the schemes are only run
+     * for the base colors that pass on their own.
+     *
+     * Passing palettes are ranked by their score, the smallest ratio of
+     * actual to required contrast over all colors and constraints, so the
+     * most robust palettes come first.
+     *
+     * run () searches synchronously.  start () returns immediately and
+     * reports progress and completion through signals that are emitted
+     * from the main loop, so it can be used from the user interface.
+     * IScheme::generate () of the schemes is called from several threads.
+     */
+    class PaletteSearch
+    {
+        public:
+            struct Result
+            {
+                boost::shared_ptr<IScheme> scheme;
+                hsv_t base;
+                /// the smallest ratio of actual to required contrast
+                double score;
+            };
+
+            /// The default grid: 5 degree hue steps, 5% saturation and value
+            /// steps
+            static const unsigned int DEFAULT_HUE_STEPS = 72;
+            static const unsigned int DEFAULT_SATURATION_STEPS = 21;
+            static const unsigned int DEFAULT_VALUE_STEPS = 21;
+            static const std::size_t DEFAULT_MAX_RESULTS = 100;
+
+            /**
+             * Create a search over all schemes of the SchemeManager
+             */
+            PaletteSearch ();
+            ~PaletteSearch ();
+
+            void set_schemes (const std::vector<boost::shared_ptr<IScheme> >& schemes);
+
+            /**
+             * Require every color of a palette to have a contrast ratio of
+             * at least @a min_ratio against @a against (e.g. 4.5 against
+             * white for normal text in WCAG 2 AA)
+             */
+            void add_contrast_constraint (const rgb_t& against,
+                                          double min_ratio);
+            void clear_constraints ();
+
+            /**
+             * Set the number of grid points along each axis of the HSV cube.
+             * Hues are spaced evenly around the circle, saturation and value
+             * include both 0.0 and 1.0.
+             */
+            void set_grid (unsigned int hue_steps,
+                           unsigned int saturation_steps,
+                           unsigned int value_steps);
+
+            /**
+             * Limit the length of the result list.  All passing palettes are
+             * still counted in get_num_matches ().
+             */
+            void set_max_results (std::size_t max_results);
+
+            /**
+             * Set the number of worker threads, 0 (the default) uses one per
+             * processor
+             */
+            void set_threads (unsigned int threads);
+
+            /**
+             * Run the search and wait for it to finish
+             *
+             * @return  false if the search was cancelled from another thread
+             */
+            bool run ();
+
+            /**
+             * Start the search in the background.  signal_progress () and
+             * signal_finished () are emitted from the main loop.
+             *
+             * @return  false if a search is already running
+             */
+            bool start ();
+
+            /**
+             * Stop a running search.  The workers finish the row they are on,
+             * then signal_finished () is emitted with the results found so
+             * far.
+             */
+            void cancel ();
+            bool is_running () const;
+
+            /// The fraction of the grid that has been searched (0.0 - 1.0)
+            double get_progress () const;
+
+            /**
+             * The best palettes of the last search, best first.  Ties are
+             * ordered by scheme and grid position, so the results don't
+             * depend on the number of threads.
+             */
+            const std::vector<Result>& get_results () const;
+
+            /// The total number of passing palettes of the last search
+            std::size_t get_num_matches () const;
+
+            sigc::signal<void, double>& signal_progress ();
+
+            /// Emitted with true if the search was cancelled
+            sigc::signal<void, bool>& signal_finished ();
+
+        private:
+            // not copyable
+            PaletteSearch (const PaletteSearch& other);
+            PaletteSearch& operator= (const PaletteSearch& other);
+
+            struct Priv;
+            boost::shared_ptr<Priv> m_priv;
+    };
+}
+
+#endif // __PALETTE_SEARCH_H
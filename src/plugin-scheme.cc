@@ -0,0 +1,334 @@
+/*******************************************************************************
+ *
+ *  Copyright (c) 2008 Jonathon Jongsma
+ *
+ *  This file is part of Agave
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ *******************************************************************************/
+#include <algorithm>
+#include <cfloat>
+#include <cstddef>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <boost/static_assert.hpp>
+#include <glibmm/module.h>
+#include <glibmm-utils/exception.h>
+#include "plugin-scheme.h"
+#include "agave-scheme-plugin.h"
+
+namespace agave
+{
+    /**
+     * An upper bound for num_outputs, so that a corrupt description can't
+     * make callers of IScheme::generate () allocate huge buffers
+     */
+    const unsigned int PLUGIN_SCHEME_MAX_OUTPUTS = 256;
+
+    // generate_batch () hands hsv_t arrays to the plugin without copying
+    BOOST_STATIC_ASSERT (sizeof (agave_hsva_t) == sizeof (hsv_t));
+
+    /**
+     * The fields of agave_scheme_info_t that the application uses, copied
+     * out of the plugin so that older plugins with a smaller structure can
+     * be handled
+     */
+    struct PluginSchemeInfo
+    {
+        Glib::ustring name;
+        unsigned int num_outputs;
+        agave_scheme_generate_func generate;
+        agave_scheme_generate_batch_func generate_batch;
+        void* user_data;
+    };
+
+    static inline bool is_finite (double value)
+    {
+        return std::fabs (value) <= DBL_MAX;
+    }
+
+    /**
+     * Bring a color computed by a plugin into range.  A result that isn't
+     * finite is replaced by the base color.
+     */
+    static inline hsv_t sanitize (const hsv_t& base, const hsv_t& result)
+    {
+        if (!is_finite (result.h) || !is_finite (result.s) ||
+            !is_finite (result.v) || !is_finite (result.a))
+        {
+            return base;
+        }
+        return clamp_hsv (result);
+    }
+
+    static inline agave_hsva_t to_plugin (const hsv_t& hsv)
+    {
+        const agave_hsva_t result = { hsv.h, hsv.s, hsv.v, hsv.a };
+        return result;
+    }
+
+    static inline hsv_t from_plugin (const agave_hsva_t& hsva)
+    {
+        const hsv_t result = { hsva.h, hsva.s, hsva.v, hsva.a };
+        return result;
+    }
+
+    /**
+     * Runs one output of a plugin scheme as a ColorRelation generator
+     */
+    class PluginGenerator : public sigc::functor_base
+    {
+        public:
+            typedef Color result_type;
+
+            PluginGenerator (const boost::shared_ptr<const PluginSchemeInfo>& info,
+                             const boost::shared_ptr<Glib::Module>& module,
+                             unsigned int output) :
+                m_info (info),
+                m_module (module),
+                m_output (output)
+            {}
+
+            Color operator() (const Color& c) const
+            {
+                // schemes with fewer outputs pass the base color through
+                if (m_output >= m_info->num_outputs)
+                {
+                    return c;
+                }
+                const hsv_t hsv = c.as_hsv ();
+                const agave_hsva_t base = to_plugin (hsv);
+                agave_hsva_t result = base;
+                m_info->generate (m_info->user_data, m_output, &base, &result);
+                return Color (ColorValue (sanitize (hsv, from_plugin (result))));
+            }
+
+        private:
+            boost::shared_ptr<const PluginSchemeInfo> m_info;
+            // keeps the plugin loaded while the generator is in use
+            boost::shared_ptr<Glib::Module> m_module;
+            unsigned int m_output;
+    };
+
+    struct PluginScheme::Priv
+    {
+        boost::shared_ptr<Glib::Module> m_module;
+        boost::shared_ptr<const PluginSchemeInfo> m_info;
+
+        ColorRelation::SlotColorGen get_generator (unsigned int output) const
+        {
+            return PluginGenerator (m_info, m_module, output);
+        }
+    };
+
+    PluginScheme::PluginScheme (const boost::shared_ptr<Glib::Module>& module,
+                                const PluginSchemeInfo& info) :
+        m_priv (new Priv ())
+    {
+        THROW_IF_FAIL (m_priv);
+        m_priv->m_module = module;
+        m_priv->m_info.reset (new PluginSchemeInfo (info));
+    }
+
+    static void report_rejected (const std::string& filename,
+                                 const Glib::ustring& reason)
+    {
+        std::cerr << Glib::ustring::compose ("Rejecting scheme plugin %1: %2",
+                filename, reason)
+            << std::endl;
+    }
+
+    std::size_t PluginScheme::load_plugin (const std::string& filename,
+            std::vector<boost::shared_ptr<IScheme> >& schemes)
+    {
+        if (!Glib::Module::get_supported ())
+        {
+            report_rejected (filename, "plugins are not supported on this platform");
+            return 0;
+        }
+
+        // resolve the symbols of the plugin locally, so that two plugins
+        // can't interfere with each other
+        boost::shared_ptr<Glib::Module> module (new Glib::Module (filename,
+                    Glib::MODULE_BIND_LOCAL));
+        if (!*module)
+        {
+            report_rejected (filename, Glib::Module::get_last_error ());
+            return 0;
+        }
+
+        void* symbol = 0;
+        if (!module->get_symbol (AGAVE_SCHEME_PLUGIN_QUERY_SYMBOL, symbol) ||
+            !symbol)
+        {
+            report_rejected (filename, Glib::ustring::compose
+                    ("%1 () not found", AGAVE_SCHEME_PLUGIN_QUERY_SYMBOL));
+            return 0;
+        }
+
+        agave_scheme_plugin_query_func query =
+            reinterpret_cast<agave_scheme_plugin_query_func> (symbol);
+        const agave_scheme_plugin_t* plugin =
+            query (AGAVE_SCHEME_PLUGIN_ABI_VERSION);
+        if (!plugin)
+        {
+            report_rejected (filename, "the plugin doesn't support this version of the application");
+            return 0;
+        }
+        if (plugin->abi_version != AGAVE_SCHEME_PLUGIN_ABI_VERSION)
+        {
+            report_rejected (filename, Glib::ustring::compose
+                    ("plugin ABI version %1, expected %2",
+                     plugin->abi_version, AGAVE_SCHEME_PLUGIN_ABI_VERSION));
+            return 0;
+        }
+        if (plugin->struct_size < sizeof (agave_scheme_plugin_t) ||
+            (plugin->num_schemes > 0 && !plugin->schemes))
+        {
+            report_rejected (filename, "invalid plugin description");
+            return 0;
+        }
+
+        // check all schemes first, a plugin is either loaded completely or
+        // not at all
+        std::vector<PluginSchemeInfo> infos;
+        // the plugin's idea of the structure size is the array stride
+        const std::size_t size =
+            plugin->num_schemes ? plugin->schemes->struct_size : 0;
+        const char* entry = reinterpret_cast<const char*> (plugin->schemes);
+        for (unsigned int i = 0; i < plugin->num_schemes; ++i, entry += size)
+        {
+            const agave_scheme_info_t* scheme =
+                reinterpret_cast<const agave_scheme_info_t*> (entry);
+            if (size < offsetof (agave_scheme_info_t, generate_batch) ||
+                scheme->struct_size != size)
+            {
+                report_rejected (filename, "invalid scheme description");
+                return 0;
+            }
+
+            agave_scheme_info_t copy;
+            std::memset (&copy, 0, sizeof (copy));
+            std::memcpy (&copy, scheme, std::min (size, sizeof (copy)));
+            if (!copy.name || !copy.generate)
+            {
+                report_rejected (filename, Glib::ustring::compose
+                        ("scheme %1 is incomplete", i));
+                return 0;
+            }
+            if (copy.num_outputs == 0 ||
+                copy.num_outputs > PLUGIN_SCHEME_MAX_OUTPUTS)
+            {
+                report_rejected (filename, Glib::ustring::compose
+                        ("scheme '%1' has %2 outputs, expected 1 to %3",
+                         copy.name, copy.num_outputs,
+                         PLUGIN_SCHEME_MAX_OUTPUTS));
+                return 0;
+            }
+
+            PluginSchemeInfo info;
+            info.name = copy.name;
+            info.num_outputs = copy.num_outputs;
+            info.generate = copy.generate;
+            info.generate_batch = copy.generate_batch;
+            info.user_data = copy.user_data;
+            infos.push_back (info);
+        }
+
+        for (std::vector<PluginSchemeInfo>::const_iterator iter = infos.begin ();
+             iter != infos.end (); ++iter)
+        {
+            schemes.push_back (boost::shared_ptr<IScheme>
+                    (new PluginScheme (module, *iter)));
+        }
+        return infos.size ();
+    }
+
+    Glib::ustring PluginScheme::get_name () const
+    {
+        THROW_IF_FAIL (m_priv);
+        return m_priv->m_info->name;
+    }
+
+    ColorRelation::SlotColorGen PluginScheme::get_outer_left () const
+    {
+        THROW_IF_FAIL (m_priv);
+        return m_priv->get_generator (0);
+    }
+
+    ColorRelation::SlotColorGen PluginScheme::get_inner_left () const
+    {
+        THROW_IF_FAIL (m_priv);
+        return m_priv->get_generator (1);
+    }
+
+    ColorRelation::SlotColorGen PluginScheme::get_inner_right () const
+    {
+        THROW_IF_FAIL (m_priv);
+        return m_priv->get_generator (2);
+    }
+
+    ColorRelation::SlotColorGen PluginScheme::get_outer_right () const
+    {
+        THROW_IF_FAIL (m_priv);
+        return m_priv->get_generator (3);
+    }
+
+    unsigned int PluginScheme::get_num_outputs () const
+    {
+        THROW_IF_FAIL (m_priv);
+        return m_priv->m_info->num_outputs;
+    }
+
+    void PluginScheme::generate (const hsv_t& base, hsv_t* outputs) const
+    {
+        generate_batch (&base, 1, outputs);
+    }
+
+    void PluginScheme::generate_batch (const hsv_t* bases, std::size_t n,
+                                       hsv_t* outputs) const
+    {
+        THROW_IF_FAIL (m_priv);
+        const PluginSchemeInfo& info = *m_priv->m_info;
+        if (info.generate_batch)
+        {
+            info.generate_batch (info.user_data,
+                    reinterpret_cast<const agave_hsva_t*> (bases), n,
+                    reinterpret_cast<agave_hsva_t*> (outputs));
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                hsv_t* results = outputs + i * info.num_outputs;
+                for (unsigned int j = 0; j < info.num_outputs; ++j)
+                {
+                    results[j] = sanitize (bases[i], results[j]);
+                }
+            }
+            return;
+        }
+
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            const agave_hsva_t base = to_plugin (bases[i]);
+            hsv_t* results = outputs + i * info.num_outputs;
+            for (unsigned int j = 0; j < info.num_outputs; ++j)
+            {
+                agave_hsva_t result = base;
+                info.generate (info.user_data, j, &base, &result);
+                results[j] = sanitize (bases[i], from_plugin (result));
+            }
+        }
+    }
+}
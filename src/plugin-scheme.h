@@ -0,0 +1,85 @@
+/*******************************************************************************
+ *
+ *  Copyright (c) 2008 Jonathon Jongsma
+ *
+ *  This file is part of Agave
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ *******************************************************************************/
+#ifndef __PLUGIN_SCHEME_H
+#define __PLUGIN_SCHEME_H
+
+#include <string>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <glibmm/ustring.h>
+#include "i-scheme.h"
+
+namespace Glib
+{
+    class Module;
+}
+
+namespace agave
+{
+    struct PluginSchemeInfo;
+
+    /**
+     * A color scheme that is implemented in a dynamically loaded plugin, see
+     * agave-scheme-plugin.h for the interface that plugins implement.  The
+     * plugin stays loaded as long as any of its schemes exists.
+     *
+     * Plugin schemes can have any number of outputs.  The get_*() generators
+     * map to the first four of them and pass the base color through for
+     * outputs that a scheme doesn't have.
+     */
+    class PluginScheme : public IScheme
+    {
+        public:
+            /**
+             * Load a plugin and append the schemes it provides to
+             * @a schemes.  Plugins that can't be loaded or don't match the
+             * ABI of the application are rejected, the reason is reported on
+             * stderr.
+             *
+             * @return  The number of schemes added
+             */
+            static std::size_t load_plugin (const std::string& filename,
+                    std::vector<boost::shared_ptr<IScheme> >& schemes);
+
+            virtual Glib::ustring get_name () const;
+            virtual ColorRelation::SlotColorGen get_outer_left () const;
+            virtual ColorRelation::SlotColorGen get_inner_left () const;
+            virtual ColorRelation::SlotColorGen get_inner_right () const;
+            virtual ColorRelation::SlotColorGen get_outer_right () const;
+            virtual unsigned int get_num_outputs () const;
+            virtual void generate (const hsv_t& base, hsv_t* outputs) const;
+
+            /**
+             * Uses the batch function of the plugin if it has one
+             */
+            virtual void generate_batch (const hsv_t* bases, std::size_t n,
+                                         hsv_t* outputs) const;
+
+        private:
+            PluginScheme (const boost::shared_ptr<Glib::Module>& module,
+                          const PluginSchemeInfo& info);
+
+            struct Priv;
+            boost::shared_ptr<Priv> m_priv;
+    };
+}
+
+#endif // __PLUGIN_SCHEME_H
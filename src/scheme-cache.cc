@@ -0,0 +1,449 @@
+/*******************************************************************************
+ *
+ *  Copyright (c) 2008 Jonathon Jongsma
+ *
+ *  This file is part of Agave
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ *******************************************************************************/
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <glibmm-utils/exception.h>
+#include "scheme-cache.h"
+
+namespace agave
+{
+    SchemeCache* SchemeCache::s_instance = 0;
+
+    static const guint32 NO_ENTRY = 0xffffffff;
+
+    struct cache_entry_t
+    {
+        const IScheme* scheme;
+        guint32 key[4];
+        guint32 hash;
+        unsigned int num_outputs;
+        /// neighbours in the LRU list (or the next free entry)
+        guint32 prev;
+        guint32 next;
+    };
+
+    static guint32 quantize_component (double value, unsigned int steps)
+    {
+        if (!(value >= 0.0))
+            value = 0.0;
+        if (value > 1.0)
+            value = 1.0;
+        return static_cast<guint32> (std::floor (value * steps + 0.5));
+    }
+
+    /**
+     * Looks up a ColorRelation output in the cache
+     */
+    class CachedGenerator : public sigc::functor_base
+    {
+        public:
+            typedef Color result_type;
+
+            CachedGenerator (SchemeCache* cache,
+                             const boost::shared_ptr<IScheme>& scheme,
+                             unsigned int output) :
+                m_cache (cache),
+                m_scheme (scheme),
+                m_output (output)
+            {}
+
+            Color operator() (const Color& c) const
+            {
+                if (m_output >= m_scheme->get_num_outputs ())
+                {
+                    return c;
+                }
+                const hsv_t* outputs = m_cache->lookup (*m_scheme, c.as_hsv ());
+                return Color (ColorValue (outputs[m_output]));
+            }
+
+        private:
+            SchemeCache* m_cache;
+            boost::shared_ptr<IScheme> m_scheme;
+            unsigned int m_output;
+    };
+
+    /**
+     * The entries are kept in an array with a doubly linked LRU list running
+     * through it and an open addressing hash table (linear probing) of
+     * entry indices on top.  The array and the outputs grow up to the
+     * capacity and are reused after that.
+     */
+    struct SchemeCache::Priv
+    {
+        std::size_t m_capacity;
+        unsigned int m_quantization;
+        std::vector<cache_entry_t> m_entries;
+        /// m_stride colors per entry
+        std::vector<hsv_t> m_outputs;
+        unsigned int m_stride;
+        std::vector<guint32> m_table;
+        guint32 m_mask;
+        /// the most and least recently used entries
+        guint32 m_head;
+        guint32 m_tail;
+        guint32 m_free;
+        std::size_t m_size;
+        guint64 m_hits;
+        guint64 m_misses;
+
+        Priv (std::size_t capacity, unsigned int quantization) :
+            m_capacity (std::max<std::size_t> (capacity, 1)),
+            m_quantization (std::max (quantization, 1u)),
+            m_stride (4),
+            m_mask (0),
+            m_head (NO_ENTRY),
+            m_tail (NO_ENTRY),
+            m_free (NO_ENTRY),
+            m_size (0),
+            m_hits (0),
+            m_misses (0)
+        {
+            clear ();
+        }
+
+        void clear ()
+        {
+            // keep the load factor of the table at 0.5 or below
+            std::size_t table_size = 2;
+            while (table_size < 2 * m_capacity)
+            {
+                table_size *= 2;
+            }
+            m_table.assign (table_size, NO_ENTRY);
+            m_mask = table_size - 1;
+            m_entries.clear ();
+            m_outputs.clear ();
+            m_head = m_tail = m_free = NO_ENTRY;
+            m_size = 0;
+        }
+
+        void make_key (const hsv_t& base, guint32* key) const
+        {
+            key[0] = quantize_component (base.h - std::floor (base.h),
+                                         m_quantization);
+            if (key[0] >= m_quantization)
+            {
+                key[0] = 0;
+            }
+            key[1] = quantize_component (base.s, m_quantization);
+            key[2] = quantize_component (base.v, m_quantization);
+            key[3] = quantize_component (base.a, m_quantization);
+        }
+
+        static guint32 hash (const IScheme* scheme, const guint32* key)
+        {
+            const std::size_t address = reinterpret_cast<std::size_t> (scheme);
+            guint32 h = static_cast<guint32> (address ^ (address >> 16 >> 16));
+            for (int i = 0; i < 4; ++i)
+            {
+                h = (h ^ key[i]) * 0x9e3779b1u;
+                h ^= h >> 15;
+            }
+            return h;
+        }
+
+        void unlink (guint32 index)
+        {
+            cache_entry_t& entry = m_entries[index];
+            if (entry.prev != NO_ENTRY)
+                m_entries[entry.prev].next = entry.next;
+            else
+                m_head = entry.next;
+            if (entry.next != NO_ENTRY)
+                m_entries[entry.next].prev = entry.prev;
+            else
+                m_tail = entry.prev;
+        }
+
+        void push_front (guint32 index)
+        {
+            cache_entry_t& entry = m_entries[index];
+            entry.prev = NO_ENTRY;
+            entry.next = m_head;
+            if (m_head != NO_ENTRY)
+                m_entries[m_head].prev = index;
+            m_head = index;
+            if (m_tail == NO_ENTRY)
+                m_tail = index;
+        }
+
+        /**
+         * Remove an entry from the hash table, moving the entries of the
+         * same probe sequence back so that no lookup ends early
+         */
+        void remove_from_table (guint32 index)
+        {
+            guint32 pos = m_entries[index].hash & m_mask;
+            while (m_table[pos] != index)
+            {
+                pos = (pos + 1) & m_mask;
+            }
+
+            m_table[pos] = NO_ENTRY;
+            guint32 next = (pos + 1) & m_mask;
+            while (m_table[next] != NO_ENTRY)
+            {
+                const guint32 home = m_entries[m_table[next]].hash & m_mask;
+                // the entry can move to pos unless its home slot lies
+                // cyclically within (pos, next]
+                const bool stays = (pos <= next) ?
+                    (home > pos && home <= next) :
+                    (home > pos || home <= next);
+                if (!stays)
+                {
+                    m_table[pos] = m_table[next];
+                    m_table[next] = NO_ENTRY;
+                    pos = next;
+                }
+                next = (next + 1) & m_mask;
+            }
+        }
+
+        void remove (guint32 index)
+        {
+            remove_from_table (index);
+            unlink (index);
+            m_entries[index].scheme = 0;
+            m_entries[index].next = m_free;
+            m_free = index;
+            --m_size;
+        }
+
+        /**
+         * Get an unused entry, evicting the least recently used one if the
+         * cache is full
+         */
+        guint32 acquire ()
+        {
+            guint32 index;
+            if (m_free != NO_ENTRY)
+            {
+                index = m_free;
+                m_free = m_entries[index].next;
+            }
+            else if (m_entries.size () < m_capacity)
+            {
+                index = m_entries.size ();
+                m_entries.push_back (cache_entry_t ());
+                m_outputs.resize (m_entries.size () * m_stride);
+            }
+            else
+            {
+                index = m_tail;
+                remove_from_table (index);
+                unlink (index);
+                --m_size;
+            }
+            ++m_size;
+            return index;
+        }
+
+        const hsv_t* lookup (const IScheme& scheme, const hsv_t& base)
+        {
+            guint32 key[4];
+            make_key (base, key);
+            const guint32 h = hash (&scheme, key);
+            for (guint32 pos = h & m_mask; m_table[pos] != NO_ENTRY;
+                 pos = (pos + 1) & m_mask)
+            {
+                const guint32 index = m_table[pos];
+                const cache_entry_t& entry = m_entries[index];
+                if (entry.hash == h && entry.scheme == &scheme &&
+                    std::equal (key, key + 4, entry.key))
+                {
+                    ++m_hits;
+                    if (index != m_head)
+                    {
+                        unlink (index);
+                        push_front (index);
+                    }
+                    return &m_outputs[index * m_stride];
+                }
+            }
+
+            ++m_misses;
+            const unsigned int num_outputs = scheme.get_num_outputs ();
+            if (num_outputs > m_stride)
+            {
+                // rare: make room for a scheme with more outputs
+                m_stride = num_outputs;
+                clear ();
+            }
+
+            const guint32 index = acquire ();
+            guint32 pos = h & m_mask;
+            while (m_table[pos] != NO_ENTRY)
+            {
+                pos = (pos + 1) & m_mask;
+            }
+            m_table[pos] = index;
+
+            cache_entry_t& entry = m_entries[index];
+            entry.scheme = &scheme;
+            std::copy (key, key + 4, entry.key);
+            entry.hash = h;
+            entry.num_outputs = num_outputs;
+            push_front (index);
+
+            // evaluate at the grid point so that the result doesn't depend
+            // on which base color of the cell came first
+            const double steps = m_quantization;
+            const hsv_t grid_point = { key[0] / steps, key[1] / steps,
+                                       key[2] / steps, key[3] / steps };
+            hsv_t* outputs = &m_outputs[index * m_stride];
+            scheme.generate (grid_point, outputs);
+            return outputs;
+        }
+    };
+
+    SchemeCache::SchemeCache (std::size_t capacity, unsigned int quantization) :
+        m_priv (new Priv (capacity, quantization))
+    {
+    }
+
+    // NOTE: this is not thread-safe, don't use in multi-threaded apps
+    SchemeCache& SchemeCache::instance ()
+    {
+        if (!s_instance)
+        {
+            s_instance = new SchemeCache ();
+        }
+        return *s_instance;
+    }
+
+    const hsv_t* SchemeCache::lookup (const IScheme& scheme, const hsv_t& base)
+    {
+        THROW_IF_FAIL (m_priv);
+        return m_priv->lookup (scheme, base);
+    }
+
+    void SchemeCache::generate (const IScheme& scheme, const hsv_t& base,
+                                hsv_t* outputs)
+    {
+        THROW_IF_FAIL (m_priv);
+        const hsv_t* cached = m_priv->lookup (scheme, base);
+        std::copy (cached, cached + scheme.get_num_outputs (), outputs);
+    }
+
+    void SchemeCache::generate_batch (const IScheme& scheme, const hsv_t* bases,
+                                      std::size_t n, hsv_t* outputs)
+    {
+        THROW_IF_FAIL (m_priv);
+        const unsigned int num_outputs = scheme.get_num_outputs ();
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            const hsv_t* cached = m_priv->lookup (scheme, bases[i]);
+            std::copy (cached, cached + num_outputs, outputs + i * num_outputs);
+        }
+    }
+
+    ColorRelation::SlotColorGen SchemeCache::get_generator (
+            const boost::shared_ptr<IScheme>& scheme, unsigned int output)
+    {
+        THROW_IF_FAIL (scheme);
+        return CachedGenerator (this, scheme, output);
+    }
+
+    hsv_t SchemeCache::quantize (const hsv_t& hsv) const
+    {
+        THROW_IF_FAIL (m_priv);
+        guint32 key[4];
+        m_priv->make_key (hsv, key);
+        const double steps = m_priv->m_quantization;
+        const hsv_t result = { key[0] / steps, key[1] / steps,
+                               key[2] / steps, key[3] / steps };
+        return result;
+    }
+
+    void SchemeCache::invalidate (const IScheme& scheme)
+    {
+        THROW_IF_FAIL (m_priv);
+        guint32 index = m_priv->m_head;
+        while (index != NO_ENTRY)
+        {
+            const guint32 next = m_priv->m_entries[index].next;
+            if (m_priv->m_entries[index].scheme == &scheme)
+            {
+                m_priv->remove (index);
+            }
+            index = next;
+        }
+    }
+
+    void SchemeCache::clear ()
+    {
+        THROW_IF_FAIL (m_priv);
+        m_priv->clear ();
+    }
+
+    void SchemeCache::set_capacity (std::size_t capacity)
+    {
+        THROW_IF_FAIL (m_priv);
+        m_priv->m_capacity = std::max<std::size_t> (capacity, 1);
+        m_priv->clear ();
+    }
+
+    std::size_t SchemeCache::get_capacity () const
+    {
+        THROW_IF_FAIL (m_priv);
+        return m_priv->m_capacity;
+    }
+
+    void SchemeCache::set_quantization (unsigned int steps)
+    {
+        THROW_IF_FAIL (m_priv);
+        m_priv->m_quantization = std::max (steps, 1u);
+        m_priv->clear ();
+    }
+
+    unsigned int SchemeCache::get_quantization () const
+    {
+        THROW_IF_FAIL (m_priv);
+        return m_priv->m_quantization;
+    }
+
+    std::size_t SchemeCache::size () const
+    {
+        THROW_IF_FAIL (m_priv);
+        return m_priv->m_size;
+    }
+
+    guint64 SchemeCache::get_hits () const
+    {
+        THROW_IF_FAIL (m_priv);
+        return m_priv->m_hits;
+    }
+
+    guint64 SchemeCache::get_misses () const
+    {
+        THROW_IF_FAIL (m_priv);
+        return m_priv->m_misses;
+    }
+
+    void SchemeCache::reset_stats ()
+    {
+        THROW_IF_FAIL (m_priv);
+        m_priv->m_hits = 0;
+        m_priv->m_misses = 0;
+    }
+}
@@ -0,0 +1,139 @@
+/*******************************************************************************
+ *
+ *  Copyright (c) 2008 Jonathon Jongsma
+ *
+ *  This file is part of Agave
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ *******************************************************************************/
+#ifndef __SCHEME_CACHE_H
+#define __SCHEME_CACHE_H
+
+#include <cstddef>
+#include <boost/shared_ptr.hpp>
+#include <glib/gtypes.h>
+#include "i-scheme.h"
+
+namespace agave
+{
+    /**
+     * A memoization cache for scheme evaluations.
+     *
+     * The cache is keyed on the identity of the scheme and the base color,
+     * quantized to a grid of 1 / get_quantization () in each HSVA component.
+     * A scheme is always evaluated at the grid point closest to the base
+     * color, so the results don't depend on the order of the lookups and
+     * base colors that differ by less than half a grid step share an entry.
+     * The default grid (1/1024) is finer than 8 bit color channels.
+     *
+     * All entries live in preallocated storage, so lookups don't allocate
+     * memory.  When the cache is full, the least recently used entry is
+     * replaced.  Entries refer to schemes by address, so a scheme has to be
+     * removed with invalidate () before it is destroyed.
+     *
+     * A cache must not be used by several threads at once.  Workers that run
+     * in parallel should each use their own cache.
+     */
+    class SchemeCache
+    {
+        public:
+            /// The default number of cached evaluations
+            static const std::size_t DEFAULT_CAPACITY = 4096;
+            /// The default number of grid steps per unit (see quantize ())
+            static const unsigned int DEFAULT_QUANTIZATION = 1024;
+
+            explicit SchemeCache (std::size_t capacity = DEFAULT_CAPACITY,
+                    unsigned int quantization = DEFAULT_QUANTIZATION);
+
+            /**
+             * Get the cache that is shared by the color relations of the
+             * user interface, see get_generator ()
+             */
+            static SchemeCache& instance ();
+
+            /**
+             * Get the outputs of @a scheme for @a base, evaluating the scheme
+             * on a miss.
+             *
+             * @return  An array of scheme.get_num_outputs () colors, valid
+             * until the next call that changes the cache
+             */
+            const hsv_t* lookup (const IScheme& scheme, const hsv_t& base);
+
+            /**
+             * Like IScheme::generate (), but served from the cache
+             */
+            void generate (const IScheme& scheme, const hsv_t& base,
+                           hsv_t* outputs);
+
+            /**
+             * Like IScheme::generate_batch (), but served from the cache
+             */
+            void generate_batch (const IScheme& scheme, const hsv_t* bases,
+                                 std::size_t n, hsv_t* outputs);
+
+            /**
+             * Get a ColorRelation generator for output @a output of
+             * @a scheme that looks up its results in this cache.  The
+             * generators for the different outputs of a scheme share the
+             * entries, so a change of the base color only evaluates the
+             * scheme once.  The cache has to outlive the generator.
+             */
+            ColorRelation::SlotColorGen get_generator (
+                    const boost::shared_ptr<IScheme>& scheme,
+                    unsigned int output);
+
+            /**
+             * Snap @a hsv to the closest point of the quantization grid
+             */
+            hsv_t quantize (const hsv_t& hsv) const;
+
+            /**
+             * Remove all entries of @a scheme
+             */
+            void invalidate (const IScheme& scheme);
+            void clear ();
+
+            /**
+             * Change the number of entries.  This clears the cache.
+             */
+            void set_capacity (std::size_t capacity);
+            std::size_t get_capacity () const;
+
+            /**
+             * Change the number of grid steps per unit.  This clears the
+             * cache.
+             */
+            void set_quantization (unsigned int steps);
+            unsigned int get_quantization () const;
+
+            /// The number of entries in use
+            std::size_t size () const;
+
+            /// \name Statistics
+            /// @{
+            guint64 get_hits () const;
+            guint64 get_misses () const;
+            void reset_stats ();
+            /// @}
+
+        private:
+            struct Priv;
+            boost::shared_ptr<Priv> m_priv;
+            static SchemeCache* s_instance;
+    };
+}
+
+#endif // __SCHEME_CACHE_H
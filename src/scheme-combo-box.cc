@@ -18,42 +18,297 @@
  *  along with this program; if not, see <http://www.gnu.org/licenses/>
  *
  *******************************************************************************/
+#include <cstring>
+#include <list>
+#include <map>
+#include <vector>
+#include <glibmm/dispatcher.h>
+#include <glibmm/thread.h>
 #include <glibmm-utils/exception.h>
+#include <gdkmm/pixbuf.h>
 #include <gtkmm/liststore.h>
 #include "scheme-combo-box.h"
 #include "scheme-manager.h"
 
 namespace agave
 {
+    static const int SWATCH_WIDTH = 12;
+    static const int SWATCH_HEIGHT = 12;
+    static const int SWATCH_SPACING = 1;
+    /// the number of rendered strips that are kept around
+    static const std::size_t THUMBNAIL_CACHE_SIZE = 64;
+
+    /**
+     * The colors of a thumbnail as packed 0xRRGGBB values, left to right
+     */
+    typedef std::vector<guint32> thumbnail_key_t;
+
+    /**
+     * A thumbnail rendered by the worker thread.  The pixels are plain
+     * RGBA data since GDK objects are only created on the main thread.
+     */
+    struct rendered_thumbnail_t
+    {
+        thumbnail_key_t key;
+        int width;
+        std::vector<guint8> pixels;
+    };
+
+    static guint8 to_byte (double value)
+    {
+        return static_cast<guint8> (value * 255.0 + 0.5);
+    }
+
+    static guint32 pack_color (const hsv_t& hsv)
+    {
+        const rgb_t rgb = Color::hsv_to_rgb (hsv);
+        return (guint32 (to_byte (rgb.r)) << 16) |
+            (guint32 (to_byte (rgb.g)) << 8) | to_byte (rgb.b);
+    }
+
+    /**
+     * Render a strip of swatches with transparent gaps between them
+     */
+    static void render_strip (rendered_thumbnail_t& thumbnail)
+    {
+        const int count = thumbnail.key.size ();
+        thumbnail.width = count * SWATCH_WIDTH + (count - 1) * SWATCH_SPACING;
+        thumbnail.pixels.assign (thumbnail.width * SWATCH_HEIGHT * 4, 0);
+        for (int i = 0; i < count; ++i)
+        {
+            const guint32 color = thumbnail.key[i];
+            guint8* row = &thumbnail.pixels[i * (SWATCH_WIDTH + SWATCH_SPACING) * 4];
+            for (int x = 0; x < SWATCH_WIDTH; ++x)
+            {
+                row[x * 4] = (color >> 16) & 0xff;
+                row[x * 4 + 1] = (color >> 8) & 0xff;
+                row[x * 4 + 2] = color & 0xff;
+                row[x * 4 + 3] = 0xff;
+            }
+        }
+        // all rows are the same
+        const std::size_t row_bytes = thumbnail.width * 4;
+        for (int y = 1; y < SWATCH_HEIGHT; ++y)
+        {
+            std::memcpy (&thumbnail.pixels[y * row_bytes], &thumbnail.pixels[0],
+                         row_bytes);
+        }
+    }
+
     struct SchemeColumnRecord : public Gtk::TreeModel::ColumnRecord
     {
         SchemeColumnRecord ()
         {
+            add (thumbnail);
             add (name);
             add (scheme);
         }
+        Gtk::TreeModelColumn<Glib::RefPtr<Gdk::Pixbuf> > thumbnail;
         Gtk::TreeModelColumn<Glib::ustring> name;
         Gtk::TreeModelColumn<boost::shared_ptr<IScheme> > scheme;
     };
 
     struct SchemeComboBox::Priv
     {
+        typedef std::list<thumbnail_key_t> lru_list_t;
+        typedef std::pair<Glib::RefPtr<Gdk::Pixbuf>, lru_list_t::iterator> cache_value_t;
+        typedef std::map<thumbnail_key_t, cache_value_t> cache_map_t;
+
         SchemeColumnRecord m_columns;
         Glib::RefPtr<Gtk::ListStore> m_model;
+        std::vector<boost::shared_ptr<IScheme> > m_schemes;
+        /// the palette currently shown in each row
+        std::vector<thumbnail_key_t> m_row_keys;
+
+        /// rendered strips, least recently used at the back of the list
+        cache_map_t m_cache;
+        lru_list_t m_lru;
+
+        /// \name Worker state
+        /// The worker is started by the first base color and then waits
+        /// for the next one.  Only the latest base color is kept, so a
+        /// base color that changes faster than the thumbnails can be
+        /// rendered doesn't queue up work.
+        /// @{
+        Glib::Thread* m_worker;
+        Glib::Dispatcher m_job_done;
+        /// \name Shared with the worker, protected by m_mutex
+        /// @{
+        Glib::Mutex m_mutex;
+        Glib::Cond m_job_ready;
+        hsv_t m_next_base;
+        bool m_has_next;
+        bool m_quit;
+        std::vector<rendered_thumbnail_t> m_job_results;
+        bool m_has_results;
+        /// @}
+        /// @}
+        std::vector<rendered_thumbnail_t> m_shown_results;
 
         Priv () :
-            m_model (Gtk::ListStore::create (m_columns))
+            m_model (Gtk::ListStore::create (m_columns)),
+            m_schemes (SchemeManager::instance ().get_schemes ()),
+            m_worker (0),
+            m_has_next (false),
+            m_quit (false),
+            m_has_results (false)
         {
-            std::vector<boost::shared_ptr<IScheme> > schemes =
-                SchemeManager::instance ().get_schemes ();
             typedef std::vector<boost::shared_ptr<IScheme> >::const_iterator scheme_iter_t;
-            for (scheme_iter_t iter = schemes.begin ();
-                    iter != schemes.end (); ++iter)
+            for (scheme_iter_t iter = m_schemes.begin ();
+                    iter != m_schemes.end (); ++iter)
             {
                 Gtk::TreeModel::iterator tree_iter = m_model->append ();
                 (*tree_iter)[m_columns.name] = (*iter)->get_name ();
                 (*tree_iter)[m_columns.scheme] = *iter;
             }
+            m_row_keys.resize (m_schemes.size ());
+            m_job_done.connect (sigc::mem_fun (this, &Priv::on_job_done));
+        }
+
+        ~Priv ()
+        {
+            if (m_worker)
+            {
+                {
+                    Glib::Mutex::Lock lock (m_mutex);
+                    m_quit = true;
+                    m_job_ready.signal ();
+                }
+                m_worker->join ();
+            }
+        }
+
+        void set_base_color (const hsv_t& base)
+        {
+            {
+                Glib::Mutex::Lock lock (m_mutex);
+                m_next_base = base;
+                m_has_next = true;
+                m_job_ready.signal ();
+            }
+            if (!m_worker)
+            {
+                m_worker = Glib::Thread::create (sigc::mem_fun (this,
+                            &Priv::run_worker), true);
+            }
+        }
+
+        /**
+         * Runs in the worker thread
+         */
+        void run_worker ()
+        {
+            std::vector<rendered_thumbnail_t> results;
+            for (;;)
+            {
+                hsv_t base;
+                {
+                    Glib::Mutex::Lock lock (m_mutex);
+                    while (!m_has_next && !m_quit)
+                    {
+                        m_job_ready.wait (m_mutex);
+                    }
+                    if (m_quit)
+                    {
+                        return;
+                    }
+                    base = m_next_base;
+                    m_has_next = false;
+                }
+
+                render_thumbnails (base, results);
+                {
+                    Glib::Mutex::Lock lock (m_mutex);
+                    m_job_results.swap (results);
+                    m_has_results = true;
+                }
+                m_job_done ();
+            }
+        }
+
+        /**
+         * Runs in the worker thread
+         */
+        void render_thumbnails (const hsv_t& base,
+                                std::vector<rendered_thumbnail_t>& results)
+        {
+            results.resize (m_schemes.size ());
+            std::vector<hsv_t> outputs;
+            for (std::size_t i = 0; i < m_schemes.size (); ++i)
+            {
+                const unsigned int num_outputs = m_schemes[i]->get_num_outputs ();
+                outputs.resize (num_outputs);
+                m_schemes[i]->generate_batch (&base, 1, &outputs[0]);
+
+                // the base color goes in the middle, as in the main window
+                rendered_thumbnail_t& thumbnail = results[i];
+                thumbnail.key.clear ();
+                for (unsigned int j = 0; j < num_outputs; ++j)
+                {
+                    if (j == num_outputs / 2)
+                    {
+                        thumbnail.key.push_back (pack_color (base));
+                    }
+                    thumbnail.key.push_back (pack_color (outputs[j]));
+                }
+                render_strip (thumbnail);
+            }
+        }
+
+        void on_job_done ()
+        {
+            {
+                Glib::Mutex::Lock lock (m_mutex);
+                // several notifications may have been coalesced into one
+                // set of results
+                if (!m_has_results)
+                {
+                    return;
+                }
+                m_shown_results.swap (m_job_results);
+                m_has_results = false;
+            }
+
+            Gtk::TreeModel::Children rows = m_model->children ();
+            std::size_t index = 0;
+            for (Gtk::TreeModel::iterator iter = rows.begin ();
+                 iter != rows.end () && index < m_shown_results.size ();
+                 ++iter, ++index)
+            {
+                const rendered_thumbnail_t& thumbnail = m_shown_results[index];
+                if (thumbnail.key == m_row_keys[index])
+                    continue;
+                (*iter)[m_columns.thumbnail] = get_pixbuf (thumbnail);
+                m_row_keys[index] = thumbnail.key;
+            }
+        }
+
+        Glib::RefPtr<Gdk::Pixbuf> get_pixbuf (const rendered_thumbnail_t& thumbnail)
+        {
+            cache_map_t::iterator cached = m_cache.find (thumbnail.key);
+            if (cached != m_cache.end ())
+            {
+                m_lru.splice (m_lru.begin (), m_lru, cached->second.second);
+                return cached->second.first;
+            }
+
+            Glib::RefPtr<Gdk::Pixbuf> pixbuf = Gdk::Pixbuf::create (
+                    Gdk::COLORSPACE_RGB, true, 8, thumbnail.width, SWATCH_HEIGHT);
+            const std::size_t row_bytes = thumbnail.width * 4;
+            for (int y = 0; y < SWATCH_HEIGHT; ++y)
+            {
+                std::memcpy (pixbuf->get_pixels () + y * pixbuf->get_rowstride (),
+                             &thumbnail.pixels[y * row_bytes], row_bytes);
+            }
+
+            if (m_cache.size () >= THUMBNAIL_CACHE_SIZE)
+            {
+                m_cache.erase (m_lru.back ());
+                m_lru.pop_back ();
+            }
+            m_lru.push_front (thumbnail.key);
+            m_cache[thumbnail.key] = cache_value_t (pixbuf, m_lru.begin ());
+            return pixbuf;
         }
     };
 
@@ -62,10 +317,17 @@ namespace agave
     {
         THROW_IF_FAIL (m_priv);
         set_model (m_priv->m_model);
+        pack_start (m_priv->m_columns.thumbnail, false);
         pack_start (m_priv->m_columns.name);
         set_active (0);
     }
 
+    void SchemeComboBox::set_base_color (const Color& color)
+    {
+        THROW_IF_FAIL (m_priv);
+        m_priv->set_base_color (color.as_hsv ());
+    }
+
     boost::shared_ptr<IScheme> SchemeComboBox::get_active_scheme ()
     {
         THROW_IF_FAIL (m_priv);
@@ -27,13 +27,32 @@
 namespace agave
 {
     class IScheme;
+    class Color;
 
+    /**
+     * A combo box for choosing a scheme.  Each entry shows a strip of
+     * swatches with the palette that the scheme generates for the current
+     * base color.
+     *
+     * The palettes of all schemes are generated and rendered in a worker
+     * thread, so changing the base color doesn't block the main loop.  Only
+     * the entries whose palette changed (at 8 bits per channel) are updated,
+     * and the rendered strips are kept in a small cache so that returning to
+     * a previous palette, e.g. on undo, doesn't render it again.
+     */
     class SchemeComboBox : public Gtk::ComboBox
     {
         public:
             SchemeComboBox ();
             boost::shared_ptr<IScheme> get_active_scheme ();
 
+            /**
+             * Update the preview thumbnails for a new base color.  Changes
+             * that arrive while a previous color is being rendered are
+             * coalesced.
+             */
+            void set_base_color (const Color& color);
+
         private:
             struct Priv;
             boost::shared_ptr<Priv> m_priv;
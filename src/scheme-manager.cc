@@ -18,58 +18,139 @@
  *  along with this program; if not, see <http://www.gnu.org/licenses/>
  *
  *******************************************************************************/
+#include <algorithm>
+#include <iostream>
+#include <glibmm/fileutils.h>
+#include <glibmm/miscutils.h>
+#include <glibmm/module.h>
+#include <glibmm-utils/exception.h>
 #include "scheme-manager.h"
+#include "scheme-cache.h"
+#include "scripted-scheme.h"
+#include "plugin-scheme.h"
 
 namespace agave
 {
     SchemeManager* SchemeManager::s_instance = 0;
 
-    class AnalogousScheme : public IScheme
+    /**
+     * Adapts one of the hsv_t-based generator functions of a scheme to the
+     * Color-based slot type used by ColorRelation.  The generators work on
+     * stack values, so computing an output color only allocates the single
+     * Color that is handed back to the relation.
+     */
+    template <class SchemeT>
+    class ValueGenerator : public sigc::functor_base
     {
         public:
-            virtual Glib::ustring get_name () const {
-                return "Analogous";
+            typedef Color result_type;
+            typedef hsv_t (SchemeT::*func_t) (const hsv_t&) const;
+
+            ValueGenerator (const SchemeT* scheme, func_t func) :
+                m_scheme (scheme),
+                m_func (func)
+            {}
+
+            Color operator() (const Color& c) const
+            {
+                return Color (ColorValue ((m_scheme->*m_func) (c.as_hsv ())));
             }
 
-            virtual ColorRelation::SlotColorGen
-                get_outer_left () const
-                {
-                    return sigc::mem_fun (this, &AnalogousScheme::outer_left);
-                }
+        private:
+            const SchemeT* m_scheme;
+            func_t m_func;
+    };
 
-            virtual ColorRelation::SlotColorGen
-                get_inner_left () const
-                {
-                    return sigc::mem_fun (this, &AnalogousScheme::inner_left);
-                }
+    template <class SchemeT>
+    ValueGenerator<SchemeT> value_gen (const SchemeT* scheme,
+            typename ValueGenerator<SchemeT>::func_t func)
+    {
+        return ValueGenerator<SchemeT> (scheme, func);
+    }
 
-            virtual ColorRelation::SlotColorGen
-                get_inner_right () const
-                {
-                    return sigc::mem_fun (this, &AnalogousScheme::inner_right);
-                }
+    /**
+     * The IScheme implementation shared by the built-in schemes.  SchemeT
+     * provides the generator functions outer_left (), inner_left (),
+     * inner_right () and outer_right ().  generate () and generate_batch ()
+     * call them directly, so the compiler can inline them into the loop.
+     */
+    template <class SchemeT>
+    class BuiltinScheme : public IScheme
+    {
+        public:
+            virtual ColorRelation::SlotColorGen get_outer_left () const
+            { return value_gen (scheme (), &SchemeT::outer_left); }
+
+            virtual ColorRelation::SlotColorGen get_inner_left () const
+            { return value_gen (scheme (), &SchemeT::inner_left); }
+
+            virtual ColorRelation::SlotColorGen get_inner_right () const
+            { return value_gen (scheme (), &SchemeT::inner_right); }
+
+            virtual ColorRelation::SlotColorGen get_outer_right () const
+            { return value_gen (scheme (), &SchemeT::outer_right); }
 
-            virtual ColorRelation::SlotColorGen
-                get_outer_right () const
+            virtual unsigned int get_num_outputs () const
+            {
+                return NUM_OUTPUTS;
+            }
+
+            virtual void generate (const hsv_t& base, hsv_t* outputs) const
+            {
+                generate_outputs (base, outputs);
+            }
+
+            virtual void generate_batch (const hsv_t* bases, std::size_t n,
+                                         hsv_t* outputs) const
+            {
+                for (std::size_t i = 0; i < n; ++i)
                 {
-                    return sigc::mem_fun (this, &AnalogousScheme::outer_right);
+                    generate_outputs (bases[i], outputs + i * NUM_OUTPUTS);
                 }
+            }
 
         private:
-            Color outer_left (const Color& c) const
+            static const unsigned int NUM_OUTPUTS = 4;
+
+            const SchemeT* scheme () const
+            {
+                return static_cast<const SchemeT*> (this);
+            }
+
+            void generate_outputs (const hsv_t& base, hsv_t* outputs) const
+            {
+                const SchemeT* s = scheme ();
+                outputs[0] = clamp_hsv (s->outer_left (base));
+                outputs[1] = clamp_hsv (s->inner_left (base));
+                outputs[2] = clamp_hsv (s->inner_right (base));
+                outputs[3] = clamp_hsv (s->outer_right (base));
+            }
+    };
+
+    class AnalogousScheme : public BuiltinScheme<AnalogousScheme>
+    {
+        public:
+            virtual Glib::ustring get_name () const {
+                return "Analogous";
+            }
+
+        private:
+            friend class BuiltinScheme<AnalogousScheme>;
+
+            hsv_t outer_left (const hsv_t& c) const
             {
                 double s_shift = -0.05;
-                if (c.get_saturation () <= 0.95)
+                if (c.s <= 0.95)
                 {
                     s_shift = 0.05;
                 }
                 double v_shift = -0.09;
-                if (c.get_value () <= 0.91)
+                if (c.v <= 0.91)
                 {
                     v_shift = 0.09;
                 }
                 hsv_t shift = {0.05, s_shift, v_shift, 0.0};
-                hsv_t result = c.as_hsv () + shift;
+                hsv_t result = c + shift;
                 if (result.s < 0.1)
                 {
                     result.s = 0.1;
@@ -78,23 +159,23 @@ namespace agave
                 {
                     result.v = 0.2;
                 }
-                return Color (result);
+                return result;
             }
 
-            Color inner_left (const Color& c) const
+            hsv_t inner_left (const hsv_t& c) const
             {
                 double s_shift = -0.05;
-                if (c.get_saturation () <= 0.95)
+                if (c.s <= 0.95)
                 {
                     s_shift = 0.05;
                 }
                 double v_shift = 0.0;
-                if (c.get_value () <= 0.95)
+                if (c.v <= 0.95)
                 {
                     v_shift = 0.05;
                 }
                 hsv_t shift = {0.1, s_shift, v_shift, 0.0};
-                hsv_t result = c.as_hsv () + shift;
+                hsv_t result = c + shift;
                 if (result.s < 0.1)
                 {
                     result.s = 0.1;
@@ -103,23 +184,23 @@ namespace agave
                 {
                     result.v = 0.2;
                 }
-                return Color (result);
+                return result;
             }
 
-            Color inner_right (const Color& c) const
+            hsv_t inner_right (const hsv_t& c) const
             {
                 double s_shift = -0.05;
-                if (c.get_saturation () <= 0.95)
+                if (c.s <= 0.95)
                 {
                     s_shift = 0.05;
                 }
                 double v_shift = -0.09;
-                if (c.get_value () <= 0.91)
+                if (c.v <= 0.91)
                 {
                     v_shift = 0.09;
                 }
                 hsv_t shift = {-0.05, s_shift, v_shift, 0.0};
-                hsv_t result = c.as_hsv () + shift;
+                hsv_t result = c + shift;
                 if (result.s < 0.1)
                 {
                     result.s = 0.1;
@@ -128,23 +209,23 @@ namespace agave
                 {
                     result.v = 0.2;
                 }
-                return Color (result);
+                return result;
             }
 
-            Color outer_right (const Color& c) const
+            hsv_t outer_right (const hsv_t& c) const
             {
                 double s_shift = -0.05;
-                if (c.get_saturation () <= 0.95)
+                if (c.s <= 0.95)
                 {
                     s_shift = 0.05;
                 }
                 double v_shift = 0.0;
-                if (c.get_value () <= 0.95)
+                if (c.v <= 0.95)
                 {
                     v_shift = 0.05;
                 }
                 hsv_t shift = {-0.1, s_shift, v_shift, 0.0};
-                hsv_t result = c.as_hsv () + shift;
+                hsv_t result = c + shift;
                 if (result.s < 0.1)
                 {
                     result.s = 0.1;
@@ -153,46 +234,24 @@ namespace agave
                 {
                     result.v = 0.2;
                 }
-                return Color (result);
+                return result;
             }
     };
 
-    class MonochromaticScheme : public IScheme
+    class MonochromaticScheme : public BuiltinScheme<MonochromaticScheme>
     {
         public:
             virtual Glib::ustring get_name () const {
                 return "Monochromatic";
             }
 
-            virtual ColorRelation::SlotColorGen
-                get_outer_left () const
-                {
-                    return sigc::mem_fun (this, &MonochromaticScheme::outer_left);
-                }
-
-            virtual ColorRelation::SlotColorGen
-                get_inner_left () const
-                {
-                    return sigc::mem_fun (this, &MonochromaticScheme::inner_left);
-                }
-
-            virtual ColorRelation::SlotColorGen
-                get_inner_right () const
-                {
-                    return sigc::mem_fun (this, &MonochromaticScheme::inner_right);
-                }
-
-            virtual ColorRelation::SlotColorGen
-                get_outer_right () const
-                {
-                    return sigc::mem_fun (this, &MonochromaticScheme::outer_right);
-                }
-
         private:
-            Color outer_left (const Color& c) const
+            friend class BuiltinScheme<MonochromaticScheme>;
+
+            hsv_t outer_left (const hsv_t& c) const
             {
                 hsv_t shift = {0.0, 0.0, 0.0, 0.0};
-                if (c.get_saturation () < 0.40)
+                if (c.s < 0.40)
                 {
                     shift.s = 0.30;
                 }
@@ -200,30 +259,30 @@ namespace agave
                 {
                     shift.s = -0.30;
                 }
-                if (c.get_value () < 0.4)
+                if (c.v < 0.4)
                 {
                     shift.v = 0.1;
                 }
                 else
                 {
-                    shift.v = 0.1 - (0.1 / 0.6) * (c.get_value () - 0.4);
+                    shift.v = 0.1 - (0.1 / 0.6) * (c.v - 0.4);
                 }
-                hsv_t result = c.as_hsv () + shift;
+                hsv_t result = c + shift;
                 if (result.v < 0.2)
                 {
                     result.v = 0.2;
                 }
-                return Color (result);
+                return result;
             }
 
-            Color inner_left (const Color& c) const
+            hsv_t inner_left (const hsv_t& c) const
             {
                 hsv_t shift = {0.0, 0.0, 0.0, 0.0};
-                if (c.get_value () > 0.70)
+                if (c.v > 0.70)
                 {
                     shift.v = -0.50;
                 }
-                else if (c.get_value () > 0.40)
+                else if (c.v > 0.40)
                 {
                     shift.v = 0.30;
                 }
@@ -231,13 +290,13 @@ namespace agave
                 {
                     shift.v = 0.30;
                 }
-                return Color (c.as_hsv () + shift);
+                return c + shift;
             }
 
-            Color inner_right (const Color& c) const
+            hsv_t inner_right (const hsv_t& c) const
             {
                 hsv_t shift = {0.0, 0.0, 0.0, 0.0};
-                if (c.get_saturation () < 0.40)
+                if (c.s < 0.40)
                 {
                     shift.s = 0.30;
                 }
@@ -245,11 +304,11 @@ namespace agave
                 {
                     shift.s = -0.30;
                 }
-                if (c.get_value () > 0.70)
+                if (c.v > 0.70)
                 {
                     shift.v = -0.50;
                 }
-                else if (c.get_value () > 0.40)
+                else if (c.v > 0.40)
                 {
                     shift.v = 0.30;
                 }
@@ -257,17 +316,17 @@ namespace agave
                 {
                     shift.v = 0.30;
                 }
-                return Color (c.as_hsv () + shift);
+                return c + shift;
             }
 
-            Color outer_right (const Color& c) const
+            hsv_t outer_right (const hsv_t& c) const
             {
                 hsv_t shift = {0.0, 0.0, 0.0, 0.0};
-                if (c.get_value () > 0.70)
+                if (c.v > 0.70)
                 {
                     shift.v = -0.20;
                 }
-                else if (c.get_value () > 0.40)
+                else if (c.v > 0.40)
                 {
                     shift.v = -0.20;
                 }
@@ -275,47 +334,25 @@ namespace agave
                 {
                     shift.v = 0.60;
                 }
-                return Color (c.as_hsv () + shift);
+                return c + shift;
             }
     };
 
-    class TriadScheme : public IScheme
+    class TriadScheme : public BuiltinScheme<TriadScheme>
     {
         public:
             virtual Glib::ustring get_name () const {
                 return "Triadic";
             }
 
-            virtual ColorRelation::SlotColorGen
-                get_outer_left () const
-                {
-                    return sigc::mem_fun (this, &TriadScheme::outer_left);
-                }
-
-            virtual ColorRelation::SlotColorGen
-                get_inner_left () const
-                {
-                    return sigc::mem_fun (this, &TriadScheme::inner_left);
-                }
-
-            virtual ColorRelation::SlotColorGen
-                get_inner_right () const
-                {
-                    return sigc::mem_fun (this, &TriadScheme::inner_right);
-                }
-
-            virtual ColorRelation::SlotColorGen
-                get_outer_right () const
-                {
-                    return sigc::mem_fun (this, &TriadScheme::outer_right);
-                }
-
         private:
-            Color outer_left (const Color& c) const
+            friend class BuiltinScheme<TriadScheme>;
+
+            hsv_t outer_left (const hsv_t& c) const
             {
                 hsv_t shift = {1.0 / 3.0, 0.0, 0.0, 0.0};
 
-                if (c.get_saturation () > 0.2)
+                if (c.s > 0.2)
                 {
                     shift.s = -0.1;
                 }
@@ -323,30 +360,30 @@ namespace agave
                 {
                     shift.s = 0.1;
                 }
-                if (c.get_value () > 0.7)
+                if (c.v > 0.7)
                 {
                     // value shift is 0 at 1.0 and 0.05 at 0.7, so make the shift change
                     // linearly between these points
-                    shift.v = (c.get_value () - 0.7) * (0.05 / 0.3);
+                    shift.v = (c.v - 0.7) * (0.05 / 0.3);
                 }
                 else
                 {
                     shift.v = 0.05;
                 }
-                hsv_t result = c.as_hsv () + shift;
+                hsv_t result = c + shift;
 
                 // don't let the value get below 0.2
                 if (result.v < 0.2)
                 {
                     result.v = 0.2;
                 }
-                return Color (result);
+                return result;
             }
 
-            Color inner_left (const Color& c) const
+            hsv_t inner_left (const hsv_t& c) const
             {
                 hsv_t shift = {0.0, 0.0, 0.0, 0.0};
-                if (c.get_saturation () > 0.9)
+                if (c.s > 0.9)
                 {
                     shift.s = -0.1;
                 }
@@ -354,7 +391,7 @@ namespace agave
                 {
                     shift.s = 0.1;
                 }
-                if (c.get_value () > 0.5)
+                if (c.v > 0.5)
                 {
                     shift.v = -0.3;
                 }
@@ -363,15 +400,15 @@ namespace agave
                     shift.v = 0.3;
                 }
 
-                hsv_t result = c.as_hsv () + shift;
-                return Color (result);
+                hsv_t result = c + shift;
+                return result;
             }
 
-            Color inner_right (const Color& c) const
+            hsv_t inner_right (const hsv_t& c) const
             {
                 hsv_t shift = {-1.0 / 3.0, 0.0, 0.0, 0.0};
 
-                if (c.get_saturation () > 0.1)
+                if (c.s > 0.1)
                 {
                     shift.s = -0.1;
                 }
@@ -379,7 +416,7 @@ namespace agave
                 {
                     shift.s = 0.1;
                 }
-                if (c.get_value () > 0.5)
+                if (c.v > 0.5)
                 {
                     shift.v = -0.2;
                 }
@@ -388,15 +425,15 @@ namespace agave
                     shift.v = 0.2;
                 }
 
-                hsv_t result = c.as_hsv () + shift;
-                return Color (result);
+                hsv_t result = c + shift;
+                return result;
             }
 
-            Color outer_right (const Color& c) const
+            hsv_t outer_right (const hsv_t& c) const
             {
                 hsv_t shift = {-1.0 / 3.0, 0.0, 0.0, 0.0};
 
-                if (c.get_saturation () > 0.95)
+                if (c.s > 0.95)
                 {
                     shift.s = -0.05;
                 }
@@ -404,7 +441,7 @@ namespace agave
                 {
                     shift.s = 0.05;
                 }
-                if (c.get_value () > 0.7)
+                if (c.v > 0.7)
                 {
                     shift.v = -0.3;
                 }
@@ -413,60 +450,50 @@ namespace agave
                     shift.v = 0.3;
                 }
 
-                hsv_t result = c.as_hsv () + shift;
-                return Color (result);
+                hsv_t result = c + shift;
+                return result;
             }
     };
 
-    class ComplementaryScheme : public IScheme
+    class ComplementaryScheme : public BuiltinScheme<ComplementaryScheme>
     {
         public:
             virtual Glib::ustring get_name () const {
                 return "Complementary";
             }
 
-            virtual ColorRelation::SlotColorGen get_outer_left () const
-            { return sigc::mem_fun (this, &ComplementaryScheme::outer_left); }
-
-            virtual ColorRelation::SlotColorGen get_inner_left () const
-            { return sigc::mem_fun (this, &ComplementaryScheme::inner_left); }
-
-            virtual ColorRelation::SlotColorGen get_inner_right () const
-            { return sigc::mem_fun (this, &ComplementaryScheme::inner_right); }
-
-            virtual ColorRelation::SlotColorGen get_outer_right () const
-            { return sigc::mem_fun (this, &ComplementaryScheme::outer_right); }
-
         private:
-            Color outer_left (const Color& c) const
+            friend class BuiltinScheme<ComplementaryScheme>;
+
+            hsv_t outer_left (const hsv_t& c) const
             {
                 hsv_t shift = {0.0, -0.1, 0.0, 0.0};
-                if (c.get_value () >= 0.7)
+                if (c.v >= 0.7)
                 {
-                    shift.v = c.get_value () - 0.7;
+                    shift.v = c.v - 0.7;
                 }
                 else
                 {
                     shift.v = 0.3;
                 }
-                hsv_t result = c.as_hsv () + shift;
-                return Color (result);
+                hsv_t result = c + shift;
+                return result;
             }
 
-            Color inner_left (const Color& c) const
+            hsv_t inner_left (const hsv_t& c) const
             {
                 hsv_t shift = {0.0, 0.0, 0.0, 0.0};
                 // saturation shift is 0 at 1.0 and 0.1 at 0.8, so make the
                 // shift change linearly between these points
-                if (c.get_saturation () > 0.8)
+                if (c.s > 0.8)
                 {
-                    shift.s = (c.get_saturation () - 0.8) * (0.1 / 0.2);
+                    shift.s = (c.s - 0.8) * (0.1 / 0.2);
                 }
                 else
                 {
                     shift.s = 0.1;
                 }
-                if (c.get_value () >= 0.5)
+                if (c.v >= 0.5)
                 {
                     shift.v = -0.3;
                 }
@@ -474,23 +501,23 @@ namespace agave
                 {
                     shift.v = 0.3;
                 }
-                hsv_t result = c.as_hsv () + shift;
-                return Color (result);
+                hsv_t result = c + shift;
+                return result;
             }
 
-            Color inner_right (const Color& c) const
+            hsv_t inner_right (const hsv_t& c) const
             {
                 hsv_t shift = {0.5, 0.0, -0.3, 0.0};
 
-                if (c.get_saturation () > 0.8)
+                if (c.s > 0.8)
                 {
-                    shift.s = c.get_saturation () - 0.8;
+                    shift.s = c.s - 0.8;
                 }
                 else
                 {
                     shift.s = 0.2;
                 }
-                if (c.get_value () >= 0.5)
+                if (c.v >= 0.5)
                 {
                     shift.v = -0.3;
                 }
@@ -498,42 +525,32 @@ namespace agave
                 {
                     shift.v = 0.3;
                 }
-                hsv_t result = c.as_hsv () + shift;
-                return Color (result);
+                hsv_t result = c + shift;
+                return result;
             }
 
-            Color outer_right (const Color& c) const
+            hsv_t outer_right (const hsv_t& c) const
             {
                 hsv_t shift = {0.5, 0.0, 0.0, 0.0};
-                hsv_t result = c.as_hsv () + shift;
-                return Color (result);
+                hsv_t result = c + shift;
+                return result;
             }
     };
 
-    class ShadesScheme : public IScheme
+    class ShadesScheme : public BuiltinScheme<ShadesScheme>
     {
         public:
             virtual Glib::ustring get_name () const {
                 return "Shades";
             }
 
-            virtual ColorRelation::SlotColorGen get_outer_left () const
-            { return sigc::mem_fun (this, &ShadesScheme::outer_left); }
-
-            virtual ColorRelation::SlotColorGen get_inner_left () const
-            { return sigc::mem_fun (this, &ShadesScheme::inner_left); }
-
-            virtual ColorRelation::SlotColorGen get_inner_right () const
-            { return sigc::mem_fun (this, &ShadesScheme::inner_right); }
-
-            virtual ColorRelation::SlotColorGen get_outer_right () const
-            { return sigc::mem_fun (this, &ShadesScheme::outer_right); }
-
         private:
-            Color outer_left (const Color& c) const
+            friend class BuiltinScheme<ShadesScheme>;
+
+            hsv_t outer_left (const hsv_t& c) const
             {
                 hsv_t shift = {0.0, 0.0, 0.0, 0.0};
-                if (c.get_value () >= 0.7)
+                if (c.v >= 0.7)
                 {
                     shift.v = -0.5;
                 }
@@ -541,14 +558,14 @@ namespace agave
                 {
                     shift.v = 0.3;
                 }
-                hsv_t result = c.as_hsv () + shift;
-                return Color (result);
+                hsv_t result = c + shift;
+                return result;
             }
 
-            Color inner_left (const Color& c) const
+            hsv_t inner_left (const hsv_t& c) const
             {
                 hsv_t shift = {0.0, 0.0, 0.0, 0.0};
-                if (c.get_value () >= 0.45)
+                if (c.v >= 0.45)
                 {
                     shift.v = -0.25;
                 }
@@ -556,14 +573,14 @@ namespace agave
                 {
                     shift.v = 0.55;
                 }
-                hsv_t result = c.as_hsv () + shift;
-                return Color (result);
+                hsv_t result = c + shift;
+                return result;
             }
 
-            Color inner_right (const Color& c) const
+            hsv_t inner_right (const hsv_t& c) const
             {
                 hsv_t shift = {0.0, 0.0, 0.0, 0.0};
-                if (c.get_value () >= 0.95)
+                if (c.v >= 0.95)
                 {
                     shift.v = -0.75;
                 }
@@ -571,24 +588,24 @@ namespace agave
                 {
                     shift.v = 0.05;
                 }
-                hsv_t result = c.as_hsv () + shift;
+                hsv_t result = c + shift;
 
                 if (result.v < 0.2)
                 {
                     result.v = 0.2;
                 }
-                return Color (result);
+                return result;
             }
 
-            Color outer_right (const Color& c) const
+            hsv_t outer_right (const hsv_t& c) const
             {
                 hsv_t shift = {0.0, 0.0, -0.1, 0.0};
-                hsv_t result = c.as_hsv () + shift;
+                hsv_t result = c + shift;
                 if (result.v < 0.2)
                 {
                     result.v = 0.2;
                 }
-                return Color (result);
+                return result;
             }
     };
 
@@ -620,9 +637,17 @@ namespace agave
         boost::shared_ptr<IScheme> shades (new ShadesScheme ());
         m_schemes.push_back (shades);
 
-        // theoretically this could now load user-defined schemes somewhere
-        // (either as defined to-be-defined text format or as compiled plugins),
-        // but that hasn't been implemented
+        // compiled schemes, see agave-scheme-plugin.h
+#ifdef AGAVE_PLUGINDIR
+        load_plugin_directory (AGAVE_PLUGINDIR);
+#endif
+
+        // user-defined schemes, see ScriptedScheme for the file format
+#ifdef AGAVE_SCHEMEDIR
+        load_directory (AGAVE_SCHEMEDIR);
+#endif
+        load_directory (Glib::build_filename (Glib::get_user_data_dir (),
+                                              "agave2", "schemes"));
     }
 
     SchemeManager::~SchemeManager ()
@@ -633,4 +658,91 @@ namespace agave
     {
         return m_schemes;
     }
+
+    void SchemeManager::add_scheme (const boost::shared_ptr<IScheme>& scheme)
+    {
+        THROW_IF_FAIL (scheme);
+        for (std::vector<boost::shared_ptr<IScheme> >::iterator iter =
+             m_schemes.begin (); iter != m_schemes.end (); ++iter)
+        {
+            if ((*iter)->get_name () == scheme->get_name ())
+            {
+                SchemeCache::instance ().invalidate (**iter);
+                *iter = scheme;
+                return;
+            }
+        }
+        m_schemes.push_back (scheme);
+    }
+
+    /**
+     * Get the full paths of the files in @a dirname whose names end with
+     * @a suffix, sorted so that schemes are loaded in a reproducible order
+     */
+    static std::vector<std::string> list_files (const std::string& dirname,
+                                                const std::string& suffix)
+    {
+        std::vector<std::string> filenames;
+        if (!Glib::file_test (dirname, Glib::FILE_TEST_IS_DIR))
+            return filenames;
+
+        try
+        {
+            Glib::Dir dir (dirname);
+            for (std::string name = dir.read_name (); !name.empty ();
+                 name = dir.read_name ())
+            {
+                if (name.size () > suffix.size () &&
+                    name.compare (name.size () - suffix.size (),
+                                  suffix.size (), suffix) == 0)
+                {
+                    filenames.push_back (Glib::build_filename (dirname, name));
+                }
+            }
+        }
+        catch (const Glib::FileError& exception)
+        {
+            std::cerr << Glib::ustring::compose ("Couldn't read directory %1: %2",
+                    dirname, exception.what ())
+                << std::endl;
+        }
+        std::sort (filenames.begin (), filenames.end ());
+        return filenames;
+    }
+
+    std::size_t SchemeManager::load_directory (const std::string& dirname)
+    {
+        const std::vector<std::string> filenames = list_files (dirname, ".scheme");
+        std::size_t count = 0;
+        for (std::vector<std::string>::const_iterator iter = filenames.begin ();
+             iter != filenames.end (); ++iter)
+        {
+            boost::shared_ptr<IScheme> scheme = ScriptedScheme::load_file (*iter);
+            if (scheme)
+            {
+                add_scheme (scheme);
+                ++count;
+            }
+        }
+        return count;
+    }
+
+    std::size_t SchemeManager::load_plugin_directory (const std::string& dirname)
+    {
+        const std::vector<std::string> filenames =
+            list_files (dirname, "." G_MODULE_SUFFIX);
+        std::size_t count = 0;
+        for (std::vector<std::string>::const_iterator iter = filenames.begin ();
+             iter != filenames.end (); ++iter)
+        {
+            std::vector<boost::shared_ptr<IScheme> > schemes;
+            count += PluginScheme::load_plugin (*iter, schemes);
+            for (std::vector<boost::shared_ptr<IScheme> >::const_iterator scheme =
+                 schemes.begin (); scheme != schemes.end (); ++scheme)
+            {
+                add_scheme (*scheme);
+            }
+        }
+        return count;
+    }
 }
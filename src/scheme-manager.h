@@ -21,6 +21,7 @@
 #ifndef __SCHEME_MANAGER_H
 #define __SCHEME_MANAGER_H
 
+#include <string>
 #include <vector>
 #include "i-scheme.h"
 
@@ -32,6 +33,30 @@ namespace agave
             static SchemeManager& instance ();
             const std::vector<boost::shared_ptr<IScheme> >& get_schemes ();
 
+            /**
+             * Add a scheme.  A scheme with the same name as an existing one
+             * replaces it.
+             */
+            void add_scheme (const boost::shared_ptr<IScheme>& scheme);
+
+            /**
+             * Load all scheme files (*.scheme) in a directory, see
+             * ScriptedScheme.  Errors are reported on stderr and a missing
+             * directory is not an error.
+             *
+             * @return  The number of schemes loaded
+             */
+            std::size_t load_directory (const std::string& dirname);
+
+            /**
+             * Load all scheme plugins in a directory, see
+             * agave-scheme-plugin.h.  Plugins that don't match the ABI of
+             * the application are skipped with a warning.
+             *
+             * @return  The number of schemes loaded
+             */
+            std::size_t load_plugin_directory (const std::string& dirname);
+
         private:
             SchemeManager ();
             virtual ~SchemeManager ();
@@ -0,0 +1,1353 @@
+/*******************************************************************************
+ *
+ *  Copyright (c) 2008 Jonathon Jongsma
+ *
+ *  This file is part of Agave
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ *******************************************************************************/
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <vector>
+#include <glib.h>
+#include <glibmm/fileutils.h>
+#include <glibmm/miscutils.h>
+#include <glibmm-utils/exception.h>
+#include "scripted-scheme.h"
+
+namespace agave
+{
+    /************************************************************
+     * Bytecode
+     ***********************************************************/
+    enum opcode_t
+    {
+        // push constants[arg]
+        OP_CONST,
+        // push slots[slot]
+        OP_LOAD,
+        // pop into slots[slot]
+        OP_STORE,
+        // slots[slot] += constants[arg] (for 'x += <constant>')
+        OP_ADD_CONST,
+        // slots[slot] *= constants[arg]
+        OP_MUL_CONST,
+        OP_ADD,
+        OP_SUB,
+        OP_MUL,
+        OP_DIV,
+        OP_NEG,
+        OP_LT,
+        OP_LE,
+        OP_GT,
+        OP_GE,
+        OP_EQ,
+        OP_NE,
+        OP_AND,
+        OP_OR,
+        OP_NOT,
+        OP_MIN,
+        OP_MAX,
+        OP_ABS,
+        OP_CLAMP,
+        OP_MIX,
+        // continue at instruction arg
+        OP_JUMP,
+        // pop, continue at instruction arg if the value was 0.0
+        OP_JUMP_IF_FALSE
+    };
+
+    struct instruction_t
+    {
+        unsigned char op;
+        unsigned char slot;
+        unsigned short arg;
+    };
+
+    // the fixed slots, locals follow them
+    enum slot_t
+    {
+        SLOT_H,
+        SLOT_S,
+        SLOT_V,
+        SLOT_A,
+        SLOT_BASE_H,
+        SLOT_BASE_S,
+        SLOT_BASE_V,
+        SLOT_BASE_A,
+        NUM_FIXED_SLOTS
+    };
+
+    static const char* const SLOT_NAMES[NUM_FIXED_SLOTS] =
+    {
+        "h", "s", "v", "a", "base_h", "base_s", "base_v", "base_a"
+    };
+
+    const unsigned int MAX_SLOTS = 32;
+    const unsigned int MAX_STACK = 32;
+    const std::size_t MAX_INSTRUCTIONS = 0xffff;
+
+    static inline double truth (bool value)
+    {
+        return value ? 1.0 : 0.0;
+    }
+
+    static inline double clamp_value (double x, double lo, double hi)
+    {
+        return std::min (std::max (x, lo), hi);
+    }
+
+    /**
+     * Apply an operator that doesn't touch the slots or the program counter
+     * to its arguments.  Used for constant folding, the evaluation loop has
+     * its own copy of these.
+     */
+    static double compute (opcode_t op, const double* args)
+    {
+        switch (op)
+        {
+            case OP_ADD: return args[0] + args[1];
+            case OP_SUB: return args[0] - args[1];
+            case OP_MUL: return args[0] * args[1];
+            case OP_DIV: return args[0] / args[1];
+            case OP_NEG: return -args[0];
+            case OP_LT: return truth (args[0] < args[1]);
+            case OP_LE: return truth (args[0] <= args[1]);
+            case OP_GT: return truth (args[0] > args[1]);
+            case OP_GE: return truth (args[0] >= args[1]);
+            case OP_EQ: return truth (args[0] == args[1]);
+            case OP_NE: return truth (args[0] != args[1]);
+            case OP_AND: return truth (args[0] != 0.0 && args[1] != 0.0);
+            case OP_OR: return truth (args[0] != 0.0 || args[1] != 0.0);
+            case OP_NOT: return truth (args[0] == 0.0);
+            case OP_MIN: return std::min (args[0], args[1]);
+            case OP_MAX: return std::max (args[0], args[1]);
+            case OP_ABS: return std::fabs (args[0]);
+            case OP_CLAMP: return clamp_value (args[0], args[1], args[2]);
+            case OP_MIX: return args[0] + (args[1] - args[0]) * args[2];
+            default:
+                break;
+        }
+        return 0.0;
+    }
+
+    /**
+     * The compiled form of one block of a scheme file
+     */
+    class SchemeProgram
+    {
+        public:
+            std::vector<instruction_t> m_code;
+            std::vector<double> m_constants;
+            unsigned int m_num_slots;
+
+            SchemeProgram () : m_num_slots (NUM_FIXED_SLOTS) {}
+
+            hsv_t run (const hsv_t& base) const;
+    };
+
+    hsv_t SchemeProgram::run (const hsv_t& base) const
+    {
+        double slots[MAX_SLOTS];
+        slots[SLOT_H] = slots[SLOT_BASE_H] = base.h;
+        slots[SLOT_S] = slots[SLOT_BASE_S] = base.s;
+        slots[SLOT_V] = slots[SLOT_BASE_V] = base.v;
+        slots[SLOT_A] = slots[SLOT_BASE_A] = base.a;
+        std::fill (slots + NUM_FIXED_SLOTS, slots + m_num_slots, 0.0);
+
+        // the compiler guarantees that the stack never exceeds MAX_STACK
+        double stack[MAX_STACK];
+        double* top = stack;
+        const instruction_t* const code = m_code.empty () ? 0 : &m_code[0];
+        const double* const constants =
+            m_constants.empty () ? 0 : &m_constants[0];
+        const std::size_t size = m_code.size ();
+        for (std::size_t pc = 0; pc < size; ++pc)
+        {
+            const instruction_t& ins = code[pc];
+            switch (ins.op)
+            {
+                case OP_CONST: *top++ = constants[ins.arg]; break;
+                case OP_LOAD: *top++ = slots[ins.slot]; break;
+                case OP_STORE: slots[ins.slot] = *--top; break;
+                case OP_ADD_CONST: slots[ins.slot] += constants[ins.arg]; break;
+                case OP_MUL_CONST: slots[ins.slot] *= constants[ins.arg]; break;
+                case OP_ADD: --top; top[-1] += top[0]; break;
+                case OP_SUB: --top; top[-1] -= top[0]; break;
+                case OP_MUL: --top; top[-1] *= top[0]; break;
+                case OP_DIV: --top; top[-1] /= top[0]; break;
+                case OP_NEG: top[-1] = -top[-1]; break;
+                case OP_LT: --top; top[-1] = truth (top[-1] < top[0]); break;
+                case OP_LE: --top; top[-1] = truth (top[-1] <= top[0]); break;
+                case OP_GT: --top; top[-1] = truth (top[-1] > top[0]); break;
+                case OP_GE: --top; top[-1] = truth (top[-1] >= top[0]); break;
+                case OP_EQ: --top; top[-1] = truth (top[-1] == top[0]); break;
+                case OP_NE: --top; top[-1] = truth (top[-1] != top[0]); break;
+                case OP_AND:
+                    --top;
+                    top[-1] = truth (top[-1] != 0.0 && top[0] != 0.0);
+                    break;
+                case OP_OR:
+                    --top;
+                    top[-1] = truth (top[-1] != 0.0 || top[0] != 0.0);
+                    break;
+                case OP_NOT: top[-1] = truth (top[-1] == 0.0); break;
+                case OP_MIN: --top; top[-1] = std::min (top[-1], top[0]); break;
+                case OP_MAX: --top; top[-1] = std::max (top[-1], top[0]); break;
+                case OP_ABS: top[-1] = std::fabs (top[-1]); break;
+                case OP_CLAMP:
+                    top -= 2;
+                    top[-1] = clamp_value (top[-1], top[0], top[1]);
+                    break;
+                case OP_MIX:
+                    top -= 2;
+                    top[-1] += (top[0] - top[-1]) * top[1];
+                    break;
+                case OP_JUMP: pc = ins.arg - 1; break;
+                case OP_JUMP_IF_FALSE:
+                    if (*--top == 0.0)
+                    {
+                        pc = ins.arg - 1;
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        hsv_t result;
+        result.h = slots[SLOT_H];
+        result.s = slots[SLOT_S];
+        result.v = slots[SLOT_V];
+        result.a = slots[SLOT_A];
+        // don't let a division by zero or similar end up in the color
+        if (!(std::fabs (result.h) <= DBL_MAX)) result.h = base.h;
+        if (!(std::fabs (result.s) <= DBL_MAX)) result.s = base.s;
+        if (!(std::fabs (result.v) <= DBL_MAX)) result.v = base.v;
+        if (!(std::fabs (result.a) <= DBL_MAX)) result.a = base.a;
+        return result;
+    }
+
+    /************************************************************
+     * Lexer
+     ***********************************************************/
+    enum token_type_t
+    {
+        TOKEN_END,
+        TOKEN_NUMBER,
+        TOKEN_IDENTIFIER,
+        TOKEN_STRING,
+        // operators and punctuation, including newlines
+        TOKEN_SYMBOL
+    };
+
+    struct token_t
+    {
+        token_type_t type;
+        std::string text;
+        double number;
+        int line;
+        int column;
+    };
+
+    static inline bool is_identifier_start (char c)
+    {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+    }
+
+    static inline bool is_digit (char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    /**
+     * Split @a source into tokens.  Newlines are kept as "\n" symbols since
+     * they separate statements.
+     */
+    static bool tokenize (const std::string& source,
+                          std::vector<token_t>& tokens,
+                          Glib::ustring& error)
+    {
+        static const char* const TWO_CHAR_SYMBOLS[] =
+        {
+            "+=", "-=", "*=", "/=", "<=", ">=", "==", "!=", 0
+        };
+
+        const char* p = source.c_str ();
+        const char* const end = p + source.size ();
+        const char* line_start = p;
+        int line = 1;
+        while (p != end)
+        {
+            token_t token;
+            token.number = 0.0;
+            token.line = line;
+            token.column = p - line_start + 1;
+            const char c = *p;
+            if (c == ' ' || c == '\t' || c == '\r')
+            {
+                ++p;
+                continue;
+            }
+            else if (c == '#')
+            {
+                while (p != end && *p != '\n')
+                    ++p;
+                continue;
+            }
+            else if (c == '\n')
+            {
+                token.type = TOKEN_SYMBOL;
+                token.text = "\n";
+                ++p;
+                ++line;
+                line_start = p;
+            }
+            else if (is_digit (c) || (c == '.' && p + 1 != end && is_digit (p[1])))
+            {
+                // scan the decimal number first and convert exactly that, so
+                // that neither the locale nor hex and inf/nan spellings
+                // change what is accepted
+                const char* start = p;
+                while (p != end && is_digit (*p))
+                    ++p;
+                if (p != end && *p == '.')
+                {
+                    ++p;
+                    while (p != end && is_digit (*p))
+                        ++p;
+                }
+                if (p != end && (*p == 'e' || *p == 'E'))
+                {
+                    const char* exponent = p + 1;
+                    if (exponent != end && (*exponent == '+' || *exponent == '-'))
+                        ++exponent;
+                    if (exponent != end && is_digit (*exponent))
+                    {
+                        p = exponent;
+                        while (p != end && is_digit (*p))
+                            ++p;
+                    }
+                }
+                const std::string text (start, p);
+                char* number_end = 0;
+                token.type = TOKEN_NUMBER;
+                token.number = g_ascii_strtod (text.c_str (), &number_end);
+                // the unit has to end the word, as in "30degx" the number
+                // would be followed by garbage
+                const bool degrees = end - p >= 3 && std::string (p, 3) == "deg" &&
+                    (p + 3 == end || !(is_identifier_start (p[3]) || is_digit (p[3])));
+                if (number_end != text.c_str () + text.size () ||
+                    (p != end && (is_digit (*p) || *p == '.' ||
+                                  (is_identifier_start (*p) && !degrees))))
+                {
+                    error = Glib::ustring::compose ("%1:%2: malformed number",
+                            token.line, token.column);
+                    return false;
+                }
+                // unit suffixes
+                if (degrees)
+                {
+                    token.number /= 360.0;
+                    p += 3;
+                }
+                else if (p != end && *p == '%')
+                {
+                    token.number /= 100.0;
+                    ++p;
+                }
+            }
+            else if (is_identifier_start (c))
+            {
+                const char* start = p;
+                while (p != end && (is_identifier_start (*p) || is_digit (*p)))
+                    ++p;
+                token.type = TOKEN_IDENTIFIER;
+                token.text.assign (start, p);
+            }
+            else if (c == '"')
+            {
+                const char* start = ++p;
+                while (p != end && *p != '"' && *p != '\n')
+                    ++p;
+                if (p == end || *p != '"')
+                {
+                    error = Glib::ustring::compose ("%1:%2: unterminated string",
+                            token.line, token.column);
+                    return false;
+                }
+                token.type = TOKEN_STRING;
+                token.text.assign (start, p);
+                ++p;
+            }
+            else
+            {
+                token.type = TOKEN_SYMBOL;
+                token.text = c;
+                for (int i = 0; TWO_CHAR_SYMBOLS[i]; ++i)
+                {
+                    if (p + 1 != end && TWO_CHAR_SYMBOLS[i][0] == c &&
+                        TWO_CHAR_SYMBOLS[i][1] == p[1])
+                    {
+                        token.text = TWO_CHAR_SYMBOLS[i];
+                        break;
+                    }
+                }
+                if (std::string ("+-*/<>=!(){},;").find (c) == std::string::npos)
+                {
+                    error = Glib::ustring::compose ("%1:%2: unexpected character '%3'",
+                            token.line, token.column, std::string (1, c));
+                    return false;
+                }
+                p += token.text.size ();
+            }
+            tokens.push_back (token);
+        }
+
+        token_t token;
+        token.type = TOKEN_END;
+        token.number = 0.0;
+        token.line = line;
+        token.column = p - line_start + 1;
+        tokens.push_back (token);
+        return true;
+    }
+
+    /************************************************************
+     * Parser and code generator
+     ***********************************************************/
+
+    /**
+     * A node of an expression tree.  Expressions are parsed into a tree
+     * first so that constant subexpressions can be folded before any code
+     * is emitted.
+     */
+    struct expr_node_t
+    {
+        // OP_CONST, OP_LOAD or an operator
+        opcode_t op;
+        double value;
+        unsigned int slot;
+        int args[3];
+        int num_args;
+    };
+
+    struct function_t
+    {
+        const char* name;
+        opcode_t op;
+        int num_args;
+    };
+
+    static const function_t FUNCTIONS[] =
+    {
+        { "min", OP_MIN, 2 },
+        { "max", OP_MAX, 2 },
+        { "abs", OP_ABS, 1 },
+        { "clamp", OP_CLAMP, 3 },
+        { "mix", OP_MIX, 3 },
+        { 0, OP_CONST, 0 }
+    };
+
+    static const char* const OUTPUT_NAMES[] =
+    {
+        "outer_left", "inner_left", "inner_right", "outer_right"
+    };
+    const int NUM_OUTPUTS = 4;
+
+    class SchemeCompiler
+    {
+        public:
+            SchemeCompiler (const std::vector<token_t>& tokens,
+                            const std::string& filename) :
+                m_tokens (tokens),
+                m_pos (0),
+                m_filename (filename),
+                m_program (0)
+            {}
+
+            bool compile (Glib::ustring& name, SchemeProgram* programs);
+            const Glib::ustring& get_error () const { return m_error; }
+
+        private:
+            const token_t& peek () const { return m_tokens[m_pos]; }
+            const token_t& next () { return m_tokens[m_pos++]; }
+            bool is_symbol (const char* symbol) const;
+            bool is_keyword (const char* keyword) const;
+            bool accept (const char* symbol);
+            bool expect (const char* symbol);
+            bool fail (const Glib::ustring& message);
+            bool fail (const token_t& token, const Glib::ustring& message);
+            void skip_newlines ();
+            bool end_statement ();
+
+            bool parse_parameter (const std::string& name);
+            bool parse_block ();
+            bool parse_statements ();
+            bool parse_statement ();
+            bool parse_assignment ();
+            bool parse_if ();
+
+            int parse_expression ();
+            int parse_or ();
+            int parse_and ();
+            int parse_not ();
+            int parse_comparison ();
+            int parse_sum ();
+            int parse_term ();
+            int parse_unary ();
+            int parse_primary ();
+            int add_constant_node (double value);
+            int add_node (opcode_t op, int a, int b = -1, int c = -1);
+
+            bool emit_expression (int node, unsigned int depth);
+            bool emit (opcode_t op, unsigned int slot = 0, unsigned int arg = 0);
+            unsigned int add_constant (double value);
+            bool lookup_slot (const std::string& name, unsigned int& slot) const;
+
+            const std::vector<token_t>& m_tokens;
+            std::size_t m_pos;
+            std::string m_filename;
+            Glib::ustring m_error;
+            std::map<std::string, double> m_parameters;
+            std::vector<expr_node_t> m_nodes;
+            // the block being compiled and the names of its locals
+            SchemeProgram* m_program;
+            std::map<std::string, unsigned int> m_locals;
+    };
+
+    bool SchemeCompiler::is_symbol (const char* symbol) const
+    {
+        return peek ().type == TOKEN_SYMBOL && peek ().text == symbol;
+    }
+
+    bool SchemeCompiler::is_keyword (const char* keyword) const
+    {
+        return peek ().type == TOKEN_IDENTIFIER && peek ().text == keyword;
+    }
+
+    bool SchemeCompiler::accept (const char* symbol)
+    {
+        if (is_symbol (symbol))
+        {
+            ++m_pos;
+            return true;
+        }
+        return false;
+    }
+
+    bool SchemeCompiler::expect (const char* symbol)
+    {
+        if (accept (symbol))
+        {
+            return true;
+        }
+        return fail (Glib::ustring::compose ("expected '%1'", symbol));
+    }
+
+    bool SchemeCompiler::fail (const Glib::ustring& message)
+    {
+        return fail (peek (), message);
+    }
+
+    bool SchemeCompiler::fail (const token_t& token, const Glib::ustring& message)
+    {
+        // only keep the first error, the others are usually caused by it
+        if (m_error.empty ())
+        {
+            m_error = Glib::ustring::compose ("%1:%2:%3: %4", m_filename,
+                    token.line, token.column, message);
+        }
+        return false;
+    }
+
+    void SchemeCompiler::skip_newlines ()
+    {
+        while (accept ("\n") || accept (";"))
+        {
+        }
+    }
+
+    bool SchemeCompiler::end_statement ()
+    {
+        if (accept ("\n") || accept (";") || is_symbol ("}") ||
+            peek ().type == TOKEN_END)
+        {
+            return true;
+        }
+        return fail ("expected the end of the statement");
+    }
+
+    bool SchemeCompiler::compile (Glib::ustring& name, SchemeProgram* programs)
+    {
+        bool seen[NUM_OUTPUTS] = { false, false, false, false };
+        for (skip_newlines (); peek ().type != TOKEN_END; skip_newlines ())
+        {
+            if (peek ().type != TOKEN_IDENTIFIER)
+            {
+                return fail ("expected a name, a parameter or a block");
+            }
+            const token_t& token = next ();
+
+            int output = -1;
+            for (int i = 0; i < NUM_OUTPUTS; ++i)
+            {
+                if (token.text == OUTPUT_NAMES[i])
+                {
+                    output = i;
+                }
+            }
+
+            if (token.text == "name")
+            {
+                if (!expect ("="))
+                {
+                    return false;
+                }
+                if (peek ().type != TOKEN_STRING)
+                {
+                    return fail ("expected a string");
+                }
+                name = next ().text;
+                if (!end_statement ())
+                {
+                    return false;
+                }
+            }
+            else if (output >= 0)
+            {
+                if (seen[output])
+                {
+                    return fail (token, Glib::ustring::compose
+                            ("'%1' is defined twice", token.text));
+                }
+                seen[output] = true;
+                m_program = &programs[output];
+                m_locals.clear ();
+                if (!parse_block ())
+                {
+                    return false;
+                }
+            }
+            else if (!parse_parameter (token.text))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool SchemeCompiler::parse_parameter (const std::string& name)
+    {
+        const token_t& token = m_tokens[m_pos - 1];
+        unsigned int slot;
+        if (lookup_slot (name, slot) || m_parameters.count (name))
+        {
+            return fail (token, Glib::ustring::compose
+                    ("'%1' can't be redefined", name));
+        }
+        if (!expect ("="))
+        {
+            return false;
+        }
+        const int node = parse_expression ();
+        if (node < 0)
+        {
+            return false;
+        }
+        if (m_nodes[node].op != OP_CONST)
+        {
+            return fail (token, "parameters must be constant");
+        }
+        m_parameters[name] = m_nodes[node].value;
+        return end_statement ();
+    }
+
+    bool SchemeCompiler::parse_block ()
+    {
+        skip_newlines ();
+        return expect ("{") && parse_statements () && expect ("}");
+    }
+
+    bool SchemeCompiler::parse_statements ()
+    {
+        for (skip_newlines (); !is_symbol ("}"); skip_newlines ())
+        {
+            if (peek ().type == TOKEN_END)
+            {
+                return fail ("expected '}'");
+            }
+            if (!parse_statement ())
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool SchemeCompiler::parse_statement ()
+    {
+        if (is_keyword ("if"))
+        {
+            return parse_if ();
+        }
+        return parse_assignment () && end_statement ();
+    }
+
+    bool SchemeCompiler::parse_assignment ()
+    {
+        if (peek ().type != TOKEN_IDENTIFIER)
+        {
+            return fail ("expected a statement");
+        }
+        const token_t& target = next ();
+        if (peek ().type != TOKEN_SYMBOL)
+        {
+            return fail ("expected '='");
+        }
+        const std::string op = next ().text;
+        if (op != "=" && op != "+=" && op != "-=" && op != "*=" && op != "/=")
+        {
+            return fail (m_tokens[m_pos - 1], "expected '='");
+        }
+
+        unsigned int slot;
+        if (!lookup_slot (target.text, slot))
+        {
+            if (op != "=" || m_parameters.count (target.text))
+            {
+                return fail (target, Glib::ustring::compose
+                        ("'%1' is not a variable", target.text));
+            }
+            if (m_program->m_num_slots == MAX_SLOTS)
+            {
+                return fail (target, "too many variables");
+            }
+            // the slot is only declared after the value is parsed
+            slot = m_program->m_num_slots;
+        }
+        else if (slot >= SLOT_BASE_H && slot < NUM_FIXED_SLOTS)
+        {
+            return fail (target, Glib::ustring::compose
+                    ("'%1' can't be changed", target.text));
+        }
+
+        int value = parse_expression ();
+        if (value < 0)
+        {
+            return false;
+        }
+
+        if (slot == m_program->m_num_slots)
+        {
+            m_locals[target.text] = slot;
+            ++m_program->m_num_slots;
+        }
+
+        if (op == "=")
+        {
+            return emit_expression (value, 0) && emit (OP_STORE, slot);
+        }
+
+        // compound assignments with a constant operand are a single
+        // instruction, since that is the most common statement
+        const expr_node_t& node = m_nodes[value];
+        if (node.op == OP_CONST && op != "/=")
+        {
+            if (op == "*=")
+            {
+                return emit (OP_MUL_CONST, slot, add_constant (node.value));
+            }
+            const double delta = (op == "+=") ? node.value : -node.value;
+            return emit (OP_ADD_CONST, slot, add_constant (delta));
+        }
+
+        opcode_t arithmetic = OP_ADD;
+        if (op == "-=")
+            arithmetic = OP_SUB;
+        else if (op == "*=")
+            arithmetic = OP_MUL;
+        else if (op == "/=")
+            arithmetic = OP_DIV;
+
+        expr_node_t load;
+        load.op = OP_LOAD;
+        load.value = 0.0;
+        load.slot = slot;
+        load.num_args = 0;
+        m_nodes.push_back (load);
+        value = add_node (arithmetic, m_nodes.size () - 1, value);
+        return emit_expression (value, 0) && emit (OP_STORE, slot);
+    }
+
+    bool SchemeCompiler::parse_if ()
+    {
+        // positions of the jumps to the end of the whole if/else chain
+        std::vector<std::size_t> end_jumps;
+        // once a condition is known to be true, the remaining branches are
+        // parsed but their code is thrown away
+        bool done = false;
+        while (true)
+        {
+            ++m_pos; // 'if'
+            const int condition = parse_expression ();
+            if (condition < 0)
+            {
+                return false;
+            }
+
+            const std::size_t start = m_program->m_code.size ();
+            const bool constant = (m_nodes[condition].op == OP_CONST);
+            const bool always = constant && m_nodes[condition].value != 0.0;
+            const bool never = constant && !always;
+            std::size_t jump = 0;
+            if (!constant)
+            {
+                if (!emit_expression (condition, 0))
+                {
+                    return false;
+                }
+                jump = m_program->m_code.size ();
+                if (!emit (OP_JUMP_IF_FALSE))
+                {
+                    return false;
+                }
+            }
+
+            if (!parse_block ())
+            {
+                return false;
+            }
+
+            if (done || never)
+            {
+                m_program->m_code.resize (start);
+            }
+            else if (always)
+            {
+                done = true;
+            }
+            else
+            {
+                end_jumps.push_back (m_program->m_code.size ());
+                if (!emit (OP_JUMP))
+                {
+                    return false;
+                }
+                m_program->m_code[jump].arg = m_program->m_code.size ();
+            }
+
+            // 'else' may be on the line after the closing brace
+            std::size_t after_block = m_pos;
+            skip_newlines ();
+            if (!is_keyword ("else"))
+            {
+                m_pos = after_block;
+                break;
+            }
+            ++m_pos;
+            if (is_keyword ("if"))
+            {
+                continue;
+            }
+
+            const std::size_t else_start = m_program->m_code.size ();
+            if (!parse_block ())
+            {
+                return false;
+            }
+            if (done)
+            {
+                m_program->m_code.resize (else_start);
+            }
+            break;
+        }
+
+        // an unconditional jump at the very end is not needed
+        if (!end_jumps.empty () &&
+            end_jumps.back () == m_program->m_code.size () - 1)
+        {
+            m_program->m_code.pop_back ();
+            end_jumps.pop_back ();
+            // the condition of the last branch jumped past that jump
+            for (std::vector<instruction_t>::iterator iter =
+                 m_program->m_code.begin (); iter != m_program->m_code.end ();
+                 ++iter)
+            {
+                if (iter->op == OP_JUMP_IF_FALSE &&
+                    iter->arg == m_program->m_code.size () + 1)
+                {
+                    iter->arg = m_program->m_code.size ();
+                }
+            }
+        }
+        for (std::vector<std::size_t>::const_iterator iter = end_jumps.begin ();
+             iter != end_jumps.end (); ++iter)
+        {
+            m_program->m_code[*iter].arg = m_program->m_code.size ();
+        }
+        return end_statement ();
+    }
+
+    int SchemeCompiler::parse_expression ()
+    {
+        return parse_or ();
+    }
+
+    int SchemeCompiler::parse_or ()
+    {
+        int node = parse_and ();
+        while (node >= 0 && is_keyword ("or"))
+        {
+            ++m_pos;
+            const int rhs = parse_and ();
+            node = (rhs < 0) ? -1 : add_node (OP_OR, node, rhs);
+        }
+        return node;
+    }
+
+    int SchemeCompiler::parse_and ()
+    {
+        int node = parse_not ();
+        while (node >= 0 && is_keyword ("and"))
+        {
+            ++m_pos;
+            const int rhs = parse_not ();
+            node = (rhs < 0) ? -1 : add_node (OP_AND, node, rhs);
+        }
+        return node;
+    }
+
+    int SchemeCompiler::parse_not ()
+    {
+        if (is_keyword ("not"))
+        {
+            ++m_pos;
+            const int node = parse_not ();
+            return (node < 0) ? -1 : add_node (OP_NOT, node);
+        }
+        return parse_comparison ();
+    }
+
+    int SchemeCompiler::parse_comparison ()
+    {
+        static const char* const SYMBOLS[] = { "<", "<=", ">", ">=", "==", "!=", 0 };
+        static const opcode_t OPS[] = { OP_LT, OP_LE, OP_GT, OP_GE, OP_EQ, OP_NE };
+
+        int node = parse_sum ();
+        for (int i = 0; node >= 0 && SYMBOLS[i]; ++i)
+        {
+            if (accept (SYMBOLS[i]))
+            {
+                const int rhs = parse_sum ();
+                return (rhs < 0) ? -1 : add_node (OPS[i], node, rhs);
+            }
+        }
+        return node;
+    }
+
+    int SchemeCompiler::parse_sum ()
+    {
+        int node = parse_term ();
+        while (node >= 0 && (is_symbol ("+") || is_symbol ("-")))
+        {
+            const opcode_t op = (next ().text == "+") ? OP_ADD : OP_SUB;
+            const int rhs = parse_term ();
+            node = (rhs < 0) ? -1 : add_node (op, node, rhs);
+        }
+        return node;
+    }
+
+    int SchemeCompiler::parse_term ()
+    {
+        int node = parse_unary ();
+        while (node >= 0 && (is_symbol ("*") || is_symbol ("/")))
+        {
+            const opcode_t op = (next ().text == "*") ? OP_MUL : OP_DIV;
+            const int rhs = parse_unary ();
+            node = (rhs < 0) ? -1 : add_node (op, node, rhs);
+        }
+        return node;
+    }
+
+    int SchemeCompiler::parse_unary ()
+    {
+        if (accept ("-"))
+        {
+            const int node = parse_unary ();
+            return (node < 0) ? -1 : add_node (OP_NEG, node);
+        }
+        if (accept ("+"))
+        {
+            return parse_unary ();
+        }
+        return parse_primary ();
+    }
+
+    int SchemeCompiler::parse_primary ()
+    {
+        const token_t& token = peek ();
+        if (token.type == TOKEN_NUMBER)
+        {
+            ++m_pos;
+            return add_constant_node (token.number);
+        }
+
+        if (accept ("("))
+        {
+            const int node = parse_expression ();
+            if (node < 0 || !expect (")"))
+            {
+                return -1;
+            }
+            return node;
+        }
+
+        if (token.type != TOKEN_IDENTIFIER)
+        {
+            fail ("expected a value");
+            return -1;
+        }
+        ++m_pos;
+
+        if (accept ("("))
+        {
+            const function_t* function = FUNCTIONS;
+            while (function->name && token.text != function->name)
+            {
+                ++function;
+            }
+            if (!function->name)
+            {
+                fail (token, Glib::ustring::compose ("unknown function '%1'",
+                            token.text));
+                return -1;
+            }
+
+            int args[3] = { -1, -1, -1 };
+            for (int i = 0; i < function->num_args; ++i)
+            {
+                if (i > 0 && !expect (","))
+                {
+                    return -1;
+                }
+                if ((args[i] = parse_expression ()) < 0)
+                {
+                    return -1;
+                }
+            }
+            if (!accept (")"))
+            {
+                fail (Glib::ustring::compose ("%1 () takes %2 arguments",
+                            token.text, function->num_args));
+                return -1;
+            }
+            return add_node (function->op, args[0], args[1], args[2]);
+        }
+
+        std::map<std::string, double>::const_iterator parameter =
+            m_parameters.find (token.text);
+        if (parameter != m_parameters.end ())
+        {
+            return add_constant_node (parameter->second);
+        }
+
+        unsigned int slot;
+        if (!m_program || !lookup_slot (token.text, slot))
+        {
+            fail (token, Glib::ustring::compose ("unknown name '%1'", token.text));
+            return -1;
+        }
+        expr_node_t node;
+        node.op = OP_LOAD;
+        node.value = 0.0;
+        node.slot = slot;
+        node.num_args = 0;
+        m_nodes.push_back (node);
+        return m_nodes.size () - 1;
+    }
+
+    int SchemeCompiler::add_constant_node (double value)
+    {
+        expr_node_t node;
+        node.op = OP_CONST;
+        node.value = value;
+        node.slot = 0;
+        node.num_args = 0;
+        m_nodes.push_back (node);
+        return m_nodes.size () - 1;
+    }
+
+    int SchemeCompiler::add_node (opcode_t op, int a, int b, int c)
+    {
+        expr_node_t node;
+        node.op = op;
+        node.value = 0.0;
+        node.slot = 0;
+        node.args[0] = a;
+        node.args[1] = b;
+        node.args[2] = c;
+        node.num_args = (c >= 0) ? 3 : (b >= 0) ? 2 : 1;
+
+        // fold operations on constants
+        bool constant = true;
+        double values[3] = { 0.0, 0.0, 0.0 };
+        for (int i = 0; i < node.num_args; ++i)
+        {
+            const expr_node_t& arg = m_nodes[node.args[i]];
+            constant = constant && arg.op == OP_CONST;
+            values[i] = arg.value;
+        }
+        if (constant)
+        {
+            return add_constant_node (compute (op, values));
+        }
+
+        m_nodes.push_back (node);
+        return m_nodes.size () - 1;
+    }
+
+    bool SchemeCompiler::emit_expression (int index, unsigned int depth)
+    {
+        const expr_node_t node = m_nodes[index];
+        if (node.op == OP_CONST)
+        {
+            return depth < MAX_STACK &&
+                emit (OP_CONST, 0, add_constant (node.value));
+        }
+        if (node.op == OP_LOAD)
+        {
+            return depth < MAX_STACK && emit (OP_LOAD, node.slot);
+        }
+        // the arguments end up on the stack next to each other
+        for (int i = 0; i < node.num_args; ++i)
+        {
+            if (depth + i >= MAX_STACK)
+            {
+                return fail ("expression is too complex");
+            }
+            if (!emit_expression (node.args[i], depth + i))
+            {
+                return false;
+            }
+        }
+        return emit (node.op);
+    }
+
+    bool SchemeCompiler::emit (opcode_t op, unsigned int slot, unsigned int arg)
+    {
+        if (m_program->m_code.size () >= MAX_INSTRUCTIONS)
+        {
+            return fail ("block is too long");
+        }
+        instruction_t instruction;
+        instruction.op = op;
+        instruction.slot = slot;
+        instruction.arg = arg;
+        m_program->m_code.push_back (instruction);
+        return true;
+    }
+
+    unsigned int SchemeCompiler::add_constant (double value)
+    {
+        std::vector<double>& constants = m_program->m_constants;
+        std::vector<double>::iterator iter =
+            std::find (constants.begin (), constants.end (), value);
+        if (iter != constants.end ())
+        {
+            return iter - constants.begin ();
+        }
+        constants.push_back (value);
+        return constants.size () - 1;
+    }
+
+    bool SchemeCompiler::lookup_slot (const std::string& name,
+                                      unsigned int& slot) const
+    {
+        for (unsigned int i = 0; i < NUM_FIXED_SLOTS; ++i)
+        {
+            if (name == SLOT_NAMES[i])
+            {
+                slot = i;
+                return true;
+            }
+        }
+        std::map<std::string, unsigned int>::const_iterator iter =
+            m_locals.find (name);
+        if (iter != m_locals.end ())
+        {
+            slot = iter->second;
+            return true;
+        }
+        return false;
+    }
+
+    /************************************************************
+     * ScriptedScheme
+     ***********************************************************/
+
+    /**
+     * Runs one of the compiled blocks as a ColorRelation generator
+     */
+    class ProgramGenerator : public sigc::functor_base
+    {
+        public:
+            typedef Color result_type;
+
+            ProgramGenerator (const boost::shared_ptr<SchemeProgram>& program) :
+                m_program (program)
+            {}
+
+            Color operator() (const Color& c) const
+            {
+                return Color (ColorValue (m_program->run (c.as_hsv ())));
+            }
+
+        private:
+            boost::shared_ptr<SchemeProgram> m_program;
+    };
+
+    struct ScriptedScheme::Priv
+    {
+        Glib::ustring m_name;
+        boost::shared_ptr<SchemeProgram> m_programs[NUM_OUTPUTS];
+    };
+
+    ScriptedScheme::ScriptedScheme () :
+        m_priv (new Priv ())
+    {
+    }
+
+    boost::shared_ptr<ScriptedScheme> ScriptedScheme::parse (
+            const std::string& source,
+            const std::string& filename,
+            Glib::ustring* error)
+    {
+        boost::shared_ptr<ScriptedScheme> scheme;
+        Glib::ustring message;
+        std::vector<token_t> tokens;
+        if (!tokenize (source, tokens, message))
+        {
+            message = Glib::ustring::compose ("%1:%2", filename, message);
+        }
+        else
+        {
+            SchemeProgram programs[NUM_OUTPUTS];
+            SchemeCompiler compiler (tokens, filename);
+            Glib::ustring name;
+            if (compiler.compile (name, programs))
+            {
+                scheme.reset (new ScriptedScheme ());
+                if (name.empty ())
+                {
+                    // fall back to the file name without the extension
+                    name = Glib::path_get_basename (filename);
+                    const Glib::ustring::size_type dot = name.rfind ('.');
+                    if (dot != Glib::ustring::npos && dot > 0)
+                    {
+                        name.erase (dot);
+                    }
+                }
+                scheme->m_priv->m_name = name;
+                for (int i = 0; i < NUM_OUTPUTS; ++i)
+                {
+                    scheme->m_priv->m_programs[i].reset
+                        (new SchemeProgram (programs[i]));
+                }
+            }
+            else
+            {
+                message = compiler.get_error ();
+            }
+        }
+
+        if (error)
+        {
+            *error = message;
+        }
+        return scheme;
+    }
+
+    boost::shared_ptr<ScriptedScheme> ScriptedScheme::load_file (
+            const std::string& filename)
+    {
+        boost::shared_ptr<ScriptedScheme> scheme;
+        try
+        {
+            Glib::ustring error;
+            scheme = parse (Glib::file_get_contents (filename), filename,
+                            &error);
+            if (!scheme)
+            {
+                std::cerr << Glib::ustring::compose ("Couldn't load scheme %1",
+                        error) << std::endl;
+            }
+        }
+        catch (const Glib::FileError& exception)
+        {
+            std::cerr << Glib::ustring::compose ("Couldn't load scheme %1: %2",
+                    filename, exception.what ())
+                << std::endl;
+        }
+        return scheme;
+    }
+
+    Glib::ustring ScriptedScheme::get_name () const
+    {
+        THROW_IF_FAIL (m_priv);
+        return m_priv->m_name;
+    }
+
+    ColorRelation::SlotColorGen ScriptedScheme::get_outer_left () const
+    {
+        THROW_IF_FAIL (m_priv);
+        return ProgramGenerator (m_priv->m_programs[0]);
+    }
+
+    ColorRelation::SlotColorGen ScriptedScheme::get_inner_left () const
+    {
+        THROW_IF_FAIL (m_priv);
+        return ProgramGenerator (m_priv->m_programs[1]);
+    }
+
+    ColorRelation::SlotColorGen ScriptedScheme::get_inner_right () const
+    {
+        THROW_IF_FAIL (m_priv);
+        return ProgramGenerator (m_priv->m_programs[2]);
+    }
+
+    ColorRelation::SlotColorGen ScriptedScheme::get_outer_right () const
+    {
+        THROW_IF_FAIL (m_priv);
+        return ProgramGenerator (m_priv->m_programs[3]);
+    }
+
+    unsigned int ScriptedScheme::get_num_outputs () const
+    {
+        return NUM_OUTPUTS;
+    }
+
+    void ScriptedScheme::generate (const hsv_t& base, hsv_t* outputs) const
+    {
+        THROW_IF_FAIL (m_priv);
+        for (int i = 0; i < NUM_OUTPUTS; ++i)
+        {
+            outputs[i] = clamp_hsv (m_priv->m_programs[i]->run (base));
+        }
+    }
+}
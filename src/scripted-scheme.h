@@ -0,0 +1,108 @@
+/*******************************************************************************
+ *
+ *  Copyright (c) 2008 Jonathon Jongsma
+ *
+ *  This file is part of Agave
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ *******************************************************************************/
+#ifndef __SCRIPTED_SCHEME_H
+#define __SCRIPTED_SCHEME_H
+
+#include <string>
+#include <boost/shared_ptr.hpp>
+#include <glibmm/ustring.h>
+#include "i-scheme.h"
+
+namespace agave
+{
+    /**
+     * A color scheme that is defined in a text file instead of in C++.
+     *
+     * A scheme file sets the name of the scheme and describes how each of
+     * the four generated colors is derived from the base color:
+     * \code
+     * # comments start with '#'
+     * name = "Split Complementary"
+     *
+     * # parameters can be used in all of the blocks below
+     * spread = 30deg
+     *
+     * outer_left {
+     *     h += 0.5 - spread
+     *     if base_s > 0.9 { s -= 0.1 } else { s += 0.1 }
+     *     v = clamp (v, 0.2, 1.0)
+     * }
+     * inner_left { h += 0.5 - spread / 2; v *= 0.8 }
+     * inner_right { h += 0.5 + spread / 2; v *= 0.8 }
+     * outer_right { h += 0.5 + spread }
+     * \endcode
+     *
+     * Within a block, h, s, v and a start out as the HSV components of the
+     * base color and hold the generated color at the end.  base_h, base_s,
+     * base_v and base_a always refer to the base color.  Any other name that
+     * is assigned to becomes a local variable.  Expressions support the usual
+     * arithmetic, comparison, 'and', 'or' and 'not' operators and the
+     * functions min, max, abs, clamp (x, lo, hi) and mix (a, b, t).  Numbers
+     * may carry a 'deg' (hue in degrees) or '%' suffix.  Statements are
+     * separated by newlines or ';'.  A block that is missing generates the
+     * base color unchanged.
+     *
+     * Each block is compiled into a small bytecode program when the file is
+     * loaded (with constant expressions and branches folded), so generating a
+     * color doesn't involve any name lookups or memory allocation.
+     */
+    class ScriptedScheme : public IScheme
+    {
+        public:
+            /**
+             * Compile a scheme definition
+             *
+             * @param filename  Only used in error messages and as the name
+             * of the scheme if the source doesn't set one
+             * @param error  If non-NULL, receives a description of the first
+             * error
+             * @return  The scheme, or an empty pointer if @a source is invalid
+             */
+            static boost::shared_ptr<ScriptedScheme> parse (
+                    const std::string& source,
+                    const std::string& filename = "<string>",
+                    Glib::ustring* error = 0);
+
+            /**
+             * Load and compile a scheme file.  Errors are reported on stderr.
+             *
+             * @return  The scheme, or an empty pointer on error
+             */
+            static boost::shared_ptr<ScriptedScheme> load_file (
+                    const std::string& filename);
+
+            virtual Glib::ustring get_name () const;
+            virtual ColorRelation::SlotColorGen get_outer_left () const;
+            virtual ColorRelation::SlotColorGen get_inner_left () const;
+            virtual ColorRelation::SlotColorGen get_inner_right () const;
+            virtual ColorRelation::SlotColorGen get_outer_right () const;
+            virtual unsigned int get_num_outputs () const;
+            virtual void generate (const hsv_t& base, hsv_t* outputs) const;
+
+        private:
+            ScriptedScheme ();
+
+            struct Priv;
+            boost::shared_ptr<Priv> m_priv;
+    };
+}
+
+#endif // __SCRIPTED_SCHEME_H
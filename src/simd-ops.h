@@ -0,0 +1,203 @@
+/*******************************************************************************
+ *
+ *  Copyright (c) 2008 Jonathon Jongsma
+ *
+ *  This file is part of Agave
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ *******************************************************************************/
+#ifndef __SIMD_OPS_H
+#define __SIMD_OPS_H
+
+// Primitive vector operations for the batch kernels (internal header).
+//
+// Every supported instruction set gets a namespace with an 'Ops' type that
+// wraps the same set of primitive operations.  A kernel file is written once
+// against 'Ops' and then included into each of these namespaces, inside the
+// matching '#pragma GCC target' region (see color-convert.cc).  Since every
+// variant of a kernel is built from exactly the same sequence of operations,
+// the SIMD versions produce bit-identical results to the scalar one.
+
+#include <cmath>
+#include <cstddef>
+#include <stdint.h>
+
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#define AGAVE_X86_SIMD 1
+#include <immintrin.h>
+// The SIMD and scalar kernels must perform exactly the same rounding steps,
+// so don't let the compiler fuse multiplies and adds behind our back.
+#pragma GCC optimize ("fp-contract=off")
+#endif
+
+namespace agave
+{
+    namespace kernels_scalar
+    {
+        struct Ops
+        {
+            typedef float vec;
+            typedef bool mask;
+            static const std::size_t WIDTH = 1;
+
+            static inline vec load (const float* p) { return *p; }
+            static inline void store (float* p, vec v) { *p = v; }
+            static inline vec set1 (float f) { return f; }
+            static inline vec add (vec a, vec b) { return a + b; }
+            static inline vec sub (vec a, vec b) { return a - b; }
+            static inline vec mul (vec a, vec b) { return a * b; }
+            static inline vec div (vec a, vec b) { return a / b; }
+            static inline vec sqrt (vec a) { return std::sqrt (a); }
+            // these match the semantics of the minps / maxps instructions
+            static inline vec min (vec a, vec b) { return (a < b) ? a : b; }
+            static inline vec max (vec a, vec b) { return (a > b) ? a : b; }
+            static inline mask lt (vec a, vec b) { return a < b; }
+            static inline mask le (vec a, vec b) { return a <= b; }
+            static inline mask gt (vec a, vec b) { return a > b; }
+            static inline mask ge (vec a, vec b) { return a >= b; }
+            static inline mask eq (vec a, vec b) { return a == b; }
+            static inline vec select (mask m, vec a, vec b) { return m ? a : b; }
+            static inline vec trunc (vec a)
+            { return static_cast<float> (static_cast<int32_t> (a)); }
+
+            static inline void store_argb32 (uint32_t* p, vec r, vec g, vec b)
+            {
+                *p = 0xff000000u |
+                    (static_cast<uint32_t> (static_cast<int32_t> (r)) << 16) |
+                    (static_cast<uint32_t> (static_cast<int32_t> (g)) << 8) |
+                    static_cast<uint32_t> (static_cast<int32_t> (b));
+            }
+
+            static inline void load_argb32 (const uint32_t* p,
+                                            vec& a, vec& r, vec& g, vec& b)
+            {
+                a = static_cast<float> (static_cast<int32_t> ((*p >> 24) & 0xff));
+                r = static_cast<float> (static_cast<int32_t> ((*p >> 16) & 0xff));
+                g = static_cast<float> (static_cast<int32_t> ((*p >> 8) & 0xff));
+                b = static_cast<float> (static_cast<int32_t> (*p & 0xff));
+            }
+        };
+    }
+
+#ifdef AGAVE_X86_SIMD
+#pragma GCC push_options
+#pragma GCC target ("sse2")
+    namespace kernels_sse2
+    {
+        struct Ops
+        {
+            typedef __m128 vec;
+            typedef __m128 mask;
+            static const std::size_t WIDTH = 4;
+
+            static inline vec load (const float* p) { return _mm_loadu_ps (p); }
+            static inline void store (float* p, vec v) { _mm_storeu_ps (p, v); }
+            static inline vec set1 (float f) { return _mm_set1_ps (f); }
+            static inline vec add (vec a, vec b) { return _mm_add_ps (a, b); }
+            static inline vec sub (vec a, vec b) { return _mm_sub_ps (a, b); }
+            static inline vec mul (vec a, vec b) { return _mm_mul_ps (a, b); }
+            static inline vec div (vec a, vec b) { return _mm_div_ps (a, b); }
+            static inline vec sqrt (vec a) { return _mm_sqrt_ps (a); }
+            static inline vec min (vec a, vec b) { return _mm_min_ps (a, b); }
+            static inline vec max (vec a, vec b) { return _mm_max_ps (a, b); }
+            static inline mask lt (vec a, vec b) { return _mm_cmplt_ps (a, b); }
+            static inline mask le (vec a, vec b) { return _mm_cmple_ps (a, b); }
+            static inline mask gt (vec a, vec b) { return _mm_cmpgt_ps (a, b); }
+            static inline mask ge (vec a, vec b) { return _mm_cmpge_ps (a, b); }
+            static inline mask eq (vec a, vec b) { return _mm_cmpeq_ps (a, b); }
+            static inline vec select (mask m, vec a, vec b)
+            { return _mm_or_ps (_mm_and_ps (m, a), _mm_andnot_ps (m, b)); }
+            static inline vec trunc (vec a)
+            { return _mm_cvtepi32_ps (_mm_cvttps_epi32 (a)); }
+
+            static inline void store_argb32 (uint32_t* p, vec r, vec g, vec b)
+            {
+                __m128i px = _mm_set1_epi32 (static_cast<int> (0xff000000u));
+                px = _mm_or_si128 (px, _mm_slli_epi32 (_mm_cvttps_epi32 (r), 16));
+                px = _mm_or_si128 (px, _mm_slli_epi32 (_mm_cvttps_epi32 (g), 8));
+                px = _mm_or_si128 (px, _mm_cvttps_epi32 (b));
+                _mm_storeu_si128 (reinterpret_cast<__m128i*> (p), px);
+            }
+
+            static inline void load_argb32 (const uint32_t* p,
+                                            vec& a, vec& r, vec& g, vec& b)
+            {
+                __m128i px = _mm_loadu_si128 (reinterpret_cast<const __m128i*> (p));
+                __m128i byte = _mm_set1_epi32 (0xff);
+                a = _mm_cvtepi32_ps (_mm_and_si128 (_mm_srli_epi32 (px, 24), byte));
+                r = _mm_cvtepi32_ps (_mm_and_si128 (_mm_srli_epi32 (px, 16), byte));
+                g = _mm_cvtepi32_ps (_mm_and_si128 (_mm_srli_epi32 (px, 8), byte));
+                b = _mm_cvtepi32_ps (_mm_and_si128 (px, byte));
+            }
+        };
+    }
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target ("avx2")
+    namespace kernels_avx2
+    {
+        struct Ops
+        {
+            typedef __m256 vec;
+            typedef __m256 mask;
+            static const std::size_t WIDTH = 8;
+
+            static inline vec load (const float* p) { return _mm256_loadu_ps (p); }
+            static inline void store (float* p, vec v) { _mm256_storeu_ps (p, v); }
+            static inline vec set1 (float f) { return _mm256_set1_ps (f); }
+            static inline vec add (vec a, vec b) { return _mm256_add_ps (a, b); }
+            static inline vec sub (vec a, vec b) { return _mm256_sub_ps (a, b); }
+            static inline vec mul (vec a, vec b) { return _mm256_mul_ps (a, b); }
+            static inline vec div (vec a, vec b) { return _mm256_div_ps (a, b); }
+            static inline vec sqrt (vec a) { return _mm256_sqrt_ps (a); }
+            static inline vec min (vec a, vec b) { return _mm256_min_ps (a, b); }
+            static inline vec max (vec a, vec b) { return _mm256_max_ps (a, b); }
+            static inline mask lt (vec a, vec b) { return _mm256_cmp_ps (a, b, _CMP_LT_OQ); }
+            static inline mask le (vec a, vec b) { return _mm256_cmp_ps (a, b, _CMP_LE_OQ); }
+            static inline mask gt (vec a, vec b) { return _mm256_cmp_ps (a, b, _CMP_GT_OQ); }
+            static inline mask ge (vec a, vec b) { return _mm256_cmp_ps (a, b, _CMP_GE_OQ); }
+            static inline mask eq (vec a, vec b) { return _mm256_cmp_ps (a, b, _CMP_EQ_OQ); }
+            static inline vec select (mask m, vec a, vec b)
+            { return _mm256_or_ps (_mm256_and_ps (m, a), _mm256_andnot_ps (m, b)); }
+            static inline vec trunc (vec a)
+            { return _mm256_cvtepi32_ps (_mm256_cvttps_epi32 (a)); }
+
+            static inline void store_argb32 (uint32_t* p, vec r, vec g, vec b)
+            {
+                __m256i px = _mm256_set1_epi32 (static_cast<int> (0xff000000u));
+                px = _mm256_or_si256 (px, _mm256_slli_epi32 (_mm256_cvttps_epi32 (r), 16));
+                px = _mm256_or_si256 (px, _mm256_slli_epi32 (_mm256_cvttps_epi32 (g), 8));
+                px = _mm256_or_si256 (px, _mm256_cvttps_epi32 (b));
+                _mm256_storeu_si256 (reinterpret_cast<__m256i*> (p), px);
+            }
+
+            static inline void load_argb32 (const uint32_t* p,
+                                            vec& a, vec& r, vec& g, vec& b)
+            {
+                __m256i px = _mm256_loadu_si256 (reinterpret_cast<const __m256i*> (p));
+                __m256i byte = _mm256_set1_epi32 (0xff);
+                a = _mm256_cvtepi32_ps (_mm256_and_si256 (_mm256_srli_epi32 (px, 24), byte));
+                r = _mm256_cvtepi32_ps (_mm256_and_si256 (_mm256_srli_epi32 (px, 16), byte));
+                g = _mm256_cvtepi32_ps (_mm256_and_si256 (_mm256_srli_epi32 (px, 8), byte));
+                b = _mm256_cvtepi32_ps (_mm256_and_si256 (px, byte));
+            }
+        };
+    }
+#pragma GCC pop_options
+#endif // AGAVE_X86_SIMD
+}
+
+#endif // __SIMD_OPS_H
@@ -22,8 +22,10 @@
 #include <gdkmm/general.h>  // cairo helpers
 #include <glibmm-utils/exception.h>
 #include <gtkmm/drawingarea.h>
+#include <gtkmm/tooltip.h>
 #include "swatch.h"
 #include "color-model.h"
+#include "named-color-index.h"
 
 namespace agave
 {
@@ -58,6 +60,11 @@ namespace agave
             drag_source_set(drag_targets);
             signal_drag_data_get().connect(sigc::mem_fun(*this, &Priv::on_drag_data_get));
             signal_drag_begin().connect(sigc::mem_fun(*this, &Priv::set_color_icon));
+
+            // show the hexstring and the closest named color as a tooltip
+            set_has_tooltip ();
+            signal_query_tooltip ().connect (sigc::mem_fun (this,
+                        &Priv::on_query_tooltip));
         }
 
         void set_model (const boost::shared_ptr<ColorModel>& model)
@@ -87,6 +94,24 @@ namespace agave
             queue_draw ();
         }
 
+        bool on_query_tooltip (int x, int y, bool keyboard_tooltip,
+                const Glib::RefPtr<Gtk::Tooltip>& tooltip)
+        {
+            Color c = m_model->get_color ();
+            Glib::ustring hexstring = "#" + c.as_hexstring ();
+            Glib::ustring name = NamedColorIndex::instance ().nearest_name (c);
+            if (name.empty ())
+            {
+                tooltip->set_text (hexstring);
+            }
+            else
+            {
+                tooltip->set_text (Glib::ustring::compose ("%1 (%2)", name,
+                            hexstring));
+            }
+            return true;
+        }
+
         void render_swatch (Cairo::RefPtr<Cairo::Context>& cr, double w, double h)
         {
             double x, y;
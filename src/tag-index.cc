@@ -0,0 +1,418 @@
+/*******************************************************************************
+ *
+ *  Copyright (c) 2008 Jonathon Jongsma
+ *
+ *  This file is part of Agave
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ *******************************************************************************/
+
+#include <algorithm>
+#include <map>
+#include <glibmm-utils/exception.h>
+#include "tag-index.h"
+
+namespace agave
+{
+    typedef std::vector<guint64> bitset_t;
+
+    static const guint32 BITS_PER_WORD = 64;
+
+    /**
+     * Get the index of the lowest bit that is set in @a word (which must not
+     * be 0) with a de Bruijn sequence
+     */
+    static inline guint32 lowest_bit (guint64 word)
+    {
+        static const guint32 positions[64] = {
+            0, 1, 48, 2, 57, 49, 28, 3, 61, 58, 50, 42, 38, 29, 17, 4,
+            62, 55, 59, 36, 53, 51, 43, 22, 45, 39, 33, 30, 24, 18, 12, 5,
+            63, 47, 56, 27, 60, 41, 37, 16, 54, 35, 52, 21, 44, 32, 23, 11,
+            46, 26, 40, 15, 34, 20, 31, 10, 25, 14, 19, 9, 13, 8, 7, 6
+        };
+        return positions[((word & (~word + 1)) *
+                G_GUINT64_CONSTANT (0x03f79d71b4cb0a89)) >> 58];
+    }
+
+    static inline void set_bit (bitset_t& bits, guint32 item)
+    {
+        const std::size_t word = item / BITS_PER_WORD;
+        if (word >= bits.size ())
+        {
+            bits.resize (word + 1, 0);
+        }
+        bits[word] |= G_GUINT64_CONSTANT (1) << (item % BITS_PER_WORD);
+    }
+
+    static inline void clear_bit (bitset_t& bits, guint32 item)
+    {
+        const std::size_t word = item / BITS_PER_WORD;
+        if (word < bits.size ())
+        {
+            bits[word] &= ~(G_GUINT64_CONSTANT (1) << (item % BITS_PER_WORD));
+        }
+    }
+
+    enum token_type_t
+    {
+        TOKEN_TAG,
+        TOKEN_AND,
+        TOKEN_OR,
+        TOKEN_NOT,
+        TOKEN_OPEN,
+        TOKEN_CLOSE,
+        TOKEN_END
+    };
+
+    struct token_t
+    {
+        token_type_t type;
+        Glib::ustring text;
+    };
+
+    /**
+     * Split a query into tokens
+     *
+     * @return  false if a quote isn't closed
+     */
+    static bool tokenize (const Glib::ustring& expression,
+                          std::vector<token_t>& tokens)
+    {
+        const std::string& text = expression.raw ();
+        std::string::size_type pos = 0;
+        while (pos < text.size ())
+        {
+            const char c = text[pos];
+            token_t token;
+            if (c == ' ' || c == '\t' || c == '\n')
+            {
+                ++pos;
+                continue;
+            }
+            else if (c == '(' || c == ')')
+            {
+                token.type = (c == '(') ? TOKEN_OPEN : TOKEN_CLOSE;
+                ++pos;
+            }
+            else if (c == '"')
+            {
+                const std::string::size_type end = text.find ('"', pos + 1);
+                if (end == std::string::npos)
+                {
+                    return false;
+                }
+                token.type = TOKEN_TAG;
+                token.text = text.substr (pos + 1, end - pos - 1);
+                pos = end + 1;
+            }
+            else
+            {
+                const std::string::size_type end =
+                    text.find_first_of (" \t\n()\"", pos);
+                const std::string word = text.substr (pos, end - pos);
+                pos = (end == std::string::npos) ? text.size () : end;
+                if (word == "AND")
+                    token.type = TOKEN_AND;
+                else if (word == "OR")
+                    token.type = TOKEN_OR;
+                else if (word == "NOT")
+                    token.type = TOKEN_NOT;
+                else
+                {
+                    token.type = TOKEN_TAG;
+                    token.text = word;
+                }
+            }
+            tokens.push_back (token);
+        }
+        token_t end;
+        end.type = TOKEN_END;
+        tokens.push_back (end);
+        return true;
+    }
+
+    struct TagIndex::Priv
+    {
+        typedef std::map<Glib::ustring, guint32> tag_map_t;
+
+        tag_map_t m_tag_ids;
+        std::vector<Glib::ustring> m_tag_names;
+        /// the items of each tag
+        std::vector<bitset_t> m_tag_items;
+        std::vector<std::size_t> m_tag_counts;
+        /// the tags of each item
+        std::vector<std::vector<guint32> > m_item_tags;
+        /// the items that are in the index
+        bitset_t m_items;
+
+        guint32 get_tag_id (const Glib::ustring& tag)
+        {
+            std::pair<tag_map_t::iterator, bool> result =
+                m_tag_ids.insert (std::make_pair (tag, m_tag_names.size ()));
+            if (result.second)
+            {
+                m_tag_names.push_back (tag);
+                m_tag_items.push_back (bitset_t ());
+                m_tag_counts.push_back (0);
+            }
+            return result.first->second;
+        }
+
+        void add_item (guint32 item)
+        {
+            set_bit (m_items, item);
+            if (item >= m_item_tags.size ())
+            {
+                m_item_tags.resize (item + 1);
+            }
+        }
+
+        void add_tag (guint32 item, const Glib::ustring& tag)
+        {
+            add_item (item);
+            const guint32 tag_id = get_tag_id (tag);
+            std::vector<guint32>& item_tags = m_item_tags[item];
+            if (std::find (item_tags.begin (), item_tags.end (), tag_id) ==
+                item_tags.end ())
+            {
+                item_tags.push_back (tag_id);
+                set_bit (m_tag_items[tag_id], item);
+                ++m_tag_counts[tag_id];
+            }
+        }
+
+        void remove_tags (guint32 item)
+        {
+            if (item >= m_item_tags.size ())
+            {
+                return;
+            }
+            std::vector<guint32>& item_tags = m_item_tags[item];
+            for (std::vector<guint32>::const_iterator iter = item_tags.begin ();
+                 iter != item_tags.end (); ++iter)
+            {
+                clear_bit (m_tag_items[*iter], item);
+                --m_tag_counts[*iter];
+            }
+            item_tags.clear ();
+        }
+
+        /// \name Query evaluation
+        /// A recursive descent parser that computes the bitsets directly.
+        /// Operands are padded to the size of m_items.
+        /// @{
+        bool parse_or (const std::vector<token_t>& tokens, std::size_t& pos,
+                       bitset_t& result) const
+        {
+            if (!parse_and (tokens, pos, result))
+                return false;
+            while (tokens[pos].type == TOKEN_OR)
+            {
+                ++pos;
+                bitset_t operand;
+                if (!parse_and (tokens, pos, operand))
+                    return false;
+                for (std::size_t i = 0; i < result.size (); ++i)
+                {
+                    result[i] |= operand[i];
+                }
+            }
+            return true;
+        }
+
+        bool parse_and (const std::vector<token_t>& tokens, std::size_t& pos,
+                        bitset_t& result) const
+        {
+            if (!parse_not (tokens, pos, result))
+                return false;
+            for (;;)
+            {
+                const token_type_t type = tokens[pos].type;
+                if (type == TOKEN_AND)
+                {
+                    ++pos;
+                }
+                else if (type != TOKEN_TAG && type != TOKEN_NOT &&
+                         type != TOKEN_OPEN)
+                {
+                    return true;
+                }
+                bitset_t operand;
+                if (!parse_not (tokens, pos, operand))
+                    return false;
+                for (std::size_t i = 0; i < result.size (); ++i)
+                {
+                    result[i] &= operand[i];
+                }
+            }
+        }
+
+        bool parse_not (const std::vector<token_t>& tokens, std::size_t& pos,
+                        bitset_t& result) const
+        {
+            const token_t& token = tokens[pos];
+            if (token.type == TOKEN_NOT)
+            {
+                ++pos;
+                if (!parse_not (tokens, pos, result))
+                    return false;
+                for (std::size_t i = 0; i < result.size (); ++i)
+                {
+                    result[i] = m_items[i] & ~result[i];
+                }
+                return true;
+            }
+            else if (token.type == TOKEN_OPEN)
+            {
+                ++pos;
+                if (!parse_or (tokens, pos, result) ||
+                    tokens[pos].type != TOKEN_CLOSE)
+                {
+                    return false;
+                }
+                ++pos;
+                return true;
+            }
+            else if (token.type == TOKEN_TAG)
+            {
+                ++pos;
+                result.assign (m_items.size (), 0);
+                tag_map_t::const_iterator iter = m_tag_ids.find (token.text);
+                if (iter != m_tag_ids.end ())
+                {
+                    const bitset_t& items = m_tag_items[iter->second];
+                    std::copy (items.begin (), items.end (), result.begin ());
+                }
+                return true;
+            }
+            return false;
+        }
+        /// @}
+    };
+
+    TagIndex::TagIndex () :
+        m_priv (new Priv ())
+    {
+        THROW_IF_FAIL (m_priv);
+    }
+
+    void TagIndex::set_tags (guint32 item, const std::list<Glib::ustring>& tags)
+    {
+        THROW_IF_FAIL (m_priv);
+        m_priv->remove_tags (item);
+        m_priv->add_item (item);
+        for (std::list<Glib::ustring>::const_iterator iter = tags.begin ();
+             iter != tags.end (); ++iter)
+        {
+            m_priv->add_tag (item, *iter);
+        }
+    }
+
+    void TagIndex::add_tag (guint32 item, const Glib::ustring& tag)
+    {
+        THROW_IF_FAIL (m_priv);
+        m_priv->add_tag (item, tag);
+    }
+
+    void TagIndex::remove_tag (guint32 item, const Glib::ustring& tag)
+    {
+        THROW_IF_FAIL (m_priv);
+        Priv::tag_map_t::const_iterator tag_iter = m_priv->m_tag_ids.find (tag);
+        if (tag_iter == m_priv->m_tag_ids.end () ||
+            item >= m_priv->m_item_tags.size ())
+        {
+            return;
+        }
+        std::vector<guint32>& item_tags = m_priv->m_item_tags[item];
+        std::vector<guint32>::iterator iter =
+            std::find (item_tags.begin (), item_tags.end (), tag_iter->second);
+        if (iter != item_tags.end ())
+        {
+            item_tags.erase (iter);
+            clear_bit (m_priv->m_tag_items[tag_iter->second], item);
+            --m_priv->m_tag_counts[tag_iter->second];
+        }
+    }
+
+    void TagIndex::remove (guint32 item)
+    {
+        THROW_IF_FAIL (m_priv);
+        m_priv->remove_tags (item);
+        clear_bit (m_priv->m_items, item);
+    }
+
+    void TagIndex::clear ()
+    {
+        THROW_IF_FAIL (m_priv);
+        m_priv.reset (new Priv ());
+    }
+
+    std::vector<Glib::ustring> TagIndex::get_tags () const
+    {
+        THROW_IF_FAIL (m_priv);
+        std::vector<Glib::ustring> tags;
+        for (Priv::tag_map_t::const_iterator iter = m_priv->m_tag_ids.begin ();
+             iter != m_priv->m_tag_ids.end (); ++iter)
+        {
+            if (m_priv->m_tag_counts[iter->second])
+            {
+                tags.push_back (iter->first);
+            }
+        }
+        return tags;
+    }
+
+    std::size_t TagIndex::count (const Glib::ustring& tag) const
+    {
+        THROW_IF_FAIL (m_priv);
+        Priv::tag_map_t::const_iterator iter = m_priv->m_tag_ids.find (tag);
+        if (iter == m_priv->m_tag_ids.end ())
+        {
+            return 0;
+        }
+        return m_priv->m_tag_counts[iter->second];
+    }
+
+    bool TagIndex::query (const Glib::ustring& expression,
+                          std::vector<guint32>& items) const
+    {
+        THROW_IF_FAIL (m_priv);
+        items.clear ();
+        std::vector<token_t> tokens;
+        if (!tokenize (expression, tokens))
+        {
+            return false;
+        }
+
+        std::size_t pos = 0;
+        bitset_t result;
+        if (!m_priv->parse_or (tokens, pos, result) ||
+            tokens[pos].type != TOKEN_END)
+        {
+            return false;
+        }
+
+        for (std::size_t i = 0; i < result.size (); ++i)
+        {
+            guint64 word = result[i];
+            while (word)
+            {
+                items.push_back (i * BITS_PER_WORD + lowest_bit (word));
+                word &= word - 1;
+            }
+        }
+        return true;
+    }
+}
@@ -0,0 +1,92 @@
+/*******************************************************************************
+ *
+ *  Copyright (c) 2008 Jonathon Jongsma
+ *
+ *  This file is part of Agave
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ *******************************************************************************/
+#ifndef __TAG_INDEX_H
+#define __TAG_INDEX_H
+
+#include <list>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <glib/gtypes.h>
+#include <glibmm/ustring.h>
+
+namespace agave
+{
+    /**
+     * An inverted index from tags to items, which are identified by small
+     * integers (e.g. the slots of a ColorSetManager).
+     *
+     * Each tag has a bitset of the items that carry it, so boolean queries
+     * are evaluated a machine word at a time.  Queries consist of tags
+     * combined with the operators AND, OR and NOT (in upper case, so that
+     * lower case tags with those names still work) and parentheses, e.g.
+     * \code
+     * warm AND print AND NOT draft
+     * (pastel OR muted) web
+     * \endcode
+     * Adjacent terms are combined with AND, and tags that contain spaces or
+     * parentheses can be quoted with double quotes.  Tags are case
+     * sensitive.
+     */
+    class TagIndex
+    {
+        public:
+            TagIndex ();
+
+            /**
+             * Replace the tags of @a item
+             */
+            void set_tags (guint32 item, const std::list<Glib::ustring>& tags);
+            void add_tag (guint32 item, const Glib::ustring& tag);
+            void remove_tag (guint32 item, const Glib::ustring& tag);
+
+            /**
+             * Remove @a item and its tags from the index
+             */
+            void remove (guint32 item);
+            void clear ();
+
+            /**
+             * Get the tags that are used by at least one item, in
+             * alphabetical order
+             */
+            std::vector<Glib::ustring> get_tags () const;
+
+            /**
+             * Get the number of items with @a tag
+             */
+            std::size_t count (const Glib::ustring& tag) const;
+
+            /**
+             * Evaluate a query
+             *
+             * @param items  Receives the matching items in ascending order
+             * @return  false if the query has a syntax error
+             */
+            bool query (const Glib::ustring& expression,
+                        std::vector<guint32>& items) const;
+
+        private:
+            struct Priv;
+            boost::shared_ptr<Priv> m_priv;
+    };
+}
+
+#endif // __TAG_INDEX_H
@@ -0,0 +1,563 @@
+/*******************************************************************************
+ *
+ *  Copyright (c) 2008 Jonathon Jongsma
+ *
+ *  This file is part of Agave
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ *******************************************************************************/
+
+#include <algorithm>
+#include <string>
+#include <boost/unordered_map.hpp>
+#include <glib.h>
+#include <glibmm-utils/exception.h>
+#include "text-index.h"
+
+namespace agave
+{
+    /// three characters of 21 bits each
+    typedef guint64 gram_t;
+    /// a sorted list of items or words
+    typedef std::vector<guint32> posting_t;
+    typedef boost::unordered_map<gram_t, posting_t> posting_map_t;
+
+    /**
+     * Pack three characters into a gram.  The prefix grams of a word use 0
+     * (which is never part of a word) for the missing leading characters.
+     */
+    static inline gram_t make_gram (gunichar first, gunichar second,
+                                    gunichar third)
+    {
+        return (static_cast<gram_t> (first) << 42) |
+               (static_cast<gram_t> (second) << 21) | third;
+    }
+
+    /// marks the first trigram of a word, which the 63 bits of the
+    /// characters leave free
+    static const gram_t LEADING_GRAM = G_GUINT64_CONSTANT (1) << 63;
+
+    struct word_t
+    {
+        /// the UTF-8 text of the word
+        std::string text;
+        std::vector<gunichar> chars;
+    };
+
+    static Glib::ustring fold (const Glib::ustring& text)
+    {
+        // case folding can produce unnormalized text
+        return text.casefold ().normalize ();
+    }
+
+    /**
+     * Split text that has already been folded into words
+     */
+    static void split_words (const std::string& text, std::vector<word_t>& words)
+    {
+        const char* pos = text.c_str ();
+        const char* const end = pos + text.size ();
+        const char* word_start = 0;
+        word_t word;
+        while (pos <= end)
+        {
+            const gunichar c = (pos < end) ? g_utf8_get_char (pos) : 0;
+            if (c && g_unichar_isalnum (c))
+            {
+                if (!word_start)
+                {
+                    word_start = pos;
+                }
+                word.chars.push_back (c);
+            }
+            else if (word_start)
+            {
+                word.text.assign (word_start, pos);
+                words.push_back (word);
+                word.chars.clear ();
+                word_start = 0;
+            }
+            if (pos == end)
+            {
+                break;
+            }
+            pos = g_utf8_next_char (pos);
+        }
+    }
+
+    /**
+     * Get the first trigram of @a word, marked with LEADING_GRAM, and the
+     * trigrams after it
+     */
+    static void get_trigrams (const word_t& word, std::vector<gram_t>& grams)
+    {
+        const std::vector<gunichar>& c = word.chars;
+        for (std::size_t i = 0; i + 2 < c.size (); ++i)
+        {
+            grams.push_back (make_gram (c[i], c[i + 1], c[i + 2]) |
+                             (i == 0 ? LEADING_GRAM : 0));
+        }
+    }
+
+    /**
+     * Get the sorted grams of the words of an item: the prefixes of each
+     * word of up to three characters
+     */
+    static void get_item_grams (const std::vector<word_t>& words,
+                                std::vector<gram_t>& grams)
+    {
+        for (std::vector<word_t>::const_iterator iter = words.begin ();
+             iter != words.end (); ++iter)
+        {
+            const std::vector<gunichar>& c = iter->chars;
+            grams.push_back (make_gram (0, 0, c[0]));
+            if (c.size () > 1)
+            {
+                grams.push_back (make_gram (0, c[0], c[1]));
+            }
+            if (c.size () > 2)
+            {
+                grams.push_back (make_gram (c[0], c[1], c[2]) | LEADING_GRAM);
+            }
+        }
+        std::sort (grams.begin (), grams.end ());
+        grams.erase (std::unique (grams.begin (), grams.end ()), grams.end ());
+    }
+
+    static void add_to_posting (posting_t& items, guint32 item)
+    {
+        // items are usually added in ascending order
+        if (items.empty () || items.back () < item)
+        {
+            items.push_back (item);
+            return;
+        }
+        posting_t::iterator pos =
+            std::lower_bound (items.begin (), items.end (), item);
+        if (*pos != item)
+        {
+            items.insert (pos, item);
+        }
+    }
+
+    static void add_to_postings (posting_map_t& postings,
+                                 const std::vector<gram_t>& grams,
+                                 guint32 item)
+    {
+        for (std::vector<gram_t>::const_iterator iter = grams.begin ();
+             iter != grams.end (); ++iter)
+        {
+            add_to_posting (postings[*iter], item);
+        }
+    }
+
+    static void remove_from_posting (posting_t& items, guint32 item)
+    {
+        posting_t::iterator pos =
+            std::lower_bound (items.begin (), items.end (), item);
+        if (pos != items.end () && *pos == item)
+        {
+            items.erase (pos);
+        }
+    }
+
+    static void remove_from_postings (posting_map_t& postings,
+                                      const std::vector<gram_t>& grams,
+                                      guint32 item)
+    {
+        for (std::vector<gram_t>::const_iterator iter = grams.begin ();
+             iter != grams.end (); ++iter)
+        {
+            posting_map_t::iterator posting = postings.find (*iter);
+            if (posting != postings.end ())
+            {
+                remove_from_posting (posting->second, item);
+                if (posting->second.empty ())
+                {
+                    postings.erase (posting);
+                }
+            }
+        }
+    }
+
+    /**
+     * Remove the items that aren't in @a other from @a items
+     *
+     * @param bits  Scratch space
+     */
+    static void intersect (posting_t& items, const posting_t& other,
+                           std::vector<guint64>& bits)
+    {
+        posting_t::iterator out = items.begin ();
+        if (other.empty ())
+        {
+            items.clear ();
+        }
+        else if (other.size () / 16 > items.size ())
+        {
+            // look the few candidates up in the much longer list
+            posting_t::const_iterator pos = other.begin ();
+            for (posting_t::const_iterator candidate = items.begin ();
+                 candidate != items.end (); ++candidate)
+            {
+                pos = std::lower_bound (pos, other.end (), *candidate);
+                if (pos == other.end ())
+                {
+                    break;
+                }
+                if (*pos == *candidate)
+                {
+                    *out++ = *candidate;
+                }
+            }
+            items.erase (out, items.end ());
+        }
+        else
+        {
+            // a merge of lists of similar length mispredicts a branch for
+            // almost every item, so test the candidates against a bitset of
+            // the other list without branching instead
+            const guint32 limit = other.back ();
+            bits.assign (limit / 64 + 1, 0);
+            for (posting_t::const_iterator item = other.begin ();
+                 item != other.end (); ++item)
+            {
+                bits[*item / 64] |= G_GUINT64_CONSTANT (1) << (*item % 64);
+            }
+            for (posting_t::const_iterator candidate = items.begin ();
+                 candidate != items.end () && *candidate <= limit; ++candidate)
+            {
+                *out = *candidate;
+                out += (bits[*candidate / 64] >> (*candidate % 64)) & 1;
+            }
+            items.erase (out, items.end ());
+        }
+    }
+
+    /**
+     * Orders posting lists by length
+     */
+    static bool shorter (const posting_t* first, const posting_t* second)
+    {
+        return first->size () < second->size ();
+    }
+
+    static bool is_cancelled (const Glib::RefPtr<Gio::Cancellable>& cancellable)
+    {
+        return cancellable && cancellable->is_cancelled ();
+    }
+
+    struct TextIndex::Priv
+    {
+        typedef boost::unordered_map<std::string, guint32> word_map_t;
+
+        /// maps the prefix grams of the words to items
+        posting_map_t m_postings;
+        /// the folded words of each item, separated by spaces
+        std::vector<std::string> m_texts;
+
+        /// \name Vocabulary
+        /// Query words longer than a trigram are first matched against the
+        /// distinct words of all texts, which is much cheaper than comparing
+        /// them with the text of every candidate item.  Since the leading
+        /// trigram is marked, the candidate words already start with the
+        /// query word's first three characters.
+        /// @{
+        word_map_t m_word_ids;
+        /// the word of each id, empty if the id is unused
+        std::vector<std::string> m_words;
+        /// the items that contain each word
+        std::vector<posting_t> m_word_items;
+        /// maps trigrams to words
+        posting_map_t m_word_postings;
+        std::vector<guint32> m_free_words;
+        /// @}
+
+        guint32 get_word_id (const word_t& word)
+        {
+            word_map_t::const_iterator iter = m_word_ids.find (word.text);
+            if (iter != m_word_ids.end ())
+            {
+                return iter->second;
+            }
+            guint32 id;
+            if (!m_free_words.empty ())
+            {
+                id = m_free_words.back ();
+                m_free_words.pop_back ();
+                m_words[id] = word.text;
+            }
+            else
+            {
+                id = m_words.size ();
+                m_words.push_back (word.text);
+                m_word_items.push_back (posting_t ());
+            }
+            m_word_ids.insert (std::make_pair (word.text, id));
+            std::vector<gram_t> grams;
+            get_trigrams (word, grams);
+            std::sort (grams.begin (), grams.end ());
+            grams.erase (std::unique (grams.begin (), grams.end ()), grams.end ());
+            add_to_postings (m_word_postings, grams, id);
+            return id;
+        }
+
+        void release_word (guint32 id, const word_t& word)
+        {
+            std::vector<gram_t> grams;
+            get_trigrams (word, grams);
+            remove_from_postings (m_word_postings, grams, id);
+            m_word_ids.erase (word.text);
+            m_words[id].clear ();
+            m_free_words.push_back (id);
+        }
+
+        void add_postings (guint32 item, const std::string& text)
+        {
+            std::vector<word_t> words;
+            split_words (text, words);
+            std::vector<gram_t> grams;
+            get_item_grams (words, grams);
+            add_to_postings (m_postings, grams, item);
+            for (std::vector<word_t>::const_iterator iter = words.begin ();
+                 iter != words.end (); ++iter)
+            {
+                add_to_posting (m_word_items[get_word_id (*iter)], item);
+            }
+        }
+
+        void remove_postings (guint32 item, const std::string& text)
+        {
+            std::vector<word_t> words;
+            split_words (text, words);
+            std::vector<gram_t> grams;
+            get_item_grams (words, grams);
+            remove_from_postings (m_postings, grams, item);
+            for (std::vector<word_t>::const_iterator iter = words.begin ();
+                 iter != words.end (); ++iter)
+            {
+                word_map_t::const_iterator word = m_word_ids.find (iter->text);
+                if (word == m_word_ids.end ())
+                {
+                    // repeated word that has already been released
+                    continue;
+                }
+                const guint32 id = word->second;
+                remove_from_posting (m_word_items[id], item);
+                if (m_word_items[id].empty ())
+                {
+                    release_word (id, *iter);
+                }
+            }
+        }
+
+        /**
+         * Find the items that contain a word longer than a trigram
+         *
+         * @param items  Receives the items
+         * @return  false if the query was cancelled
+         */
+        bool match_long_word (const word_t& word, posting_t& items,
+                              const Glib::RefPtr<Gio::Cancellable>& cancellable) const
+        {
+            std::vector<gram_t> grams;
+            get_trigrams (word, grams);
+            std::vector<const posting_t*> postings;
+            for (std::vector<gram_t>::const_iterator iter = grams.begin ();
+                 iter != grams.end (); ++iter)
+            {
+                posting_map_t::const_iterator posting =
+                    m_word_postings.find (*iter);
+                if (posting == m_word_postings.end ())
+                {
+                    return true;
+                }
+                postings.push_back (&posting->second);
+            }
+            std::sort (postings.begin (), postings.end (), shorter);
+            posting_t words = *postings.front ();
+            std::vector<guint64> bits;
+            for (std::size_t i = 1; i < postings.size () && !words.empty (); ++i)
+            {
+                intersect (words, *postings[i], bits);
+            }
+            // the other trigrams can be anywhere in the word
+            posting_t::iterator out = words.begin ();
+            for (posting_t::const_iterator iter = words.begin ();
+                 iter != words.end (); ++iter)
+            {
+                if (m_words[*iter].compare (0, word.text.size (), word.text) == 0)
+                {
+                    *out++ = *iter;
+                }
+            }
+            words.erase (out, words.end ());
+
+            if (words.size () == 1)
+            {
+                items = m_word_items[words.front ()];
+                return true;
+            }
+            // merge the items of all matching words through a bitset
+            bits.assign ((m_texts.size () + 63) / 64, 0);
+            for (posting_t::const_iterator iter = words.begin ();
+                 iter != words.end (); ++iter)
+            {
+                if (is_cancelled (cancellable))
+                {
+                    return false;
+                }
+                const posting_t& word_items = m_word_items[*iter];
+                for (posting_t::const_iterator item = word_items.begin ();
+                     item != word_items.end (); ++item)
+                {
+                    bits[*item / 64] |= G_GUINT64_CONSTANT (1) << (*item % 64);
+                }
+            }
+            for (std::size_t i = 0; i < bits.size (); ++i)
+            {
+                for (guint32 bit = 0; bits[i]; ++bit, bits[i] >>= 1)
+                {
+                    if (bits[i] & 1)
+                    {
+                        items.push_back (i * 64 + bit);
+                    }
+                }
+            }
+            return true;
+        }
+    };
+
+    TextIndex::TextIndex () :
+        m_priv (new Priv ())
+    {
+        THROW_IF_FAIL (m_priv);
+    }
+
+    void TextIndex::set_text (guint32 item, const Glib::ustring& text)
+    {
+        THROW_IF_FAIL (m_priv);
+        std::vector<word_t> words;
+        split_words (fold (text).raw (), words);
+        std::string joined;
+        for (std::vector<word_t>::const_iterator iter = words.begin ();
+             iter != words.end (); ++iter)
+        {
+            if (!joined.empty ())
+            {
+                joined += ' ';
+            }
+            joined += iter->text;
+        }
+
+        if (item >= m_priv->m_texts.size ())
+        {
+            m_priv->m_texts.resize (item + 1);
+        }
+        std::string& old_text = m_priv->m_texts[item];
+        if (old_text == joined)
+        {
+            return;
+        }
+        m_priv->remove_postings (item, old_text);
+        m_priv->add_postings (item, joined);
+        old_text.swap (joined);
+    }
+
+    void TextIndex::remove (guint32 item)
+    {
+        THROW_IF_FAIL (m_priv);
+        if (item < m_priv->m_texts.size ())
+        {
+            m_priv->remove_postings (item, m_priv->m_texts[item]);
+            m_priv->m_texts[item].clear ();
+        }
+    }
+
+    void TextIndex::clear ()
+    {
+        THROW_IF_FAIL (m_priv);
+        m_priv.reset (new Priv ());
+    }
+
+    bool TextIndex::query (const Glib::ustring& query,
+                           std::vector<guint32>& items,
+                           const Glib::RefPtr<Gio::Cancellable>& cancellable) const
+    {
+        THROW_IF_FAIL (m_priv);
+        items.clear ();
+        std::vector<word_t> words;
+        split_words (fold (query).raw (), words);
+        if (words.empty ())
+        {
+            return true;
+        }
+
+        // collect a list of matching items for every gram of the short
+        // words and for every long word
+        std::vector<const posting_t*> postings;
+        std::vector<posting_t> long_word_items (words.size ());
+        for (std::size_t i = 0; i < words.size (); ++i)
+        {
+            const std::vector<gunichar>& c = words[i].chars;
+            std::vector<gram_t> grams;
+            if (c.size () > 3)
+            {
+                if (!m_priv->match_long_word (words[i], long_word_items[i],
+                                              cancellable))
+                {
+                    return false;
+                }
+                postings.push_back (&long_word_items[i]);
+                continue;
+            }
+            else if (c.size () == 3)
+            {
+                grams.push_back (make_gram (c[0], c[1], c[2]) | LEADING_GRAM);
+            }
+            else
+            {
+                grams.push_back (make_gram (0, c.size () == 2 ? c[0] : 0,
+                                            c.back ()));
+            }
+            posting_map_t::const_iterator posting =
+                m_priv->m_postings.find (grams.front ());
+            if (posting == m_priv->m_postings.end ())
+            {
+                return true;
+            }
+            postings.push_back (&posting->second);
+        }
+        // words can share a gram
+        std::sort (postings.begin (), postings.end ());
+        postings.erase (std::unique (postings.begin (), postings.end ()),
+                        postings.end ());
+        std::sort (postings.begin (), postings.end (), shorter);
+
+        // the result is never longer than the shortest list
+        items = *postings.front ();
+        std::vector<guint64> bits;
+        for (std::size_t i = 1; i < postings.size () && !items.empty (); ++i)
+        {
+            if (is_cancelled (cancellable))
+            {
+                items.clear ();
+                return false;
+            }
+            intersect (items, *postings[i], bits);
+        }
+        return true;
+    }
+}
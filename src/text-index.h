@@ -0,0 +1,88 @@
+/*******************************************************************************
+ *
+ *  Copyright (c) 2008 Jonathon Jongsma
+ *
+ *  This file is part of Agave
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>
+ *
+ *******************************************************************************/
+#ifndef __TEXT_INDEX_H
+#define __TEXT_INDEX_H
+
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <glib/gtypes.h>
+#include <glibmm/ustring.h>
+#include <giomm/cancellable.h>
+
+namespace agave
+{
+    /**
+     * A full-text index for search-as-you-type over short texts such as the
+     * names and descriptions of color sets.  Items are identified by small
+     * integers, as in TagIndex.
+     *
+     * Texts are case folded and split into words at every character that
+     * isn't a letter or a digit.  A query matches an item if each of its
+     * words is the start of a word of the item's text, so "blu sea" matches
+     * "Deep Sea Blues", but "lue" doesn't.  Since every query word is a
+     * prefix match, typing more characters only ever narrows the results.
+     *
+     * The index maps the first one, two and three characters of each word
+     * to sorted lists of items, so query words of up to three characters
+     * are a single lookup.  Longer query words are matched against the
+     * distinct words of all texts first, through a trigram index, and then
+     * stand for the items of the matching words.  The lists of the query
+     * words are intersected starting with the shortest one.  Updating an
+     * item only touches the lists of its own words.
+     */
+    class TextIndex
+    {
+        public:
+            TextIndex ();
+
+            /**
+             * Replace the text of @a item.  Several fields can be separated
+             * by any non-word character (e.g. a newline).
+             */
+            void set_text (guint32 item, const Glib::ustring& text);
+
+            /**
+             * Remove @a item from the index
+             */
+            void remove (guint32 item);
+            void clear ();
+
+            /**
+             * Find the items that match @a query
+             *
+             * @param items  Receives the matching items in ascending order.
+             * A query without any words matches nothing.
+             * @param cancellable  If it is cancelled while the query runs
+             * (e.g. by the next keystroke when the query runs in another
+             * thread), the query stops early.
+             * @return  false if the query was cancelled
+             */
+            bool query (const Glib::ustring& query, std::vector<guint32>& items,
+                        const Glib::RefPtr<Gio::Cancellable>& cancellable =
+                            Glib::RefPtr<Gio::Cancellable> ()) const;
+
+        private:
+            struct Priv;
+            boost::shared_ptr<Priv> m_priv;
+    };
+}
+
+#endif // __TEXT_INDEX_H